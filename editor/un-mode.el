@@ -70,7 +70,7 @@
 
 ;; Gather all keyword font locks together into big daddy keyword font-lock
 (setq un--font-lock-defaults
-      (let* ((keywords '("if" "else"))
+      (let* ((keywords '("if" "else" "while"))
              (binary-operators '("+" "*" "-" "/"
                                  "<" ">"
                                  ":" "=" ":="
@@ -0,0 +1,68 @@
+#include <arena.h>
+
+#include <error.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+static size_t arena_align(size_t size) {
+  return (size + (ARENA_ALIGNMENT - 1)) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+static ArenaSlab *arena_slab_create(size_t capacity) {
+  ArenaSlab *slab = malloc(sizeof(ArenaSlab) + capacity);
+  ASSERT(slab, "Could not allocate memory for arena slab");
+  slab->next = NULL;
+  slab->capacity = capacity;
+  slab->used = 0;
+  return slab;
+}
+
+void *arena_allocate(Arena *arena, size_t size) {
+  ASSERT(arena, "Can not allocate from NULL arena");
+  size = arena_align(size ? size : 1);
+
+  // Find a slab with enough space left, starting at the current one.
+  // Slabs after the current one only exist after a reset.
+  ArenaSlab *slab = arena->current;
+  while (slab && slab->capacity - slab->used < size) {
+    slab = slab->next;
+  }
+
+  if (!slab) {
+    size_t slab_size = arena->slab_size ? arena->slab_size : ARENA_DEFAULT_SLAB_SIZE;
+    // Allocations larger than a slab get a slab all to themselves.
+    slab = arena_slab_create(size > slab_size ? size : slab_size);
+    if (arena->current) {
+      // Keep slabs that are still unused after a reset reachable.
+      slab->next = arena->current->next;
+      arena->current->next = slab;
+    } else {
+      arena->first = slab;
+    }
+  }
+  arena->current = slab;
+
+  void *out = slab->data + slab->used;
+  slab->used += size;
+  memset(out, 0, size);
+  return out;
+}
+
+void arena_reset(Arena *arena) {
+  for (ArenaSlab *slab = arena->first; slab; slab = slab->next) {
+    slab->used = 0;
+  }
+  arena->current = arena->first;
+}
+
+void arena_free(Arena *arena) {
+  ArenaSlab *slab = arena->first;
+  while (slab) {
+    ArenaSlab *next = slab->next;
+    free(slab);
+    slab = next;
+  }
+  arena->first = NULL;
+  arena->current = NULL;
+}
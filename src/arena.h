@@ -0,0 +1,45 @@
+#ifndef COMPILER_ARENA_H
+#define COMPILER_ARENA_H
+
+#include <stddef.h>
+
+/// Size in bytes of a slab when an arena is not given one explicitly.
+#define ARENA_DEFAULT_SLAB_SIZE (64 * 1024)
+
+/// Every allocation is aligned to this many bytes, as long as malloc()
+/// returns memory aligned to at least as many.
+#define ARENA_ALIGNMENT 16
+
+/// A contiguous chunk of memory that allocations are carved out of.
+typedef struct ArenaSlab {
+  struct ArenaSlab *next;
+  size_t capacity;
+  size_t used;
+  /// Slab memory directly follows the header, padded so that it is
+  /// aligned like the allocations carved out of it.
+  _Alignas(ARENA_ALIGNMENT) char data[];
+} ArenaSlab;
+
+/// A bump-pointer allocator.
+///
+/// Allocations can not be freed individually; everything allocated
+/// from an arena lives until the arena is reset or freed as a whole.
+/// A zero-initialized Arena is valid and uses the default slab size.
+typedef struct Arena {
+  ArenaSlab *first;
+  ArenaSlab *current;
+  /// Size of newly created slabs. Zero means ARENA_DEFAULT_SLAB_SIZE.
+  size_t slab_size;
+} Arena;
+
+/// Allocate SIZE zeroed bytes from ARENA, creating a new slab if needed.
+void *arena_allocate(Arena *arena, size_t size);
+
+/// Make all memory of ARENA available again, but keep the slabs around
+/// for reuse. Every pointer previously returned from ARENA is invalid.
+void arena_reset(Arena *arena);
+
+/// Free every slab of ARENA.
+void arena_free(Arena *arena);
+
+#endif /* COMPILER_ARENA_H */
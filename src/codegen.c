@@ -1,11 +1,17 @@
 #include <codegen.h>
 
+#include <codegen/code_buffer.h>
 #include <codegen/codegen_forward.h>
+#include <codegen/elf.h>
 #include <codegen/intermediate_representation.h>
+#include <codegen/jit.h>
+#include <codegen/object_file.h>
+#include <codegen/optimization.h>
 #include <codegen/x86_64/arch_x86_64.h>
 #include <environment.h>
 #include <error.h>
 #include <inttypes.h>
+#include <intern.h>
 #include <parser.h>
 #include <stdarg.h>
 #include <stddef.h>
@@ -16,25 +22,26 @@
 #include <typechecker.h>
 
 char codegen_verbose = 1;
+char codegen_statistics = 0;
+size_t codegen_jobs = 0;
 
 CodegenContext *codegen_context_create_top_level
 (ParsingContext *parse_context,
  enum CodegenOutputFormat format,
  enum CodegenCallingConvention call_convention,
  enum CodegenAssemblyDialect dialect,
- FILE* code
+ CodeBuffer *code
  )
 {
   CodegenContext *context;
 
-  if (format == CG_FMT_x86_64_GAS) {
-    // TODO: Handle call_convention for creating codegen context!
+  if (format == CG_FMT_x86_64_GAS || format == CG_FMT_x86_64_ELF) {
     if (call_convention == CG_CALL_CONV_MSWIN) {
       context = codegen_context_x86_64_mswin_create(NULL);
       ASSERT(context);
     } else if (call_convention == CG_CALL_CONV_LINUX) {
-      // TODO: Create codegen context for GAS linux assembly.
-      panic("Not implemented: Create codegen context for GAS linux x86_64 assembly.");
+      context = codegen_context_x86_64_linux_create(NULL);
+      ASSERT(context);
     } else {
       panic("Unrecognized calling convention!");
     }
@@ -44,23 +51,31 @@ CodegenContext *codegen_context_create_top_level
 
   context->parse_context = parse_context;
   context->code = code;
+  context->format = format;
   context->dialect = dialect;
+  if (format == CG_FMT_x86_64_ELF) {
+    context->object = object_file_create();
+  }
   return context;
 }
 
 CodegenContext *codegen_context_create(CodegenContext *parent) {
   ASSERT(parent, "create_codegen_context() can only create contexts when a parent is given.");
-  ASSERT(CG_FMT_COUNT == 1, "create_codegen_context() must exhaustively handle all codegen output formats.");
+  ASSERT(CG_FMT_COUNT == 2, "create_codegen_context() must exhaustively handle all codegen output formats.");
   ASSERT(CG_CALL_CONV_COUNT == 2, "create_codegen_context() must exhaustively handle all calling conventions.");
 
   CodegenContext *new_context = NULL;
 
   switch (parent->format) {
   case CG_FMT_x86_64_GAS:
+  case CG_FMT_x86_64_ELF:
     switch (parent->call_convention) {
     case CG_CALL_CONV_MSWIN:
       new_context = codegen_context_x86_64_mswin_create(parent);
       break;
+    case CG_CALL_CONV_LINUX:
+      new_context = codegen_context_x86_64_linux_create(parent);
+      break;
     default:
       TODO("Handle %d codegen call convention.", parent->call_convention);
       break;
@@ -79,16 +94,21 @@ CodegenContext *codegen_context_create(CodegenContext *parent) {
   new_context->call_convention  = parent->call_convention;
   new_context->format           = parent->format;
   new_context->code             = parent->code;
+  new_context->object           = parent->object;
+  new_context->optimization_level = parent->optimization_level;
 
   return new_context;
 }
 
 void codegen_context_free(CodegenContext *context) {
-  if (context->format == CG_FMT_x86_64_GAS) {
+  if (!context->parent) {
+    object_file_free(context->object);
+  }
+  if (context->format == CG_FMT_x86_64_GAS || context->format == CG_FMT_x86_64_ELF) {
     if (context->call_convention == CG_CALL_CONV_MSWIN) {
       return codegen_context_x86_64_mswin_free(context);
     } else if (context->call_convention == CG_CALL_CONV_LINUX) {
-      // return codegen_context_x86_64_gas_linux_free(parent);
+      return codegen_context_x86_64_linux_free(context);
     }
   }
   PANIC("Could not free the given context.");
@@ -96,21 +116,14 @@ void codegen_context_free(CodegenContext *context) {
 
 //================================================================ BEG CG_FMT_x86_64_MSWIN
 
-#define label_buffer_size 1024
-char label_buffer[label_buffer_size];
-size_t label_index = 0;
-size_t label_count = 0;
-static char *label_generate() {
-  char *label = label_buffer + label_index;
-  label_index += snprintf(label, label_buffer_size - label_index,
-                          ".L%zu", label_count);
-  label_index++;
-  if (label_index >= label_buffer_size) {
-    label_index = 0;
-    return label_generate();
-  }
-  label_count++;
-  return label;
+/// Labels are interned, as functions keep referring to them by name
+/// until code for the whole program has been emitted. They are
+/// numbered per program, by the top-level context.
+static char *label_generate(CodegenContext *context) {
+  while (context->parent) { context = context->parent; }
+  char label[32];
+  snprintf(label, sizeof(label), ".L%zu", context->label_count++);
+  return intern(label);
 }
 
 /// The address of a local or global symbol, or an error
@@ -149,7 +162,7 @@ SymbolAddress symbol_to_address(CodegenContext *cg_ctx, Node *symbol) {
   // Local variable access.
   // TODO: Make a custom symbol to local instruction hash map/table.
   // That way, we can get rid of IR node type in the AST.
-  Node *stack_offset = node_allocate();
+  Node *stack_offset = node_allocate_scratch();
   if (!environment_get(*cg_ctx->locals, symbol, stack_offset)) {
     putchar('\n');
     print_node(symbol,0);
@@ -170,12 +183,31 @@ SymbolAddress symbol_to_address(CodegenContext *cg_ctx, Node *symbol) {
   }
 
   IRInstruction *address = stack_offset->value.ir_instruction;
-  free(stack_offset);
   out.mode = SYMBOL_ADDRESS_MODE_LOCAL;
   out.local = address;
   return out;
 }
 
+/// How to generate code for a builtin binary operator: either with a
+/// builder taking both operands, or as a comparison.
+typedef struct BinaryOperatorCodegen {
+  IRInstruction *(*build)(CodegenContext *, IRInstruction *, IRInstruction *);
+  enum ComparisonType comparison;
+} BinaryOperatorCodegen;
+
+static const BinaryOperatorCodegen binary_operator_codegen[BINARY_OPERATOR_COUNT] = {
+  [BINARY_OPERATOR_EQUAL]        = { NULL, COMPARE_EQ },
+  [BINARY_OPERATOR_LESS_THAN]    = { NULL, COMPARE_LT },
+  [BINARY_OPERATOR_GREATER_THAN] = { NULL, COMPARE_GT },
+  [BINARY_OPERATOR_SHIFT_LEFT]   = { ir_shift_left },
+  [BINARY_OPERATOR_SHIFT_RIGHT]  = { ir_shift_right_arithmetic },
+  [BINARY_OPERATOR_ADD]          = { ir_add },
+  [BINARY_OPERATOR_SUBTRACT]     = { ir_subtract },
+  [BINARY_OPERATOR_MULTIPLY]     = { ir_multiply },
+  [BINARY_OPERATOR_DIVIDE]       = { ir_divide },
+  [BINARY_OPERATOR_MODULO]       = { ir_modulo },
+};
+
 // Forward declare codegen_function for codegen_expression
 Error codegen_function
 (CodegenContext *cg_context,
@@ -193,13 +225,11 @@ Error codegen_expression
 {
   Error err = ok;
   char *result = NULL;
-  Node *tmpnode = node_allocate();
+  Node *tmpnode = node_allocate_scratch();
   Node *iterator = NULL;
-  FILE *code = cg_context->code;
-
   ParsingContext *original_context = context;
 
-  ASSERT(NODE_TYPE_MAX == 15, "codegen_expression_x86_64() must exhaustively handle node types!");
+  ASSERT(NODE_TYPE_MAX == 16, "codegen_expression_x86_64() must exhaustively handle node types!");
   switch (expression->type) {
   default:
     break;
@@ -208,14 +238,14 @@ Error codegen_expression
     break;
   case NODE_TYPE_FUNCTION_CALL:
     if (0) {}
-    // Use `typecheck_expression()` to get type of variable.
-    Node *variable_type = node_allocate();
-    // err is ignored purposefully, program already type-checked valid.
-    typecheck_expression(context, NULL, expression->children, variable_type);
+    // The program has already been typechecked, which recorded the
+    // type of the called variable.
+    Node *variable_type = expression->children->resolved_type;
+    ASSERT(variable_type, "Callee of function call has not been typechecked.");
 
-    INSTRUCTION(call, IR_CALL);
+    IRInstruction *call = ir_instruction_create(cg_context->function, IR_CALL);
 
-    if (strcmp(variable_type->value.symbol, "external function") == 0) {
+    if (variable_type->value.symbol == symbol_external_function) {
       call->value.call.type = IR_CALLTYPE_DIRECT;
       call->value.call.value.name = expression->children->value.symbol;
     } else {
@@ -252,8 +282,7 @@ Error codegen_expression
     }
     if (!result) {
       // TODO: Keep track of local lambda label in environment or something.
-      // FIXME: Completely memory leaked here, no chance of freeing!
-      result = label_generate();
+      result = label_generate(cg_context);
     }
     err = codegen_function
       (cg_context,
@@ -289,11 +318,10 @@ Error codegen_expression
     if (err.type) { return err; }
 
     // Get size of base type of accessed array.
-    Node *base_type_info = node_allocate();
+    Node *base_type_info = node_allocate_scratch();
     err = parse_get_type(context, tmpnode->children->next_child, base_type_info);
     if (err.type) { return err; }
     long long base_type_size = base_type_info->children->value.integer;
-    free(base_type_info);
 
     long long offset = base_type_size * expression->value.integer;
 
@@ -311,7 +339,9 @@ Error codegen_expression
     }
     // Offset memory address by index.
     if (offset) {
-      TODO("Create IR_IMMEDIATE to load offset into temporary, then generate an add between the new temporary and the result of loading the array's address.");
+      expression->result = ir_add(cg_context,
+                                  expression->result,
+                                  ir_immediate(cg_context, offset));
     }
     break;
   }
@@ -338,11 +368,11 @@ Error codegen_expression
      *       +------+
      */
 
-    IRBlock *then_block = ir_block_create();
+    IRBlock *then_block = ir_block_create(cg_context->function);
     IRBlock *last_then_block = then_block;
-    IRBlock *otherwise_block = ir_block_create();
+    IRBlock *otherwise_block = ir_block_create(cg_context->function);
     IRBlock *last_otherwise_block = otherwise_block;
-    IRBlock *join_block = ir_block_create();
+    IRBlock *join_block = ir_block_create(cg_context->function);
 
     // Generate if instruction with then, otherwise blocks
     ir_branch_conditional(cg_context, expression->children->result, then_block, otherwise_block);
@@ -376,6 +406,13 @@ Error codegen_expression
       expr = expr->next_child;
     }
 
+    // The result of an empty body, or of one that ends in a
+    // declaration, is zero.
+    IRInstruction *then_return_value = last_expr ? last_expr->result : NULL;
+    if (!then_return_value) {
+      then_return_value = ir_immediate(cg_context, 0);
+    }
+
     // Generate an unconditional branch to the join_block.
     ir_branch(cg_context, join_block);
 
@@ -412,20 +449,16 @@ Error codegen_expression
         last_expr = expr;
         expr = expr->next_child;
       }
+    }
 
-      ir_branch(cg_context, join_block);
-
-      last_otherwise_block = cg_context->block;
-
-    } else {
-      ir_immediate(cg_context, 0);
+    IRInstruction *otherwise_return_value = last_expr ? last_expr->result : NULL;
+    if (!otherwise_return_value) {
+      otherwise_return_value = ir_immediate(cg_context, 0);
     }
 
-    // This assumes that the last instruction in a block returns a
-    // value; if it doesn't, we will simply return zero. This should
-    // probably be ensured in the type checker in the future.
-    IRInstruction *then_return_value = last_then_block->last_instruction;
-    IRInstruction *otherwise_return_value = last_otherwise_block->last_instruction;
+    ir_branch(cg_context, join_block);
+
+    last_otherwise_block = cg_context->block;
 
     // Attach join_block to function and set it as the active context
     // block.
@@ -433,20 +466,70 @@ Error codegen_expression
 
     // Insert phi node for result of if expression in join block.
     IRInstruction *phi = ir_phi(cg_context);
-    ir_phi_argument(phi, last_otherwise_block, then_return_value);
-    ir_phi_argument(phi, last_otherwise_block, otherwise_return_value);
+    ir_phi_argument(cg_context->function, phi, last_then_block, then_return_value);
+    ir_phi_argument(cg_context->function, phi, last_otherwise_block, otherwise_return_value);
 
     expression->result = phi;
 
     break;
-  case NODE_TYPE_BINARY_OPERATOR:
-    while (context->parent) { context = context->parent; }
-    // FIXME: Second argument is memory leaked! :^(
-    environment_get(*context->binary_operators, node_symbol(expression->value.symbol), tmpnode);
+  case NODE_TYPE_WHILE: {
+    /** The condition is tested in a block of its own, that the body
+     *  branches back to.
+     *
+     *      +---------+
+     *      | current |
+     *      +---------+
+     *           |
+     *     +-----------+
+     *     | condition | <--+
+     *     +-----------+    |
+     *      /         \     |
+     * +------+    +------+ |
+     * | exit |    | body | |
+     * +------+    +------+ |
+     *                 \____/
+     */
+    IRBlock *condition_block = ir_block_create(cg_context->function);
+    IRBlock *body_block = ir_block_create(cg_context->function);
+    IRBlock *exit_block = ir_block_create(cg_context->function);
 
-    //printf("Codegenning binary operator %s\n", expression->value.symbol);
-    //print_node(tmpnode,0);
+    ir_branch(cg_context, condition_block);
+    ir_block_attach(cg_context, condition_block);
 
+    err = codegen_expression(cg_context,
+                             context, next_child_context,
+                             expression->children);
+    if (err.type) { return err; }
+    ir_branch_conditional(cg_context, expression->children->result, body_block, exit_block);
+
+    ir_block_attach(cg_context, body_block);
+
+    // Enter while body context
+    ParsingContext *ctx = context;
+    ParsingContext *next_child_ctx = *next_child_context;
+    if (next_child_context) {
+      ctx = *next_child_context;
+      next_child_ctx = ctx->children;
+      *next_child_context = (*next_child_context)->next_child;
+    }
+
+    Node *expr = expression->children->next_child->children;
+    while (expr) {
+      err = codegen_expression(cg_context,
+                               ctx, &next_child_ctx,
+                               expr);
+      if (err.type) { return err; }
+      expr = expr->next_child;
+    }
+
+    ir_branch(cg_context, condition_block);
+    ir_block_attach(cg_context, exit_block);
+
+    // A loop has no value of its own.
+    expression->result = ir_immediate(cg_context, 0);
+    break;
+  }
+  case NODE_TYPE_BINARY_OPERATOR: {
     err = codegen_expression(cg_context,
                              context, next_child_context,
                              expression->children);
@@ -456,65 +539,25 @@ Error codegen_expression
                              expression->children->next_child);
     if (err.type) { return err; }
 
-    if (strcmp(expression->value.symbol, ">") == 0) {
-      expression->result = ir_comparison
-        (cg_context,
-         COMPARE_GT,
-         expression->children->result,
-         expression->children->next_child->result);
-    } else if (strcmp(expression->value.symbol, "<") == 0) {
-      expression->result = ir_comparison
+    if (expression->opcode < 0 || expression->opcode >= BINARY_OPERATOR_COUNT) {
+      fprintf(stderr, "Unrecognized binary operator: \"%s\"\n", expression->value.symbol);
+      ERROR_PREP(err, ERROR_GENERIC, "codegen_expression() does not recognize binary operator");
+      return err;
+    }
+    const BinaryOperatorCodegen *operator = binary_operator_codegen + expression->opcode;
+    if (operator->build) {
+      expression->result = operator->build
         (cg_context,
-         COMPARE_LT,
          expression->children->result,
          expression->children->next_child->result);
-    } else if (strcmp(expression->value.symbol, "=") == 0) {
+    } else {
       expression->result = ir_comparison
         (cg_context,
-         COMPARE_EQ,
+         operator->comparison,
          expression->children->result,
          expression->children->next_child->result);
-    } else if (strcmp(expression->value.symbol, "+") == 0) {
-      expression->result = ir_add
-        (cg_context,
-         expression->children->result,
-         expression->children->next_child->result);
-    } else if (strcmp(expression->value.symbol, "-") == 0) {
-      expression->result = ir_subtract
-        (cg_context,
-         expression->children->result,
-         expression->children->next_child->result);
-    } else if (strcmp(expression->value.symbol, "*") == 0) {
-      expression->result = ir_multiply
-        (cg_context,
-         expression->children->result,
-         expression->children->next_child->result);
-    } else if (strcmp(expression->value.symbol, "/") == 0) {
-      expression->result = ir_divide
-        (cg_context,
-         expression->children->result,
-         expression->children->next_child->result);
-    } else if (strcmp(expression->value.symbol, "%") == 0) {
-      expression->result = ir_modulo
-        (cg_context,
-         expression->children->result,
-         expression->children->next_child->result);
-    } else if (strcmp(expression->value.symbol, "<<") == 0) {
-      expression->result = ir_shift_left
-        (cg_context,
-         expression->children->result,
-         expression->children->next_child->result);
-    } else if (strcmp(expression->value.symbol, ">>") == 0) {
-      expression->result = ir_shift_right_arithmetic
-        (cg_context,
-         expression->children->result,
-         expression->children->next_child->result);
-    } else {
-      fprintf(stderr, "Unrecognized binary operator: \"%s\"\n", expression->value.symbol);
-      ERROR_PREP(err, ERROR_GENERIC, "codegen_expression() does not recognize binary operator");
-      return err;
     }
-    break;
+  } break;
   case NODE_TYPE_VARIABLE_ACCESS:
     if (0) {}
 
@@ -554,7 +597,7 @@ Error codegen_expression
       ERROR_PREP(err, ERROR_GENERIC, "Invalid AST/context fed to codegen. Could not find variable declaration in environment");
       return err;
     }
-    if (strcmp(tmpnode->value.symbol, "external function") == 0) {
+    if (tmpnode->value.symbol == symbol_external_function) {
       break;
     }
     // Get size in bytes from types environment.
@@ -587,49 +630,56 @@ Error codegen_expression
         case SYMBOL_ADDRESS_MODE_ERROR:
           return address.error;
         case SYMBOL_ADDRESS_MODE_GLOBAL:
-          expression->result = ir_store_global
+          ir_store_global
             (cg_context,
              expression->children->next_child->result,
              address.global);
           break;
         case SYMBOL_ADDRESS_MODE_LOCAL:
-          expression->result = ir_store_local
+          ir_store_local
             (cg_context,
              expression->children->next_child->result,
              address.local);
           break;
       }
+    } else if (expression->children->type == NODE_TYPE_DEREFERENCE) {
+      // Store to the address that is dereferenced, rather than to the
+      // address loaded from it.
+      err = codegen_expression(cg_context, context, next_child_context,
+                               expression->children->children);
+      if (err.type) { break; }
+      ir_store(cg_context,
+               expression->children->next_child->result,
+               expression->children->children->result);
     } else {
       // Codegen LHS
       err = codegen_expression(cg_context, context, next_child_context,
                                expression->children);
       if (err.type) { break; }
-      expression->result = ir_store(cg_context,
+      ir_store(cg_context,
                expression->children->next_child->result,
                expression->children->result);
     }
+    // A reassignment evaluates to the value that was assigned.
+    expression->result = expression->children->next_child->result;
     break;
   case NODE_TYPE_CAST:
     if (0) {}
 
     Node *cast_type = expression->children;
-    // TODO: Somehow avoid typechecking twice; this is only needed to get result type of expression.
-    Node *expression_type = node_allocate();
-    err = typecheck_expression(context, next_child_context, expression->children->next_child, expression_type);
-    if (err.type) { return err; }
+    Node *expression_type = expression->children->next_child->resolved_type;
+    ASSERT(expression_type, "Casted expression has not been typechecked.");
 
     // Get size of cast_type and expression_type to determine kind of
     // typecast.
-    Node *cast_type_info = node_allocate();
-    Node *expression_type_info = node_allocate();
+    Node *cast_type_info = node_allocate_scratch();
+    Node *expression_type_info = node_allocate_scratch();
     err = parse_get_type(context, cast_type, cast_type_info);
     if (err.type) { return err; }
     err = parse_get_type(context, expression_type, expression_type_info);
     if (err.type) { return err; }
     size_t cast_type_size = cast_type_info->children->value.integer;
     size_t expression_type_size = expression_type_info->children->value.integer;
-    free(cast_type_info);
-    free(expression_type_info);
 
     if (cast_type_size > expression_type_size) {
       // TODO: Set `expression_signed` to `1` iff expression_type is of signed type.
@@ -646,7 +696,6 @@ Error codegen_expression
     break;
   }
 
-  free(tmpnode);
   return err;
 }
 
@@ -661,11 +710,11 @@ Error codegen_function
  )
 {
   Error err = ok;
-  FILE *code = cg_context->code;
 
   cg_context = codegen_context_create(cg_context);
 
   IRFunction *f = ir_function(cg_context);
+  f->name = name;
 
   // Store base pointer integer offset within locals environment
   // Start at one to make space for pushed RBP in function header.
@@ -674,7 +723,7 @@ Error codegen_function
   while (parameter) {
     Node *param_node = node_allocate();
 
-    INSTRUCTION(param, IR_PARAMETER_REFERENCE);
+    IRInstruction *param = ir_instruction_create(f, IR_PARAMETER_REFERENCE);
     param->value.immediate = param_count++;
     ir_insert(cg_context, param);
 
@@ -684,10 +733,6 @@ Error codegen_function
     parameter = parameter->next_child;
   }
 
-  // TODO: REMOVE THIS!!!
-  // Function beginning label
-  fprintf(code, "%s:\n", name);
-
   // Function body
   ParsingContext *ctx = context;
   ParsingContext *next_child_ctx = *next_child_context;
@@ -716,7 +761,9 @@ Error codegen_function
   IRInstruction *branch = ir_return(cg_context);
   f->last->branch = branch;
 
-  f->return_value = last_expression->result;
+  if (last_expression) {
+    f->return_value = last_expression->result;
+  }
 
   // Free context;
   codegen_context_free(cg_context);
@@ -727,6 +774,7 @@ Error codegen_program(CodegenContext *context, Node *program) {
   Error err = ok;
 
   IRFunction *main = ir_function(context);
+  main->name = "main";
 
   ParsingContext *next_child_context = context->parse_context->children;
   Node *last_expression = NULL;
@@ -737,6 +785,7 @@ Error codegen_program(CodegenContext *context, Node *program) {
       continue;
     }
     err = codegen_expression(context, context->parse_context, &next_child_context, expression);
+    node_scratch_reset();
     if (err.type) { return err; }
     last_expression = expression;
     expression = expression->next_child;
@@ -758,15 +807,66 @@ void codegen_emit(CodegenContext *context) {
   case CG_FMT_x86_64_GAS:
     codegen_emit_x86_64(context);
     break;
+  case CG_FMT_x86_64_ELF:
+    codegen_emit_x86_64(context);
+    object_file_resolve(context->object);
+    // Programs that are run in memory are not written anywhere.
+    if (context->code) {
+      elf_write_object(context->object, context->code);
+    }
+    break;
   default:
     TODO("Handle %d code generation format.", context->format);
   }
 }
 
+void codegen_benchmark_emitter
+(enum CodegenOutputFormat format,
+ enum CodegenAssemblyDialect dialect,
+ FILE *sink,
+ size_t iterations)
+{
+  switch (format) {
+  case CG_FMT_x86_64_GAS:
+    codegen_benchmark_emitter_x86_64(dialect, sink, iterations);
+    break;
+  case CG_FMT_x86_64_ELF:
+    codegen_benchmark_encoder_x86_64(iterations);
+    break;
+  default:
+    TODO("Handle %d code generation format.", format);
+  }
+}
+
+/// Generate code for PROGRAM, optimize it, and emit it in the output
+/// format of CONTEXT.
+static Error codegen_compile(CodegenContext *context, Node *program) {
+  Error err = codegen_program(context, program);
+  // Whatever IR was generated before the error may not even have
+  // branches at the end of its blocks.
+  if (err.type) {
+    ir_free_functions(context);
+    return err;
+  }
+
+  codegen_optimize(context);
+
+  ir_set_ids(context);
+  if (codegen_verbose) {
+    ir_femit(stdout, context);
+  }
+
+  codegen_emit(context);
+
+  ir_free_functions(context);
+  return err;
+}
+
 Error codegen
 (enum CodegenOutputFormat format,
  enum CodegenCallingConvention call_convention,
  enum CodegenAssemblyDialect dialect,
+ int optimization_level,
  char *filepath,
  ParsingContext *parse_context,
  Node *program
@@ -778,24 +878,44 @@ Error codegen
     return err;
   }
   // Open file for writing.
-  FILE *code = fopen(filepath, "w");
-  if (!code) {
+  FILE *file = fopen(filepath, format == CG_FMT_x86_64_ELF ? "wb" : "w");
+  if (!file) {
     printf("Filepath: \"%s\"\n", filepath);
     ERROR_PREP(err, ERROR_GENERIC, "codegen(): fopen failed to open file at path.");
     return err;
   }
 
+  CodeBuffer *code = code_buffer_create(file);
   CodegenContext *context = codegen_context_create_top_level
     (parse_context, format, call_convention, dialect, code);
-  err = codegen_program(context, program);
+  context->optimization_level = optimization_level;
+  err = codegen_compile(context, program);
+  codegen_context_free(context);
 
-  ir_set_ids(context);
-  ir_femit(stdout, context);
+  code_buffer_free(code);
+  fclose(file);
+  return err;
+}
 
-  codegen_emit(context);
+Error codegen_run
+(enum CodegenCallingConvention call_convention,
+ int optimization_level,
+ ParsingContext *parse_context,
+ Node *program,
+ int *status
+ )
+{
+  CodegenContext *context = codegen_context_create_top_level
+    (parse_context, CG_FMT_x86_64_ELF, call_convention, CG_ASM_DIALECT_DEFAULT, NULL);
+  context->optimization_level = optimization_level;
+  Error err = codegen_compile(context, program);
+
+  if (err.type == ERROR_NONE) {
+    int64_t result = 0;
+    err = jit_run(context->object, &result);
+    *status = (int)result;
+  }
 
   codegen_context_free(context);
-
-  fclose(code);
   return err;
 }
@@ -2,6 +2,8 @@
 #define CODEGEN_H
 
 #include <codegen/codegen_forward.h>
+#include <codegen/code_buffer.h>
+#include <codegen/object_file.h>
 
 #include <environment.h>
 #include <error.h>
@@ -13,7 +15,7 @@ CodegenContext *codegen_context_create_top_level
  enum CodegenOutputFormat format,
  enum CodegenCallingConvention call_convention,
  enum CodegenAssemblyDialect dialect,
- FILE* code);
+ CodeBuffer *code);
 
 CodegenContext *codegen_context_create(CodegenContext *parent);
 void codegen_context_free(CodegenContext *context);
@@ -37,7 +39,10 @@ struct RegisterPool {
 struct CodegenContext {
   CodegenContext *parent;
   ParsingContext *parse_context;
-  FILE* code;
+  CodeBuffer *code;
+  /// Machine code, if the output format is an object file rather
+  /// than assembly. Nothing is written to `code` until the end then.
+  ObjectFile *object;
 
   IRFunction *all_functions;
   IRFunction *function;
@@ -52,19 +57,56 @@ struct CodegenContext {
   enum CodegenOutputFormat format;
   enum CodegenCallingConvention call_convention;
   enum CodegenAssemblyDialect dialect;
+  /// How hard to try to generate fast code, as in `-O2`.
+  int optimization_level;
+  /// The number of labels generated for the program so far. Only
+  /// used in the top-level context.
+  size_t label_count;
   /// Architecture-specific data.
   void *arch_data;
 };
 
-// TODO/FIXME: Make this a parameter affectable by command line arguments.
+/// If non-zero, the IR and what became of it are printed while code
+/// is generated. `--run` turns this off, so that the output of the
+/// program is all there is.
 extern char codegen_verbose;
 
+/// If non-zero, the optimizer prints what its passes did to standard
+/// error, as with `-v`.
+extern char codegen_statistics;
+
+/// How many threads functions are optimized and emitted on, as in
+/// `-j4`. Zero means one per processor.
+extern size_t codegen_jobs;
+
+/// Measure how fast code of the given FORMAT is emitted to SINK, or
+/// encoded in memory for object files.
+void codegen_benchmark_emitter
+(enum CodegenOutputFormat format,
+ enum CodegenAssemblyDialect dialect,
+ FILE *sink,
+ size_t iterations);
+
 Error codegen
 (enum CodegenOutputFormat,
  enum CodegenCallingConvention,
  enum CodegenAssemblyDialect,
+ int optimization_level,
  char *output_filepath,
  ParsingContext *context,
  Node *program);
 
+/** Compile PROGRAM to machine code in memory and run it right away,
+ * without writing anything to disk.
+ *
+ * @return What the program returns, in STATUS, the same as it would
+ *         have exited with.
+ */
+Error codegen_run
+(enum CodegenCallingConvention,
+ int optimization_level,
+ ParsingContext *context,
+ Node *program,
+ int *status);
+
 #endif /* CODEGEN_H */
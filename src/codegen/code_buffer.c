@@ -0,0 +1,124 @@
+#include <codegen/code_buffer.h>
+
+#include <error.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+CodeBuffer *code_buffer_create(FILE *file) {
+  CodeBuffer *buffer = malloc(sizeof(CodeBuffer));
+  ASSERT(buffer, "Could not allocate memory for code buffer.");
+  buffer->file = file;
+  buffer->memory = NULL;
+  buffer->memory_size = 0;
+  buffer->memory_capacity = 0;
+  buffer->used = 0;
+  return buffer;
+}
+
+void code_buffer_free(CodeBuffer *buffer) {
+  if (!buffer) { return; }
+  code_buffer_flush(buffer);
+  free(buffer->memory);
+  free(buffer);
+}
+
+/// Write LENGTH bytes at DATA past the buffered data of BUFFER.
+static void code_buffer_spill(CodeBuffer *buffer, const char *data, size_t length) {
+  if (buffer->file) {
+    size_t written = fwrite(data, 1, length, buffer->file);
+    ASSERT(written == length, "Could not write generated code to file.");
+    return;
+  }
+  if (buffer->memory_capacity - buffer->memory_size < length) {
+    size_t capacity = buffer->memory_capacity ? buffer->memory_capacity : 4096;
+    while (capacity - buffer->memory_size < length) { capacity *= 2; }
+    buffer->memory = realloc(buffer->memory, capacity);
+    ASSERT(buffer->memory, "Could not allocate memory for generated code.");
+    buffer->memory_capacity = capacity;
+  }
+  memcpy(buffer->memory + buffer->memory_size, data, length);
+  buffer->memory_size += length;
+}
+
+void code_buffer_flush(CodeBuffer *buffer) {
+  if (!buffer->used) { return; }
+  code_buffer_spill(buffer, buffer->data, buffer->used);
+  buffer->used = 0;
+}
+
+char *code_buffer_take(CodeBuffer *buffer, size_t *size) {
+  ASSERT(!buffer->file, "code_buffer_take(): Code written to a file can not be taken.");
+  code_buffer_flush(buffer);
+  char *memory = buffer->memory;
+  *size = buffer->memory_size;
+  buffer->memory = NULL;
+  buffer->memory_size = 0;
+  buffer->memory_capacity = 0;
+  return memory;
+}
+
+void code_buffer_write(CodeBuffer *buffer, const char *data, size_t length) {
+  if (CODE_BUFFER_CAPACITY - buffer->used < length) {
+    code_buffer_flush(buffer);
+    // Data that would not fit even in an empty buffer is written directly.
+    if (length > CODE_BUFFER_CAPACITY) {
+      code_buffer_spill(buffer, data, length);
+      return;
+    }
+  }
+  memcpy(buffer->data + buffer->used, data, length);
+  buffer->used += length;
+}
+
+void code_buffer_string(CodeBuffer *buffer, const char *string) {
+  code_buffer_write(buffer, string, strlen(string));
+}
+
+void code_buffer_integer(CodeBuffer *buffer, int64_t integer) {
+  // Enough for "-9223372036854775808".
+  char digits[20];
+  char *it = digits + sizeof digits;
+  // Negate into unsigned space, so that INT64_MIN does not overflow.
+  uint64_t magnitude = integer < 0 ? 0 - (uint64_t)integer : (uint64_t)integer;
+  do {
+    *--it = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude);
+  if (integer < 0) {
+    *--it = '-';
+  }
+  code_buffer_write(buffer, it, (size_t)(digits + sizeof digits - it));
+}
+
+void code_buffer_printf(CodeBuffer *buffer, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+  ASSERT(length >= 0, "code_buffer_printf(): Invalid format string.");
+
+  if ((size_t)length >= CODE_BUFFER_CAPACITY - buffer->used) {
+    code_buffer_flush(buffer);
+  }
+  if ((size_t)length < CODE_BUFFER_CAPACITY - buffer->used) {
+    va_start(args, format);
+    vsnprintf(buffer->data + buffer->used, CODE_BUFFER_CAPACITY - buffer->used, format, args);
+    va_end(args);
+    buffer->used += (size_t)length;
+    return;
+  }
+
+  // Too large for the buffer altogether.
+  code_buffer_flush(buffer);
+  char *text = malloc((size_t)length + 1);
+  ASSERT(text, "Could not allocate memory for formatted code.");
+  va_start(args, format);
+  vsnprintf(text, (size_t)length + 1, format, args);
+  va_end(args);
+  code_buffer_spill(buffer, text, (size_t)length);
+  free(text);
+}
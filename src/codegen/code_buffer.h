@@ -0,0 +1,64 @@
+#ifndef CODE_BUFFER_H
+#define CODE_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <error.h>
+
+/// Size in bytes of the write buffer of a CodeBuffer.
+#define CODE_BUFFER_CAPACITY (1024 * 1024)
+
+/// Generated code is collected here, then written out in large chunks.
+///
+/// Appending to a code buffer never allocates and never parses a
+/// format string; use code_buffer_printf() only off the hot path.
+///
+/// A code buffer without a file keeps everything in memory instead,
+/// until it is taken with code_buffer_take().
+typedef struct CodeBuffer {
+  FILE *file;
+  /// What was flushed so far, if there is no file.
+  char *memory;
+  size_t memory_size;
+  size_t memory_capacity;
+  size_t used;
+  char data[CODE_BUFFER_CAPACITY];
+} CodeBuffer;
+
+/// Create a buffer that writes to FILE, or to memory if it is NULL.
+CodeBuffer *code_buffer_create(FILE *file);
+/// Flush and free BUFFER. The underlying file is left open.
+void code_buffer_free(CodeBuffer *buffer);
+
+/// Write all buffered data to the underlying file.
+void code_buffer_flush(CodeBuffer *buffer);
+
+/// Get everything written to BUFFER, which must not have a file, and
+/// empty it. The caller frees the result, which is SIZE bytes long
+/// and not NUL-terminated.
+char *code_buffer_take(CodeBuffer *buffer, size_t *size);
+
+void code_buffer_write(CodeBuffer *buffer, const char *data, size_t length);
+
+static inline void code_buffer_char(CodeBuffer *buffer, char c) {
+  if (buffer->used == CODE_BUFFER_CAPACITY) {
+    code_buffer_flush(buffer);
+  }
+  buffer->data[buffer->used++] = c;
+}
+
+/// Write a string literal, without having to measure it at runtime.
+#define code_buffer_literal(buffer, literal) \
+  code_buffer_write((buffer), "" literal, sizeof(literal) - 1)
+
+/// Write a NUL-terminated STRING.
+void code_buffer_string(CodeBuffer *buffer, const char *string);
+
+/// Write INTEGER in decimal, the same as "%" PRId64 would.
+void code_buffer_integer(CodeBuffer *buffer, int64_t integer);
+
+FORMAT(printf, 2, 3)
+void code_buffer_printf(CodeBuffer *buffer, const char *format, ...);
+
+#endif /* CODE_BUFFER_H */
@@ -21,6 +21,8 @@ enum CodegenAssemblyDialect {
 
 enum CodegenOutputFormat {
   CG_FMT_x86_64_GAS,
+  /// An ELF64 relocatable object file, ready to link.
+  CG_FMT_x86_64_ELF,
   CG_FMT_COUNT,
 
   CG_FMT_DEFAULT = CG_FMT_x86_64_GAS,
@@ -31,7 +33,11 @@ enum CodegenCallingConvention {
   CG_CALL_CONV_LINUX,
   CG_CALL_CONV_COUNT,
 
+#ifdef _WIN32
   CG_CALL_CONV_DEFAULT = CG_CALL_CONV_MSWIN,
+#else
+  CG_CALL_CONV_DEFAULT = CG_CALL_CONV_LINUX,
+#endif
 };
 
 // Types of comparison to be implemented by codegen backend.
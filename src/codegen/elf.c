@@ -0,0 +1,311 @@
+#include <codegen/elf.h>
+
+#include <codegen/code_buffer.h>
+#include <codegen/object_file.h>
+#include <error.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ELF_HEADER_SIZE 64
+#define ELF_SECTION_HEADER_SIZE 64
+#define ELF_SYMBOL_SIZE 24
+#define ELF_RELOCATION_SIZE 24
+
+#define ELF_TYPE_RELOCATABLE 1
+#define ELF_MACHINE_X86_64 62
+
+#define ELF_SECTION_TYPE_PROGBITS 1
+#define ELF_SECTION_TYPE_SYMTAB 2
+#define ELF_SECTION_TYPE_STRTAB 3
+#define ELF_SECTION_TYPE_RELA 4
+#define ELF_SECTION_TYPE_NOBITS 8
+
+#define ELF_SECTION_FLAG_WRITE 0x1
+#define ELF_SECTION_FLAG_ALLOC 0x2
+#define ELF_SECTION_FLAG_EXECUTE 0x4
+#define ELF_SECTION_FLAG_INFO_LINK 0x40
+
+#define ELF_SYMBOL_BIND_LOCAL 0
+#define ELF_SYMBOL_BIND_GLOBAL 1
+#define ELF_SYMBOL_TYPE_NOTYPE 0
+#define ELF_SYMBOL_TYPE_OBJECT 1
+#define ELF_SYMBOL_TYPE_FUNC 2
+
+#define ELF_RELOCATION_X86_64_PC32 2
+#define ELF_RELOCATION_X86_64_PLT32 4
+
+/// Sections of the object file, in order.
+enum ElfSection {
+  ELF_SECTION_NULL,
+  ELF_SECTION_TEXT,
+  ELF_SECTION_BSS,
+  ELF_SECTION_SYMTAB,
+  ELF_SECTION_STRTAB,
+  ELF_SECTION_RELA_TEXT,
+  /// Tells the linker that the stack need not be executable.
+  ELF_SECTION_NOTE_GNU_STACK,
+  ELF_SECTION_SHSTRTAB,
+  ELF_SECTION_COUNT,
+};
+
+static const char *elf_section_names[ELF_SECTION_COUNT] = {
+  "",
+  ".text",
+  ".bss",
+  ".symtab",
+  ".strtab",
+  ".rela.text",
+  ".note.GNU-stack",
+  ".shstrtab",
+};
+
+/// Write the SIZE lowest bytes of VALUE, little-endian.
+static void elf_integer(CodeBuffer *out, uint64_t value, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    code_buffer_char(out, (char)(uint8_t)(value >> (8 * i)));
+  }
+}
+
+static uint64_t elf_align(uint64_t offset, uint64_t alignment) {
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+/// Write zeroes from POSITION up to OFFSET.
+static void elf_pad(CodeBuffer *out, uint64_t position, uint64_t offset) {
+  ASSERT(position <= offset, "ELF sections were laid out wrong.");
+  for (; position < offset; ++position) {
+    code_buffer_char(out, 0);
+  }
+}
+
+/// Labels starting with `.L` are only ever referred to from within the
+/// code, so they are not worth a symbol.
+static char elf_symbol_listed(ObjectSymbol *symbol) {
+  return symbol->section != OBJECT_SECTION_TEXT || strncmp(symbol->name, ".L", 2) != 0;
+}
+
+/// Global and undefined symbols have to come after all local ones.
+static char elf_symbol_global(ObjectSymbol *symbol) {
+  return symbol->global || symbol->section == OBJECT_SECTION_UNDEFINED;
+}
+
+static void elf_write_symbol
+(CodeBuffer *out,
+ ObjectSymbol *symbol,
+ uint32_t name)
+{
+  uint8_t bind = elf_symbol_global(symbol) ? ELF_SYMBOL_BIND_GLOBAL : ELF_SYMBOL_BIND_LOCAL;
+  uint8_t type = ELF_SYMBOL_TYPE_NOTYPE;
+  uint16_t section = 0;
+  switch (symbol->section) {
+  case OBJECT_SECTION_UNDEFINED:
+    break;
+  case OBJECT_SECTION_TEXT:
+    type = ELF_SYMBOL_TYPE_FUNC;
+    section = ELF_SECTION_TEXT;
+    break;
+  case OBJECT_SECTION_BSS:
+    type = ELF_SYMBOL_TYPE_OBJECT;
+    section = ELF_SECTION_BSS;
+    break;
+  }
+  elf_integer(out, name, 4);
+  elf_integer(out, (uint64_t)(bind << 4 | type), 1);
+  elf_integer(out, 0, 1);
+  elf_integer(out, section, 2);
+  elf_integer(out, symbol->section == OBJECT_SECTION_UNDEFINED ? 0 : symbol->offset, 8);
+  elf_integer(out, symbol->size, 8);
+}
+
+typedef struct ElfSectionHeader {
+  uint32_t type;
+  uint64_t flags;
+  uint64_t offset;
+  uint64_t size;
+  uint32_t link;
+  uint32_t info;
+  uint64_t alignment;
+  uint64_t entry_size;
+} ElfSectionHeader;
+
+void elf_write_object(ObjectFile *object, CodeBuffer *out) {
+  // Number the symbols that make it into the symbol table, locals
+  // first, and lay out their names.
+  size_t *indices = calloc(object->symbol_count ? object->symbol_count : 1, sizeof(size_t));
+  uint32_t *names = calloc(object->symbol_count ? object->symbol_count : 1, sizeof(uint32_t));
+  ASSERT(indices && names, "Could not allocate memory for ELF symbols.");
+  size_t symbol_count = 1;
+  size_t local_count = 1;
+  uint64_t strtab_size = 1;
+  for (char global = 0; global < 2; ++global) {
+    for (size_t i = 0; i < object->symbol_count; ++i) {
+      ObjectSymbol *symbol = object->symbols + i;
+      if (!elf_symbol_listed(symbol) || elf_symbol_global(symbol) != global) { continue; }
+      indices[i] = symbol_count++;
+      names[i] = (uint32_t)strtab_size;
+      strtab_size += strlen(symbol->name) + 1;
+    }
+    if (!global) { local_count = symbol_count; }
+  }
+
+  uint64_t shstrtab_size = 0;
+  uint32_t section_names[ELF_SECTION_COUNT];
+  for (size_t i = 0; i < ELF_SECTION_COUNT; ++i) {
+    section_names[i] = (uint32_t)shstrtab_size;
+    shstrtab_size += strlen(elf_section_names[i]) + 1;
+  }
+
+  ElfSectionHeader sections[ELF_SECTION_COUNT];
+  memset(sections, 0, sizeof(sections));
+  uint64_t offset = ELF_HEADER_SIZE;
+
+  sections[ELF_SECTION_TEXT] = (ElfSectionHeader){
+    .type = ELF_SECTION_TYPE_PROGBITS,
+    .flags = ELF_SECTION_FLAG_ALLOC | ELF_SECTION_FLAG_EXECUTE,
+    .offset = elf_align(offset, 16),
+    .size = object->code_size,
+    .alignment = 16,
+  };
+  offset = sections[ELF_SECTION_TEXT].offset + object->code_size;
+
+  sections[ELF_SECTION_BSS] = (ElfSectionHeader){
+    .type = ELF_SECTION_TYPE_NOBITS,
+    .flags = ELF_SECTION_FLAG_ALLOC | ELF_SECTION_FLAG_WRITE,
+    .offset = offset,
+    .size = object->bss_size,
+    .alignment = 16,
+  };
+
+  sections[ELF_SECTION_SYMTAB] = (ElfSectionHeader){
+    .type = ELF_SECTION_TYPE_SYMTAB,
+    .offset = elf_align(offset, 8),
+    .size = symbol_count * ELF_SYMBOL_SIZE,
+    .link = ELF_SECTION_STRTAB,
+    .info = (uint32_t)local_count,
+    .alignment = 8,
+    .entry_size = ELF_SYMBOL_SIZE,
+  };
+  offset = sections[ELF_SECTION_SYMTAB].offset + sections[ELF_SECTION_SYMTAB].size;
+
+  sections[ELF_SECTION_STRTAB] = (ElfSectionHeader){
+    .type = ELF_SECTION_TYPE_STRTAB,
+    .offset = offset,
+    .size = strtab_size,
+    .alignment = 1,
+  };
+  offset += strtab_size;
+
+  sections[ELF_SECTION_RELA_TEXT] = (ElfSectionHeader){
+    .type = ELF_SECTION_TYPE_RELA,
+    .flags = ELF_SECTION_FLAG_INFO_LINK,
+    .offset = elf_align(offset, 8),
+    .size = object->relocation_count * ELF_RELOCATION_SIZE,
+    .link = ELF_SECTION_SYMTAB,
+    .info = ELF_SECTION_TEXT,
+    .alignment = 8,
+    .entry_size = ELF_RELOCATION_SIZE,
+  };
+  offset = sections[ELF_SECTION_RELA_TEXT].offset + sections[ELF_SECTION_RELA_TEXT].size;
+
+  sections[ELF_SECTION_NOTE_GNU_STACK] = (ElfSectionHeader){
+    .type = ELF_SECTION_TYPE_PROGBITS,
+    .offset = offset,
+    .alignment = 1,
+  };
+
+  sections[ELF_SECTION_SHSTRTAB] = (ElfSectionHeader){
+    .type = ELF_SECTION_TYPE_STRTAB,
+    .offset = offset,
+    .size = shstrtab_size,
+    .alignment = 1,
+  };
+  offset += shstrtab_size;
+
+  uint64_t section_headers_offset = elf_align(offset, 8);
+
+  // ELF header.
+  code_buffer_literal(out, "\x7f" "ELF");
+  elf_integer(out, 2, 1); // 64-bit
+  elf_integer(out, 1, 1); // Little-endian
+  elf_integer(out, 1, 1); // Version
+  elf_pad(out, 7, 16);
+  elf_integer(out, ELF_TYPE_RELOCATABLE, 2);
+  elf_integer(out, ELF_MACHINE_X86_64, 2);
+  elf_integer(out, 1, 4); // Version
+  elf_integer(out, 0, 8); // Entry point
+  elf_integer(out, 0, 8); // Program headers
+  elf_integer(out, section_headers_offset, 8);
+  elf_integer(out, 0, 4); // Flags
+  elf_integer(out, ELF_HEADER_SIZE, 2);
+  elf_integer(out, 0, 2); // Program header size
+  elf_integer(out, 0, 2); // Program header count
+  elf_integer(out, ELF_SECTION_HEADER_SIZE, 2);
+  elf_integer(out, ELF_SECTION_COUNT, 2);
+  elf_integer(out, ELF_SECTION_SHSTRTAB, 2);
+
+  elf_pad(out, ELF_HEADER_SIZE, sections[ELF_SECTION_TEXT].offset);
+  code_buffer_write(out, (const char *)object->code, object->code_size);
+
+  elf_pad(out,
+          sections[ELF_SECTION_TEXT].offset + object->code_size,
+          sections[ELF_SECTION_SYMTAB].offset);
+  elf_pad(out, 0, ELF_SYMBOL_SIZE);
+  for (char global = 0; global < 2; ++global) {
+    for (size_t i = 0; i < object->symbol_count; ++i) {
+      ObjectSymbol *symbol = object->symbols + i;
+      if (!elf_symbol_listed(symbol) || elf_symbol_global(symbol) != global) { continue; }
+      elf_write_symbol(out, symbol, names[i]);
+    }
+  }
+
+  code_buffer_char(out, 0);
+  for (char global = 0; global < 2; ++global) {
+    for (size_t i = 0; i < object->symbol_count; ++i) {
+      ObjectSymbol *symbol = object->symbols + i;
+      if (!elf_symbol_listed(symbol) || elf_symbol_global(symbol) != global) { continue; }
+      code_buffer_write(out, symbol->name, strlen(symbol->name) + 1);
+    }
+  }
+
+  elf_pad(out,
+          sections[ELF_SECTION_STRTAB].offset + strtab_size,
+          sections[ELF_SECTION_RELA_TEXT].offset);
+  for (size_t i = 0; i < object->relocation_count; ++i) {
+    ObjectRelocation *relocation = object->relocations + i;
+    ASSERT(indices[relocation->symbol],
+           "Relocation against \"%s\", which is not in the symbol table.",
+           object->symbols[relocation->symbol].name);
+    uint64_t type = 0;
+    switch (relocation->type) {
+    case OBJECT_RELOCATION_PC32: type = ELF_RELOCATION_X86_64_PC32; break;
+    case OBJECT_RELOCATION_PLT32: type = ELF_RELOCATION_X86_64_PLT32; break;
+    }
+    elf_integer(out, relocation->offset, 8);
+    elf_integer(out, (uint64_t)indices[relocation->symbol] << 32 | type, 8);
+    elf_integer(out, (uint64_t)relocation->addend, 8);
+  }
+
+  for (size_t i = 0; i < ELF_SECTION_COUNT; ++i) {
+    code_buffer_write(out, elf_section_names[i], strlen(elf_section_names[i]) + 1);
+  }
+
+  elf_pad(out, offset, section_headers_offset);
+  for (size_t i = 0; i < ELF_SECTION_COUNT; ++i) {
+    ElfSectionHeader *section = sections + i;
+    elf_integer(out, section_names[i], 4);
+    elf_integer(out, section->type, 4);
+    elf_integer(out, section->flags, 8);
+    elf_integer(out, 0, 8); // Address
+    elf_integer(out, section->offset, 8);
+    elf_integer(out, section->size, 8);
+    elf_integer(out, section->link, 4);
+    elf_integer(out, section->info, 4);
+    elf_integer(out, section->alignment, 8);
+    elf_integer(out, section->entry_size, 8);
+  }
+
+  free(indices);
+  free(names);
+}
@@ -0,0 +1,16 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include <codegen/code_buffer.h>
+#include <codegen/object_file.h>
+
+/** Write OBJECT to OUT as an ELF64 relocatable object file for x86_64.
+ *
+ * The code goes into `.text` and the data into `.bss`. Only symbols
+ * that do not start with `.L` end up in the symbol table, the same as
+ * with the GNU assembler, and relocations against them are written to
+ * `.rela.text` for the linker to fill in. Resolve OBJECT first.
+ */
+void elf_write_object(ObjectFile *object, CodeBuffer *out);
+
+#endif /* ELF_H */
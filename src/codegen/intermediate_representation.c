@@ -3,32 +3,152 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 
+/// Make room for COUNT more instructions in BLOCK of FUNCTION.
+static void ir_reserve
+(IRFunction *function,
+ IRBlock *block,
+ uint32_t count
+ )
+{
+  ASSERT(count <= UINT32_MAX - block->instruction_count, "Too many instructions in a block.");
+  uint32_t needed = block->instruction_count + count;
+  if (needed <= block->instruction_capacity) { return; }
+  uint32_t capacity = block->instruction_capacity ? block->instruction_capacity : 4;
+  while (capacity < needed) {
+    capacity = capacity > UINT32_MAX / 2 ? UINT32_MAX : capacity * 2;
+  }
+  // The old array stays in the arena until the function is freed.
+  IRInstruction **instructions = arena_allocate(&function->arena, capacity * sizeof(IRInstruction *));
+  if (block->instruction_count) {
+    memcpy(instructions, block->instructions, block->instruction_count * sizeof(IRInstruction *));
+  }
+  block->instructions = instructions;
+  block->instruction_capacity = capacity;
+}
+
 void ir_insert
 (CodegenContext *context,
  IRInstruction *new_instruction
  )
 {
-  // If block is closed, open a new block.
-  if (context->block->branch) {
-    //
-  }
   ASSERT(context->block->branch == NULL, "Can not insert into a closed IRBlock.");
-  // [ ] <-> [ ] <-> [NULL]
-  //         [ ] <-> [new] <-> [NULL]
-  if (!context->block->instructions) {
-    context->block->instructions = new_instruction;
-    context->block->last_instruction = new_instruction;
-    return;
-  }
-  context->block->last_instruction->next = new_instruction;
-  new_instruction->previous = context->block->last_instruction;
-  context->block->last_instruction = new_instruction;
+  ir_reserve(context->function, context->block, 1);
+  context->block->instructions[context->block->instruction_count++] = new_instruction;
 }
 
 #define INSERT(instruction) ir_insert(context, (instruction))
 
+void ir_insert_at
+(IRFunction *function,
+ IRBlock *block,
+ uint32_t position,
+ IRInstruction *new_instruction
+ )
+{
+  ASSERT(position <= block->instruction_count, "Can not insert past the end of a block.");
+  ir_reserve(function, block, 1);
+  memmove(block->instructions + position + 1,
+          block->instructions + position,
+          (block->instruction_count - position) * sizeof(IRInstruction *));
+  block->instructions[position] = new_instruction;
+  block->instruction_count++;
+}
+
+void ir_insert_before
+(IRFunction *function,
+ IRBlock *block,
+ IRInstruction *instruction,
+ IRInstruction *new_instruction
+ )
+{
+  ir_insert_at(function, block, ir_position(block, instruction), new_instruction);
+}
+
+void ir_insert_after
+(IRFunction *function,
+ IRBlock *block,
+ IRInstruction *instruction,
+ IRInstruction *new_instruction
+ )
+{
+  ir_insert_at(function, block, ir_position(block, instruction) + 1, new_instruction);
+}
+
+uint32_t ir_position
+(IRBlock *block,
+ IRInstruction *instruction
+ )
+{
+  for (uint32_t position = 0; position < block->instruction_count; ++position) {
+    if (block->instructions[position] == instruction) { return position; }
+  }
+  PANIC("Instruction %%%zu is not in block bb%zu.", instruction->id, block->id);
+  return 0;
+}
+
+void ir_remove_at
+(IRBlock *block,
+ uint32_t position
+ )
+{
+  ASSERT(position < block->instruction_count, "Can not remove past the end of a block.");
+  block->instruction_count--;
+  memmove(block->instructions + position,
+          block->instructions + position + 1,
+          (block->instruction_count - position) * sizeof(IRInstruction *));
+}
+
+void ir_remove
+(IRBlock *block,
+ IRInstruction *instruction
+ )
+{
+  ir_remove_at(block, ir_position(block, instruction));
+}
+
+void ir_move_instructions
+(IRFunction *function,
+ IRBlock *to,
+ IRBlock *from,
+ uint32_t position
+ )
+{
+  ASSERT(position <= from->instruction_count, "Can not move instructions past the end of a block.");
+  uint32_t count = from->instruction_count - position;
+  if (!count) { return; }
+  ir_reserve(function, to, count);
+  memcpy(to->instructions + to->instruction_count,
+         from->instructions + position,
+         count * sizeof(IRInstruction *));
+  to->instruction_count += count;
+  from->instruction_count = position;
+}
+
+IRInstruction *ir_instruction_create(IRFunction *function, int type) {
+  IRInstruction *instruction = function->free_instructions;
+  if (instruction) {
+    function->free_instructions = instruction->value.reference;
+    memset(instruction, 0, sizeof(IRInstruction));
+  } else {
+    instruction = arena_allocate(&function->arena, sizeof(IRInstruction));
+  }
+  instruction->type = type;
+  return instruction;
+}
+
+void ir_free_instruction
+(IRFunction *function,
+ IRInstruction *instruction
+ )
+{
+  // The argument lists live in the arena, so they go with it.
+  instruction->value.reference = function->free_instructions;
+  function->free_instructions = instruction;
+}
+
 void ir_femit_instruction
 (FILE *file,
  IRInstruction *instruction
@@ -63,13 +183,8 @@ void ir_femit_instruction
       break;
     }
     fputc('(', file);
-    IRCallArgument *argument = instruction->value.call.arguments;
-    if (argument) {
-      fprintf(file, "%%%zu", argument->value->id);
-      argument = argument->next;
-    }
-    for (; argument; argument = argument->next) {
-      fprintf(file, ", %%%zu", argument->value->id);
+    for (uint32_t i = 0; i < instruction->value.call.argument_count; ++i) {
+      fprintf(file, i ? ", %%%zu" : "%%%zu", instruction->value.call.arguments[i]->id);
     }
     fputc(')', file);
     break;
@@ -86,6 +201,42 @@ void ir_femit_instruction
             instruction->value.pair.car->id,
             instruction->value.pair.cdr->id);
     break;
+  case IR_MULTIPLY:
+    fprintf(file, "multiply %%%zu, %%%zu",
+            instruction->value.pair.car->id,
+            instruction->value.pair.cdr->id);
+    break;
+  case IR_DIVIDE:
+    fprintf(file, "divide %%%zu, %%%zu",
+            instruction->value.pair.car->id,
+            instruction->value.pair.cdr->id);
+    break;
+  case IR_MODULO:
+    fprintf(file, "modulo %%%zu, %%%zu",
+            instruction->value.pair.car->id,
+            instruction->value.pair.cdr->id);
+    break;
+  case IR_SHIFT_LEFT:
+    fprintf(file, "shift.left %%%zu, %%%zu",
+            instruction->value.pair.car->id,
+            instruction->value.pair.cdr->id);
+    break;
+  case IR_SHIFT_RIGHT_ARITHMETIC:
+    fprintf(file, "shift.right.arithmetic %%%zu, %%%zu",
+            instruction->value.pair.car->id,
+            instruction->value.pair.cdr->id);
+    break;
+  case IR_LOAD:
+    fprintf(file, "load %%%zu", instruction->value.reference->id);
+    break;
+  case IR_STORE:
+    fprintf(file, "store %%%zu, %%%zu",
+            instruction->value.pair.cdr->id,
+            instruction->value.pair.car->id);
+    break;
+  case IR_STACK_ALLOCATE:
+    fprintf(file, "stack.allocate %"PRId64, instruction->value.immediate);
+    break;
   case IR_GLOBAL_LOAD:
     fprintf(file, "g.load %s", instruction->value.name);
     break;
@@ -100,6 +251,14 @@ void ir_femit_instruction
   case IR_LOCAL_LOAD:
     fprintf(file, "l.load %%%zu", instruction->value.reference->id);
     break;
+  case IR_LOCAL_STORE:
+    fprintf(file, "l.store %%%zu, %%%zu",
+            instruction->value.pair.cdr->id,
+            instruction->value.pair.car->id);
+    break;
+  case IR_LOCAL_ADDRESS:
+    fprintf(file, "l.address %%%zu", instruction->value.reference->id);
+    break;
   case IR_PARAMETER_REFERENCE:
     fprintf(file, "parameter.reference %%%"PRId64,
             instruction->value.immediate);
@@ -167,11 +326,8 @@ void ir_femit_block
  )
 {
   fprintf(file, "  bb%zu\n", block->id);
-  for (IRInstruction *instruction = block->instructions;
-       instruction;
-       instruction = instruction->next
-       ) {
-    ir_femit_instruction(file, instruction);
+  for (uint32_t i = 0; i < block->instruction_count; ++i) {
+    ir_femit_instruction(file, block->instructions[i]);
   }
   ir_femit_instruction(file, block->branch);
 }
@@ -189,7 +345,9 @@ void ir_femit_function
     ir_femit_block(file, block);
   }
 
-  fprintf(file, "return value: %%%zu\n", function->return_value->id);
+  if (function->return_value) {
+    fprintf(file, "return value: %%%zu\n", function->return_value->id);
+  }
 }
 
 void ir_femit
@@ -218,11 +376,8 @@ void ir_set_ids(CodegenContext *context) {
          block;
          block = block->next
          ) {
-      for (IRInstruction *instruction = block->instructions;
-           instruction;
-           instruction = instruction->next
-           ) {
-        instruction->id = ++instruction_id;
+      for (uint32_t i = 0; i < block->instruction_count; ++i) {
+        block->instructions[i]->id = ++instruction_id;
       }
       block->branch->id = ++instruction_id;
       block->id = ++block_id;
@@ -231,39 +386,254 @@ void ir_set_ids(CodegenContext *context) {
   }
 }
 
+char ir_is_value(IRInstruction *instruction) {
+  ASSERT(IR_COUNT == 24, "ir_is_value() must exhaustively handle IRTypes.");
+  switch (instruction->type) {
+  case IR_IMMEDIATE:
+  case IR_CALL:
+  case IR_LOAD:
+  case IR_PHI:
+  case IR_ADD:
+  case IR_SUBTRACT:
+  case IR_MULTIPLY:
+  case IR_DIVIDE:
+  case IR_MODULO:
+  case IR_SHIFT_LEFT:
+  case IR_SHIFT_RIGHT_ARITHMETIC:
+  case IR_LOCAL_LOAD:
+  case IR_LOCAL_ADDRESS:
+  case IR_GLOBAL_LOAD:
+  case IR_GLOBAL_ADDRESS:
+  case IR_COMPARISON:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+void ir_for_each_operand
+(IRInstruction *instruction,
+ IROperandCallback *callback,
+ void *data
+ )
+{
+  ASSERT(IR_COUNT == 24, "ir_for_each_operand() must exhaustively handle IRTypes.");
+  switch (instruction->type) {
+  case IR_CALL:
+    if (instruction->value.call.type == IR_CALLTYPE_INDIRECT) {
+      callback(&instruction->value.call.value.callee, data);
+    }
+    for (uint32_t i = 0; i < instruction->value.call.argument_count; ++i) {
+      callback(instruction->value.call.arguments + i, data);
+    }
+    break;
+  case IR_PHI:
+    for (IRPhiArgument *argument = instruction->value.phi_argument;
+         argument;
+         argument = argument->next
+         ) {
+      callback(&argument->value, data);
+    }
+    break;
+  case IR_LOAD:
+  case IR_LOCAL_LOAD:
+  case IR_LOCAL_ADDRESS:
+    callback(&instruction->value.reference, data);
+    break;
+  case IR_ADD:
+  case IR_SUBTRACT:
+  case IR_MULTIPLY:
+  case IR_DIVIDE:
+  case IR_MODULO:
+  case IR_SHIFT_LEFT:
+  case IR_SHIFT_RIGHT_ARITHMETIC:
+  case IR_LOCAL_STORE:
+  case IR_STORE:
+    callback(&instruction->value.pair.car, data);
+    callback(&instruction->value.pair.cdr, data);
+    break;
+  case IR_COMPARISON:
+    callback(&instruction->value.comparison.pair.car, data);
+    callback(&instruction->value.comparison.pair.cdr, data);
+    break;
+  case IR_GLOBAL_STORE:
+    callback(&instruction->value.global_assignment.new_value, data);
+    break;
+  case IR_BRANCH_CONDITIONAL:
+    callback(&instruction->value.conditional_branch.condition, data);
+    break;
+  default:
+    break;
+  }
+}
+
 void ir_add_function_call_argument
 (CodegenContext *context,
  IRInstruction *call,
  IRInstruction *argument
  )
 {
-  IRCallArgument *new_argument = calloc(1, sizeof(IRCallArgument));
-  ASSERT(new_argument, "Could not allocate memory for new_argument.");
+  IRCall *value = &call->value.call;
+  ASSERT(value->argument_count < UINT32_MAX, "Too many arguments to a function call.");
+  // The array is full whenever the count is zero or a power of two.
+  if ((value->argument_count & (value->argument_count - 1)) == 0) {
+    size_t capacity = value->argument_count ? 2 * (size_t)value->argument_count : 1;
+    IRInstruction **arguments = arena_allocate(&context->function->arena, capacity * sizeof(IRInstruction *));
+    if (value->argument_count) {
+      memcpy(arguments, value->arguments, value->argument_count * sizeof(IRInstruction *));
+    }
+    value->arguments = arguments;
+  }
+  value->arguments[value->argument_count++] = argument;
+}
+
+IRBlock *ir_block_create(IRFunction *function) {
+  IRBlock *block = function->free_blocks;
+  if (block) {
+    function->free_blocks = block->next;
+    // Keep the array of instructions around for reuse.
+    IRInstruction **instructions = block->instructions;
+    uint32_t capacity = block->instruction_capacity;
+    memset(block, 0, sizeof(IRBlock));
+    block->instructions = instructions;
+    block->instruction_capacity = capacity;
+  } else {
+    block = arena_allocate(&function->arena, sizeof(IRBlock));
+  }
+  return block;
+}
 
-  new_argument->value = argument;
+void ir_free_block(IRFunction *function, IRBlock *block) {
+  block->next = function->free_blocks;
+  function->free_blocks = block;
+}
 
-  if (!call->value.call.arguments) {
-    call->value.call.arguments = new_argument;
-  } else {
-    IRCallArgument *arguments = call->value.call.arguments;
-    for (; arguments->next; arguments = arguments->next);
-    arguments->next = new_argument;
+size_t ir_successors(IRBlock *block, IRBlock *successors[2]) {
+  ASSERT(block->branch, "Block bb%zu does not end with a branch.", block->id);
+  switch (block->branch->type) {
+  case IR_RETURN:
+    return 0;
+  case IR_BRANCH:
+    successors[0] = block->branch->value.block;
+    return 1;
+  case IR_BRANCH_CONDITIONAL:
+    successors[0] = block->branch->value.conditional_branch.true_branch;
+    successors[1] = block->branch->value.conditional_branch.false_branch;
+    return successors[0] == successors[1] ? 1 : 2;
+  default:
+    PANIC("Block ends in IRType %d, which is not a branch.", block->branch->type);
   }
+  return 0;
 }
 
-IRBlock *ir_block_create() {
-  IRBlock *block = calloc(1, sizeof(IRBlock));
-  ASSERT(block, "Could not allocate memory for first IRBlock of new IRFunction.");
-  return block;
+/// An instruction, and the position of its function in the list.
+typedef struct IROwner {
+  IRInstruction *instruction;
+  size_t function;
+} IROwner;
+
+static int ir_compare_owners(const void *a, const void *b) {
+  uintptr_t lhs = (uintptr_t)((const IROwner *)a)->instruction;
+  uintptr_t rhs = (uintptr_t)((const IROwner *)b)->instruction;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+typedef struct IROwnerCheck {
+  IROwner *owners;
+  size_t count;
+  size_t function;
+  char foreign;
+} IROwnerCheck;
+
+static void ir_check_owner(IRInstruction **operand, void *data) {
+  IROwnerCheck *check = data;
+  IROwner key = { *operand, 0 };
+  IROwner *owner = bsearch(&key, check->owners, check->count, sizeof(IROwner), ir_compare_owners);
+  if (!owner || owner->function != check->function) { check->foreign = 1; }
+}
+
+char ir_functions_self_contained(IRFunction *functions) {
+  IROwnerCheck check = {0};
+  for (IRFunction *function = functions; function; function = function->next) {
+    for (IRBlock *block = function->first; block; block = block->next) {
+      check.count += block->instruction_count;
+      if (block->branch) { check.count++; }
+    }
+  }
+  check.owners = calloc(check.count ? check.count : 1, sizeof(IROwner));
+  ASSERT(check.owners, "Could not allocate memory for instruction owners.");
+
+  size_t index = 0;
+  size_t function_index = 0;
+  for (IRFunction *function = functions; function; function = function->next, ++function_index) {
+    for (IRBlock *block = function->first; block; block = block->next) {
+      for (uint32_t i = 0; i < block->instruction_count; ++i) {
+        check.owners[index++] = (IROwner){ block->instructions[i], function_index };
+      }
+      if (block->branch) { check.owners[index++] = (IROwner){ block->branch, function_index }; }
+    }
+  }
+  qsort(check.owners, check.count, sizeof(IROwner), ir_compare_owners);
+
+  for (IRFunction *function = functions; function && !check.foreign; function = function->next, ++check.function) {
+    for (IRBlock *block = function->first; block; block = block->next) {
+      for (uint32_t i = 0; i < block->instruction_count; ++i) {
+        ir_for_each_operand(block->instructions[i], ir_check_owner, &check);
+      }
+      if (block->branch) { ir_for_each_operand(block->branch, ir_check_owner, &check); }
+    }
+    if (function->return_value) { ir_check_owner(&function->return_value, &check); }
+  }
+
+  free(check.owners);
+  return !check.foreign;
+}
+
+void ir_set_predecessors(IRFunction *function) {
+  size_t total = 0;
+  for (IRBlock *block = function->first; block; block = block->next) {
+    block->predecessor_count = 0;
+  }
+  for (IRBlock *block = function->first; block; block = block->next) {
+    IRBlock *successors[2];
+    size_t count = ir_successors(block, successors);
+    for (size_t i = 0; i < count; ++i) {
+      successors[i]->predecessor_count++;
+    }
+    total += count;
+  }
+  ASSERT(total <= UINT32_MAX, "Too many branches in function f%zu.", function->id);
+  if (total > function->predecessor_capacity) {
+    function->predecessors = realloc(function->predecessors, total * sizeof(IRBlock *));
+    ASSERT(function->predecessors, "Could not allocate memory for predecessors of function f%zu.", function->id);
+    function->predecessor_capacity = (uint32_t)total;
+  }
+
+  // Each block gets the slice after those of the blocks before it, and
+  // is filled from the back, so that its predecessors are in reverse
+  // layout order.
+  size_t offset = 0;
+  for (IRBlock *block = function->first; block; block = block->next) {
+    offset += block->predecessor_count;
+    block->predecessors = function->predecessors + offset;
+  }
+  for (IRBlock *block = function->first; block; block = block->next) {
+    IRBlock *successors[2];
+    size_t count = ir_successors(block, successors);
+    for (size_t i = 0; i < count; ++i) {
+      *--successors[i]->predecessors = block;
+    }
+  }
 }
 
 void ir_phi_argument
-(IRInstruction *phi,
+(IRFunction *function,
+ IRInstruction *phi,
  IRBlock *phi_predecessor,
  IRInstruction *argument
  )
 {
-  IRPhiArgument *phi_argument = calloc(1, sizeof(IRPhiArgument));
+  IRPhiArgument *phi_argument = arena_allocate(&function->arena, sizeof(IRPhiArgument));
   phi_argument->block = phi_predecessor;
   phi_argument->value = argument;
 
@@ -296,11 +666,28 @@ IRFunction *ir_function_create() {
   return function;
 }
 
+void ir_function_free(IRFunction *function) {
+  free(function->predecessors);
+  arena_free(&function->arena);
+  free(function);
+}
+
+void ir_free_functions(CodegenContext *context) {
+  IRFunction *function = context->function;
+  while (function) {
+    IRFunction *next = function->next;
+    ir_function_free(function);
+    function = next;
+  }
+  context->function = NULL;
+  context->block = NULL;
+}
+
 IRFunction *ir_function(CodegenContext *context) {
   IRFunction *function = ir_function_create();
   // A function *must* contain at least one block, so we start new
   // functions out with an empty block.
-  IRBlock *block = ir_block_create();
+  IRBlock *block = ir_block_create(function);
 
   if (context->function) {
     IRFunction *last_function = context->function;
@@ -438,7 +825,11 @@ IRInstruction *ir_store
  IRInstruction *address
  )
 {
-  TODO();
+  INSTRUCTION(store, IR_STORE);
+  store->value.pair.car = address;
+  store->value.pair.cdr = data;
+  INSERT(store);
+  return store;
 }
 
 IRInstruction *ir_branch_conditional
@@ -528,7 +919,11 @@ IRInstruction *ir_multiply
  IRInstruction *rhs
  )
 {
-  TODO();
+  INSTRUCTION(mul, IR_MULTIPLY);
+  mul->value.pair.car = lhs;
+  mul->value.pair.cdr = rhs;
+  INSERT(mul);
+  return mul;
 }
 
 IRInstruction *ir_divide
@@ -537,7 +932,11 @@ IRInstruction *ir_divide
  IRInstruction *rhs
  )
 {
-  TODO();
+  INSTRUCTION(div, IR_DIVIDE);
+  div->value.pair.car = lhs;
+  div->value.pair.cdr = rhs;
+  INSERT(div);
+  return div;
 }
 
 IRInstruction *ir_modulo
@@ -546,7 +945,11 @@ IRInstruction *ir_modulo
  IRInstruction *rhs
  )
 {
-  TODO();
+  INSTRUCTION(mod, IR_MODULO);
+  mod->value.pair.car = lhs;
+  mod->value.pair.cdr = rhs;
+  INSERT(mod);
+  return mod;
 }
 
 IRInstruction *ir_shift_left
@@ -555,7 +958,11 @@ IRInstruction *ir_shift_left
  IRInstruction *rhs
  )
 {
-  TODO();
+  INSTRUCTION(shl, IR_SHIFT_LEFT);
+  shl->value.pair.car = lhs;
+  shl->value.pair.cdr = rhs;
+  INSERT(shl);
+  return shl;
 }
 
 IRInstruction *ir_shift_right_arithmetic
@@ -564,7 +971,11 @@ IRInstruction *ir_shift_right_arithmetic
  IRInstruction *rhs
  )
 {
-  TODO();
+  INSTRUCTION(sar, IR_SHIFT_RIGHT_ARITHMETIC);
+  sar->value.pair.car = lhs;
+  sar->value.pair.cdr = rhs;
+  INSERT(sar);
+  return sar;
 }
 
 IRInstruction *ir_stack_allocate
@@ -572,7 +983,10 @@ IRInstruction *ir_stack_allocate
  int64_t size
  )
 {
-  TODO();
+  INSTRUCTION(alloca, IR_STACK_ALLOCATE);
+  alloca->value.immediate = size;
+  INSERT(alloca);
+  return alloca;
 }
 
 #undef INSERT
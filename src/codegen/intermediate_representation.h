@@ -1,14 +1,15 @@
 #ifndef INTERMEDIATE_REPRESENTATION_H
 #define INTERMEDIATE_REPRESENTATION_H
 
+#include <arena.h>
 #include <codegen.h>
 #include <codegen/codegen_forward.h>
 #include <inttypes.h>
 
-#define INSTRUCTION(name, given_type)                       \
-  IRInstruction *(name) = calloc(1, sizeof(IRInstruction)); \
-  ASSERT((name), "Could not allocate new IRInstruction.");  \
-  (name)->type = (given_type);
+/// Declare NAME as a new instruction of the function being generated
+/// in `context`.
+#define INSTRUCTION(name, given_type) \
+  IRInstruction *(name) = ir_instruction_create(context->function, (given_type));
 
 typedef enum IRType {
   IR_IMMEDIATE,
@@ -21,6 +22,11 @@ typedef enum IRType {
 
   IR_ADD,
   IR_SUBTRACT,
+  IR_MULTIPLY,
+  IR_DIVIDE,
+  IR_MODULO,
+  IR_SHIFT_LEFT,
+  IR_SHIFT_RIGHT_ARITHMETIC,
 
   IR_LOCAL_LOAD,
   IR_LOCAL_STORE,
@@ -34,6 +40,11 @@ typedef enum IRType {
 
   IR_PARAMETER_REFERENCE,
 
+  /// Memory on the stack, `value.immediate` bytes large.
+  IR_STACK_ALLOCATE,
+  /// Store `value.pair.cdr` at the address `value.pair.car`.
+  IR_STORE,
+
   IR_COUNT
 } IRType;
 
@@ -57,11 +68,6 @@ typedef struct IRPair {
   IRInstruction *cdr;
 } IRPair;
 
-typedef struct IRCallArgument {
-  IRInstruction *value;
-  struct IRCallArgument *next;
-} IRCallArgument;
-
 typedef enum IRCallType {
   IR_CALLTYPE_DIRECT,
   IR_CALLTYPE_INDIRECT,
@@ -75,8 +81,11 @@ typedef union IRCallValue {
 
 typedef struct IRCall {
   IRCallType type;
+  uint32_t argument_count;
   IRCallValue value;
-  IRCallArgument *arguments;
+  /// The arguments in order. Room is made for twice as many whenever
+  /// the count reaches a power of two.
+  IRInstruction **arguments;
 } IRCall;
 
 typedef struct IRBranchConditional {
@@ -116,27 +125,31 @@ typedef struct IRInstruction {
   size_t id;
 
   // Register allocation.
+  /// Position of this instruction within its function, in layout order.
   size_t index;
-
-  // Doubly linked list.
-  struct IRInstruction *previous;
-  struct IRInstruction *next;
+  /// The register holding the value of this instruction, unless it
+  /// was spilled.
+  RegisterDescriptor result;
+  /// If non-zero, the value of this instruction lives in this stack
+  /// slot (counting from one) instead of a register.
+  size_t spill_slot;
 } IRInstruction;
 
-typedef struct IRBlockPredecessor {
-  IRBlock *block;
-  struct IRBlockPredecessor *next;
-} IRBlockPredecessor;
-
 /// A block is a list of instructions that have control flow enter at
 /// the beginning and leave at the end.
 typedef struct IRBlock {
-  IRInstruction *instructions;
-  IRInstruction *last_instruction;
+  /// The instructions of the block in order, not counting its branch.
+  /// The array is allocated from the arena of the function.
+  IRInstruction **instructions;
+  uint32_t instruction_count;
+  uint32_t instruction_capacity;
 
   IRInstruction *branch;
 
-  IRBlockPredecessor *predecessor;
+  /// Blocks that branch here, as found by ir_set_predecessors(). They
+  /// are a slice of the `predecessors` of the function.
+  IRBlock **predecessors;
+  uint32_t predecessor_count;
 
   // Doubly linked list.
   struct IRBlock *previous;
@@ -144,14 +157,43 @@ typedef struct IRBlock {
 
   // Unique ID (among blocks)
   size_t id;
+
+  /// Position of this block within its function, in whatever order
+  /// the pass that last numbered the blocks needed.
+  size_t index;
 } IRBlock;
 
 typedef struct IRFunction {
+  /// The label of the function's entry point.
+  char *name;
+
   IRBlock *first;
   IRBlock *last;
 
   IRInstruction *return_value;
 
+  /// Number of stack slots needed for values that did not get a
+  /// register.
+  size_t spill_slots;
+  /// Bit N is set iff register allocation put a value in the register
+  /// with descriptor N.
+  uint64_t registers_used;
+
+  /// Blocks, instructions, phi arguments, and the arrays of
+  /// instructions and call arguments of this function are allocated
+  /// from here, and freed all at once with it.
+  Arena arena;
+  /// Instructions that were freed and can be handed out again,
+  /// linked through `value.reference`.
+  IRInstruction *free_instructions;
+  /// Blocks are allocated from `arena` as well, and freed ones are
+  /// linked through `next` to be handed out again.
+  IRBlock *free_blocks;
+
+  /// The predecessors of every block, one block after the other.
+  IRBlock **predecessors;
+  uint32_t predecessor_capacity;
+
   // Linked list.
   struct IRFunction *next;
 
@@ -161,6 +203,28 @@ typedef struct IRFunction {
 
 void ir_set_ids(CodegenContext *context);
 
+/// Return non-zero iff INSTRUCTION computes a value that has to be
+/// kept somewhere. Parameter references and stack allocations name a
+/// stack location rather than holding a value, so they are not values.
+char ir_is_value(IRInstruction *instruction);
+
+typedef void IROperandCallback(IRInstruction **operand, void *data);
+
+/// Call CALLBACK with the address of every operand of INSTRUCTION that
+/// refers to another instruction, in evaluation order. The value
+/// returned by an IR_RETURN lives in its function, not the
+/// instruction, so it is not visited.
+void ir_for_each_operand
+(IRInstruction *instruction,
+ IROperandCallback *callback,
+ void *data);
+
+/// Return non-zero iff no instruction of the list FUNCTIONS refers to
+/// an instruction of another function, so that they can be worked on
+/// at the same time. Nested functions that refer to locals of the
+/// function they are in do.
+char ir_functions_self_contained(IRFunction *functions);
+
 void ir_femit_instruction
 (FILE *file,
  IRInstruction *instruction);
@@ -179,7 +243,21 @@ void ir_add_function_call_argument
  IRInstruction *call,
  IRInstruction *argument);
 
-IRBlock *ir_block_create();
+/// Create an empty block that belongs to FUNCTION, without attaching
+/// it anywhere.
+IRBlock *ir_block_create(IRFunction *function);
+
+/// Give BLOCK back to FUNCTION to be reused by the next block it
+/// creates. Its instructions have to be freed or moved beforehand.
+void ir_free_block(IRFunction *function, IRBlock *block);
+
+/// Store the blocks that BLOCK may branch to in SUCCESSORS, and
+/// return how many there are. A block that branches to the same
+/// place either way has one successor.
+size_t ir_successors(IRBlock *block, IRBlock *successors[2]);
+
+/// Recompute the predecessors of every block of FUNCTION.
+void ir_set_predecessors(IRFunction *function);
 
 void ir_block_attach
 (CodegenContext *context,
@@ -188,12 +266,77 @@ void ir_block_attach
 IRFunction *ir_function_create();
 IRFunction *ir_function(CodegenContext *context);
 
+/// Free FUNCTION along with its blocks and instructions.
+void ir_function_free(IRFunction *function);
+
+/// Free every function of CONTEXT.
+void ir_free_functions(CodegenContext *context);
+
+/// Create an instruction of TYPE that belongs to FUNCTION, without
+/// inserting it anywhere.
+IRInstruction *ir_instruction_create(IRFunction *function, int type);
+
 void ir_insert
 (CodegenContext *context,
  IRInstruction *new_instruction);
 
+/// Insert NEW_INSTRUCTION into BLOCK of FUNCTION, so that it ends up
+/// at POSITION. Instructions from there on move back by one.
+void ir_insert_at
+(IRFunction *function,
+ IRBlock *block,
+ uint32_t position,
+ IRInstruction *new_instruction);
+
+/// Insert NEW_INSTRUCTION into BLOCK of FUNCTION, right before
+/// INSTRUCTION.
+void ir_insert_before
+(IRFunction *function,
+ IRBlock *block,
+ IRInstruction *instruction,
+ IRInstruction *new_instruction);
+
+/// Insert NEW_INSTRUCTION into BLOCK of FUNCTION, right after
+/// INSTRUCTION.
+void ir_insert_after
+(IRFunction *function,
+ IRBlock *block,
+ IRInstruction *instruction,
+ IRInstruction *new_instruction);
+
+/// Return the position of INSTRUCTION within BLOCK. This searches
+/// the block, so passes that know the position should use it.
+uint32_t ir_position
+(IRBlock *block,
+ IRInstruction *instruction);
+
+/// Remove the instruction at POSITION from BLOCK, without freeing it.
+void ir_remove_at
+(IRBlock *block,
+ uint32_t position);
+
+/// Remove INSTRUCTION from BLOCK, without freeing it.
+void ir_remove
+(IRBlock *block,
+ IRInstruction *instruction);
+
+/// Move the instructions of FROM starting at POSITION to the end of
+/// TO, both blocks of FUNCTION.
+void ir_move_instructions
+(IRFunction *function,
+ IRBlock *to,
+ IRBlock *from,
+ uint32_t position);
+
+/// Give INSTRUCTION back to FUNCTION to be reused by the next one it
+/// creates. Nothing may refer to it any more.
+void ir_free_instruction
+(IRFunction *function,
+ IRInstruction *instruction);
+
 void ir_phi_argument
-(IRInstruction *phi,
+(IRFunction *function,
+ IRInstruction *phi,
  IRBlock *phi_predecessor,
  IRInstruction *argument);
 
@@ -0,0 +1,195 @@
+#ifndef _WIN32
+// For RTLD_DEFAULT.
+#  define _GNU_SOURCE
+#endif
+
+#include <codegen/jit.h>
+
+#include <codegen/object_file.h>
+#include <error.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#  include <dlfcn.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#else
+#  include <windows.h>
+#endif
+
+/// Size in bytes of the code that jumps to an undefined symbol.
+#define JIT_STUB_SIZE 16
+
+static uint64_t jit_align(uint64_t offset, uint64_t alignment) {
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+#ifndef _WIN32
+
+static uint64_t jit_page_size() {
+  return (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+/// Map SIZE bytes of readable and writable memory, or return NULL.
+static uint8_t *jit_map(uint64_t size) {
+  void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return memory == MAP_FAILED ? NULL : memory;
+}
+
+/// Make the first SIZE bytes of MEMORY executable instead of writable.
+/// Return non-zero iff that worked.
+static char jit_make_executable(uint8_t *memory, uint64_t size) {
+  return mprotect(memory, size, PROT_READ | PROT_EXEC) == 0;
+}
+
+static void jit_unmap(uint8_t *memory, uint64_t size) {
+  munmap(memory, size);
+}
+
+/// Find the external symbol NAME in this process, or return NULL.
+static void *jit_find_symbol(const char *name) {
+  return dlsym(RTLD_DEFAULT, name);
+}
+
+#else /* _WIN32 */
+
+static uint64_t jit_page_size() {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwPageSize;
+}
+
+/// Map SIZE bytes of readable and writable memory, or return NULL.
+static uint8_t *jit_map(uint64_t size) {
+  return VirtualAlloc(NULL, (SIZE_T)size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
+
+/// Make the first SIZE bytes of MEMORY executable instead of writable.
+/// Return non-zero iff that worked.
+static char jit_make_executable(uint8_t *memory, uint64_t size) {
+  DWORD old_protection;
+  if (!VirtualProtect(memory, (SIZE_T)size, PAGE_EXECUTE_READ, &old_protection)) { return 0; }
+  FlushInstructionCache(GetCurrentProcess(), memory, (SIZE_T)size);
+  return 1;
+}
+
+static void jit_unmap(uint8_t *memory, uint64_t size) {
+  (void)size;
+  VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+/// Find the external symbol NAME in this process, or return NULL.
+/// Windows has no single namespace of symbols, so the compiler itself
+/// and the C runtimes it may be linked against are searched in turn.
+static void *jit_find_symbol(const char *name) {
+  static const char *modules[] = { NULL, "ucrtbase.dll", "msvcrt.dll", "kernel32.dll" };
+  for (size_t i = 0; i < sizeof(modules) / sizeof(*modules); ++i) {
+    HMODULE module = GetModuleHandleA(modules[i]);
+    if (!module) { continue; }
+    FARPROC procedure = GetProcAddress(module, name);
+    if (procedure) {
+      void *address;
+      memcpy(&address, &procedure, sizeof(address));
+      return address;
+    }
+  }
+  return NULL;
+}
+
+#endif /* _WIN32 */
+
+Error jit_run(ObjectFile *object, int64_t *result) {
+  Error err = ok;
+
+  // The code comes first, followed by a stub for every undefined
+  // symbol that jumps to wherever it was found; shared libraries are
+  // usually too far away to be reached with a 32-bit displacement.
+  // The data starts on the next page, so that it can stay writable
+  // when the code is made executable.
+  uint64_t page_size = jit_page_size();
+  uint64_t stubs_offset = jit_align(object->code_size, JIT_STUB_SIZE);
+  uint64_t *stub_offsets = calloc(object->symbol_count ? object->symbol_count : 1, sizeof(uint64_t));
+  ASSERT(stub_offsets, "Could not allocate memory for stubs.");
+  uint64_t text_size = stubs_offset;
+  for (size_t i = 0; i < object->symbol_count; ++i) {
+    if (object->symbols[i].section != OBJECT_SECTION_UNDEFINED) { continue; }
+    stub_offsets[i] = text_size;
+    text_size += JIT_STUB_SIZE;
+  }
+  text_size = jit_align(text_size ? text_size : 1, page_size);
+  uint64_t size = text_size + jit_align(object->bss_size, page_size);
+
+  uint8_t *memory = jit_map(size);
+  if (!memory) {
+    free(stub_offsets);
+    ERROR_PREP(err, ERROR_GENERIC, "jit_run(): Could not map memory for the program.");
+    return err;
+  }
+  memcpy(memory, object->code, object->code_size);
+
+  uint8_t *entry = NULL;
+  for (size_t i = 0; i < object->symbol_count; ++i) {
+    ObjectSymbol *symbol = object->symbols + i;
+    if (symbol->section == OBJECT_SECTION_TEXT && strcmp(symbol->name, "main") == 0) {
+      entry = memory + symbol->offset;
+    }
+    if (symbol->section != OBJECT_SECTION_UNDEFINED) { continue; }
+    void *address = jit_find_symbol(symbol->name);
+    if (!address) {
+      printf("Symbol: \"%s\"\n", symbol->name);
+      ERROR_PREP(err, ERROR_GENERIC, "jit_run(): Could not find external symbol.");
+      break;
+    }
+    // jmp *0(%rip), followed by the address.
+    uint8_t *stub = memory + stub_offsets[i];
+    stub[0] = 0xff;
+    stub[1] = 0x25;
+    memset(stub + 2, 0, 4);
+    uint64_t value = (uint64_t)(uintptr_t)address;
+    for (size_t byte = 0; byte < 8; ++byte) {
+      stub[6 + byte] = (uint8_t)(value >> (8 * byte));
+    }
+  }
+  if (!entry && err.type == ERROR_NONE) {
+    ERROR_PREP(err, ERROR_GENERIC, "jit_run(): The program has no entry point.");
+  }
+
+  for (size_t i = 0; err.type == ERROR_NONE && i < object->relocation_count; ++i) {
+    ObjectRelocation *relocation = object->relocations + i;
+    ObjectSymbol *symbol = object->symbols + relocation->symbol;
+    uint64_t offset = 0;
+    switch (symbol->section) {
+    case OBJECT_SECTION_UNDEFINED: offset = stub_offsets[relocation->symbol]; break;
+    case OBJECT_SECTION_TEXT: offset = symbol->offset; break;
+    case OBJECT_SECTION_BSS: offset = text_size + symbol->offset; break;
+    }
+    int64_t distance = (int64_t)offset + relocation->addend - (int64_t)relocation->offset;
+    ASSERT(distance >= INT32_MIN && distance <= INT32_MAX,
+           "Distance to \"%s\" does not fit in 32 bits.", symbol->name);
+    uint32_t field = (uint32_t)(int32_t)distance;
+    for (size_t byte = 0; byte < 4; ++byte) {
+      memory[relocation->offset + byte] = (uint8_t)(field >> (8 * byte));
+    }
+  }
+  free(stub_offsets);
+
+  if (err.type == ERROR_NONE && !jit_make_executable(memory, text_size)) {
+    ERROR_PREP(err, ERROR_GENERIC, "jit_run(): Could not make the program executable.");
+  }
+
+  if (err.type == ERROR_NONE) {
+    int64_t (*main_function)(void);
+    // Object pointers can not be cast to function pointers in ISO C,
+    // but POSIX and Windows both require this to work, as dlsym() and
+    // GetProcAddress() depend on it.
+    memcpy(&main_function, &entry, sizeof(main_function));
+    *result = main_function();
+  }
+
+  jit_unmap(memory, size);
+  return err;
+}
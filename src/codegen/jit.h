@@ -0,0 +1,19 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <codegen/object_file.h>
+#include <error.h>
+#include <stdint.h>
+
+/** Load OBJECT into executable memory and call its `main`.
+ *
+ * Undefined symbols are looked up in this process, so external
+ * functions can be called as long as the compiler itself is linked
+ * against them, as it is against the C library. The memory is freed
+ * again once `main` returns.
+ *
+ * @return What `main` returns, in RESULT.
+ */
+Error jit_run(ObjectFile *object, int64_t *result);
+
+#endif /* JIT_H */
@@ -0,0 +1,216 @@
+#include <codegen/object_file.h>
+
+#include <arena.h>
+#include <error.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OBJECT_FILE_INITIAL_CODE_CAPACITY (64 * 1024)
+#define OBJECT_FILE_INITIAL_SYMBOL_CAPACITY 256
+
+ObjectFile *object_file_create() {
+  ObjectFile *object = calloc(1, sizeof(ObjectFile));
+  ASSERT(object, "Could not allocate memory for object file.");
+  return object;
+}
+
+void object_file_free(ObjectFile *object) {
+  if (!object) { return; }
+  free(object->code);
+  free(object->symbols);
+  free(object->symbol_table);
+  free(object->relocations);
+  arena_free(&object->names);
+  free(object);
+}
+
+void object_file_reserve(ObjectFile *object, size_t size) {
+  if (object->code_capacity - object->code_size >= size) { return; }
+  size_t capacity = object->code_capacity ? object->code_capacity : OBJECT_FILE_INITIAL_CODE_CAPACITY;
+  while (capacity - object->code_size < size) { capacity *= 2; }
+  object->code = realloc(object->code, capacity);
+  ASSERT(object->code, "Could not allocate memory for machine code.");
+  object->code_capacity = capacity;
+}
+
+void object_file_integer(ObjectFile *object, uint64_t value, size_t size) {
+  object_file_reserve(object, size);
+  for (size_t i = 0; i < size; ++i) {
+    object->code[object->code_size++] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+static size_t object_file_hash(const char *name) {
+  // FNV-1a
+  size_t hash = 14695981039346656037ULL;
+  for (; *name; ++name) {
+    hash ^= (unsigned char)*name;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/// Get the slot of the symbol table that either holds the symbol NAME
+/// or is the empty slot it would be inserted into.
+static size_t *object_file_slot(ObjectFile *object, const char *name) {
+  size_t mask = object->symbol_table_capacity - 1;
+  size_t index = object_file_hash(name) & mask;
+  for (;;) {
+    size_t *slot = object->symbol_table + index;
+    if (!*slot || strcmp(object->symbols[*slot - 1].name, name) == 0) {
+      return slot;
+    }
+    index = (index + 1) & mask;
+  }
+}
+
+/// Make sure there is room for another symbol.
+static void object_file_grow(ObjectFile *object) {
+  if (object->symbol_count == object->symbol_capacity) {
+    object->symbol_capacity = object->symbol_capacity
+      ? object->symbol_capacity * 2
+      : OBJECT_FILE_INITIAL_SYMBOL_CAPACITY;
+    object->symbols = realloc(object->symbols, object->symbol_capacity * sizeof(ObjectSymbol));
+    ASSERT(object->symbols, "Could not allocate memory for symbols.");
+  }
+
+  // Keep the load factor at or below one half.
+  if ((object->symbol_count + 1) * 2 <= object->symbol_table_capacity) { return; }
+  free(object->symbol_table);
+  object->symbol_table_capacity = object->symbol_table_capacity
+    ? object->symbol_table_capacity * 2
+    : 2 * OBJECT_FILE_INITIAL_SYMBOL_CAPACITY;
+  object->symbol_table = calloc(object->symbol_table_capacity, sizeof(size_t));
+  ASSERT(object->symbol_table, "Could not allocate memory for symbol table.");
+  for (size_t i = 0; i < object->symbol_count; ++i) {
+    *object_file_slot(object, object->symbols[i].name) = i + 1;
+  }
+}
+
+size_t object_file_symbol(ObjectFile *object, const char *name) {
+  object_file_grow(object);
+  size_t *slot = object_file_slot(object, name);
+  if (*slot) { return *slot - 1; }
+
+  size_t length = strlen(name);
+  char *copy = arena_allocate(&object->names, length + 1);
+  memcpy(copy, name, length + 1);
+
+  ObjectSymbol *symbol = object->symbols + object->symbol_count;
+  memset(symbol, 0, sizeof(ObjectSymbol));
+  symbol->name = copy;
+  symbol->section = OBJECT_SECTION_UNDEFINED;
+  *slot = ++object->symbol_count;
+  return *slot - 1;
+}
+
+/// Get the symbol NAME, which must not have been defined yet.
+static ObjectSymbol *object_file_define(ObjectFile *object, const char *name) {
+  size_t index = object_file_symbol(object, name);
+  ObjectSymbol *symbol = object->symbols + index;
+  ASSERT(symbol->section == OBJECT_SECTION_UNDEFINED, "Symbol \"%s\" is defined more than once.", name);
+  return symbol;
+}
+
+void object_file_label(ObjectFile *object, const char *name, char global) {
+  ObjectSymbol *symbol = object_file_define(object, name);
+  symbol->section = OBJECT_SECTION_TEXT;
+  symbol->offset = object->code_size;
+  symbol->global = global;
+}
+
+void object_file_allocate(ObjectFile *object, const char *name, uint64_t size, uint64_t alignment) {
+  ObjectSymbol *symbol = object_file_define(object, name);
+  object->bss_size = (object->bss_size + alignment - 1) & ~(alignment - 1);
+  symbol->section = OBJECT_SECTION_BSS;
+  symbol->offset = object->bss_size;
+  symbol->size = size;
+  object->bss_size += size;
+}
+
+/// Record a relocation at OFFSET in the code against symbol SYMBOL.
+static void object_file_add_relocation
+(ObjectFile *object,
+ uint64_t offset,
+ size_t symbol,
+ enum ObjectRelocationType type,
+ int64_t addend)
+{
+  if (object->relocation_count == object->relocation_capacity) {
+    object->relocation_capacity = object->relocation_capacity
+      ? object->relocation_capacity * 2
+      : OBJECT_FILE_INITIAL_SYMBOL_CAPACITY;
+    object->relocations = realloc(object->relocations,
+                                  object->relocation_capacity * sizeof(ObjectRelocation));
+    ASSERT(object->relocations, "Could not allocate memory for relocations.");
+  }
+  ObjectRelocation *relocation = object->relocations + object->relocation_count++;
+  relocation->offset = offset;
+  relocation->symbol = symbol;
+  relocation->type = type;
+  relocation->addend = addend;
+}
+
+void object_file_relocation
+(ObjectFile *object,
+ const char *name,
+ enum ObjectRelocationType type,
+ int64_t addend)
+{
+  object_file_add_relocation(object, object->code_size, object_file_symbol(object, name), type, addend);
+  object_file_integer(object, 0, 4);
+}
+
+void object_file_resolve(ObjectFile *object) {
+  size_t kept = 0;
+  for (size_t i = 0; i < object->relocation_count; ++i) {
+    ObjectRelocation *relocation = object->relocations + i;
+    ObjectSymbol *symbol = object->symbols + relocation->symbol;
+    if (symbol->section != OBJECT_SECTION_TEXT) {
+      object->relocations[kept++] = *relocation;
+      continue;
+    }
+    int64_t distance = (int64_t)symbol->offset + relocation->addend - (int64_t)relocation->offset;
+    ASSERT(distance >= INT32_MIN && distance <= INT32_MAX,
+           "Distance to \"%s\" does not fit in 32 bits.", symbol->name);
+    uint32_t field = (uint32_t)(int32_t)distance;
+    for (size_t byte = 0; byte < 4; ++byte) {
+      object->code[relocation->offset + byte] = (uint8_t)(field >> (8 * byte));
+    }
+  }
+  object->relocation_count = kept;
+}
+
+void object_file_append(ObjectFile *object, ObjectFile *other) {
+  ASSERT(!other->bss_size, "object_file_append(): Only code can be appended.");
+  uint64_t base = object->code_size;
+  if (other->code_size) {
+    object_file_reserve(object, other->code_size);
+    memcpy(object->code + base, other->code, other->code_size);
+    object->code_size += other->code_size;
+  }
+
+  // Going by index adds symbols in the order they were added to OTHER.
+  size_t *symbols = calloc(other->symbol_count ? other->symbol_count : 1, sizeof(size_t));
+  ASSERT(symbols, "Could not allocate memory for symbols.");
+  for (size_t i = 0; i < other->symbol_count; ++i) {
+    ObjectSymbol *symbol = other->symbols + i;
+    if (symbol->section != OBJECT_SECTION_TEXT) {
+      symbols[i] = object_file_symbol(object, symbol->name);
+      continue;
+    }
+    ObjectSymbol *copy = object_file_define(object, symbol->name);
+    copy->section = OBJECT_SECTION_TEXT;
+    copy->offset = base + symbol->offset;
+    copy->global = symbol->global;
+    symbols[i] = (size_t)(copy - object->symbols);
+  }
+  for (size_t i = 0; i < other->relocation_count; ++i) {
+    ObjectRelocation *relocation = other->relocations + i;
+    object_file_add_relocation(object, base + relocation->offset, symbols[relocation->symbol],
+                               relocation->type, relocation->addend);
+  }
+  free(symbols);
+}
@@ -0,0 +1,124 @@
+#ifndef OBJECT_FILE_H
+#define OBJECT_FILE_H
+
+#include <arena.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Where a symbol of an object file is defined.
+enum ObjectSection {
+  /// Defined by some other object or library, like external functions.
+  OBJECT_SECTION_UNDEFINED,
+  /// Machine code.
+  OBJECT_SECTION_TEXT,
+  /// Zero-initialized data that takes up no space in the file.
+  OBJECT_SECTION_BSS,
+};
+
+enum ObjectRelocationType {
+  /// The 32-bit distance from the end of the field to the symbol.
+  OBJECT_RELOCATION_PC32,
+  /// Like OBJECT_RELOCATION_PC32, but to a procedure linkage table
+  /// entry of the symbol if it ends up in a shared library.
+  OBJECT_RELOCATION_PLT32,
+};
+
+typedef struct ObjectSymbol {
+  const char *name;
+  enum ObjectSection section;
+  /// Offset into the section, if the symbol is defined.
+  uint64_t offset;
+  /// Size in bytes of the data at the symbol, or zero for labels.
+  uint64_t size;
+  /// If non-zero, other objects can refer to the symbol.
+  char global;
+} ObjectSymbol;
+
+/// A 32-bit field in the code that can only be filled in once it is
+/// known where SYMBOL is.
+typedef struct ObjectRelocation {
+  uint64_t offset;
+  /// Index into the symbols of the object file.
+  size_t symbol;
+  enum ObjectRelocationType type;
+  int64_t addend;
+} ObjectRelocation;
+
+/// Machine code and data in memory, along with the symbols that are
+/// needed to put them anywhere: enough to write a relocatable object
+/// file, or to load it straight into memory.
+typedef struct ObjectFile {
+  uint8_t *code;
+  size_t code_size;
+  size_t code_capacity;
+  uint64_t bss_size;
+
+  ObjectSymbol *symbols;
+  size_t symbol_count;
+  size_t symbol_capacity;
+  /// Open-addressed hash table of indices into `symbols`, plus one so
+  /// that zero is an empty slot. Its capacity is zero or a power of
+  /// two.
+  size_t *symbol_table;
+  size_t symbol_table_capacity;
+  /// Storage for the names of the symbols.
+  Arena names;
+
+  ObjectRelocation *relocations;
+  size_t relocation_count;
+  size_t relocation_capacity;
+} ObjectFile;
+
+ObjectFile *object_file_create();
+void object_file_free(ObjectFile *object);
+
+/// Make room for SIZE more bytes of code in OBJECT.
+void object_file_reserve(ObjectFile *object, size_t size);
+
+static inline void object_file_byte(ObjectFile *object, uint8_t byte) {
+  if (object->code_size == object->code_capacity) {
+    object_file_reserve(object, 1);
+  }
+  object->code[object->code_size++] = byte;
+}
+
+/// Append the SIZE lowest bytes of VALUE to the code, little-endian.
+void object_file_integer(ObjectFile *object, uint64_t value, size_t size);
+
+/// Get the index of the symbol called NAME, which is added as an
+/// undefined symbol if there is none yet.
+size_t object_file_symbol(ObjectFile *object, const char *name);
+
+/// Define the symbol NAME at the end of the code.
+void object_file_label(ObjectFile *object, const char *name, char global);
+
+/// Define the symbol NAME as SIZE zeroed bytes of data, aligned to
+/// ALIGNMENT, which is a power of two.
+void object_file_allocate(ObjectFile *object, const char *name, uint64_t size, uint64_t alignment);
+
+/// Append a 32-bit field for the distance to the symbol NAME to the
+/// code, and remember to fill it in later.
+void object_file_relocation
+(ObjectFile *object,
+ const char *name,
+ enum ObjectRelocationType type,
+ int64_t addend);
+
+/** Fill in every relocation of OBJECT against a symbol in the code.
+ *
+ * The distance between two places in the code does not depend on
+ * where it ends up, so only relocations against data and undefined
+ * symbols are left for the linker or loader.
+ */
+void object_file_resolve(ObjectFile *object);
+
+/** Append the code of OTHER to OBJECT, along with the labels it
+ * defines and its relocations.
+ *
+ * Symbols end up in OBJECT in the same order as if the code of OTHER
+ * had been emitted into it right away. OTHER must not have data, nor
+ * be resolved yet.
+ */
+void object_file_append(ObjectFile *object, ObjectFile *other);
+
+#endif /* OBJECT_FILE_H */
@@ -0,0 +1,2751 @@
+#include <codegen/optimization.h>
+
+#include <codegen.h>
+#include <codegen/intermediate_representation.h>
+#include <error.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <worker_pool.h>
+
+static void *opt_allocate(size_t count, size_t size) {
+  void *memory = calloc(count ? count : 1, size);
+  ASSERT(memory, "Could not allocate memory for optimization.");
+  return memory;
+}
+
+/// The instructions of a function by index, and what a pass replaced
+/// each of them with.
+typedef struct Numbering {
+  IRInstruction **instructions;
+  IRInstruction **replacement;
+  size_t count;
+} Numbering;
+
+/// Number every instruction of FUNCTION in layout order, branches
+/// included.
+static void opt_number(Numbering *numbering, IRFunction *function) {
+  size_t count = 0;
+  for (IRBlock *block = function->first; block; block = block->next) {
+    ASSERT(block->branch, "Every block must end with a branch before optimization.");
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      instruction->index = count++;
+    }
+    block->branch->index = count++;
+  }
+
+  numbering->count = count;
+  numbering->instructions = opt_allocate(count, sizeof(IRInstruction *));
+  numbering->replacement = opt_allocate(count, sizeof(IRInstruction *));
+  for (IRBlock *block = function->first; block; block = block->next) {
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      numbering->instructions[instruction->index] = instruction;
+    }
+    numbering->instructions[block->branch->index] = block->branch;
+  }
+}
+
+static void opt_numbering_free(Numbering *numbering) {
+  free(numbering->instructions);
+  free(numbering->replacement);
+  *numbering = (Numbering){0};
+}
+
+/// Return non-zero iff INSTRUCTION was there when NUMBERING was made.
+/// Instructions created since, and locals of enclosing functions that
+/// nested ones refer to, were not.
+static char opt_numbered(Numbering *numbering, IRInstruction *instruction) {
+  return instruction->index < numbering->count
+    && numbering->instructions[instruction->index] == instruction;
+}
+
+/// Make OPERAND refer to whatever its value was replaced with.
+static void opt_resolve_operand(IRInstruction **operand, void *data) {
+  Numbering *numbering = data;
+  IRInstruction *value = *operand;
+  while (opt_numbered(numbering, value) && numbering->replacement[value->index]) {
+    value = numbering->replacement[value->index];
+  }
+  *operand = value;
+}
+
+/// Resolve every operand in FUNCTION, as well as its return value.
+static void opt_resolve_function(Numbering *numbering, IRFunction *function) {
+  for (IRBlock *block = function->first; block; block = block->next) {
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      ir_for_each_operand(instruction, opt_resolve_operand, numbering);
+    }
+    ir_for_each_operand(block->branch, opt_resolve_operand, numbering);
+  }
+  if (function->return_value) {
+    opt_resolve_operand(&function->return_value, numbering);
+  }
+}
+
+typedef struct FoldState {
+  IRFunction *function;
+  Numbering numbering;
+  /// Instructions that lost a use, and so may be dead now.
+  IRInstruction **candidates;
+  size_t candidate_count;
+  size_t candidate_capacity;
+  /// Number of uses of each instruction, by index.
+  size_t *uses;
+} FoldState;
+
+static void opt_candidate(FoldState *state, IRInstruction *instruction) {
+  if (state->candidate_count == state->candidate_capacity) {
+    state->candidate_capacity = state->candidate_capacity ? state->candidate_capacity * 2 : 32;
+    state->candidates = realloc(state->candidates, state->candidate_capacity * sizeof(IRInstruction *));
+    ASSERT(state->candidates, "Could not grow dead instruction candidates.");
+  }
+  state->candidates[state->candidate_count++] = instruction;
+}
+
+static void opt_drop_operand(IRInstruction **operand, void *data) {
+  opt_candidate(data, *operand);
+}
+
+/// Make every use of INSTRUCTION use VALUE instead.
+static void opt_replace(FoldState *state, IRInstruction *instruction, IRInstruction *value) {
+  state->numbering.replacement[instruction->index] = value;
+  opt_candidate(state, instruction);
+}
+
+/// Turn INSTRUCTION into an immediate, in place.
+static void opt_fold_to_immediate(FoldState *state, IRInstruction *instruction, int64_t value) {
+  ir_for_each_operand(instruction, opt_drop_operand, state);
+  instruction->type = IR_IMMEDIATE;
+  instruction->value.immediate = value;
+}
+
+static char opt_is_immediate(IRInstruction *instruction, int64_t value) {
+  return instruction->type == IR_IMMEDIATE && instruction->value.immediate == value;
+}
+
+/// Return N if VALUE is 2^N for some N > 0, and zero otherwise.
+static int64_t opt_shift_amount(int64_t value) {
+  if (value < 2 || (value & (value - 1))) { return 0; }
+  int64_t amount = 0;
+  while (value >>= 1) { amount++; }
+  return amount;
+}
+
+/// Compute LHS <TYPE> RHS the way the generated code would. Return
+/// zero if that would trap.
+static char opt_evaluate(int type, int64_t lhs, int64_t rhs, int64_t *result) {
+  switch (type) {
+  // Wrap around on overflow, like the hardware does.
+  case IR_ADD: *result = (int64_t)((uint64_t)lhs + (uint64_t)rhs); return 1;
+  case IR_SUBTRACT: *result = (int64_t)((uint64_t)lhs - (uint64_t)rhs); return 1;
+  case IR_MULTIPLY: *result = (int64_t)((uint64_t)lhs * (uint64_t)rhs); return 1;
+  case IR_DIVIDE:
+  case IR_MODULO:
+    if (rhs == 0 || (lhs == INT64_MIN && rhs == -1)) { return 0; }
+    *result = type == IR_DIVIDE ? lhs / rhs : lhs % rhs;
+    return 1;
+  // Only the low six bits of a shift count are used.
+  case IR_SHIFT_LEFT: *result = (int64_t)((uint64_t)lhs << (rhs & 63)); return 1;
+  case IR_SHIFT_RIGHT_ARITHMETIC: *result = lhs >> (rhs & 63); return 1;
+  default: UNREACHABLE();
+  }
+  return 0;
+}
+
+static char opt_compare(enum ComparisonType type, int64_t lhs, int64_t rhs) {
+  switch (type) {
+  case COMPARE_EQ: return lhs == rhs;
+  case COMPARE_NE: return lhs != rhs;
+  case COMPARE_LT: return lhs < rhs;
+  case COMPARE_LE: return lhs <= rhs;
+  case COMPARE_GT: return lhs > rhs;
+  case COMPARE_GE: return lhs >= rhs;
+  default: PANIC("Invalid comparison type %d", type);
+  }
+  return 0;
+}
+
+static char opt_fold_arithmetic(FoldState *state, IRBlock *block, IRInstruction *instruction) {
+  IRInstruction *lhs = instruction->value.pair.car;
+  IRInstruction *rhs = instruction->value.pair.cdr;
+
+  if (lhs->type == IR_IMMEDIATE && rhs->type == IR_IMMEDIATE) {
+    int64_t result;
+    if (!opt_evaluate(instruction->type, lhs->value.immediate, rhs->value.immediate, &result)) {
+      return 0;
+    }
+    opt_fold_to_immediate(state, instruction, result);
+    return 1;
+  }
+
+  switch (instruction->type) {
+  case IR_ADD:
+    if (opt_is_immediate(rhs, 0)) { opt_replace(state, instruction, lhs); return 1; }
+    if (opt_is_immediate(lhs, 0)) { opt_replace(state, instruction, rhs); return 1; }
+    break;
+  case IR_SUBTRACT:
+    if (opt_is_immediate(rhs, 0)) { opt_replace(state, instruction, lhs); return 1; }
+    if (lhs == rhs) { opt_fold_to_immediate(state, instruction, 0); return 1; }
+    break;
+  case IR_MULTIPLY: {
+    if (opt_is_immediate(rhs, 0)) { opt_replace(state, instruction, rhs); return 1; }
+    if (opt_is_immediate(lhs, 0)) { opt_replace(state, instruction, lhs); return 1; }
+    if (opt_is_immediate(rhs, 1)) { opt_replace(state, instruction, lhs); return 1; }
+    if (opt_is_immediate(lhs, 1)) { opt_replace(state, instruction, rhs); return 1; }
+
+    IRInstruction *factor = rhs->type == IR_IMMEDIATE ? rhs : lhs->type == IR_IMMEDIATE ? lhs : NULL;
+    int64_t amount = factor ? opt_shift_amount(factor->value.immediate) : 0;
+    if (!amount) { break; }
+    IRInstruction *shift = ir_instruction_create(state->function, IR_IMMEDIATE);
+    shift->value.immediate = amount;
+    ir_insert_before(state->function, block, instruction, shift);
+    opt_candidate(state, factor);
+    instruction->type = IR_SHIFT_LEFT;
+    instruction->value.pair.car = factor == rhs ? lhs : rhs;
+    instruction->value.pair.cdr = shift;
+    return 1;
+  }
+  case IR_DIVIDE:
+    if (opt_is_immediate(rhs, 1)) { opt_replace(state, instruction, lhs); return 1; }
+    break;
+  case IR_MODULO:
+    if (opt_is_immediate(rhs, 1) || opt_is_immediate(rhs, -1)) {
+      opt_fold_to_immediate(state, instruction, 0);
+      return 1;
+    }
+    break;
+  case IR_SHIFT_LEFT:
+  case IR_SHIFT_RIGHT_ARITHMETIC:
+    if (rhs->type == IR_IMMEDIATE && (rhs->value.immediate & 63) == 0) {
+      opt_replace(state, instruction, lhs);
+      return 1;
+    }
+    if (opt_is_immediate(lhs, 0)) { opt_replace(state, instruction, lhs); return 1; }
+    break;
+  default:
+    UNREACHABLE();
+  }
+  return 0;
+}
+
+static char opt_fold_comparison(FoldState *state, IRInstruction *instruction) {
+  enum ComparisonType type = instruction->value.comparison.type;
+  IRInstruction *lhs = instruction->value.comparison.pair.car;
+  IRInstruction *rhs = instruction->value.comparison.pair.cdr;
+  if (lhs->type == IR_IMMEDIATE && rhs->type == IR_IMMEDIATE) {
+    opt_fold_to_immediate(state, instruction,
+                          opt_compare(type, lhs->value.immediate, rhs->value.immediate));
+    return 1;
+  }
+  if (lhs == rhs) {
+    opt_fold_to_immediate(state, instruction, opt_compare(type, 0, 0));
+    return 1;
+  }
+  return 0;
+}
+
+/// A phi that only ever merges one value, or immediates that are all
+/// equal, is that value. Arguments that are the phi itself come from
+/// a loop that does not change it, so they do not count.
+static char opt_fold_phi(FoldState *state, IRInstruction *phi) {
+  IRInstruction *value = NULL;
+  char same_value = 1;
+  char same_immediate = 1;
+  for (IRPhiArgument *argument = phi->value.phi_argument; argument; argument = argument->next) {
+    if (argument->value == phi) { continue; }
+    if (!value) {
+      value = argument->value;
+      same_immediate = value->type == IR_IMMEDIATE;
+      continue;
+    }
+    if (argument->value != value) { same_value = 0; }
+    if (argument->value->type != IR_IMMEDIATE
+        || (value->type == IR_IMMEDIATE
+            && argument->value->value.immediate != value->value.immediate)) {
+      same_immediate = 0;
+    }
+  }
+  if (!value) { return 0; }
+  if (same_value) {
+    opt_replace(state, phi, value);
+    return 1;
+  }
+  if (same_immediate) {
+    opt_fold_to_immediate(state, phi, value->value.immediate);
+    return 1;
+  }
+  return 0;
+}
+
+/// Try to simplify INSTRUCTION of BLOCK. Return non-zero iff anything
+/// changed.
+static char opt_fold_instruction(FoldState *state, IRBlock *block, IRInstruction *instruction) {
+  switch (instruction->type) {
+  case IR_ADD:
+  case IR_SUBTRACT:
+  case IR_MULTIPLY:
+  case IR_DIVIDE:
+  case IR_MODULO:
+  case IR_SHIFT_LEFT:
+  case IR_SHIFT_RIGHT_ARITHMETIC:
+    return opt_fold_arithmetic(state, block, instruction);
+  case IR_COMPARISON:
+    return opt_fold_comparison(state, instruction);
+  case IR_PHI:
+    return opt_fold_phi(state, instruction);
+  default:
+    return 0;
+  }
+}
+
+/// Return non-zero iff INSTRUCTION may be deleted once its value is
+/// no longer used.
+static char opt_removable(IRInstruction *instruction) {
+  switch (instruction->type) {
+  case IR_IMMEDIATE:
+  case IR_PHI:
+  case IR_ADD:
+  case IR_SUBTRACT:
+  case IR_MULTIPLY:
+  case IR_SHIFT_LEFT:
+  case IR_SHIFT_RIGHT_ARITHMETIC:
+  case IR_COMPARISON:
+  case IR_LOAD:
+  case IR_LOCAL_LOAD:
+  case IR_LOCAL_ADDRESS:
+  case IR_GLOBAL_LOAD:
+  case IR_GLOBAL_ADDRESS:
+    return 1;
+  // Division traps on a zero divisor, and on overflow.
+  case IR_DIVIDE:
+  case IR_MODULO: {
+    IRInstruction *divisor = instruction->value.pair.cdr;
+    return divisor->type == IR_IMMEDIATE
+      && divisor->value.immediate != 0
+      && divisor->value.immediate != -1;
+  }
+  default:
+    return 0;
+  }
+}
+
+static void opt_count_use(IRInstruction **operand, void *data) {
+  FoldState *state = data;
+  if (!opt_numbered(&state->numbering, *operand)) { return; }
+  state->uses[(*operand)->index]++;
+}
+
+static void opt_release_operand(IRInstruction **operand, void *data) {
+  FoldState *state = data;
+  if (!opt_numbered(&state->numbering, *operand)) { return; }
+  if (--state->uses[(*operand)->index] == 0) {
+    opt_candidate(state, *operand);
+  }
+}
+
+size_t opt_fold_constants(IRFunction *function) {
+  FoldState state = {0};
+  state.function = function;
+  opt_number(&state.numbering, function);
+
+  // Phis may refer to values that are only simplified later on, so
+  // go again until nothing changes.
+  char changed = 1;
+  while (changed) {
+    changed = 0;
+    for (IRBlock *block = function->first; block; block = block->next) {
+      for (uint32_t i = 0; i < block->instruction_count; ++i) {
+        IRInstruction *instruction = block->instructions[i];
+        if (opt_numbered(&state.numbering, instruction)
+            && state.numbering.replacement[instruction->index]) {
+          continue;
+        }
+        ir_for_each_operand(instruction, opt_resolve_operand, &state.numbering);
+        changed |= opt_fold_instruction(&state, block, instruction);
+        // Folding may have inserted instructions in front of this one.
+        if (block->instructions[i] != instruction) { i = ir_position(block, instruction); }
+      }
+      ir_for_each_operand(block->branch, opt_resolve_operand, &state.numbering);
+    }
+    if (function->return_value) {
+      opt_resolve_operand(&function->return_value, &state.numbering);
+    }
+  }
+  opt_numbering_free(&state.numbering);
+
+  // Delete whatever lost its last use, along with the operands that
+  // only it was using.
+  opt_number(&state.numbering, function);
+  size_t count = state.numbering.count;
+  char *removed = opt_allocate(count, sizeof(char));
+  state.uses = opt_allocate(count, sizeof(size_t));
+  for (IRBlock *block = function->first; block; block = block->next) {
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      ir_for_each_operand(block->instructions[i], opt_count_use, &state);
+    }
+    ir_for_each_operand(block->branch, opt_count_use, &state);
+  }
+  if (function->return_value) {
+    opt_count_use(&function->return_value, &state);
+  }
+
+  size_t removed_count = 0;
+  while (state.candidate_count) {
+    IRInstruction *instruction = state.candidates[--state.candidate_count];
+    size_t index = instruction->index;
+    if (!opt_numbered(&state.numbering, instruction)
+        || removed[index] || state.uses[index] || !opt_removable(instruction)) {
+      continue;
+    }
+    ir_for_each_operand(instruction, opt_release_operand, &state);
+    removed[index] = 1;
+    removed_count++;
+  }
+  for (IRBlock *block = function->first; block; block = block->next) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      if (!removed[instruction->index]) { block->instructions[kept++] = instruction; }
+    }
+    block->instruction_count = kept;
+  }
+  for (size_t index = 0; index < count; ++index) {
+    if (removed[index]) { ir_free_instruction(function, state.numbering.instructions[index]); }
+  }
+
+  free(state.candidates);
+  free(state.uses);
+  free(removed);
+  opt_numbering_free(&state.numbering);
+  return removed_count;
+}
+
+#define NO_INDEX SIZE_MAX
+
+#define BIT_SET(set, bit)  ((set)[(bit) / 64] |= (uint64_t)1 << ((bit) % 64))
+#define BIT_TEST(set, bit) (((set)[(bit) / 64] >> ((bit) % 64)) & 1)
+
+typedef struct Dominators {
+  /// Blocks reachable from the entry, in reverse postorder. The
+  /// `index` of each of them is its position in here; that of
+  /// unreachable blocks is NO_INDEX.
+  IRBlock **blocks;
+  size_t count;
+  /// Immediate dominator of each block. The entry is its own.
+  size_t *idom;
+  /// Children of each block in the dominator tree, as linked lists.
+  size_t *first_child;
+  size_t *next_sibling;
+  /// Dominance frontier of each block, as a bit set of `words` words.
+  uint64_t *frontier;
+  size_t words;
+} Dominators;
+
+/// Walk up the dominator tree from A and B to their closest common
+/// dominator. Reverse postorder puts dominators first.
+static size_t opt_common_dominator(Dominators *dominators, size_t a, size_t b) {
+  while (a != b) {
+    while (a > b) { a = dominators->idom[a]; }
+    while (b > a) { b = dominators->idom[b]; }
+  }
+  return a;
+}
+
+/** Compute the dominator tree and dominance frontiers of FUNCTION.
+ *
+ * This is the iterative algorithm of Cooper, Harvey and Kennedy, from
+ * "A Simple, Fast Dominance Algorithm". Predecessors of every block
+ * must be up to date.
+ */
+static void opt_dominators(Dominators *dominators, IRFunction *function) {
+  size_t block_count = 0;
+  for (IRBlock *block = function->first; block; block = block->next) {
+    block->index = NO_INDEX;
+    block_count++;
+  }
+
+  // Depth-first search for a postorder, without recursing.
+  IRBlock **postorder = opt_allocate(block_count, sizeof(IRBlock *));
+  IRBlock **stack = opt_allocate(block_count, sizeof(IRBlock *));
+  size_t *next_successor = opt_allocate(block_count, sizeof(size_t));
+  size_t count = 0;
+  size_t depth = 0;
+  // Mark blocks as seen by giving them any index but NO_INDEX.
+  function->first->index = 0;
+  stack[depth++] = function->first;
+  while (depth) {
+    IRBlock *block = stack[depth - 1];
+    IRBlock *successors[2];
+    size_t successor_count = ir_successors(block, successors);
+    if (next_successor[depth - 1] < successor_count) {
+      IRBlock *successor = successors[next_successor[depth - 1]++];
+      if (successor->index == NO_INDEX) {
+        successor->index = 0;
+        next_successor[depth] = 0;
+        stack[depth++] = successor;
+      }
+      continue;
+    }
+    postorder[count++] = block;
+    depth--;
+  }
+  free(next_successor);
+  free(stack);
+
+  dominators->count = count;
+  dominators->blocks = opt_allocate(count, sizeof(IRBlock *));
+  for (size_t i = 0; i < count; ++i) {
+    IRBlock *block = postorder[count - 1 - i];
+    block->index = i;
+    dominators->blocks[i] = block;
+  }
+  free(postorder);
+
+  size_t *idom = opt_allocate(count, sizeof(size_t));
+  dominators->idom = idom;
+  for (size_t i = 1; i < count; ++i) { idom[i] = NO_INDEX; }
+  char changed = 1;
+  while (changed) {
+    changed = 0;
+    for (size_t i = 1; i < count; ++i) {
+      size_t new_idom = NO_INDEX;
+      IRBlock *block = dominators->blocks[i];
+      for (uint32_t j = 0; j < block->predecessor_count; ++j) {
+        size_t p = block->predecessors[j]->index;
+        if (p == NO_INDEX || idom[p] == NO_INDEX) { continue; }
+        new_idom = new_idom == NO_INDEX ? p : opt_common_dominator(dominators, new_idom, p);
+      }
+      if (idom[i] != new_idom) {
+        idom[i] = new_idom;
+        changed = 1;
+      }
+    }
+  }
+
+  dominators->first_child = opt_allocate(count, sizeof(size_t));
+  dominators->next_sibling = opt_allocate(count, sizeof(size_t));
+  for (size_t i = 0; i < count; ++i) {
+    dominators->first_child[i] = NO_INDEX;
+    dominators->next_sibling[i] = NO_INDEX;
+  }
+  // Add children back to front, so that they end up in reverse postorder.
+  for (size_t i = count - 1; i > 0; --i) {
+    dominators->next_sibling[i] = dominators->first_child[idom[i]];
+    dominators->first_child[idom[i]] = i;
+  }
+
+  // A block is in the frontier of every block that dominates one of
+  // its predecessors, but not itself.
+  dominators->words = (count + 63) / 64;
+  dominators->frontier = opt_allocate(count * dominators->words, sizeof(uint64_t));
+  for (size_t i = 0; i < count; ++i) {
+    IRBlock *block = dominators->blocks[i];
+    if (block->predecessor_count < 2) { continue; }
+    for (uint32_t j = 0; j < block->predecessor_count; ++j) {
+      size_t runner = block->predecessors[j]->index;
+      if (runner == NO_INDEX) { continue; }
+      while (runner != idom[i]) {
+        BIT_SET(dominators->frontier + runner * dominators->words, i);
+        runner = idom[runner];
+      }
+    }
+  }
+}
+
+static void opt_dominators_free(Dominators *dominators) {
+  free(dominators->blocks);
+  free(dominators->idom);
+  free(dominators->first_child);
+  free(dominators->next_sibling);
+  free(dominators->frontier);
+  *dominators = (Dominators){0};
+}
+
+/// A phi that mem2reg inserted for a local.
+typedef struct InsertedPhi {
+  IRInstruction *phi;
+  IRBlock *block;
+  size_t local;
+  struct InsertedPhi *next;
+} InsertedPhi;
+
+typedef struct Promotion {
+  IRFunction *function;
+  Numbering numbering;
+  Dominators dominators;
+
+  /// Stack allocations and parameters that may be promoted.
+  IRInstruction **locals;
+  size_t local_count;
+  /// The local of each instruction index, or NO_INDEX.
+  size_t *local_of;
+  /// Whether each local has to stay in memory, because it is used for
+  /// anything but loads and stores, or is not worth promoting.
+  char *escapes;
+  /// Whether each local is ever stored to.
+  char *stored;
+
+  /// Phis inserted into each block, by block index.
+  InsertedPhi **phis;
+  /// Loads and stores that were removed, to be freed.
+  IRInstruction **removed;
+  size_t removed_count;
+  size_t removed_capacity;
+
+  /// The instruction being looked at by opt_note_local_use().
+  IRInstruction *user;
+} Promotion;
+
+/// The promotable local that INSTRUCTION names, or NO_INDEX.
+static size_t opt_local(Promotion *promotion, IRInstruction *instruction) {
+  if (!opt_numbered(&promotion->numbering, instruction)) { return NO_INDEX; }
+  return promotion->local_of[instruction->index];
+}
+
+/// Only loading from a local and storing to it can be done without
+/// memory. Anything else, like taking its address, needs it to stay.
+static void opt_note_local_use(IRInstruction **operand, void *data) {
+  Promotion *promotion = data;
+  size_t local = opt_local(promotion, *operand);
+  if (local == NO_INDEX) { return; }
+  IRInstruction *user = promotion->user;
+  if (user->type == IR_LOCAL_LOAD) { return; }
+  if (user->type == IR_LOCAL_STORE && operand == &user->value.pair.car) {
+    promotion->stored[local] = 1;
+    return;
+  }
+  promotion->escapes[local] = 1;
+}
+
+/// Note that INSTRUCTION was taken out of its block, to be freed once
+/// nothing refers to it any more.
+static void opt_promotion_remove(Promotion *promotion, IRInstruction *instruction) {
+  if (promotion->removed_count == promotion->removed_capacity) {
+    promotion->removed_capacity = promotion->removed_capacity ? promotion->removed_capacity * 2 : 32;
+    promotion->removed = realloc(promotion->removed, promotion->removed_capacity * sizeof(IRInstruction *));
+    ASSERT(promotion->removed, "Could not grow removed instructions.");
+  }
+  promotion->removed[promotion->removed_count++] = instruction;
+}
+
+/// A value for a local that has not been assigned yet, at the end of
+/// BLOCK. Whatever was in memory would have been just as good, so zero
+/// will do.
+static IRInstruction *opt_undefined(IRFunction *function, IRBlock *block) {
+  IRInstruction *undefined = ir_instruction_create(function, IR_IMMEDIATE);
+  undefined->value.immediate = 0;
+  ir_insert_at(function, block, block->instruction_count, undefined);
+  return undefined;
+}
+
+/// Replace loads and stores of promoted locals in the block with index
+/// INDEX and, recursively, in the blocks it dominates. CURRENT holds
+/// the value of each local on entry, and is clobbered.
+static void opt_rename(Promotion *promotion, size_t index, IRInstruction **current) {
+  IRBlock *block = promotion->dominators.blocks[index];
+  for (InsertedPhi *inserted = promotion->phis[index]; inserted; inserted = inserted->next) {
+    current[inserted->local] = inserted->phi;
+  }
+
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < block->instruction_count; ++i) {
+    IRInstruction *instruction = block->instructions[i];
+    // Skip the phis and initial parameter loads that were just added.
+    if (!opt_numbered(&promotion->numbering, instruction)) {
+      block->instructions[kept++] = instruction;
+      continue;
+    }
+    ir_for_each_operand(instruction, opt_resolve_operand, &promotion->numbering);
+    if (instruction->type == IR_LOCAL_LOAD) {
+      size_t local = opt_local(promotion, instruction->value.reference);
+      if (local != NO_INDEX && !promotion->escapes[local]) {
+        if (!current[local]) {
+          // Reuse the load itself as the undefined value.
+          instruction->type = IR_IMMEDIATE;
+          instruction->value.immediate = 0;
+          current[local] = instruction;
+        } else {
+          promotion->numbering.replacement[instruction->index] = current[local];
+          opt_promotion_remove(promotion, instruction);
+          continue;
+        }
+      }
+    } else if (instruction->type == IR_LOCAL_STORE) {
+      size_t local = opt_local(promotion, instruction->value.pair.car);
+      if (local != NO_INDEX && !promotion->escapes[local]) {
+        current[local] = instruction->value.pair.cdr;
+        opt_promotion_remove(promotion, instruction);
+        continue;
+      }
+    }
+    block->instructions[kept++] = instruction;
+  }
+  block->instruction_count = kept;
+  ir_for_each_operand(block->branch, opt_resolve_operand, &promotion->numbering);
+
+  IRBlock *successors[2];
+  size_t successor_count = ir_successors(block, successors);
+  for (size_t i = 0; i < successor_count; ++i) {
+    for (InsertedPhi *inserted = promotion->phis[successors[i]->index];
+         inserted;
+         inserted = inserted->next
+         ) {
+      if (!current[inserted->local]) {
+        current[inserted->local] = opt_undefined(promotion->function, block);
+      }
+      ir_phi_argument(promotion->function, inserted->phi, block, current[inserted->local]);
+    }
+  }
+
+  size_t child = promotion->dominators.first_child[index];
+  if (child == NO_INDEX) { return; }
+  IRInstruction **saved = opt_allocate(promotion->local_count, sizeof(IRInstruction *));
+  for (; child != NO_INDEX; child = promotion->dominators.next_sibling[child]) {
+    memcpy(saved, current, promotion->local_count * sizeof(IRInstruction *));
+    opt_rename(promotion, child, saved);
+  }
+  free(saved);
+}
+
+static void opt_count_phi_use(IRInstruction **operand, void *data) {
+  size_t *uses = data;
+  if ((*operand)->type == IR_PHI && (*operand)->index != NO_INDEX) {
+    uses[(*operand)->index]++;
+  }
+}
+
+/// Remove phis that mem2reg inserted, but that nothing ended up using.
+static void opt_remove_dead_phis(IRFunction *function, InsertedPhi **inserted_phis, size_t phi_count) {
+  size_t *uses = opt_allocate(phi_count, sizeof(size_t));
+  // Only the inserted phis are counted; they are numbered by their
+  // position in INSERTED_PHIS, and everything else has NO_INDEX.
+  for (IRBlock *block = function->first; block; block = block->next) {
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      if (instruction->type == IR_PHI) { instruction->index = NO_INDEX; }
+    }
+  }
+  for (size_t i = 0; i < phi_count; ++i) { inserted_phis[i]->phi->index = i; }
+  for (IRBlock *block = function->first; block; block = block->next) {
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      // A phi that only feeds itself is still dead.
+      if (instruction->type == IR_PHI) {
+        for (IRPhiArgument *argument = instruction->value.phi_argument; argument; argument = argument->next) {
+          if (argument->value != instruction) { opt_count_phi_use(&argument->value, uses); }
+        }
+      } else {
+        ir_for_each_operand(instruction, opt_count_phi_use, uses);
+      }
+    }
+    ir_for_each_operand(block->branch, opt_count_phi_use, uses);
+  }
+  if (function->return_value) {
+    opt_count_phi_use(&function->return_value, uses);
+  }
+
+  char *dead = opt_allocate(phi_count, sizeof(char));
+  size_t *worklist = opt_allocate(phi_count, sizeof(size_t));
+  size_t worklist_count = 0;
+  for (size_t i = 0; i < phi_count; ++i) {
+    if (!uses[i]) {
+      dead[i] = 1;
+      worklist[worklist_count++] = i;
+    }
+  }
+  while (worklist_count) {
+    IRInstruction *phi = inserted_phis[worklist[--worklist_count]]->phi;
+    for (IRPhiArgument *argument = phi->value.phi_argument; argument; argument = argument->next) {
+      IRInstruction *value = argument->value;
+      if (value == phi || value->type != IR_PHI || value->index == NO_INDEX) { continue; }
+      if (--uses[value->index] == 0 && !dead[value->index]) {
+        dead[value->index] = 1;
+        worklist[worklist_count++] = value->index;
+      }
+    }
+  }
+  for (IRBlock *block = function->first; block; block = block->next) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      if (instruction->type == IR_PHI && instruction->index != NO_INDEX && dead[instruction->index]) {
+        continue;
+      }
+      block->instructions[kept++] = instruction;
+    }
+    block->instruction_count = kept;
+  }
+  for (size_t i = 0; i < phi_count; ++i) {
+    if (!dead[i]) { continue; }
+    ir_free_instruction(function, inserted_phis[i]->phi);
+    inserted_phis[i]->phi = NULL;
+  }
+  free(worklist);
+  free(dead);
+  free(uses);
+}
+
+static void opt_append(IRFunction *function, IRBlock *block, IRInstruction *instruction) {
+  ir_insert_at(function, block, block->instruction_count, instruction);
+}
+
+static void opt_prepend(IRFunction *function, IRBlock *block, IRInstruction *instruction) {
+  ir_insert_at(function, block, 0, instruction);
+}
+
+size_t opt_mem2reg(IRFunction *function) {
+  // A phi in the entry block would have nowhere to get its value from
+  // when the function is called.
+  ir_set_predecessors(function);
+  if (function->first->predecessor_count) { return 0; }
+
+  Promotion promotion = {0};
+  promotion.function = function;
+  Numbering *numbering = &promotion.numbering;
+  Dominators *dominators = &promotion.dominators;
+  opt_dominators(dominators, function);
+  opt_number(numbering, function);
+
+  promotion.locals = opt_allocate(numbering->count, sizeof(IRInstruction *));
+  promotion.local_of = opt_allocate(numbering->count, sizeof(size_t));
+  IRBlock **local_block = opt_allocate(numbering->count, sizeof(IRBlock *));
+  for (IRBlock *block = function->first; block; block = block->next) {
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      promotion.local_of[instruction->index] = NO_INDEX;
+      if ((instruction->type == IR_STACK_ALLOCATE && instruction->value.immediate <= 8)
+          || instruction->type == IR_PARAMETER_REFERENCE) {
+        promotion.local_of[instruction->index] = promotion.local_count;
+        local_block[promotion.local_count] = block;
+        promotion.locals[promotion.local_count++] = instruction;
+      }
+    }
+    promotion.local_of[block->branch->index] = NO_INDEX;
+  }
+
+  promotion.escapes = opt_allocate(promotion.local_count, sizeof(char));
+  promotion.stored = opt_allocate(promotion.local_count, sizeof(char));
+  for (IRBlock *block = function->first; block; block = block->next) {
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      promotion.user = instruction;
+      ir_for_each_operand(instruction, opt_note_local_use, &promotion);
+      // Unreachable blocks are not renamed, so they must not lose
+      // the locals they refer to.
+      if (block->index == NO_INDEX && instruction->type == IR_LOCAL_LOAD) {
+        size_t local = opt_local(&promotion, instruction->value.reference);
+        if (local != NO_INDEX) { promotion.escapes[local] = 1; }
+      } else if (block->index == NO_INDEX && instruction->type == IR_LOCAL_STORE) {
+        size_t local = opt_local(&promotion, instruction->value.pair.car);
+        if (local != NO_INDEX) { promotion.escapes[local] = 1; }
+      }
+    }
+  }
+
+  // Parameters already have a home on the stack. Unless they are
+  // assigned to, loading them where they are used is just as good.
+  size_t promoted = 0;
+  for (size_t local = 0; local < promotion.local_count; ++local) {
+    if (promotion.locals[local]->type == IR_PARAMETER_REFERENCE && !promotion.stored[local]) {
+      promotion.escapes[local] = 1;
+    }
+    if (!promotion.escapes[local]) { promoted++; }
+  }
+
+  if (promoted) {
+    // Collect the blocks that store to each local, bucketed by local.
+    size_t *definition_start = opt_allocate(promotion.local_count + 1, sizeof(size_t));
+    for (size_t i = 0; i < dominators->count; ++i) {
+      for (uint32_t j = 0; j < dominators->blocks[i]->instruction_count; ++j) {
+        IRInstruction *instruction = dominators->blocks[i]->instructions[j];
+        if (instruction->type != IR_LOCAL_STORE) { continue; }
+        size_t local = opt_local(&promotion, instruction->value.pair.car);
+        if (local != NO_INDEX && !promotion.escapes[local]) { definition_start[local + 1]++; }
+      }
+    }
+    for (size_t local = 0; local < promotion.local_count; ++local) {
+      definition_start[local + 1] += definition_start[local];
+    }
+    size_t *definitions = opt_allocate(definition_start[promotion.local_count], sizeof(size_t));
+    size_t *definition_count = opt_allocate(promotion.local_count, sizeof(size_t));
+    for (size_t i = 0; i < dominators->count; ++i) {
+      for (uint32_t j = 0; j < dominators->blocks[i]->instruction_count; ++j) {
+        IRInstruction *instruction = dominators->blocks[i]->instructions[j];
+        if (instruction->type != IR_LOCAL_STORE) { continue; }
+        size_t local = opt_local(&promotion, instruction->value.pair.car);
+        if (local != NO_INDEX && !promotion.escapes[local]) {
+          definitions[definition_start[local] + definition_count[local]++] = i;
+        }
+      }
+    }
+
+    // Insert phis at the iterated dominance frontier of the stores.
+    // Blocks are marked with the local they were last handled for,
+    // plus one, so the marks need no clearing between locals.
+    promotion.phis = opt_allocate(dominators->count, sizeof(InsertedPhi *));
+    size_t *has_phi = opt_allocate(dominators->count, sizeof(size_t));
+    size_t *queued = opt_allocate(dominators->count, sizeof(size_t));
+    size_t *worklist = opt_allocate(dominators->count, sizeof(size_t));
+    size_t phi_count = 0;
+    for (size_t local = 0; local < promotion.local_count; ++local) {
+      if (promotion.escapes[local]) { continue; }
+      size_t worklist_count = 0;
+      for (size_t i = definition_start[local]; i < definition_start[local + 1]; ++i) {
+        size_t block = definitions[i];
+        if (queued[block] == local + 1) { continue; }
+        queued[block] = local + 1;
+        worklist[worklist_count++] = block;
+      }
+      while (worklist_count) {
+        uint64_t *frontier = dominators->frontier + worklist[--worklist_count] * dominators->words;
+        for (size_t block = 0; block < dominators->count; ++block) {
+          if (!BIT_TEST(frontier, block) || has_phi[block] == local + 1) { continue; }
+          has_phi[block] = local + 1;
+
+          InsertedPhi *inserted = opt_allocate(1, sizeof(InsertedPhi));
+          IRInstruction *phi = ir_instruction_create(function, IR_PHI);
+          opt_prepend(function, dominators->blocks[block], phi);
+          inserted->phi = phi;
+          inserted->block = dominators->blocks[block];
+          inserted->local = local;
+          inserted->next = promotion.phis[block];
+          promotion.phis[block] = inserted;
+          phi_count++;
+
+          if (queued[block] != local + 1) {
+            queued[block] = local + 1;
+            worklist[worklist_count++] = block;
+          }
+        }
+      }
+    }
+    free(worklist);
+    free(queued);
+    free(has_phi);
+    free(definition_count);
+    free(definitions);
+    free(definition_start);
+
+    // Promoted parameters start out with the value they were passed.
+    IRInstruction **current = opt_allocate(promotion.local_count, sizeof(IRInstruction *));
+    for (size_t local = 0; local < promotion.local_count; ++local) {
+      IRInstruction *parameter = promotion.locals[local];
+      if (promotion.escapes[local] || parameter->type != IR_PARAMETER_REFERENCE) { continue; }
+      IRInstruction *load = ir_instruction_create(function, IR_LOCAL_LOAD);
+      load->value.reference = parameter;
+      ir_insert_after(function, local_block[local], parameter, load);
+      current[local] = load;
+    }
+
+    opt_rename(&promotion, 0, current);
+    free(current);
+    opt_resolve_function(numbering, function);
+
+    InsertedPhi **inserted_phis = opt_allocate(phi_count, sizeof(InsertedPhi *));
+    size_t inserted_count = 0;
+    for (size_t block = 0; block < dominators->count; ++block) {
+      for (InsertedPhi *inserted = promotion.phis[block]; inserted; inserted = inserted->next) {
+        inserted_phis[inserted_count++] = inserted;
+      }
+    }
+    opt_remove_dead_phis(function, inserted_phis, phi_count);
+    for (size_t i = 0; i < phi_count; ++i) { free(inserted_phis[i]); }
+    free(inserted_phis);
+    free(promotion.phis);
+
+    // Nested functions may still name a promoted local, which
+    // emission rejects; so it is unlinked, but not freed.
+    for (IRBlock *block = function->first; block; block = block->next) {
+      uint32_t kept = 0;
+      for (uint32_t i = 0; i < block->instruction_count; ++i) {
+        IRInstruction *instruction = block->instructions[i];
+        size_t local = instruction->type == IR_STACK_ALLOCATE
+          ? opt_local(&promotion, instruction)
+          : NO_INDEX;
+        if (local != NO_INDEX && !promotion.escapes[local]) { continue; }
+        block->instructions[kept++] = instruction;
+      }
+      block->instruction_count = kept;
+    }
+    for (size_t i = 0; i < promotion.removed_count; ++i) {
+      ir_free_instruction(function, promotion.removed[i]);
+    }
+  }
+
+  free(promotion.removed);
+  free(promotion.stored);
+  free(promotion.escapes);
+  free(local_block);
+  free(promotion.local_of);
+  free(promotion.locals);
+  opt_numbering_free(numbering);
+  opt_dominators_free(dominators);
+  return promoted;
+}
+
+/// Remove the arguments of phis in BLOCK that come from PREDECESSOR.
+static void opt_remove_phi_arguments(IRBlock *block, IRBlock *predecessor) {
+  for (uint32_t i = 0; i < block->instruction_count; ++i) {
+    IRInstruction *phi = block->instructions[i];
+    if (phi->type != IR_PHI) { continue; }
+    IRPhiArgument **link = &phi->value.phi_argument;
+    while (*link) {
+      if ((*link)->block == predecessor) {
+        *link = (*link)->next;
+      } else {
+        link = &(*link)->next;
+      }
+    }
+  }
+}
+
+/// Free BLOCK along with its instructions, and return how many there
+/// were.
+static size_t opt_free_block(IRFunction *function, IRBlock *block) {
+  size_t count = 1 + block->instruction_count;
+  for (uint32_t i = 0; i < block->instruction_count; ++i) {
+    ir_free_instruction(function, block->instructions[i]);
+  }
+  block->instruction_count = 0;
+  ir_free_instruction(function, block->branch);
+  ir_free_block(function, block);
+  return count;
+}
+
+static void opt_unlink_block(IRFunction *function, IRBlock *block) {
+  if (block->previous) {
+    block->previous->next = block->next;
+  } else {
+    function->first = block->next;
+  }
+  if (block->next) {
+    block->next->previous = block->previous;
+  } else {
+    function->last = block->previous;
+  }
+}
+
+/// Turn conditional branches on a constant into unconditional ones.
+static void opt_fold_branches(IRFunction *function) {
+  for (IRBlock *block = function->first; block; block = block->next) {
+    IRInstruction *branch = block->branch;
+    if (branch->type != IR_BRANCH_CONDITIONAL
+        || branch->value.conditional_branch.condition->type != IR_IMMEDIATE) {
+      continue;
+    }
+    IRBranchConditional conditional = branch->value.conditional_branch;
+    IRBlock *taken = conditional.condition->value.immediate
+      ? conditional.true_branch : conditional.false_branch;
+    IRBlock *other = taken == conditional.true_branch
+      ? conditional.false_branch : conditional.true_branch;
+    if (other != taken) { opt_remove_phi_arguments(other, block); }
+    branch->type = IR_BRANCH;
+    branch->value.block = taken;
+  }
+}
+
+/// Drop the blocks of FUNCTION that can not be reached from its entry,
+/// and return how many instructions they held.
+static size_t opt_remove_unreachable_blocks(IRFunction *function) {
+  size_t block_count = 0;
+  for (IRBlock *block = function->first; block; block = block->next) {
+    block->index = 0;
+    block_count++;
+  }
+
+  // Reachable blocks are marked with a non-zero index.
+  IRBlock **stack = opt_allocate(block_count, sizeof(IRBlock *));
+  size_t depth = 0;
+  function->first->index = 1;
+  stack[depth++] = function->first;
+  while (depth) {
+    IRBlock *successors[2];
+    size_t successor_count = ir_successors(stack[--depth], successors);
+    for (size_t i = 0; i < successor_count; ++i) {
+      if (successors[i]->index) { continue; }
+      successors[i]->index = 1;
+      stack[depth++] = successors[i];
+    }
+  }
+  free(stack);
+
+  size_t removed = 0;
+  IRBlock *block = function->first;
+  while (block) {
+    IRBlock *next = block->next;
+    if (!block->index) {
+      IRBlock *successors[2];
+      size_t successor_count = ir_successors(block, successors);
+      for (size_t i = 0; i < successor_count; ++i) {
+        opt_remove_phi_arguments(successors[i], block);
+      }
+      opt_unlink_block(function, block);
+      removed += opt_free_block(function, block);
+    }
+    block = next;
+  }
+  return removed;
+}
+
+/// Append every block of FUNCTION that is the only successor of its
+/// only predecessor to that predecessor. Return the number of
+/// instructions that became redundant.
+static size_t opt_merge_blocks(IRFunction *function) {
+  ir_set_predecessors(function);
+  Numbering numbering;
+  opt_number(&numbering, function);
+
+  // Phis of merged blocks only have one argument left; they are freed
+  // once nothing refers to them any more.
+  size_t removed = 0;
+  for (IRBlock *block = function->first; block; block = block->next) {
+    while (block->branch->type == IR_BRANCH) {
+      IRBlock *successor = block->branch->value.block;
+      if (successor == block || successor == function->first
+          || successor->predecessor_count != 1) {
+        break;
+      }
+
+      uint32_t kept = 0;
+      for (uint32_t i = 0; i < successor->instruction_count; ++i) {
+        IRInstruction *instruction = successor->instructions[i];
+        if (instruction->type == IR_PHI) {
+          ASSERT(instruction->value.phi_argument && !instruction->value.phi_argument->next,
+                 "Phi in a block with one predecessor must have one argument.");
+          numbering.replacement[instruction->index] = instruction->value.phi_argument->value;
+          removed++;
+        } else {
+          successor->instructions[kept++] = instruction;
+        }
+      }
+      successor->instruction_count = kept;
+
+      // Whatever came from the successor now comes from this block.
+      IRBlock *successors[2];
+      size_t successor_count = ir_successors(successor, successors);
+      for (size_t i = 0; i < successor_count; ++i) {
+        for (uint32_t j = 0; j < successors[i]->predecessor_count; ++j) {
+          if (successors[i]->predecessors[j] == successor) { successors[i]->predecessors[j] = block; }
+        }
+        for (uint32_t j = 0; j < successors[i]->instruction_count; ++j) {
+          IRInstruction *phi = successors[i]->instructions[j];
+          if (phi->type != IR_PHI) { continue; }
+          for (IRPhiArgument *argument = phi->value.phi_argument; argument; argument = argument->next) {
+            if (argument->block == successor) { argument->block = block; }
+          }
+        }
+      }
+
+      ir_move_instructions(function, block, successor, 0);
+      ir_free_instruction(function, block->branch);
+      removed++;
+      block->branch = successor->branch;
+
+      successor->branch = NULL;
+      opt_unlink_block(function, successor);
+      ir_free_block(function, successor);
+    }
+  }
+
+  opt_resolve_function(&numbering, function);
+  // Only the phis of merged blocks were replaced.
+  for (size_t index = 0; index < numbering.count; ++index) {
+    if (numbering.replacement[index]) { ir_free_instruction(function, numbering.instructions[index]); }
+  }
+  opt_numbering_free(&numbering);
+  return removed;
+}
+
+typedef struct Liveliness {
+  Numbering numbering;
+  char *live;
+  size_t *worklist;
+  size_t worklist_count;
+} Liveliness;
+
+static void opt_mark_live(IRInstruction **operand, void *data) {
+  Liveliness *liveliness = data;
+  IRInstruction *value = *operand;
+  if (!opt_numbered(&liveliness->numbering, value) || liveliness->live[value->index]) { return; }
+  liveliness->live[value->index] = 1;
+  liveliness->worklist[liveliness->worklist_count++] = value->index;
+}
+
+size_t opt_eliminate_dead_code(IRFunction *function) {
+  opt_fold_branches(function);
+  size_t removed = opt_remove_unreachable_blocks(function);
+  removed += opt_merge_blocks(function);
+
+  // Mark everything that has an effect, and everything that it uses.
+  Liveliness liveliness = {0};
+  opt_number(&liveliness.numbering, function);
+  size_t count = liveliness.numbering.count;
+  liveliness.live = opt_allocate(count, sizeof(char));
+  liveliness.worklist = opt_allocate(count, sizeof(size_t));
+  for (size_t index = 0; index < count; ++index) {
+    IRInstruction *instruction = liveliness.numbering.instructions[index];
+    // Stack allocations and parameters are kept, as nested functions
+    // may name them.
+    if (!opt_removable(instruction)) { opt_mark_live(&instruction, &liveliness); }
+  }
+  if (function->return_value) {
+    opt_mark_live(&function->return_value, &liveliness);
+  }
+  while (liveliness.worklist_count) {
+    IRInstruction *instruction = liveliness.numbering.instructions[liveliness.worklist[--liveliness.worklist_count]];
+    ir_for_each_operand(instruction, opt_mark_live, &liveliness);
+  }
+
+  // Sweep the rest.
+  for (IRBlock *block = function->first; block; block = block->next) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      if (liveliness.live[instruction->index]) {
+        block->instructions[kept++] = instruction;
+      } else {
+        ir_free_instruction(function, instruction);
+        removed++;
+      }
+    }
+    block->instruction_count = kept;
+  }
+
+  free(liveliness.worklist);
+  free(liveliness.live);
+  opt_numbering_free(&liveliness.numbering);
+  return removed;
+}
+
+typedef struct ValueEntry {
+  IRInstruction *value;
+  size_t hash;
+  /// For loads, the state of memory they read.
+  size_t generation;
+  struct ValueEntry *next;
+} ValueEntry;
+
+/// A hash table of the values available at some point of a function.
+/// Entries are only ever removed in the opposite order they were added
+/// in, so every one of them is at the head of its bucket by then.
+typedef struct ValueTable {
+  Numbering numbering;
+  Dominators dominators;
+
+  ValueEntry **buckets;
+  size_t bucket_mask;
+  ValueEntry *entries;
+  size_t entry_count;
+  /// The last state of memory handed out. Every store and call starts
+  /// a new one, so loads on either side of it differ.
+  size_t generation;
+  /// Whether the address of each local is taken, by index. Locals
+  /// whose address is not can only be changed by storing to them.
+  char *address_taken;
+
+  IRInstruction **redundant;
+  size_t redundant_count;
+} ValueTable;
+
+static char opt_reads_memory(IRInstruction *instruction) {
+  return instruction->type == IR_LOAD
+    || instruction->type == IR_LOCAL_LOAD
+    || instruction->type == IR_GLOBAL_LOAD;
+}
+
+static char opt_writes_memory(IRInstruction *instruction) {
+  return instruction->type == IR_CALL
+    || instruction->type == IR_STORE
+    || instruction->type == IR_LOCAL_STORE
+    || instruction->type == IR_GLOBAL_STORE;
+}
+
+/// Return non-zero iff INSTRUCTION computes the same value as any
+/// other instruction with the same operands. Immediates qualify, but
+/// are never materialized, so merging them only stretches their live
+/// ranges.
+static char opt_numberable(IRInstruction *instruction) {
+  switch (instruction->type) {
+  case IR_ADD:
+  case IR_SUBTRACT:
+  case IR_MULTIPLY:
+  case IR_DIVIDE:
+  case IR_MODULO:
+  case IR_SHIFT_LEFT:
+  case IR_SHIFT_RIGHT_ARITHMETIC:
+  case IR_COMPARISON:
+  case IR_LOAD:
+  case IR_LOCAL_LOAD:
+  case IR_LOCAL_ADDRESS:
+  case IR_GLOBAL_LOAD:
+  case IR_GLOBAL_ADDRESS:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/// Order the operands of commutative operations, so that `a + b` and
+/// `b + a` look the same.
+static void opt_canonicalize(Numbering *numbering, IRInstruction *instruction) {
+  IRPair *pair = NULL;
+  switch (instruction->type) {
+  case IR_ADD:
+  case IR_MULTIPLY:
+    pair = &instruction->value.pair;
+    break;
+  case IR_COMPARISON:
+    if (instruction->value.comparison.type == COMPARE_EQ
+        || instruction->value.comparison.type == COMPARE_NE) {
+      pair = &instruction->value.comparison.pair;
+    }
+    break;
+  default:
+    break;
+  }
+  if (!pair) { return; }
+  char swap = pair->car->type == IR_IMMEDIATE
+    ? pair->cdr->type != IR_IMMEDIATE
+    : pair->cdr->type != IR_IMMEDIATE
+      && opt_numbered(numbering, pair->car) && opt_numbered(numbering, pair->cdr)
+      && pair->car->index > pair->cdr->index;
+  if (swap) {
+    IRInstruction *tmp = pair->car;
+    pair->car = pair->cdr;
+    pair->cdr = tmp;
+  }
+}
+
+static size_t opt_hash_combine(size_t hash, uintptr_t value) {
+  return (hash ^ value) * (size_t)0x100000001b3;
+}
+
+/// Immediates are compared by value, as equal ones are not merged.
+static size_t opt_hash_operand(size_t hash, IRInstruction *operand) {
+  if (operand->type == IR_IMMEDIATE) {
+    return opt_hash_combine(opt_hash_combine(hash, IR_IMMEDIATE), (uint64_t)operand->value.immediate);
+  }
+  return opt_hash_combine(hash, (uintptr_t)operand);
+}
+
+static char opt_same_operand(IRInstruction *a, IRInstruction *b) {
+  return a == b
+    || (a->type == IR_IMMEDIATE && b->type == IR_IMMEDIATE
+        && a->value.immediate == b->value.immediate);
+}
+
+static size_t opt_value_hash(IRInstruction *instruction, size_t generation) {
+  size_t hash = opt_hash_combine(0xcbf29ce484222325, instruction->type);
+  switch (instruction->type) {
+  case IR_COMPARISON:
+    hash = opt_hash_combine(hash, instruction->value.comparison.type);
+    hash = opt_hash_operand(hash, instruction->value.comparison.pair.car);
+    hash = opt_hash_operand(hash, instruction->value.comparison.pair.cdr);
+    break;
+  case IR_LOAD:
+  case IR_LOCAL_LOAD:
+  case IR_LOCAL_ADDRESS:
+    hash = opt_hash_combine(hash, (uintptr_t)instruction->value.reference);
+    break;
+  // Names are interned, so the pointer will do.
+  case IR_GLOBAL_LOAD:
+  case IR_GLOBAL_ADDRESS:
+    hash = opt_hash_combine(hash, (uintptr_t)instruction->value.name);
+    break;
+  default:
+    hash = opt_hash_operand(hash, instruction->value.pair.car);
+    hash = opt_hash_operand(hash, instruction->value.pair.cdr);
+    break;
+  }
+  if (opt_reads_memory(instruction)) {
+    hash = opt_hash_combine(hash, generation);
+  }
+  return hash;
+}
+
+static char opt_same_value(ValueEntry *entry, IRInstruction *instruction, size_t generation) {
+  IRInstruction *value = entry->value;
+  if (value->type != instruction->type) { return 0; }
+  if (opt_reads_memory(instruction) && entry->generation != generation) { return 0; }
+  switch (instruction->type) {
+  case IR_COMPARISON:
+    return value->value.comparison.type == instruction->value.comparison.type
+      && opt_same_operand(value->value.comparison.pair.car, instruction->value.comparison.pair.car)
+      && opt_same_operand(value->value.comparison.pair.cdr, instruction->value.comparison.pair.cdr);
+  case IR_LOAD:
+  case IR_LOCAL_LOAD:
+  case IR_LOCAL_ADDRESS:
+    return value->value.reference == instruction->value.reference;
+  case IR_GLOBAL_LOAD:
+  case IR_GLOBAL_ADDRESS:
+    return value->value.name == instruction->value.name;
+  default:
+    return opt_same_operand(value->value.pair.car, instruction->value.pair.car)
+      && opt_same_operand(value->value.pair.cdr, instruction->value.pair.cdr);
+  }
+}
+
+/// Return non-zero iff INSTRUCTION loads from or stores to a local
+/// whose address is never taken.
+static char opt_private_local_access(ValueTable *table, IRInstruction *instruction) {
+  IRInstruction *local = NULL;
+  if (instruction->type == IR_LOCAL_LOAD) {
+    local = instruction->value.reference;
+  } else if (instruction->type == IR_LOCAL_STORE) {
+    local = instruction->value.pair.car;
+  } else {
+    return 0;
+  }
+  return opt_numbered(&table->numbering, local) && !table->address_taken[local->index];
+}
+
+static void opt_note_address_taken(IRInstruction **operand, void *data) {
+  ValueTable *table = data;
+  if (opt_numbered(&table->numbering, *operand)) {
+    table->address_taken[(*operand)->index] = 1;
+  }
+}
+
+/// Replace instructions in the block with index INDEX, and those it
+/// dominates, that compute a value already available there.
+/// GENERATION is the state of memory at the end of the block's
+/// immediate dominator, and LOCAL_GENERATION that of the locals whose
+/// address is not taken.
+static void opt_number_values
+(ValueTable *table,
+ size_t index,
+ size_t generation,
+ size_t local_generation)
+{
+  IRBlock *block = table->dominators.blocks[index];
+  // Other paths into a join may have stored to memory in the meantime.
+  if (index != 0 && block->predecessor_count != 1) {
+    generation = ++table->generation;
+    local_generation = ++table->generation;
+  }
+
+  size_t saved_entry_count = table->entry_count;
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < block->instruction_count; ++i) {
+    IRInstruction *instruction = block->instructions[i];
+    ir_for_each_operand(instruction, opt_resolve_operand, &table->numbering);
+    char private = opt_private_local_access(table, instruction);
+    if (opt_writes_memory(instruction)) {
+      if (private) {
+        local_generation = ++table->generation;
+      } else {
+        generation = ++table->generation;
+      }
+    } else if (opt_numberable(instruction)) {
+      opt_canonicalize(&table->numbering, instruction);
+      size_t state = private ? local_generation : generation;
+      size_t hash = opt_value_hash(instruction, state);
+      ValueEntry *entry = table->buckets[hash & table->bucket_mask];
+      while (entry && (entry->hash != hash || !opt_same_value(entry, instruction, state))) {
+        entry = entry->next;
+      }
+      if (entry) {
+        table->numbering.replacement[instruction->index] = entry->value;
+        table->redundant[table->redundant_count++] = instruction;
+        continue;
+      }
+      entry = table->entries + table->entry_count++;
+      entry->value = instruction;
+      entry->hash = hash;
+      entry->generation = state;
+      entry->next = table->buckets[hash & table->bucket_mask];
+      table->buckets[hash & table->bucket_mask] = entry;
+    }
+    block->instructions[kept++] = instruction;
+  }
+  block->instruction_count = kept;
+  ir_for_each_operand(block->branch, opt_resolve_operand, &table->numbering);
+
+  for (size_t child = table->dominators.first_child[index];
+       child != NO_INDEX;
+       child = table->dominators.next_sibling[child]
+       ) {
+    opt_number_values(table, child, generation, local_generation);
+  }
+
+  while (table->entry_count > saved_entry_count) {
+    ValueEntry *entry = table->entries + --table->entry_count;
+    table->buckets[entry->hash & table->bucket_mask] = entry->next;
+  }
+}
+
+size_t opt_number_values_globally(IRFunction *function) {
+  ValueTable table = {0};
+  ir_set_predecessors(function);
+  opt_dominators(&table.dominators, function);
+  opt_number(&table.numbering, function);
+
+  size_t bucket_count = 16;
+  while (bucket_count < 2 * table.numbering.count) { bucket_count *= 2; }
+  table.buckets = opt_allocate(bucket_count, sizeof(ValueEntry *));
+  table.bucket_mask = bucket_count - 1;
+  table.entries = opt_allocate(table.numbering.count, sizeof(ValueEntry));
+  table.redundant = opt_allocate(table.numbering.count, sizeof(IRInstruction *));
+
+  table.address_taken = opt_allocate(table.numbering.count, sizeof(char));
+  for (size_t index = 0; index < table.numbering.count; ++index) {
+    IRInstruction *instruction = table.numbering.instructions[index];
+    if (instruction->type == IR_LOCAL_LOAD) { continue; }
+    if (instruction->type == IR_LOCAL_STORE) {
+      opt_note_address_taken(&instruction->value.pair.cdr, &table);
+      continue;
+    }
+    ir_for_each_operand(instruction, opt_note_address_taken, &table);
+  }
+
+  opt_number_values(&table, 0, 0, 0);
+  // Phis and unreachable blocks may still refer to what was removed.
+  opt_resolve_function(&table.numbering, function);
+  for (size_t i = 0; i < table.redundant_count; ++i) {
+    ir_free_instruction(function, table.redundant[i]);
+  }
+
+  size_t removed = table.redundant_count;
+  free(table.address_taken);
+  free(table.redundant);
+  free(table.entries);
+  free(table.buckets);
+  opt_numbering_free(&table.numbering);
+  opt_dominators_free(&table.dominators);
+  return removed;
+}
+
+/// Return non-zero iff the block with dominator index A dominates the
+/// one with index B.
+static char opt_dominates(Dominators *dominators, size_t a, size_t b) {
+  while (b > a) { b = dominators->idom[b]; }
+  return a == b;
+}
+
+/// Return the headers of the loops in FUNCTION, that is the blocks
+/// that some block they dominate branches back to, innermost first.
+/// The count is stored in COUNT.
+static IRBlock **opt_loop_headers(IRFunction *function, size_t *count) {
+  Dominators dominators = {0};
+  ir_set_predecessors(function);
+  opt_dominators(&dominators, function);
+  IRBlock **headers = opt_allocate(dominators.count, sizeof(IRBlock *));
+  *count = 0;
+  // An inner header is dominated by the outer one, so it comes later
+  // in reverse postorder. The entry has nowhere to hoist to.
+  for (size_t i = dominators.count - 1; i > 0; --i) {
+    IRBlock *block = dominators.blocks[i];
+    for (uint32_t j = 0; j < block->predecessor_count; ++j) {
+      size_t p = block->predecessors[j]->index;
+      if (p != NO_INDEX && opt_dominates(&dominators, i, p)) {
+        headers[(*count)++] = dominators.blocks[i];
+        break;
+      }
+    }
+  }
+  opt_dominators_free(&dominators);
+  return headers;
+}
+
+/// A natural loop: its header, and every block that can reach a branch
+/// back to the header without going through it.
+typedef struct Loop {
+  Dominators dominators;
+  IRBlock *header;
+  /// The only block outside of the loop that branches to the header.
+  /// It branches nowhere else, so whatever is computed in it is
+  /// available throughout the loop.
+  IRBlock *preheader;
+  /// The block that branches back to the header, if there is only one.
+  IRBlock *latch;
+  /// Whether each block is part of the loop, by dominator index.
+  char *body;
+  Numbering numbering;
+  /// The block of each instruction, by index.
+  IRBlock **block_of;
+} Loop;
+
+static void opt_loop_free(Loop *loop) {
+  opt_dominators_free(&loop->dominators);
+  opt_numbering_free(&loop->numbering);
+  free(loop->body);
+  free(loop->block_of);
+}
+
+/** Find the loop of FUNCTION headed by HEADER.
+ *
+ * If the one block that enters the loop from outside also branches
+ * elsewhere, the edge is split by a new block to serve as preheader.
+ * Loops that are entered from more than one place are left alone.
+ *
+ * @return Non-zero iff LOOP was filled in, and has to be freed.
+ */
+static char opt_find_loop(Loop *loop, IRFunction *function, IRBlock *header) {
+  *loop = (Loop){0};
+  loop->header = header;
+  for (;;) {
+    ir_set_predecessors(function);
+    opt_dominators(&loop->dominators, function);
+    size_t count = loop->dominators.count;
+    size_t h = header->index;
+    loop->body = opt_allocate(count, sizeof(char));
+    loop->body[h] = 1;
+
+    // Walk backwards from the branches back to the header.
+    size_t *worklist = opt_allocate(count, sizeof(size_t));
+    size_t work = 0;
+    size_t latch_count = 0;
+    for (uint32_t i = 0; i < header->predecessor_count; ++i) {
+      size_t p = header->predecessors[i]->index;
+      if (p == NO_INDEX || !opt_dominates(&loop->dominators, h, p)) { continue; }
+      loop->latch = header->predecessors[i];
+      latch_count++;
+      if (!loop->body[p]) {
+        loop->body[p] = 1;
+        worklist[work++] = p;
+      }
+    }
+    while (work) {
+      IRBlock *block = loop->dominators.blocks[worklist[--work]];
+      for (uint32_t i = 0; i < block->predecessor_count; ++i) {
+        size_t p = block->predecessors[i]->index;
+        if (p == NO_INDEX || loop->body[p]) { continue; }
+        loop->body[p] = 1;
+        worklist[work++] = p;
+      }
+    }
+    free(worklist);
+    if (latch_count != 1) { loop->latch = NULL; }
+
+    // Unreachable blocks are about to be removed anyway.
+    IRBlock *outside = NULL;
+    size_t outside_count = 0;
+    for (uint32_t i = 0; i < header->predecessor_count; ++i) {
+      size_t p = header->predecessors[i]->index;
+      if (p == NO_INDEX || loop->body[p]) { continue; }
+      outside = header->predecessors[i];
+      outside_count++;
+    }
+    if (outside_count != 1) {
+      opt_dominators_free(&loop->dominators);
+      free(loop->body);
+      return 0;
+    }
+    if (outside->branch->type == IR_BRANCH) {
+      loop->preheader = outside;
+      break;
+    }
+
+    IRBlock *preheader = ir_block_create(function);
+    preheader->branch = ir_instruction_create(function, IR_BRANCH);
+    preheader->branch->value.block = header;
+    IRBranchConditional *conditional = &outside->branch->value.conditional_branch;
+    if (conditional->true_branch == header) { conditional->true_branch = preheader; }
+    if (conditional->false_branch == header) { conditional->false_branch = preheader; }
+    for (uint32_t i = 0; i < header->instruction_count; ++i) {
+      IRInstruction *phi = header->instructions[i];
+      if (phi->type != IR_PHI) { continue; }
+      for (IRPhiArgument *argument = phi->value.phi_argument; argument; argument = argument->next) {
+        if (argument->block == outside) { argument->block = preheader; }
+      }
+    }
+    preheader->previous = header->previous;
+    preheader->next = header;
+    if (header->previous) {
+      header->previous->next = preheader;
+    } else {
+      function->first = preheader;
+    }
+    header->previous = preheader;
+
+    opt_dominators_free(&loop->dominators);
+    free(loop->body);
+    loop->latch = NULL;
+  }
+
+  opt_number(&loop->numbering, function);
+  loop->block_of = opt_allocate(loop->numbering.count, sizeof(IRBlock *));
+  for (IRBlock *block = function->first; block; block = block->next) {
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      loop->block_of[instruction->index] = block;
+    }
+    loop->block_of[block->branch->index] = block;
+  }
+  return 1;
+}
+
+/// Return non-zero iff INSTRUCTION is computed inside of LOOP.
+/// Instructions created since LOOP was found are not.
+static char opt_in_loop(Loop *loop, IRInstruction *instruction) {
+  if (!opt_numbered(&loop->numbering, instruction)) { return 0; }
+  size_t index = loop->block_of[instruction->index]->index;
+  return index != NO_INDEX && loop->body[index];
+}
+
+/// Return non-zero iff INSTRUCTION may be computed whether or not its
+/// result is needed, and always gives the same result for the same
+/// operands. Comparisons qualify, but are best kept right before the
+/// branch on them.
+static char opt_hoistable(IRInstruction *instruction) {
+  switch (instruction->type) {
+  case IR_ADD:
+  case IR_SUBTRACT:
+  case IR_MULTIPLY:
+  case IR_SHIFT_LEFT:
+  case IR_SHIFT_RIGHT_ARITHMETIC:
+  case IR_LOCAL_ADDRESS:
+  case IR_GLOBAL_ADDRESS:
+    return 1;
+  case IR_DIVIDE:
+  case IR_MODULO:
+    return opt_removable(instruction);
+  default:
+    return 0;
+  }
+}
+
+typedef struct Invariance {
+  Loop *loop;
+  IRFunction *function;
+  char invariant;
+  /// Whether each local may change while the loop runs: it is stored
+  /// to inside of it, or its address is taken anywhere. By index.
+  char *written;
+} Invariance;
+
+static void opt_note_written(IRInstruction **operand, void *data) {
+  Invariance *invariance = data;
+  if (opt_numbered(&invariance->loop->numbering, *operand)) {
+    invariance->written[(*operand)->index] = 1;
+  }
+}
+
+/// Immediates are free to copy, and stack memory is not a value.
+static void opt_check_invariant(IRInstruction **operand, void *data) {
+  Invariance *invariance = data;
+  IRInstruction *value = *operand;
+  if (value->type == IR_IMMEDIATE || !ir_is_value(value)) { return; }
+  if (opt_in_loop(invariance->loop, value)) { invariance->invariant = 0; }
+}
+
+/// Immediates are kept right next to their use, as they take up a
+/// register while they are live.
+static void opt_copy_immediate(IRInstruction **operand, void *data) {
+  Invariance *invariance = data;
+  IRInstruction *value = *operand;
+  if (value->type != IR_IMMEDIATE || !opt_in_loop(invariance->loop, value)) { return; }
+  IRInstruction *copy = ir_instruction_create(invariance->function, IR_IMMEDIATE);
+  copy->value.immediate = value->value.immediate;
+  opt_append(invariance->function, invariance->loop->preheader, copy);
+  *operand = copy;
+}
+
+/// Move the instructions of LOOP that compute the same value every
+/// time around to its preheader, and return how many there were.
+/// Locals are only loaded from before the loop if nothing can change
+/// them in the meantime.
+static size_t opt_hoist_invariants(Loop *loop, IRFunction *function) {
+  Invariance invariance = {0};
+  invariance.loop = loop;
+  invariance.function = function;
+  invariance.written = opt_allocate(loop->numbering.count, sizeof(char));
+  for (size_t index = 0; index < loop->numbering.count; ++index) {
+    IRInstruction *instruction = loop->numbering.instructions[index];
+    if (instruction->type == IR_LOCAL_LOAD) { continue; }
+    if (instruction->type == IR_LOCAL_STORE) {
+      opt_note_written(&instruction->value.pair.cdr, &invariance);
+      if (opt_in_loop(loop, instruction)) {
+        opt_note_written(&instruction->value.pair.car, &invariance);
+      }
+      continue;
+    }
+    ir_for_each_operand(instruction, opt_note_written, &invariance);
+  }
+
+  size_t hoisted = 0;
+  // Operands are defined in blocks that dominate their use, which come
+  // first in reverse postorder, so one pass finds everything.
+  for (size_t i = 0; i < loop->dominators.count; ++i) {
+    if (!loop->body[i]) { continue; }
+    IRBlock *block = loop->dominators.blocks[i];
+    uint32_t kept = 0;
+    for (uint32_t j = 0; j < block->instruction_count; ++j) {
+      IRInstruction *instruction = block->instructions[j];
+      invariance.invariant = opt_hoistable(instruction);
+      if (instruction->type == IR_LOCAL_LOAD) {
+        IRInstruction *local = instruction->value.reference;
+        invariance.invariant = opt_numbered(&loop->numbering, local)
+          && !invariance.written[local->index];
+      }
+      if (invariance.invariant) {
+        ir_for_each_operand(instruction, opt_check_invariant, &invariance);
+      }
+      if (invariance.invariant) {
+        ir_for_each_operand(instruction, opt_copy_immediate, &invariance);
+        opt_append(function, loop->preheader, instruction);
+        loop->block_of[instruction->index] = loop->preheader;
+        hoisted++;
+      } else {
+        block->instructions[kept++] = instruction;
+      }
+    }
+    block->instruction_count = kept;
+  }
+  free(invariance.written);
+  return hoisted;
+}
+
+size_t opt_hoist_loop_invariants(IRFunction *function) {
+  size_t header_count = 0;
+  IRBlock **headers = opt_loop_headers(function, &header_count);
+  size_t hoisted = 0;
+  for (size_t i = 0; i < header_count; ++i) {
+    Loop loop;
+    if (!opt_find_loop(&loop, function, headers[i])) { continue; }
+    hoisted += opt_hoist_invariants(&loop, function);
+    opt_loop_free(&loop);
+  }
+  free(headers);
+  return hoisted;
+}
+
+/// If PHI in the header of LOOP is an induction variable that a
+/// constant is added to or subtracted from each time around, return
+/// the instruction that does, and store its value on entry in INITIAL.
+static IRInstruction *opt_induction_step(Loop *loop, IRInstruction *phi, IRInstruction **initial) {
+  if (!loop->latch) { return NULL; }
+  IRInstruction *step = NULL;
+  size_t argument_count = 0;
+  *initial = NULL;
+  for (IRPhiArgument *argument = phi->value.phi_argument; argument; argument = argument->next) {
+    argument_count++;
+    if (argument->block == loop->preheader) { *initial = argument->value; }
+    if (argument->block == loop->latch) { step = argument->value; }
+  }
+  if (argument_count != 2 || !*initial || !step || !opt_in_loop(loop, step)) { return NULL; }
+  if (step->type != IR_ADD && step->type != IR_SUBTRACT) { return NULL; }
+  if (step->value.pair.car != phi || step->value.pair.cdr->type != IR_IMMEDIATE) { return NULL; }
+  return step;
+}
+
+/// Return the constant that INSTRUCTION multiplies VALUE by, or zero
+/// if it does something else.
+static int64_t opt_factor(IRInstruction *instruction, IRInstruction *value) {
+  if (instruction->type != IR_MULTIPLY) { return 0; }
+  IRPair pair = instruction->value.pair;
+  if (pair.car == value && pair.cdr->type == IR_IMMEDIATE) { return pair.cdr->value.immediate; }
+  if (pair.cdr == value && pair.car->type == IR_IMMEDIATE) { return pair.car->value.immediate; }
+  return 0;
+}
+
+typedef struct Replacement {
+  IRInstruction *instruction;
+  IRInstruction *value;
+} Replacement;
+
+static void opt_replace_operand(IRInstruction **operand, void *data) {
+  Replacement *replacement = data;
+  if (*operand == replacement->instruction) { *operand = replacement->value; }
+}
+
+static IRInstruction *opt_immediate_in(IRFunction *function, IRBlock *block, int64_t value) {
+  IRInstruction *immediate = ir_instruction_create(function, IR_IMMEDIATE);
+  immediate->value.immediate = value;
+  opt_append(function, block, immediate);
+  return immediate;
+}
+
+/** Replace multiplications of induction variables of LOOP by a
+ * constant with induction variables of their own.
+ *
+ * If `i` starts out as `a` and goes up by `c` each time around, then
+ * `i * k` starts out as `a * k` and goes up by `c * k`, so the product
+ * can be kept up to date by adding to it instead.
+ *
+ * @return The number of multiplications replaced.
+ */
+static size_t opt_reduce_induction_variables(Loop *loop, IRFunction *function) {
+  size_t reduced = 0;
+  for (uint32_t phi_position = 0; phi_position < loop->header->instruction_count; ++phi_position) {
+    IRInstruction *phi = loop->header->instructions[phi_position];
+    if (phi->type != IR_PHI || !opt_numbered(&loop->numbering, phi)) { continue; }
+    IRInstruction *initial = NULL;
+    IRInstruction *step = opt_induction_step(loop, phi, &initial);
+    if (!step) { continue; }
+    uint64_t increment = (uint64_t)step->value.pair.cdr->value.immediate;
+
+    for (size_t i = 0; i < loop->dominators.count; ++i) {
+      if (!loop->body[i]) { continue; }
+      IRBlock *block = loop->dominators.blocks[i];
+      uint32_t position = 0;
+      while (position < block->instruction_count) {
+        IRInstruction *instruction = block->instructions[position];
+        int64_t factor = opt_factor(instruction, phi);
+        if (!factor || !opt_in_loop(loop, instruction)) {
+          position++;
+          continue;
+        }
+
+        IRInstruction *start = NULL;
+        if (initial->type == IR_IMMEDIATE) {
+          start = opt_immediate_in(function, loop->preheader,
+                                   (int64_t)((uint64_t)initial->value.immediate * (uint64_t)factor));
+        } else {
+          start = ir_instruction_create(function, IR_MULTIPLY);
+          start->value.pair.car = initial;
+          start->value.pair.cdr = opt_immediate_in(function, loop->preheader, factor);
+          opt_append(function, loop->preheader, start);
+        }
+
+        IRInstruction *product = ir_instruction_create(function, IR_PHI);
+        opt_prepend(function, loop->header, product);
+
+        // Step the product right where the induction variable is.
+        IRBlock *step_block = loop->block_of[step->index];
+        IRInstruction *step_amount = ir_instruction_create(function, IR_IMMEDIATE);
+        step_amount->value.immediate = (int64_t)(increment * (uint64_t)factor);
+        ir_insert_after(function, step_block, step, step_amount);
+        IRInstruction *stepped = ir_instruction_create(function, step->type);
+        stepped->value.pair.car = product;
+        stepped->value.pair.cdr = step_amount;
+        ir_insert_after(function, step_block, step_amount, stepped);
+
+        ir_phi_argument(function, product, loop->preheader, start);
+        ir_phi_argument(function, product, loop->latch, stepped);
+
+        Replacement replacement = { instruction, product };
+        for (IRBlock *user = function->first; user; user = user->next) {
+          for (uint32_t j = 0; j < user->instruction_count; ++j) {
+            ir_for_each_operand(user->instructions[j], opt_replace_operand, &replacement);
+          }
+          ir_for_each_operand(user->branch, opt_replace_operand, &replacement);
+        }
+        if (function->return_value == instruction) { function->return_value = product; }
+        // The new instructions may have moved this one.
+        position = ir_position(block, instruction);
+        ir_remove_at(block, position);
+        ir_free_instruction(function, instruction);
+        reduced++;
+      }
+    }
+    // The new phis went in front of this one.
+    phi_position = ir_position(loop->header, phi);
+  }
+  return reduced;
+}
+
+size_t opt_reduce_loop_strength(IRFunction *function) {
+  size_t header_count = 0;
+  IRBlock **headers = opt_loop_headers(function, &header_count);
+  size_t reduced = 0;
+  for (size_t i = 0; i < header_count; ++i) {
+    Loop loop;
+    if (!opt_find_loop(&loop, function, headers[i])) { continue; }
+    reduced += opt_reduce_induction_variables(&loop, function);
+    opt_loop_free(&loop);
+  }
+  free(headers);
+  return reduced;
+}
+
+/// A call of a function to itself whose result is returned.
+typedef struct TailCall {
+  IRBlock *block;
+  IRInstruction *call;
+  /// The addition or multiplication that combines the result of the
+  /// call with `operand` before it is returned, if any.
+  IRInstruction *combination;
+  IRInstruction *operand;
+  /// The block that BLOCK branches to with the result.
+  IRBlock *successor;
+} TailCall;
+
+typedef struct UseCount {
+  Numbering numbering;
+  size_t *uses;
+} UseCount;
+
+static void opt_count_any_use(IRInstruction **operand, void *data) {
+  UseCount *count = data;
+  if (opt_numbered(&count->numbering, *operand)) { count->uses[(*operand)->index]++; }
+}
+
+/// Return non-zero iff VALUE, computed at the end of BLOCK, only ever
+/// makes it into the return value of FUNCTION, through phis in blocks
+/// that do nothing else. Store the first block it goes to in SUCCESSOR.
+static char opt_returned_directly
+(UseCount *count,
+ IRFunction *function,
+ IRBlock *block,
+ IRInstruction *value,
+ IRBlock **successor)
+{
+  *successor = NULL;
+  for (size_t steps = 0; steps < count->numbering.count; ++steps) {
+    if (count->uses[value->index] != 1 || block->branch->type != IR_BRANCH) { return 0; }
+    IRBlock *next = block->branch->value.block;
+    if (!*successor) { *successor = next; }
+    IRInstruction *phi = NULL;
+    for (uint32_t i = 0; i < next->instruction_count; ++i) {
+      IRInstruction *instruction = next->instructions[i];
+      if (instruction->type != IR_PHI) { return 0; }
+      for (IRPhiArgument *argument = instruction->value.phi_argument; argument; argument = argument->next) {
+        if (argument->block == block && argument->value == value) { phi = instruction; }
+      }
+    }
+    if (!phi) { return 0; }
+    if (next->branch->type == IR_RETURN) { return function->return_value == phi; }
+    block = next;
+    value = phi;
+  }
+  return 0;
+}
+
+/// Return non-zero iff the instruction at POSITION in BLOCK of
+/// FUNCTION is a tail call, and describe it in TAIL_CALL.
+static char opt_tail_call
+(UseCount *count,
+ IRFunction *function,
+ IRBlock *block,
+ uint32_t position,
+ TailCall *tail_call)
+{
+  IRInstruction *call = block->instructions[position];
+  if (call->type != IR_CALL
+      || call->value.call.type != IR_CALLTYPE_DIRECT
+      || strcmp(call->value.call.value.name, function->name) != 0
+      || count->uses[call->index] != 1) {
+    return 0;
+  }
+
+  // Whatever comes after the call would happen after all the calls it
+  // makes in turn, so it must not matter when it happens.
+  IRInstruction *value = call;
+  *tail_call = (TailCall){ block, call, NULL, NULL, NULL };
+  for (uint32_t i = position + 1; i < block->instruction_count; ++i) {
+    IRInstruction *instruction = block->instructions[i];
+    if (!opt_removable(instruction) || opt_reads_memory(instruction)) { return 0; }
+    if ((instruction->type != IR_ADD && instruction->type != IR_MULTIPLY)
+        || (instruction->value.pair.car != call && instruction->value.pair.cdr != call)) {
+      continue;
+    }
+    if (instruction->value.pair.car == instruction->value.pair.cdr) { return 0; }
+    tail_call->combination = instruction;
+    tail_call->operand = instruction->value.pair.car == call
+      ? instruction->value.pair.cdr
+      : instruction->value.pair.car;
+    value = instruction;
+  }
+  return opt_returned_directly(count, function, block, value, &tail_call->successor);
+}
+
+size_t opt_eliminate_tail_calls(IRFunction *function) {
+  // Each call would have had a fresh copy of memory whose address
+  // may have been handed out.
+  for (IRBlock *block = function->first; block; block = block->next) {
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      if (instruction->type == IR_LOCAL_ADDRESS) { return 0; }
+    }
+  }
+
+  UseCount count = {0};
+  opt_number(&count.numbering, function);
+  count.uses = opt_allocate(count.numbering.count, sizeof(size_t));
+  for (size_t index = 0; index < count.numbering.count; ++index) {
+    ir_for_each_operand(count.numbering.instructions[index], opt_count_any_use, &count);
+  }
+  if (function->return_value) {
+    opt_count_any_use(&function->return_value, &count);
+  }
+
+  // Parameters are only ever referenced at the start of the function.
+  size_t parameter_count = 0;
+  for (uint32_t i = 0; i < function->first->instruction_count; ++i) {
+    IRInstruction *instruction = function->first->instructions[i];
+    if (instruction->type == IR_PARAMETER_REFERENCE && instruction->value.immediate > 0
+        && (size_t)instruction->value.immediate > parameter_count) {
+      parameter_count = (size_t)instruction->value.immediate;
+    }
+  }
+  IRInstruction **parameters = opt_allocate(parameter_count, sizeof(IRInstruction *));
+  for (uint32_t i = 0; i < function->first->instruction_count; ++i) {
+    IRInstruction *instruction = function->first->instructions[i];
+    if (instruction->type == IR_PARAMETER_REFERENCE && instruction->value.immediate > 0) {
+      parameters[instruction->value.immediate - 1] = instruction;
+    }
+  }
+
+  TailCall *tail_calls = NULL;
+  size_t tail_call_count = 0;
+  int combination = IR_COUNT;
+  for (IRBlock *block = function->first; block; block = block->next) {
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      TailCall tail_call;
+      if (!opt_tail_call(&count, function, block, i, &tail_call)
+          || instruction->value.call.argument_count < parameter_count) {
+        continue;
+      }
+      // Results can only be combined in one way throughout.
+      if (tail_call.combination) {
+        if (combination != IR_COUNT && combination != tail_call.combination->type) { continue; }
+        combination = tail_call.combination->type;
+      }
+      if (!tail_calls) { tail_calls = opt_allocate(count.numbering.count, sizeof(TailCall)); }
+      tail_calls[tail_call_count++] = tail_call;
+      break;
+    }
+  }
+  opt_numbering_free(&count.numbering);
+  free(count.uses);
+  if (!tail_call_count) {
+    free(parameters);
+    return 0;
+  }
+
+  // The old entry becomes the head of the loop, and a new one takes
+  // over the parameters.
+  IRBlock *header = function->first;
+  IRBlock *entry = ir_block_create(function);
+  entry->next = header;
+  header->previous = entry;
+  function->first = entry;
+  entry->branch = ir_instruction_create(function, IR_BRANCH);
+  entry->branch->value.block = header;
+  for (size_t i = 0; i < parameter_count; ++i) {
+    if (!parameters[i]) { continue; }
+    ir_remove(header, parameters[i]);
+    opt_append(function, entry, parameters[i]);
+  }
+
+  // Combined results are accumulated on the way in, and combined with
+  // what is returned at the end. The accumulator starts out as the
+  // identity of the combination.
+  IRInstruction *accumulator = NULL;
+  if (combination != IR_COUNT) {
+    accumulator = ir_instruction_create(function, IR_STACK_ALLOCATE);
+    accumulator->value.immediate = 8;
+    opt_append(function, entry, accumulator);
+    IRInstruction *identity = ir_instruction_create(function, IR_IMMEDIATE);
+    identity->value.immediate = combination == IR_MULTIPLY ? 1 : 0;
+    opt_append(function, entry, identity);
+    IRInstruction *store = ir_instruction_create(function, IR_LOCAL_STORE);
+    store->value.pair.car = accumulator;
+    store->value.pair.cdr = identity;
+    opt_append(function, entry, store);
+
+    IRBlock *exit = function->first;
+    while (exit && (exit->branch->type != IR_RETURN || exit == entry)) { exit = exit->next; }
+    ASSERT(exit, "A function with tail calls that are combined must return somewhere.");
+    IRInstruction *load = ir_instruction_create(function, IR_LOCAL_LOAD);
+    load->value.reference = accumulator;
+    opt_append(function, exit, load);
+    IRInstruction *result = ir_instruction_create(function, combination);
+    result->value.pair.car = load;
+    result->value.pair.cdr = function->return_value;
+    opt_append(function, exit, result);
+    function->return_value = result;
+  }
+
+  for (size_t i = 0; i < tail_call_count; ++i) {
+    TailCall *tail_call = tail_calls + i;
+    IRBlock *block = tail_call->block;
+    if (tail_call->combination) {
+      IRInstruction *load = ir_instruction_create(function, IR_LOCAL_LOAD);
+      load->value.reference = accumulator;
+      opt_append(function, block, load);
+      IRInstruction *combined = ir_instruction_create(function, combination);
+      combined->value.pair.car = load;
+      combined->value.pair.cdr = tail_call->operand;
+      opt_append(function, block, combined);
+      IRInstruction *store = ir_instruction_create(function, IR_LOCAL_STORE);
+      store->value.pair.car = accumulator;
+      store->value.pair.cdr = combined;
+      opt_append(function, block, store);
+      ir_remove(block, tail_call->combination);
+      ir_free_instruction(function, tail_call->combination);
+    }
+    // The arguments are all computed before the call, so they can be
+    // stored one by one.
+    for (size_t parameter = 0; parameter < parameter_count; ++parameter) {
+      if (!parameters[parameter]) { continue; }
+      IRInstruction *store = ir_instruction_create(function, IR_LOCAL_STORE);
+      store->value.pair.car = parameters[parameter];
+      store->value.pair.cdr = tail_call->call->value.call.arguments[parameter];
+      opt_append(function, block, store);
+    }
+    ir_remove(block, tail_call->call);
+    ir_free_instruction(function, tail_call->call);
+    opt_remove_phi_arguments(tail_call->successor, block);
+    block->branch->value.block = header;
+  }
+
+  free(tail_calls);
+  free(parameters);
+  ir_set_predecessors(function);
+  return tail_call_count;
+}
+
+/// Callees of at most this many instructions are inlined anywhere.
+#define OPT_INLINE_BUDGET 24
+/// Callees that are called from one place only are inlined if they
+/// have at most this many instructions.
+#define OPT_INLINE_SINGLE_CALL_BUDGET 256
+/// No more is inlined into a function once it has this many
+/// instructions.
+#define OPT_INLINE_CALLER_LIMIT 2048
+
+/// The functions of a program, sorted by name to look up callees.
+typedef struct FunctionTable {
+  IRFunction **functions;
+  size_t count;
+  /// The number of direct calls to each function, by position in
+  /// `functions`.
+  size_t *calls;
+  /// The number of instructions of each function, before inlining.
+  size_t *sizes;
+  /// Whether each function only refers to its own instructions.
+  char *self_contained;
+} FunctionTable;
+
+static int opt_compare_function_names(const void *a, const void *b) {
+  return strcmp((*(IRFunction *const *)a)->name, (*(IRFunction *const *)b)->name);
+}
+
+/// Make a table of every function in the list FUNCTIONS except the
+/// first, which is the program itself and can not be called.
+static void opt_function_table(FunctionTable *table, IRFunction *functions) {
+  table->count = 0;
+  for (IRFunction *function = functions->next; function; function = function->next) {
+    table->count++;
+  }
+  table->functions = opt_allocate(table->count, sizeof(IRFunction *));
+  size_t i = 0;
+  for (IRFunction *function = functions->next; function; function = function->next) {
+    table->functions[i++] = function;
+  }
+  qsort(table->functions, table->count, sizeof(IRFunction *), opt_compare_function_names);
+}
+
+static void opt_function_table_free(FunctionTable *table) {
+  free(table->functions);
+  free(table->calls);
+  free(table->sizes);
+  free(table->self_contained);
+  *table = (FunctionTable){0};
+}
+
+/// The position of the function labelled NAME in TABLE, or NO_INDEX.
+static size_t opt_find_function(FunctionTable *table, const char *name) {
+  size_t low = 0;
+  size_t high = table->count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    int order = strcmp(name, table->functions[middle]->name);
+    if (order == 0) { return middle; }
+    if (order < 0) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+  }
+  return NO_INDEX;
+}
+
+/// What is known about a global variable from all the code that uses
+/// it.
+typedef struct GlobalBinding {
+  char *name;
+  size_t store_count;
+  /// The label of the function stored to it, if that is all that is
+  /// ever stored to it.
+  char *function;
+  char address_taken;
+} GlobalBinding;
+
+typedef struct GlobalBindings {
+  GlobalBinding *bindings;
+  size_t count;
+  size_t capacity;
+} GlobalBindings;
+
+static GlobalBinding *opt_global_binding(GlobalBindings *globals, char *name) {
+  for (size_t i = 0; i < globals->count; ++i) {
+    if (strcmp(globals->bindings[i].name, name) == 0) { return globals->bindings + i; }
+  }
+  if (globals->count == globals->capacity) {
+    globals->capacity = globals->capacity ? globals->capacity * 2 : 16;
+    globals->bindings = realloc(globals->bindings, globals->capacity * sizeof(GlobalBinding));
+    ASSERT(globals->bindings, "Could not grow global bindings.");
+  }
+  GlobalBinding *binding = globals->bindings + globals->count++;
+  *binding = (GlobalBinding){0};
+  binding->name = name;
+  return binding;
+}
+
+/// The label of the function that CALLEE is known to be the address
+/// of, or NULL.
+static char *opt_known_callee(FunctionTable *table, GlobalBindings *globals, IRInstruction *callee) {
+  if (callee->type == IR_GLOBAL_ADDRESS) {
+    return opt_find_function(table, callee->value.name) != NO_INDEX ? callee->value.name : NULL;
+  }
+  if (callee->type != IR_GLOBAL_LOAD) { return NULL; }
+  GlobalBinding *binding = opt_global_binding(globals, callee->value.name);
+  if (binding->store_count != 1 || binding->address_taken) { return NULL; }
+  return binding->function;
+}
+
+size_t opt_resolve_calls(IRFunction *functions) {
+  FunctionTable table = {0};
+  opt_function_table(&table, functions);
+
+  // A global that is assigned a function exactly once, and that can
+  // not be written to through a pointer, always holds that function
+  // by the time it is called.
+  GlobalBindings globals = {0};
+  for (IRFunction *function = functions; function; function = function->next) {
+    for (IRBlock *block = function->first; block; block = block->next) {
+      for (uint32_t i = 0; i < block->instruction_count; ++i) {
+        IRInstruction *instruction = block->instructions[i];
+        if (instruction->type == IR_GLOBAL_ADDRESS) {
+          if (opt_find_function(&table, instruction->value.name) == NO_INDEX) {
+            opt_global_binding(&globals, instruction->value.name)->address_taken = 1;
+          }
+        } else if (instruction->type == IR_GLOBAL_STORE) {
+          GlobalBinding *binding = opt_global_binding(&globals, instruction->value.global_assignment.name);
+          IRInstruction *value = instruction->value.global_assignment.new_value;
+          binding->store_count++;
+          binding->function = value->type == IR_GLOBAL_ADDRESS
+            && opt_find_function(&table, value->value.name) != NO_INDEX
+            ? value->value.name
+            : NULL;
+        }
+      }
+    }
+  }
+
+  size_t resolved = 0;
+  for (IRFunction *function = functions; function; function = function->next) {
+    for (IRBlock *block = function->first; block; block = block->next) {
+      for (uint32_t i = 0; i < block->instruction_count; ++i) {
+        IRInstruction *instruction = block->instructions[i];
+        if (instruction->type != IR_CALL || instruction->value.call.type != IR_CALLTYPE_INDIRECT) {
+          continue;
+        }
+        char *name = opt_known_callee(&table, &globals, instruction->value.call.value.callee);
+        if (!name) { continue; }
+        instruction->value.call.type = IR_CALLTYPE_DIRECT;
+        instruction->value.call.value.name = name;
+        resolved++;
+      }
+    }
+  }
+
+  free(globals.bindings);
+  opt_function_table_free(&table);
+  return resolved;
+}
+
+/// Whether an operand is numbered, as found by opt_note_foreign().
+typedef struct ForeignCheck {
+  Numbering *numbering;
+  char foreign;
+} ForeignCheck;
+
+static void opt_note_foreign(IRInstruction **operand, void *data) {
+  ForeignCheck *check = data;
+  if (!opt_numbered(check->numbering, *operand)) { check->foreign = 1; }
+}
+
+/// The copy of a callee that is being inlined.
+typedef struct InlinedCopy {
+  IRFunction *caller;
+  Numbering numbering;
+  /// The copy of each instruction of the callee, by index.
+  IRInstruction **copies;
+  /// The copy of each block of the callee, by index.
+  IRBlock **blocks;
+} InlinedCopy;
+
+static void opt_map_operand(IRInstruction **operand, void *data) {
+  InlinedCopy *copy = data;
+  *operand = copy->copies[(*operand)->index];
+}
+
+/// Copy the instructions and blocks of CALLEE into CALLER, right after
+/// BLOCK, and make them branch to CONTINUATION where CALLEE returns.
+/// Parameters become stack allocations that ARGUMENTS are stored in.
+/// Return the copy of the value CALLEE returns, or NULL.
+static IRInstruction *opt_copy_callee
+(IRFunction *caller,
+ IRFunction *callee,
+ IRBlock *block,
+ IRBlock *continuation,
+ IRCall *call)
+{
+  InlinedCopy copy = {0};
+  copy.caller = caller;
+  opt_number(&copy.numbering, callee);
+  copy.copies = opt_allocate(copy.numbering.count, sizeof(IRInstruction *));
+  size_t block_count = 0;
+  for (IRBlock *original = callee->first; original; original = original->next) {
+    original->index = block_count++;
+  }
+  copy.blocks = opt_allocate(block_count, sizeof(IRBlock *));
+
+  IRBlock *previous = block;
+  for (IRBlock *original = callee->first; original; original = original->next) {
+    IRBlock *new_block = ir_block_create(caller);
+    copy.blocks[original->index] = new_block;
+    new_block->previous = previous;
+    new_block->next = previous->next;
+    previous->next->previous = new_block;
+    previous->next = new_block;
+    previous = new_block;
+
+    for (uint32_t i = 0; i < original->instruction_count; ++i) {
+      IRInstruction *instruction = original->instructions[i];
+      IRInstruction *new_instruction = ir_instruction_create(caller, instruction->type);
+      new_instruction->value = instruction->value;
+      copy.copies[instruction->index] = new_instruction;
+      opt_append(caller, new_block, new_instruction);
+      if (instruction->type == IR_PARAMETER_REFERENCE) {
+        new_instruction->type = IR_STACK_ALLOCATE;
+        new_instruction->value.immediate = 8;
+        IRInstruction *store = ir_instruction_create(caller, IR_LOCAL_STORE);
+        store->value.pair.car = new_instruction;
+        store->value.pair.cdr = call->arguments[instruction->value.immediate - 1];
+        opt_append(caller, new_block, store);
+      }
+    }
+    IRInstruction *branch = ir_instruction_create(caller, original->branch->type);
+    branch->value = original->branch->value;
+    copy.copies[original->branch->index] = branch;
+    new_block->branch = branch;
+  }
+
+  // Now that everything has a copy, refer to the copies.
+  for (size_t index = 0; index < copy.numbering.count; ++index) {
+    IRInstruction *original = copy.numbering.instructions[index];
+    IRInstruction *new_instruction = copy.copies[index];
+    switch (original->type) {
+    case IR_PARAMETER_REFERENCE:
+      continue;
+    case IR_CALL:
+      if (original->value.call.argument_count) {
+        size_t capacity = 1;
+        while (capacity < original->value.call.argument_count) { capacity *= 2; }
+        new_instruction->value.call.arguments = arena_allocate(&caller->arena, capacity * sizeof(IRInstruction *));
+        memcpy(new_instruction->value.call.arguments,
+               original->value.call.arguments,
+               original->value.call.argument_count * sizeof(IRInstruction *));
+      }
+      break;
+    case IR_PHI: {
+      IRPhiArgument **link = &new_instruction->value.phi_argument;
+      for (IRPhiArgument *argument = original->value.phi_argument; argument; argument = argument->next) {
+        IRPhiArgument *new_argument = arena_allocate(&caller->arena, sizeof(IRPhiArgument));
+        new_argument->value = argument->value;
+        new_argument->block = copy.blocks[argument->block->index];
+        *link = new_argument;
+        link = &new_argument->next;
+      }
+    } break;
+    case IR_RETURN:
+      new_instruction->type = IR_BRANCH;
+      new_instruction->value.block = continuation;
+      continue;
+    case IR_BRANCH:
+      new_instruction->value.block = copy.blocks[original->value.block->index];
+      continue;
+    case IR_BRANCH_CONDITIONAL:
+      new_instruction->value.conditional_branch.true_branch =
+        copy.blocks[original->value.conditional_branch.true_branch->index];
+      new_instruction->value.conditional_branch.false_branch =
+        copy.blocks[original->value.conditional_branch.false_branch->index];
+      break;
+    default:
+      break;
+    }
+    ir_for_each_operand(new_instruction, opt_map_operand, &copy);
+  }
+
+  IRInstruction *result = NULL;
+  if (callee->return_value && ir_is_value(callee->return_value)) {
+    result = copy.copies[callee->return_value->index];
+  }
+  block->branch->value.block = copy.blocks[0];
+
+  free(copy.blocks);
+  free(copy.copies);
+  opt_numbering_free(&copy.numbering);
+  return result;
+}
+
+/// Replace the call at POSITION in BLOCK of CALLER by the body of
+/// CALLEE. Return the block holding what came after the call.
+static IRBlock *opt_inline_call
+(Numbering *numbering,
+ IRFunction *caller,
+ IRBlock *block,
+ uint32_t position,
+ IRFunction *callee)
+{
+  IRInstruction *call = block->instructions[position];
+  // Everything after the call moves to a block of its own.
+  IRBlock *continuation = ir_block_create(caller);
+  continuation->branch = block->branch;
+  ir_move_instructions(caller, continuation, block, position + 1);
+  ir_remove_at(block, position);
+  continuation->next = block->next;
+  continuation->previous = block;
+  if (block->next) {
+    block->next->previous = continuation;
+  } else {
+    caller->last = continuation;
+  }
+  block->next = continuation;
+
+  IRBlock *successors[2];
+  size_t successor_count = ir_successors(continuation, successors);
+  for (size_t i = 0; i < successor_count; ++i) {
+    for (uint32_t j = 0; j < successors[i]->instruction_count; ++j) {
+      IRInstruction *phi = successors[i]->instructions[j];
+      if (phi->type != IR_PHI) { continue; }
+      for (IRPhiArgument *argument = phi->value.phi_argument; argument; argument = argument->next) {
+        if (argument->block == block) { argument->block = continuation; }
+      }
+    }
+  }
+
+  block->branch = ir_instruction_create(caller, IR_BRANCH);
+  IRInstruction *result = opt_copy_callee(caller, callee, block, continuation, &call->value.call);
+  if (!result) {
+    // A function without a return value returns zero.
+    result = ir_instruction_create(caller, IR_IMMEDIATE);
+    opt_prepend(caller, continuation, result);
+  }
+  numbering->replacement[call->index] = result;
+  return continuation;
+}
+
+/// Return non-zero iff CALL is worth replacing by the body of the
+/// function at position CALLEE of TABLE, when called from CALLER of
+/// size CALLER_SIZE.
+static char opt_should_inline
+(FunctionTable *table,
+ IRFunction *caller,
+ size_t caller_size,
+ IRInstruction *call,
+ size_t callee)
+{
+  IRFunction *function = table->functions[callee];
+  if (function == caller || !table->self_contained[callee]) { return 0; }
+  if (caller_size + table->sizes[callee] > OPT_INLINE_CALLER_LIMIT) { return 0; }
+  if (table->sizes[callee] > (table->calls[callee] == 1 ? OPT_INLINE_SINGLE_CALL_BUDGET : OPT_INLINE_BUDGET)) {
+    return 0;
+  }
+  // Every parameter must have been passed.
+  for (IRBlock *block = function->first; block; block = block->next) {
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      if (instruction->type == IR_PARAMETER_REFERENCE
+          && (instruction->value.immediate < 1
+              || (uint64_t)instruction->value.immediate > call->value.call.argument_count)) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+size_t opt_inline_calls(IRFunction *functions) {
+  FunctionTable table = {0};
+  opt_function_table(&table, functions);
+  table.calls = opt_allocate(table.count, sizeof(size_t));
+  table.sizes = opt_allocate(table.count, sizeof(size_t));
+  table.self_contained = opt_allocate(table.count, sizeof(char));
+
+  for (size_t i = 0; i < table.count; ++i) {
+    IRFunction *function = table.functions[i];
+    Numbering numbering = {0};
+    opt_number(&numbering, function);
+    table.sizes[i] = numbering.count;
+    // Nested functions that refer to locals of the function they are
+    // in can not be moved anywhere else.
+    ForeignCheck check = { &numbering, 0 };
+    for (size_t index = 0; index < numbering.count; ++index) {
+      ir_for_each_operand(numbering.instructions[index], opt_note_foreign, &check);
+    }
+    if (function->return_value) {
+      opt_note_foreign(&function->return_value, &check);
+    }
+    table.self_contained[i] = !check.foreign;
+    opt_numbering_free(&numbering);
+  }
+  for (IRFunction *function = functions; function; function = function->next) {
+    for (IRBlock *block = function->first; block; block = block->next) {
+      for (uint32_t i = 0; i < block->instruction_count; ++i) {
+        IRInstruction *instruction = block->instructions[i];
+        if (instruction->type != IR_CALL || instruction->value.call.type != IR_CALLTYPE_DIRECT) {
+          continue;
+        }
+        size_t callee = opt_find_function(&table, instruction->value.call.value.name);
+        if (callee != NO_INDEX) { table.calls[callee]++; }
+      }
+    }
+  }
+
+  size_t inlined = 0;
+  for (IRFunction *caller = functions; caller; caller = caller->next) {
+    Numbering numbering = {0};
+    opt_number(&numbering, caller);
+    size_t caller_size = numbering.count;
+
+    IRInstruction **calls = NULL;
+    size_t call_count = 0;
+    for (IRBlock *block = caller->first; block; block = block->next) {
+      uint32_t i = 0;
+      while (i < block->instruction_count) {
+        IRInstruction *instruction = block->instructions[i];
+        size_t callee = instruction->type == IR_CALL && instruction->value.call.type == IR_CALLTYPE_DIRECT
+          ? opt_find_function(&table, instruction->value.call.value.name)
+          : NO_INDEX;
+        if (callee != NO_INDEX && opt_should_inline(&table, caller, caller_size, instruction, callee)) {
+          if (!calls) { calls = opt_allocate(numbering.count, sizeof(IRInstruction *)); }
+          calls[call_count++] = instruction;
+          caller_size += table.sizes[callee];
+          // Carry on after the copy of the callee.
+          block = opt_inline_call(&numbering, caller, block, i, table.functions[callee]);
+          i = 0;
+          continue;
+        }
+        i++;
+      }
+    }
+
+    if (call_count) {
+      opt_resolve_function(&numbering, caller);
+      for (size_t i = 0; i < call_count; ++i) {
+        ir_free_instruction(caller, calls[i]);
+      }
+      ir_set_predecessors(caller);
+      inlined += call_count;
+    }
+    free(calls);
+    opt_numbering_free(&numbering);
+  }
+
+  opt_function_table_free(&table);
+  return inlined;
+}
+
+typedef struct OptimizationStatistics {
+  size_t promoted;
+  size_t folded;
+  size_t redundant;
+  size_t hoisted;
+  size_t reduced;
+  size_t dead;
+  size_t tail_calls;
+} OptimizationStatistics;
+
+/// Run every pass that works on one function at a time on FUNCTION.
+static void opt_function(IRFunction *function, OptimizationStatistics *statistics) {
+  statistics->promoted += opt_mem2reg(function);
+  statistics->folded += opt_fold_constants(function);
+  statistics->redundant += opt_number_values_globally(function);
+  statistics->hoisted += opt_hoist_loop_invariants(function);
+  statistics->reduced += opt_reduce_loop_strength(function);
+  statistics->dead += opt_eliminate_dead_code(function);
+}
+
+static void opt_eliminate_function_tail_calls(IRFunction *function, OptimizationStatistics *statistics) {
+  statistics->tail_calls += opt_eliminate_tail_calls(function);
+}
+
+/// A pass that is run on every function, each on whichever worker
+/// gets to it first.
+typedef struct OptimizationJob {
+  void (*pass)(IRFunction *, OptimizationStatistics *);
+  IRFunction **functions;
+  /// What the pass did to each function, by index.
+  OptimizationStatistics *statistics;
+} OptimizationJob;
+
+static void opt_function_task(void *data, size_t worker, size_t index) {
+  (void)worker;
+  OptimizationJob *job = data;
+  job->pass(job->functions[index], job->statistics + index);
+}
+
+/// Run PASS on every one of FUNCTIONS, at the same time if they do not
+/// refer to each other's instructions, and add up what it did.
+static void opt_each_function
+(IRFunction *functions,
+ void (*pass)(IRFunction *, OptimizationStatistics *),
+ OptimizationStatistics *statistics)
+{
+  size_t count = 0;
+  for (IRFunction *function = functions; function; function = function->next) { count++; }
+
+  OptimizationJob job;
+  job.pass = pass;
+  job.functions = opt_allocate(count, sizeof(IRFunction *));
+  job.statistics = opt_allocate(count, sizeof(OptimizationStatistics));
+  size_t index = 0;
+  for (IRFunction *function = functions; function; function = function->next) {
+    job.functions[index++] = function;
+  }
+
+  size_t workers = worker_pool_size(codegen_jobs, count);
+  if (workers > 1 && !ir_functions_self_contained(functions)) { workers = 1; }
+  worker_pool_run(workers, count, opt_function_task, &job);
+
+  for (index = 0; index < count; ++index) {
+    statistics->promoted += job.statistics[index].promoted;
+    statistics->folded += job.statistics[index].folded;
+    statistics->redundant += job.statistics[index].redundant;
+    statistics->hoisted += job.statistics[index].hoisted;
+    statistics->reduced += job.statistics[index].reduced;
+    statistics->dead += job.statistics[index].dead;
+    statistics->tail_calls += job.statistics[index].tail_calls;
+  }
+  free(job.functions);
+  free(job.statistics);
+}
+
+void codegen_optimize(CodegenContext *context) {
+  if (context->optimization_level < 1) { return; }
+
+  OptimizationStatistics statistics = {0};
+  opt_each_function(context->function, opt_function, &statistics);
+
+  // Knowing what is called exposes more to optimize in the caller,
+  // so go over the functions that changed once more.
+  size_t resolved = opt_resolve_calls(context->function);
+  opt_each_function(context->function, opt_eliminate_function_tail_calls, &statistics);
+  size_t tail_calls = statistics.tail_calls;
+  size_t inlined = context->optimization_level >= 2 ? opt_inline_calls(context->function) : 0;
+  if (resolved || tail_calls || inlined) {
+    opt_each_function(context->function, opt_function, &statistics);
+  }
+
+  if (codegen_statistics) {
+    fprintf(stderr, "Made %zu calls direct, eliminated %zu tail calls, and inlined %zu.\n",
+            resolved, tail_calls, inlined);
+    fprintf(stderr, "Promoted %zu locals to SSA values.\n", statistics.promoted);
+    fprintf(stderr, "Constant folding removed %zu instructions.\n", statistics.folded);
+    fprintf(stderr, "Value numbering removed %zu instructions.\n", statistics.redundant);
+    fprintf(stderr, "Hoisted %zu instructions out of loops, and strength-reduced %zu multiplications.\n",
+            statistics.hoisted, statistics.reduced);
+    fprintf(stderr, "Dead code elimination removed %zu instructions.\n", statistics.dead);
+  }
+}
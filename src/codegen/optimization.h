@@ -0,0 +1,128 @@
+#ifndef OPTIMIZATION_H
+#define OPTIMIZATION_H
+
+#include <codegen/codegen_forward.h>
+#include <stddef.h>
+
+/** Fold constants and simplify algebraic identities in FUNCTION.
+ *
+ * Arithmetic and comparisons whose operands are all immediates become
+ * immediates. Identities like `x + 0`, `x * 1`, `x - x` and `x << 0`
+ * are simplified, and multiplication by a power of two becomes a left
+ * shift. A phi whose arguments are all the same value, or immediates
+ * of the same value, is replaced by that value.
+ *
+ * Instructions that are left without uses by this are removed.
+ *
+ * @return The number of instructions removed.
+ */
+size_t opt_fold_constants(IRFunction *function);
+
+/** Promote locals of FUNCTION that live on the stack to SSA values.
+ *
+ * Stack allocations of at most eight bytes, and parameters that are
+ * assigned to, are promoted unless something other than a load or a
+ * store refers to them, such as taking their address. Phis are placed
+ * at the iterated dominance frontier of the stores, and loads are
+ * replaced by the value stored last on the way through the dominator
+ * tree.
+ *
+ * @return The number of locals promoted.
+ */
+size_t opt_mem2reg(IRFunction *function);
+
+/** Replace instructions of FUNCTION that recompute a value which is
+ * already available by that value.
+ *
+ * This is value numbering over a hash table scoped to the dominator
+ * tree: a value is available in every block that its own block
+ * dominates. Loads only match loads of the same state of memory, and
+ * every call and store starts a new one, as does every block that
+ * can be entered from more than one place. Locals whose address is
+ * never taken are only changed by storing to them.
+ *
+ * @return The number of instructions removed.
+ */
+size_t opt_number_values_globally(IRFunction *function);
+
+/** Move computations that give the same result every time around a
+ * loop of FUNCTION to right before the loop.
+ *
+ * Arithmetic on values from outside the loop, the addresses of locals
+ * and globals, and loads of locals that are not stored to in the loop
+ * and whose address is never taken, are computed once in a preheader
+ * instead: a block that branches nowhere but into the loop, which is
+ * split off the edge into it if need be. Division is only moved if the
+ * divisor is a constant it can not trap on. Inner loops go first, so
+ * that an invariant can make its way out of several.
+ *
+ * @return The number of instructions moved.
+ */
+size_t opt_hoist_loop_invariants(IRFunction *function);
+
+/** Replace multiplications of an induction variable of a loop of
+ * FUNCTION by a constant with an addition each time around.
+ *
+ * An induction variable is a phi at the head of the loop that a
+ * constant is added to or subtracted from on the way back around.
+ *
+ * @return The number of multiplications replaced.
+ */
+size_t opt_reduce_loop_strength(IRFunction *function);
+
+/** Remove code from FUNCTION that does not affect what it does.
+ *
+ * Conditional branches on a constant become unconditional, and blocks
+ * that can not be reached any more are dropped. A block that is the
+ * only successor of its only predecessor is merged into it. Finally,
+ * instructions without side effects whose results are never used are
+ * swept away.
+ *
+ * @return The number of instructions removed, counting branches.
+ */
+size_t opt_eliminate_dead_code(IRFunction *function);
+
+/** Turn indirect calls in the list FUNCTIONS whose callee is known
+ * into direct calls to its label.
+ *
+ * The callee is known if it is the address of a function, or a global
+ * that only ever has the address of one function stored to it, and
+ * whose address is never taken.
+ *
+ * @return The number of calls made direct.
+ */
+size_t opt_resolve_calls(IRFunction *functions);
+
+/** Turn calls of FUNCTION to itself whose result it returns into a
+ * branch back to its start.
+ *
+ * The arguments are stored to the parameters instead, and the old
+ * entry block becomes the head of a loop. A result that is added to or
+ * multiplied by something before it is returned, as in `n * fact(n - 1)`,
+ * is accumulated on the way in instead. Functions that take the
+ * address of a local are left alone, as every call would have had its
+ * own copy of it.
+ *
+ * @return The number of calls eliminated.
+ */
+size_t opt_eliminate_tail_calls(IRFunction *function);
+
+/** Replace direct calls in the list FUNCTIONS by a copy of the body of
+ * the function they call.
+ *
+ * Small functions are inlined anywhere, and larger ones if they are
+ * called from one place only. Parameters of the copy become stack
+ * allocations that the arguments are stored in, for opt_mem2reg() to
+ * turn into the arguments themselves. Recursive calls, and nested
+ * functions that refer to locals of the function they are in, are
+ * left alone.
+ *
+ * @return The number of calls inlined.
+ */
+size_t opt_inline_calls(IRFunction *functions);
+
+/// Optimize every function of CONTEXT, as hard as its optimization
+/// level asks for.
+void codegen_optimize(CodegenContext *context);
+
+#endif /* OPTIMIZATION_H */
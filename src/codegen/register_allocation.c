@@ -0,0 +1,888 @@
+#include <codegen/register_allocation.h>
+
+#include <codegen/intermediate_representation.h>
+#include <error.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// The part of a function's instructions, in layout order, during
+/// which a value has to be kept alive.
+typedef struct LiveInterval {
+  IRInstruction *value;
+  size_t start;
+  size_t end;
+  /// Index into the allocatable registers, if not spilled.
+  size_t reg;
+} LiveInterval;
+
+/// Instruction indices of values, in increasing order.
+typedef struct LiveSet {
+  size_t *values;
+  size_t count;
+  size_t capacity;
+} LiveSet;
+
+typedef struct BlockLiveness {
+  IRBlock *block;
+  /// Index of the first instruction and of the branch of the block.
+  size_t first;
+  size_t last;
+  LiveSet live_in;
+  LiveSet live_out;
+  /// The value last added to live_in and live_out, so that none is
+  /// added twice.
+  size_t last_in;
+  size_t last_out;
+} BlockLiveness;
+
+/// A use of a value outside of the block that defines it.
+typedef struct BlockUse {
+  /// Instruction index of the value.
+  size_t value;
+  /// Index of the block the value is used in.
+  size_t block;
+  /// Non-zero iff a phi uses the value, in which case it is used at
+  /// the end of the block.
+  char phi;
+} BlockUse;
+
+typedef struct Liveness {
+  IRInstruction **instructions;
+  size_t instruction_count;
+  /// Number of uint64_t in a bit set over instruction indices.
+  size_t words;
+
+  BlockLiveness *blocks;
+  size_t block_count;
+  /// Block index for every instruction index.
+  size_t *block_of;
+
+  size_t *start;
+  size_t *end;
+
+  BlockUse *uses;
+  size_t use_count;
+  size_t use_capacity;
+} Liveness;
+
+#define BIT_SET(set, bit)  ((set)[(bit) / 64] |= (uint64_t)1 << ((bit) % 64))
+#define BIT_TEST(set, bit) (((set)[(bit) / 64] >> ((bit) % 64)) & 1)
+
+/// Marks a block whose live sets nothing has been added to yet.
+#define NO_VALUE SIZE_MAX
+
+static void *ra_allocate(size_t count, size_t size) {
+  void *memory = calloc(count ? count : 1, size);
+  ASSERT(memory, "Could not allocate memory for register allocation.");
+  return memory;
+}
+
+static void ra_live_set_add(LiveSet *set, size_t value) {
+  if (set->count == set->capacity) {
+    set->capacity = set->capacity ? set->capacity * 2 : 4;
+    set->values = realloc(set->values, set->capacity * sizeof(size_t));
+    ASSERT(set->values, "Could not grow live set.");
+  }
+  set->values[set->count++] = value;
+}
+
+/// Number every instruction of FUNCTION in layout order.
+static void ra_number(Liveness *liveness, IRFunction *function) {
+  size_t instruction_count = 0;
+  size_t block_count = 0;
+  for (IRBlock *block = function->first; block; block = block->next) {
+    ASSERT(block->branch, "Every block must end with a branch before register allocation.");
+    instruction_count += block->instruction_count + 1;
+    block_count++;
+  }
+
+  liveness->instruction_count = instruction_count;
+  liveness->words = (instruction_count + 63) / 64;
+  liveness->instructions = ra_allocate(instruction_count, sizeof(IRInstruction *));
+  liveness->block_of = ra_allocate(instruction_count, sizeof(size_t));
+  liveness->block_count = block_count;
+  liveness->blocks = ra_allocate(block_count, sizeof(BlockLiveness));
+
+  size_t index = 0;
+  size_t block_index = 0;
+  for (IRBlock *block = function->first; block; block = block->next) {
+    BlockLiveness *info = liveness->blocks + block_index;
+    info->block = block;
+    info->first = index;
+    info->last_in = NO_VALUE;
+    info->last_out = NO_VALUE;
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      instruction->index = index;
+      liveness->instructions[index] = instruction;
+      liveness->block_of[index++] = block_index;
+    }
+    block->branch->index = index;
+    liveness->instructions[index] = block->branch;
+    liveness->block_of[index] = block_index;
+    info->last = index++;
+    block_index++;
+  }
+}
+
+static BlockLiveness *ra_block(Liveness *liveness, IRBlock *block) {
+  return liveness->blocks + liveness->block_of[block->branch->index];
+}
+
+/// Return non-zero iff VALUE is a value defined in the function
+/// described by LIVENESS.
+static char ra_tracked(Liveness *liveness, IRInstruction *value) {
+  if (!value || !ir_is_value(value)) { return 0; }
+  ASSERT(value->index < liveness->instruction_count
+         && liveness->instructions[value->index] == value,
+         "Instruction %%%zu uses a value from outside of its function.", value->id);
+  return 1;
+}
+
+static void ra_add_block_use(Liveness *liveness, size_t value, size_t block, char phi) {
+  if (liveness->use_count == liveness->use_capacity) {
+    liveness->use_capacity = liveness->use_capacity ? liveness->use_capacity * 2 : 64;
+    liveness->uses = realloc(liveness->uses, liveness->use_capacity * sizeof(BlockUse));
+    ASSERT(liveness->uses, "Could not grow list of uses.");
+  }
+  liveness->uses[liveness->use_count++] = (BlockUse){ value, block, phi };
+}
+
+typedef struct UseVisitor {
+  Liveness *liveness;
+  size_t index;
+} UseVisitor;
+
+static void ra_record_use(IRInstruction **operand, void *data) {
+  UseVisitor *visitor = data;
+  Liveness *liveness = visitor->liveness;
+  IRInstruction *value = *operand;
+  if (!ra_tracked(liveness, value)) { return; }
+  size_t block = liveness->block_of[visitor->index];
+  if (liveness->block_of[value->index] != block) {
+    ra_add_block_use(liveness, value->index, block, 0);
+  }
+  if (liveness->end[value->index] < visitor->index) {
+    liveness->end[value->index] = visitor->index;
+  }
+}
+
+/// Extend intervals over the uses of values within their own block,
+/// and collect the uses in other blocks. Uses by phis count as uses at
+/// the end of the predecessor that the value flows in from.
+static void ra_local_liveness(Liveness *liveness, IRFunction *function) {
+  UseVisitor visitor = { liveness, 0 };
+  for (size_t index = 0; index < liveness->instruction_count; ++index) {
+    IRInstruction *instruction = liveness->instructions[index];
+    visitor.index = index;
+    if (instruction->type == IR_PHI) {
+      for (IRPhiArgument *argument = instruction->value.phi_argument;
+           argument;
+           argument = argument->next
+           ) {
+        if (!ra_tracked(liveness, argument->value)) { continue; }
+        BlockLiveness *predecessor = ra_block(liveness, argument->block);
+        ra_add_block_use(liveness, argument->value->index,
+                         (size_t)(predecessor - liveness->blocks), 1);
+        // The copy into the phi happens at the end of the predecessor.
+        if (liveness->start[index] > predecessor->last) {
+          liveness->start[index] = predecessor->last;
+        }
+      }
+    } else if (instruction->type == IR_RETURN) {
+      ra_record_use(&function->return_value, &visitor);
+    } else {
+      ir_for_each_operand(instruction, ra_record_use, &visitor);
+    }
+  }
+}
+
+static int ra_compare_block_uses(const void *a, const void *b) {
+  const BlockUse *lhs = a;
+  const BlockUse *rhs = b;
+  if (lhs->value != rhs->value) { return lhs->value < rhs->value ? -1 : 1; }
+  if (lhs->block != rhs->block) { return lhs->block < rhs->block ? -1 : 1; }
+  return (lhs->phi > rhs->phi) - (lhs->phi < rhs->phi);
+}
+
+/** Find the blocks each value is live into and out of.
+ *
+ * Starting from every block a value is used in, walk up through the
+ * predecessors until reaching the block that defines it; the value is
+ * live into every block on the way, and out of each of their
+ * predecessors. This only ever touches blocks the value is live in,
+ * so the live sets take as much memory as there is liveness, rather
+ * than a bit for every value in every block.
+ */
+static void ra_global_liveness(Liveness *liveness, IRFunction *function) {
+  ir_set_predecessors(function);
+  // Going through the uses value by value keeps every live set sorted,
+  // and lets last_in and last_out stand in for a lookup.
+  if (liveness->use_count) {
+    qsort(liveness->uses, liveness->use_count, sizeof(BlockUse), ra_compare_block_uses);
+  }
+
+  size_t *worklist = ra_allocate(liveness->block_count, sizeof(size_t));
+  for (size_t u = 0; u < liveness->use_count; ++u) {
+    size_t value = liveness->uses[u].value;
+    size_t definition = liveness->block_of[value];
+    size_t block = liveness->uses[u].block;
+    if (liveness->uses[u].phi) {
+      BlockLiveness *info = liveness->blocks + block;
+      if (info->last_out != value) {
+        info->last_out = value;
+        ra_live_set_add(&info->live_out, value);
+      }
+      if (block == definition) { continue; }
+    }
+
+    // Blocks are added to live_in as they are queued, so that each is
+    // queued at most once per value.
+    BlockLiveness *info = liveness->blocks + block;
+    if (info->last_in == value) { continue; }
+    info->last_in = value;
+    ra_live_set_add(&info->live_in, value);
+    size_t work = 0;
+    worklist[work++] = block;
+    while (work) {
+      info = liveness->blocks + worklist[--work];
+      for (uint32_t p = 0; p < info->block->predecessor_count; ++p) {
+        BlockLiveness *predecessor = ra_block(liveness, info->block->predecessors[p]);
+        if (predecessor->last_out != value) {
+          predecessor->last_out = value;
+          ra_live_set_add(&predecessor->live_out, value);
+        }
+        size_t index = (size_t)(predecessor - liveness->blocks);
+        if (index != definition && predecessor->last_in != value) {
+          predecessor->last_in = value;
+          ra_live_set_add(&predecessor->live_in, value);
+          worklist[work++] = index;
+        }
+      }
+    }
+  }
+  free(worklist);
+
+  free(liveness->uses);
+  liveness->uses = NULL;
+  liveness->use_count = 0;
+  liveness->use_capacity = 0;
+}
+
+/// Compute block liveness for FUNCTION. Intervals start out covering
+/// only the definition and uses within the defining block.
+static void ra_liveness(Liveness *liveness, IRFunction *function) {
+  ra_number(liveness, function);
+  size_t count = liveness->instruction_count;
+  liveness->start = ra_allocate(count, sizeof(size_t));
+  liveness->end = ra_allocate(count, sizeof(size_t));
+  for (size_t index = 0; index < count; ++index) {
+    liveness->start[index] = index;
+    liveness->end[index] = index;
+  }
+  ra_local_liveness(liveness, function);
+  ra_global_liveness(liveness, function);
+}
+
+static void ra_liveness_free(Liveness *liveness) {
+  for (size_t b = 0; b < liveness->block_count; ++b) {
+    free(liveness->blocks[b].live_in.values);
+    free(liveness->blocks[b].live_out.values);
+  }
+  free(liveness->blocks);
+  free(liveness->block_of);
+  free(liveness->instructions);
+  free(liveness->start);
+  free(liveness->end);
+}
+
+/// Widen the interval of every value to cover each block it is live
+/// into or out of.
+static void ra_build_intervals(Liveness *liveness) {
+  for (size_t b = 0; b < liveness->block_count; ++b) {
+    BlockLiveness *info = liveness->blocks + b;
+    for (size_t i = 0; i < info->live_in.count; ++i) {
+      size_t index = info->live_in.values[i];
+      if (liveness->start[index] > info->first) { liveness->start[index] = info->first; }
+    }
+    for (size_t i = 0; i < info->live_out.count; ++i) {
+      size_t index = info->live_out.values[i];
+      if (liveness->end[index] < info->last) { liveness->end[index] = info->last; }
+    }
+  }
+}
+
+static int ra_compare_intervals(const void *a, const void *b) {
+  const LiveInterval *lhs = a;
+  const LiveInterval *rhs = b;
+  if (lhs->start != rhs->start) { return lhs->start < rhs->start ? -1 : 1; }
+  if (lhs->value->index != rhs->value->index) {
+    return lhs->value->index < rhs->value->index ? -1 : 1;
+  }
+  return 0;
+}
+
+typedef struct SpillSlots {
+  /// End of the interval last spilled to each slot.
+  size_t *end;
+  size_t count;
+  size_t capacity;
+} SpillSlots;
+
+static void ra_spill(SpillSlots *slots, LiveInterval *interval) {
+  // Reuse a slot whose previous occupant is dead by the time this
+  // interval begins.
+  size_t slot = 0;
+  while (slot < slots->count && slots->end[slot] >= interval->start) {
+    ++slot;
+  }
+  if (slot == slots->count) {
+    if (slots->count == slots->capacity) {
+      slots->capacity = slots->capacity ? slots->capacity * 2 : 8;
+      slots->end = realloc(slots->end, slots->capacity * sizeof(size_t));
+      ASSERT(slots->end, "Could not grow spill slots.");
+    }
+    slots->count++;
+  }
+  slots->end[slot] = interval->end;
+  interval->value->spill_slot = slot + 1;
+}
+
+void ra_linear_scan(IRFunction *function, const RegisterAllocationTarget *target) {
+  ASSERT(target->register_count <= 64, "Linear scan supports at most 64 registers.");
+
+  Liveness liveness = {0};
+  ra_liveness(&liveness, function);
+  ra_build_intervals(&liveness);
+  size_t count = liveness.instruction_count;
+
+  // calls_before[i] is the number of calls at an index below i.
+  size_t *calls_before = ra_allocate(count + 1, sizeof(size_t));
+  for (size_t index = 0; index < count; ++index) {
+    calls_before[index + 1] = calls_before[index]
+      + (liveness.instructions[index]->type == IR_CALL);
+  }
+
+  LiveInterval *intervals = ra_allocate(count, sizeof(LiveInterval));
+  size_t interval_count = 0;
+  for (size_t index = 0; index < count; ++index) {
+    IRInstruction *instruction = liveness.instructions[index];
+    instruction->spill_slot = 0;
+    if (!ir_is_value(instruction)) { continue; }
+    LiveInterval *interval = intervals + interval_count++;
+    interval->value = instruction;
+    interval->start = liveness.start[index];
+    interval->end = liveness.end[index];
+  }
+  qsort(intervals, interval_count, sizeof(LiveInterval), ra_compare_intervals);
+
+  // Intervals currently holding a register, sorted by end.
+  LiveInterval **active = ra_allocate(target->register_count, sizeof(LiveInterval *));
+  size_t active_count = 0;
+  uint64_t free_registers = target->register_count == 64
+    ? ~(uint64_t)0
+    : ((uint64_t)1 << target->register_count) - 1;
+  SpillSlots slots = {0};
+
+  for (size_t i = 0; i < interval_count; ++i) {
+    LiveInterval *interval = intervals + i;
+
+    // Expire intervals that ended before this one starts.
+    size_t expired = 0;
+    while (expired < active_count && active[expired]->end < interval->start) {
+      free_registers |= (uint64_t)1 << active[expired]->reg;
+      ++expired;
+    }
+    memmove(active, active + expired, (active_count - expired) * sizeof(LiveInterval *));
+    active_count -= expired;
+
+    // Calls clobber every register we hand out.
+    if (interval->end > interval->start + 1
+        && calls_before[interval->end] > calls_before[interval->start + 1]) {
+      ra_spill(&slots, interval);
+      continue;
+    }
+
+    if (!free_registers) {
+      // Keep whichever of this and the active intervals ends first.
+      LiveInterval *last = active_count ? active[active_count - 1] : NULL;
+      if (!last || last->end <= interval->end) {
+        ra_spill(&slots, interval);
+        continue;
+      }
+      ra_spill(&slots, last);
+      free_registers |= (uint64_t)1 << last->reg;
+      --active_count;
+    }
+
+    size_t reg = 0;
+    while (!(free_registers & ((uint64_t)1 << reg))) { ++reg; }
+    free_registers &= ~((uint64_t)1 << reg);
+    interval->reg = reg;
+
+    size_t position = active_count;
+    while (position > 0 && active[position - 1]->end > interval->end) {
+      active[position] = active[position - 1];
+      --position;
+    }
+    active[position] = interval;
+    ++active_count;
+  }
+
+  function->registers_used = 0;
+  for (size_t i = 0; i < interval_count; ++i) {
+    if (!intervals[i].value->spill_slot) {
+      intervals[i].value->result = target->registers[intervals[i].reg];
+      function->registers_used |= (uint64_t)1 << intervals[i].value->result;
+    }
+  }
+  function->spill_slots = slots.count;
+
+  ra_liveness_free(&liveness);
+  free(calls_before);
+  free(intervals);
+  free(active);
+  free(slots.end);
+}
+
+//================================================================ BEG graph coloring
+
+#define NO_NODE SIZE_MAX
+
+static size_t ra_popcount(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+  return (size_t)__builtin_popcountll(bits);
+#else
+  size_t count = 0;
+  for (; bits; bits &= bits - 1) { ++count; }
+  return count;
+#endif
+}
+
+static size_t ra_lowest_bit(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+  return (size_t)__builtin_ctzll(bits);
+#else
+  size_t bit = 0;
+  while (!(bits & 1)) { bits >>= 1; ++bit; }
+  return bit;
+#endif
+}
+
+/// Call BODY with INDEX bound to every bit set in the bit set SET of
+/// WORDS words.
+#define FOR_EACH_BIT(index, set, words, ...)                          \
+  for (size_t word_ = 0; word_ < (words); ++word_) {                  \
+    for (uint64_t bits_ = (set)[word_]; bits_; bits_ &= bits_ - 1) {  \
+      size_t index = word_ * 64 + ra_lowest_bit(bits_);               \
+      __VA_ARGS__                                                     \
+    }                                                                 \
+  }
+
+typedef struct Move {
+  size_t phi;
+  size_t argument;
+} Move;
+
+typedef struct InterferenceGraph {
+  size_t node_count;
+  /// Number of uint64_t in each row of the adjacency matrix.
+  size_t words;
+  uint64_t *matrix;
+  /// Node of every instruction index, or NO_NODE.
+  size_t *node_of;
+  IRInstruction **values;
+  /// Bit set of colors each node may take.
+  uint64_t *allowed;
+  /// Number of definitions and uses, as an estimate of spill cost.
+  size_t *cost;
+  /// Node that this node was coalesced into, or itself.
+  size_t *alias;
+
+  Move *moves;
+  size_t move_count;
+  size_t move_capacity;
+} InterferenceGraph;
+
+static uint64_t *ig_row(InterferenceGraph *graph, size_t node) {
+  return graph->matrix + node * graph->words;
+}
+
+static void ig_add_edge(InterferenceGraph *graph, size_t a, size_t b) {
+  if (a == b) { return; }
+  BIT_SET(ig_row(graph, a), b);
+  BIT_SET(ig_row(graph, b), a);
+}
+
+static size_t ig_find(InterferenceGraph *graph, size_t node) {
+  while (graph->alias[node] != node) {
+    graph->alias[node] = graph->alias[graph->alias[node]];
+    node = graph->alias[node];
+  }
+  return node;
+}
+
+static size_t ig_degree(InterferenceGraph *graph, size_t node) {
+  uint64_t *row = ig_row(graph, node);
+  size_t degree = 0;
+  for (size_t w = 0; w < graph->words; ++w) {
+    degree += ra_popcount(row[w]);
+  }
+  return degree;
+}
+
+/// Make NODE interfere with every value in the instruction index bit
+/// set LIVE, except for the value at index EXCEPT.
+static void ig_interfere_with_live
+(InterferenceGraph *graph,
+ Liveness *liveness,
+ size_t node,
+ const uint64_t *live,
+ size_t except
+ )
+{
+  FOR_EACH_BIT(index, live, liveness->words, {
+    if (index != except && graph->node_of[index] != NO_NODE) {
+      ig_add_edge(graph, node, graph->node_of[index]);
+    }
+  })
+}
+
+/// Set LIVE, a bit set over instruction indices, to the values that
+/// are live out of the block described by INFO.
+static void ra_set_live_out(Liveness *liveness, BlockLiveness *info, uint64_t *live) {
+  memset(live, 0, liveness->words * sizeof(uint64_t));
+  for (size_t i = 0; i < info->live_out.count; ++i) {
+    BIT_SET(live, info->live_out.values[i]);
+  }
+}
+
+typedef struct LiveUpdate {
+  InterferenceGraph *graph;
+  Liveness *liveness;
+  uint64_t *live;
+} LiveUpdate;
+
+static void ig_record_use(IRInstruction **operand, void *data) {
+  LiveUpdate *update = data;
+  if (!ra_tracked(update->liveness, *operand)) { return; }
+  BIT_SET(update->live, (*operand)->index);
+  update->graph->cost[update->graph->node_of[(*operand)->index]]++;
+}
+
+/// Record that the phis of SUCCESSOR are copied into at the end of the
+/// block described by INFO, where LIVE is live.
+static void ig_phi_copies
+(InterferenceGraph *graph,
+ Liveness *liveness,
+ BlockLiveness *info,
+ IRBlock *successor,
+ uint64_t *live
+ )
+{
+  for (uint32_t i = 0; i < successor->instruction_count; ++i) {
+    IRInstruction *phi = successor->instructions[i];
+    if (phi->type != IR_PHI) { continue; }
+    for (IRPhiArgument *argument = phi->value.phi_argument;
+         argument;
+         argument = argument->next
+         ) {
+      if (argument->block != info->block) { continue; }
+      size_t node = graph->node_of[phi->index];
+      size_t except = NO_NODE;
+      if (ra_tracked(liveness, argument->value)) {
+        except = argument->value->index;
+        if (graph->move_count == graph->move_capacity) {
+          graph->move_capacity = graph->move_capacity ? graph->move_capacity * 2 : 16;
+          graph->moves = realloc(graph->moves, graph->move_capacity * sizeof(Move));
+          ASSERT(graph->moves, "Could not grow list of moves.");
+        }
+        graph->moves[graph->move_count++] = (Move){ node, graph->node_of[except] };
+      }
+      // A phi and its own argument hold the same value at the copy,
+      // so they may share a location.
+      ig_interfere_with_live(graph, liveness, node, live, except);
+      // Later phis of the same successor are copied into at the same
+      // time, so they interfere with this one.
+      BIT_SET(live, phi->index);
+      graph->cost[node]++;
+    }
+  }
+}
+
+static void ig_build
+(InterferenceGraph *graph,
+ Liveness *liveness,
+ IRFunction *function,
+ uint64_t preserved_colors
+ )
+{
+  size_t count = liveness->instruction_count;
+  graph->node_of = ra_allocate(count, sizeof(size_t));
+  graph->values = ra_allocate(count, sizeof(IRInstruction *));
+  for (size_t index = 0; index < count; ++index) {
+    graph->node_of[index] = NO_NODE;
+    if (ir_is_value(liveness->instructions[index])) {
+      graph->values[graph->node_count] = liveness->instructions[index];
+      graph->node_of[index] = graph->node_count++;
+    }
+  }
+
+  graph->words = (graph->node_count + 63) / 64;
+  graph->matrix = ra_allocate(graph->node_count * graph->words, sizeof(uint64_t));
+  graph->allowed = ra_allocate(graph->node_count, sizeof(uint64_t));
+  graph->cost = ra_allocate(graph->node_count, sizeof(size_t));
+  graph->alias = ra_allocate(graph->node_count, sizeof(size_t));
+  for (size_t node = 0; node < graph->node_count; ++node) {
+    graph->allowed[node] = ~(uint64_t)0;
+    graph->alias[node] = node;
+  }
+
+  uint64_t *live = ra_allocate(liveness->words, sizeof(uint64_t));
+  LiveUpdate update = { graph, liveness, live };
+  for (size_t b = 0; b < liveness->block_count; ++b) {
+    BlockLiveness *info = liveness->blocks + b;
+    IRInstruction *branch = info->block->branch;
+
+    ra_set_live_out(liveness, info, live);
+    if (branch->type == IR_BRANCH) {
+      ig_phi_copies(graph, liveness, info, branch->value.block, live);
+      ra_set_live_out(liveness, info, live);
+    } else if (branch->type == IR_BRANCH_CONDITIONAL) {
+      ig_phi_copies(graph, liveness, info, branch->value.conditional_branch.true_branch, live);
+      ra_set_live_out(liveness, info, live);
+      ig_phi_copies(graph, liveness, info, branch->value.conditional_branch.false_branch, live);
+      ra_set_live_out(liveness, info, live);
+    }
+
+    // Walk the block backwards, keeping track of what is live.
+    for (size_t index = info->last + 1; index-- > info->first;) {
+      IRInstruction *instruction = liveness->instructions[index];
+      if (ir_is_value(instruction)) {
+        size_t node = graph->node_of[index];
+        ig_interfere_with_live(graph, liveness, node, live, index);
+        live[index / 64] &= ~((uint64_t)1 << (index % 64));
+        graph->cost[node]++;
+        if (instruction->type == IR_CALL) {
+          FOR_EACH_BIT(across, live, liveness->words, {
+            graph->allowed[graph->node_of[across]] &= preserved_colors;
+          })
+        }
+      }
+      if (instruction->type == IR_PHI) { continue; }
+      if (instruction->type == IR_RETURN) {
+        ig_record_use(&function->return_value, &update);
+      } else {
+        ir_for_each_operand(instruction, ig_record_use, &update);
+      }
+    }
+  }
+  free(live);
+}
+
+/// Merge phis with their arguments wherever Briggs' test says that
+/// the merged node will still be colorable.
+static void ig_coalesce(InterferenceGraph *graph) {
+  uint64_t *neighbours = ra_allocate(graph->words, sizeof(uint64_t));
+  char changed = 1;
+  while (changed) {
+    changed = 0;
+    for (size_t m = 0; m < graph->move_count; ++m) {
+      size_t x = ig_find(graph, graph->moves[m].phi);
+      size_t y = ig_find(graph, graph->moves[m].argument);
+      if (x == y || BIT_TEST(ig_row(graph, x), y)) { continue; }
+      uint64_t allowed = graph->allowed[x] & graph->allowed[y];
+      size_t colors = ra_popcount(allowed);
+      if (!colors) { continue; }
+
+      uint64_t *row_x = ig_row(graph, x);
+      uint64_t *row_y = ig_row(graph, y);
+      for (size_t w = 0; w < graph->words; ++w) {
+        neighbours[w] = row_x[w] | row_y[w];
+      }
+      size_t significant = 0;
+      FOR_EACH_BIT(neighbour, neighbours, graph->words, {
+        if (ig_degree(graph, neighbour) >= ra_popcount(graph->allowed[neighbour])) {
+          ++significant;
+        }
+      })
+      if (significant >= colors) { continue; }
+
+      // Fold Y into X.
+      FOR_EACH_BIT(neighbour, row_y, graph->words, {
+        uint64_t *row = ig_row(graph, neighbour);
+        row[y / 64] &= ~((uint64_t)1 << (y % 64));
+        ig_add_edge(graph, x, neighbour);
+      })
+      memset(row_y, 0, graph->words * sizeof(uint64_t));
+      graph->alias[y] = x;
+      graph->allowed[x] = allowed;
+      graph->cost[x] += graph->cost[y];
+      changed = 1;
+    }
+  }
+  free(neighbours);
+}
+
+/// Functions with more values than this are allocated with linear
+/// scan, as the interference matrix grows with the square of the
+/// number of values (8 MiB at this size).
+#define GRAPH_COLORING_MAX_VALUES 8192
+
+static size_t ra_count_values(IRFunction *function) {
+  size_t count = 0;
+  for (IRBlock *block = function->first; block; block = block->next) {
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      if (ir_is_value(instruction)) { count++; }
+    }
+    if (block->branch && ir_is_value(block->branch)) { count++; }
+  }
+  return count;
+}
+
+void ra_graph_coloring(IRFunction *function, const RegisterAllocationTarget *target) {
+  if (ra_count_values(function) > GRAPH_COLORING_MAX_VALUES) {
+    ra_linear_scan(function, target);
+    return;
+  }
+
+  size_t color_count = target->register_count + target->preserved_register_count;
+  ASSERT(color_count <= 64, "Graph coloring supports at most 64 registers.");
+  uint64_t all_colors = color_count == 64
+    ? ~(uint64_t)0
+    : ((uint64_t)1 << color_count) - 1;
+  uint64_t volatile_colors = target->register_count == 64
+    ? ~(uint64_t)0
+    : ((uint64_t)1 << target->register_count) - 1;
+  uint64_t preserved_colors = all_colors & ~volatile_colors;
+
+  Liveness liveness = {0};
+  ra_liveness(&liveness, function);
+
+  InterferenceGraph graph = {0};
+  ig_build(&graph, &liveness, function, preserved_colors);
+  for (size_t node = 0; node < graph.node_count; ++node) {
+    graph.allowed[node] &= all_colors;
+  }
+  ig_coalesce(&graph);
+
+  size_t nodes = graph.node_count;
+  size_t *degree = ra_allocate(nodes, sizeof(size_t));
+  char *removed = ra_allocate(nodes, sizeof(char));
+  char *spilled = ra_allocate(nodes, sizeof(char));
+  size_t *color = ra_allocate(nodes, sizeof(size_t));
+  size_t *stack = ra_allocate(nodes, sizeof(size_t));
+  size_t stack_size = 0;
+  size_t remaining = 0;
+
+  // Coalesced nodes are gone, and nodes without any color to pick
+  // from are spilled right away.
+  for (size_t node = 0; node < nodes; ++node) {
+    degree[node] = ig_degree(&graph, node);
+    if (ig_find(&graph, node) != node) {
+      removed[node] = 1;
+    } else if (!graph.allowed[node]) {
+      removed[node] = 1;
+      spilled[node] = 1;
+    } else {
+      ++remaining;
+    }
+  }
+  for (size_t node = 0; node < nodes; ++node) {
+    if (!spilled[node]) { continue; }
+    FOR_EACH_BIT(neighbour, ig_row(&graph, node), graph.words, { degree[neighbour]--; })
+  }
+
+  // Simplify: remove nodes that are sure to get a color. When there
+  // are none, optimistically remove the cheapest spill candidate.
+  while (remaining) {
+    size_t pick = NO_NODE;
+    for (size_t node = 0; node < nodes; ++node) {
+      if (!removed[node] && degree[node] < ra_popcount(graph.allowed[node])) {
+        pick = node;
+        break;
+      }
+    }
+    if (pick == NO_NODE) {
+      for (size_t node = 0; node < nodes; ++node) {
+        if (removed[node]) { continue; }
+        if (pick == NO_NODE
+            || graph.cost[node] * degree[pick] < graph.cost[pick] * degree[node]) {
+          pick = node;
+        }
+      }
+    }
+    removed[pick] = 1;
+    stack[stack_size++] = pick;
+    --remaining;
+    FOR_EACH_BIT(neighbour, ig_row(&graph, pick), graph.words, { degree[neighbour]--; })
+  }
+
+  // Select: give nodes colors in reverse order of removal. Lower
+  // colors are the call-clobbered registers, which need no saving.
+  char *colored = ra_allocate(nodes, sizeof(char));
+  while (stack_size) {
+    size_t node = stack[--stack_size];
+    uint64_t used = 0;
+    FOR_EACH_BIT(neighbour, ig_row(&graph, node), graph.words, {
+      if (colored[neighbour]) { used |= (uint64_t)1 << color[neighbour]; }
+    })
+    uint64_t available = graph.allowed[node] & ~used;
+    if (available) {
+      color[node] = ra_lowest_bit(available);
+      colored[node] = 1;
+    } else {
+      spilled[node] = 1;
+    }
+  }
+
+  // Spilled nodes that don't interfere share a stack slot.
+  size_t slot_count = 0;
+  char *slot_used = ra_allocate(nodes + 1, sizeof(char));
+  for (size_t node = 0; node < nodes; ++node) {
+    if (!spilled[node]) { continue; }
+    memset(slot_used, 0, nodes + 1);
+    FOR_EACH_BIT(neighbour, ig_row(&graph, node), graph.words, {
+      if (spilled[neighbour] && color[neighbour]) { slot_used[color[neighbour]] = 1; }
+    })
+    size_t slot = 1;
+    while (slot_used[slot]) { ++slot; }
+    color[node] = slot;
+    if (slot > slot_count) { slot_count = slot; }
+  }
+
+  function->registers_used = 0;
+  for (size_t node = 0; node < nodes; ++node) {
+    IRInstruction *value = graph.values[node];
+    size_t representative = ig_find(&graph, node);
+    if (spilled[representative]) {
+      value->spill_slot = color[representative];
+      continue;
+    }
+    size_t c = color[representative];
+    value->spill_slot = 0;
+    value->result = c < target->register_count
+      ? target->registers[c]
+      : target->preserved_registers[c - target->register_count];
+    function->registers_used |= (uint64_t)1 << value->result;
+  }
+  function->spill_slots = slot_count;
+
+  ra_liveness_free(&liveness);
+  free(graph.node_of);
+  free(graph.values);
+  free(graph.matrix);
+  free(graph.allowed);
+  free(graph.cost);
+  free(graph.alias);
+  free(graph.moves);
+  free(degree);
+  free(removed);
+  free(spilled);
+  free(color);
+  free(stack);
+  free(colored);
+  free(slot_used);
+}
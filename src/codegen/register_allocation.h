@@ -0,0 +1,52 @@
+#ifndef REGISTER_ALLOCATION_H
+#define REGISTER_ALLOCATION_H
+
+#include <codegen/codegen_forward.h>
+#include <stddef.h>
+
+/// Registers that a register allocator may hand out.
+typedef struct RegisterAllocationTarget {
+  /// Allocatable registers that calls may clobber, in order of
+  /// preference.
+  const RegisterDescriptor *registers;
+  size_t register_count;
+  /// Allocatable registers that calls preserve. A function that uses
+  /// one of these has to save and restore it.
+  const RegisterDescriptor *preserved_registers;
+  size_t preserved_register_count;
+} RegisterAllocationTarget;
+
+/** Assign a location to every value of FUNCTION with linear scan.
+ *
+ * Instructions are numbered in layout order, and a live interval is
+ * computed for every value from block liveness. Intervals are then
+ * walked by start position, taking a free register from TARGET or,
+ * if there is none, spilling whichever interval ends last.
+ *
+ * Afterwards, every instruction for which ir_is_value() holds either
+ * has its `result` register set, or a non-zero `spill_slot`. The
+ * number of stack slots used is stored in the function.
+ *
+ * Only the registers of TARGET that calls clobber are handed out, so
+ * values that are live across a call are always spilled.
+ */
+void ra_linear_scan(IRFunction *function, const RegisterAllocationTarget *target);
+
+/** Assign a location to every value of FUNCTION by coloring its
+ * interference graph, Chaitin-Briggs style.
+ *
+ * The graph is built from the same block liveness as linear scan, but
+ * two values only interfere if one is live where the other is defined.
+ * Phi nodes and their arguments are coalesced whenever that keeps the
+ * graph colorable (Briggs' conservative test), so the copies at the
+ * end of predecessors mostly disappear. Values live across a call may
+ * only be colored with preserved registers.
+ *
+ * This is slower than ra_linear_scan(), but spills and copies less.
+ * Results are recorded in the same way. Functions too large for the
+ * interference graph to fit in a few megabytes fall back to
+ * ra_linear_scan().
+ */
+void ra_graph_coloring(IRFunction *function, const RegisterAllocationTarget *target);
+
+#endif /* REGISTER_ALLOCATION_H */
@@ -1,7 +1,11 @@
 #include <codegen/x86_64/arch_x86_64.h>
 
+#include <arena.h>
 #include <codegen.h>
+#include <codegen/code_buffer.h>
 #include <codegen/intermediate_representation.h>
+#include <codegen/object_file.h>
+#include <codegen/register_allocation.h>
 #include <error.h>
 #include <inttypes.h>
 #include <parser.h>
@@ -11,7 +15,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <typechecker.h>
+#include <worker_pool.h>
 
 #define DEFINE_REGISTER_ENUM(name, ...) REG_##name,
 #define REGISTER_NAME_64(ident, name, ...) name,
@@ -233,6 +239,74 @@ static const char *instruction_mnemonic_x86_64(CodegenContext *context, enum Ins
   }
 }
 
+/// Write a register name, prefixed with `%` in AT&T syntax.
+static void femit_x86_64_register(CodegenContext *context, const char *name) {
+  if (context->dialect == CG_ASM_DIALECT_ATT) {
+    code_buffer_char(context->code, '%');
+  }
+  code_buffer_string(context->code, name);
+}
+
+/// Write a memory operand: `OFFSET(%ADDRESS)` or `[ADDRESS + OFFSET]`.
+static void femit_x86_64_memory(CodegenContext *context, const char *address, int64_t offset) {
+  CodeBuffer *out = context->code;
+  switch (context->dialect) {
+    case CG_ASM_DIALECT_ATT:
+      code_buffer_integer(out, offset);
+      code_buffer_literal(out, "(%");
+      code_buffer_string(out, address);
+      code_buffer_char(out, ')');
+      break;
+    case CG_ASM_DIALECT_INTEL:
+      code_buffer_char(out, '[');
+      code_buffer_string(out, address);
+      code_buffer_literal(out, " + ");
+      code_buffer_integer(out, offset);
+      code_buffer_char(out, ']');
+      break;
+    default: panic("ERROR: femit_x86_64_memory(): Unsupported dialect %d", context->dialect);
+  }
+}
+
+/// Write a memory operand: `NAME(%ADDRESS)` or `[ADDRESS + NAME]`.
+static void femit_x86_64_name(CodegenContext *context, const char *address, const char *name) {
+  CodeBuffer *out = context->code;
+  switch (context->dialect) {
+    case CG_ASM_DIALECT_ATT:
+      code_buffer_string(out, name);
+      code_buffer_literal(out, "(%");
+      code_buffer_string(out, address);
+      code_buffer_char(out, ')');
+      break;
+    case CG_ASM_DIALECT_INTEL:
+      code_buffer_char(out, '[');
+      code_buffer_string(out, address);
+      code_buffer_literal(out, " + ");
+      code_buffer_string(out, name);
+      code_buffer_char(out, ']');
+      break;
+    default: panic("ERROR: femit_x86_64_name(): Unsupported dialect %d", context->dialect);
+  }
+}
+
+/// Write an immediate operand, prefixed with `$` in AT&T syntax.
+static void femit_x86_64_immediate(CodegenContext *context, int64_t immediate) {
+  if (context->dialect == CG_ASM_DIALECT_ATT) {
+    code_buffer_char(context->code, '$');
+  }
+  code_buffer_integer(context->code, immediate);
+}
+
+/// Write MNEMONIC followed by a space.
+static void femit_x86_64_mnemonic(CodegenContext *context, const char *mnemonic) {
+  code_buffer_string(context->code, mnemonic);
+  code_buffer_char(context->code, ' ');
+}
+
+static void femit_x86_64_operand_separator(CodegenContext *context) {
+  code_buffer_literal(context->code, ", ");
+}
+
 static void femit_x86_64_imm_to_reg(CodegenContext *context, enum Instructions_x86_64 inst, va_list args) {
   int64_t immediate                    = va_arg(args, int64_t);
   RegisterDescriptor destination_register  = va_arg(args, RegisterDescriptor);
@@ -240,17 +314,21 @@ static void femit_x86_64_imm_to_reg(CodegenContext *context, enum Instructions_x
   const char *mnemonic = instruction_mnemonic_x86_64(context, inst);
   const char *destination = register_name(destination_register);
 
+  femit_x86_64_mnemonic(context, mnemonic);
   switch (context->dialect) {
     case CG_ASM_DIALECT_ATT:
-      fprintf(context->code, "%s $%" PRId64 ", %%%s\n",
-          mnemonic, immediate, destination);
+      femit_x86_64_immediate(context, immediate);
+      femit_x86_64_operand_separator(context);
+      femit_x86_64_register(context, destination);
       break;
     case CG_ASM_DIALECT_INTEL:
-      fprintf(context->code, "%s %s, %" PRId64 "\n",
-          mnemonic, destination, immediate);
+      femit_x86_64_register(context, destination);
+      femit_x86_64_operand_separator(context);
+      femit_x86_64_immediate(context, immediate);
       break;
     default: panic("ERROR: femit_x86_64_imm_to_reg(): Unsupported dialect %d", context->dialect);
   }
+  code_buffer_char(context->code, '\n');
 }
 
 static void femit_x86_64_imm_to_mem(CodegenContext *context, enum Instructions_x86_64 inst, va_list args) {
@@ -261,17 +339,25 @@ static void femit_x86_64_imm_to_mem(CodegenContext *context, enum Instructions_x
   const char *mnemonic = instruction_mnemonic_x86_64(context, inst);
   const char *address = register_name(address_register);
 
+  // Neither operand implies the size of the store.
   switch (context->dialect) {
     case CG_ASM_DIALECT_ATT:
-      fprintf(context->code, "%s $%" PRId64 ", %" PRId64 "(%%%s)\n",
-          mnemonic, immediate, offset, address);
+      code_buffer_string(context->code, mnemonic);
+      femit_x86_64_mnemonic(context, "q");
+      femit_x86_64_immediate(context, immediate);
+      femit_x86_64_operand_separator(context);
+      femit_x86_64_memory(context, address, offset);
       break;
     case CG_ASM_DIALECT_INTEL:
-      fprintf(context->code, "%s [%s + %" PRId64 "], %" PRId64 "\n",
-          mnemonic, address, offset, immediate);
+      femit_x86_64_mnemonic(context, mnemonic);
+      code_buffer_literal(context->code, "qword ptr ");
+      femit_x86_64_memory(context, address, offset);
+      femit_x86_64_operand_separator(context);
+      femit_x86_64_immediate(context, immediate);
       break;
     default: panic("ERROR: femit_x86_64_imm_to_mem(): Unsupported dialect %d", context->dialect);
   }
+  code_buffer_char(context->code, '\n');
 }
 
 static void femit_x86_64_mem_to_reg(CodegenContext *context, enum Instructions_x86_64 inst, va_list args) {
@@ -283,17 +369,21 @@ static void femit_x86_64_mem_to_reg(CodegenContext *context, enum Instructions_x
   const char *address = register_name(address_register);
   const char *destination = register_name(destination_register);
 
+  femit_x86_64_mnemonic(context, mnemonic);
   switch (context->dialect) {
     case CG_ASM_DIALECT_ATT:
-      fprintf(context->code, "%s %" PRId64 "(%%%s), %%%s\n",
-          mnemonic, offset, address, destination);
+      femit_x86_64_memory(context, address, offset);
+      femit_x86_64_operand_separator(context);
+      femit_x86_64_register(context, destination);
       break;
     case CG_ASM_DIALECT_INTEL:
-      fprintf(context->code, "%s %s, [%s + %" PRId64 "]\n",
-          mnemonic, destination, address, offset);
+      femit_x86_64_register(context, destination);
+      femit_x86_64_operand_separator(context);
+      femit_x86_64_memory(context, address, offset);
       break;
     default: panic("ERROR: femit_x86_64_mem_to_reg(): Unsupported dialect %d", context->dialect);
   }
+  code_buffer_char(context->code, '\n');
 }
 
 static void femit_x86_64_name_to_reg(CodegenContext *context, enum Instructions_x86_64 inst, va_list args) {
@@ -305,17 +395,21 @@ static void femit_x86_64_name_to_reg(CodegenContext *context, enum Instructions_
   const char *address = register_name(address_register);
   const char *destination = register_name(destination_register);
 
+  femit_x86_64_mnemonic(context, mnemonic);
   switch (context->dialect) {
     case CG_ASM_DIALECT_ATT:
-      fprintf(context->code, "%s %s(%%%s), %%%s\n",
-          mnemonic, name, address, destination);
+      femit_x86_64_name(context, address, name);
+      femit_x86_64_operand_separator(context);
+      femit_x86_64_register(context, destination);
       break;
     case CG_ASM_DIALECT_INTEL:
-      fprintf(context->code, "%s %s, [%s + %s]\n",
-          mnemonic, destination, address, name);
+      femit_x86_64_register(context, destination);
+      femit_x86_64_operand_separator(context);
+      femit_x86_64_name(context, address, name);
       break;
     default: panic("ERROR: femit_x86_64_name_to_reg(): Unsupported dialect %d", context->dialect);
   }
+  code_buffer_char(context->code, '\n');
 }
 
 static void femit_x86_64_reg_to_mem(CodegenContext *context, enum Instructions_x86_64 inst, va_list args) {
@@ -326,28 +420,35 @@ static void femit_x86_64_reg_to_mem(CodegenContext *context, enum Instructions_x
   const char *mnemonic = instruction_mnemonic_x86_64(context, inst);
   const char *source = register_name(source_register);
   const char *address = register_name(address_register);
+  CodeBuffer *out = context->code;
 
+  femit_x86_64_mnemonic(context, mnemonic);
   switch (context->dialect) {
     case CG_ASM_DIALECT_ATT:
+      femit_x86_64_register(context, source);
+      femit_x86_64_operand_separator(context);
       if (offset) {
-        fprintf(context->code, "%s %%%s, %" PRId64 "(%%%s)\n",
-                mnemonic, source, offset, address);
+        femit_x86_64_memory(context, address, offset);
       } else {
-        fprintf(context->code, "%s %%%s, (%%%s)\n",
-                mnemonic, source, address);
+        code_buffer_char(out, '(');
+        femit_x86_64_register(context, address);
+        code_buffer_char(out, ')');
       }
       break;
     case CG_ASM_DIALECT_INTEL:
       if (offset) {
-        fprintf(context->code, "%s [%s + %" PRId64 "], %s\n",
-                mnemonic, address, offset, source);
+        femit_x86_64_memory(context, address, offset);
       } else {
-        fprintf(context->code, "%s [%s], %s\n",
-                mnemonic, address, source);
+        code_buffer_char(out, '[');
+        femit_x86_64_register(context, address);
+        code_buffer_char(out, ']');
       }
+      femit_x86_64_operand_separator(context);
+      femit_x86_64_register(context, source);
       break;
     default: panic("ERROR: femit_x86_64_reg_to_mem(): Unsupported dialect %d", context->dialect);
   }
+  code_buffer_char(out, '\n');
 }
 
 static void femit_x86_64_reg_to_reg(CodegenContext *context, enum Instructions_x86_64 inst, va_list args) {
@@ -361,17 +462,21 @@ static void femit_x86_64_reg_to_reg(CodegenContext *context, enum Instructions_x
   // Optimise away moves from a register to itself
   if (inst == I_MOV && source_register == destination_register) return;
 
+  femit_x86_64_mnemonic(context, mnemonic);
   switch (context->dialect) {
     case CG_ASM_DIALECT_ATT:
-      fprintf(context->code, "%s %%%s, %%%s\n",
-          mnemonic, source, destination);
+      femit_x86_64_register(context, source);
+      femit_x86_64_operand_separator(context);
+      femit_x86_64_register(context, destination);
       break;
     case CG_ASM_DIALECT_INTEL:
-      fprintf(context->code, "%s %s, %s\n",
-          mnemonic, destination, source);
+      femit_x86_64_register(context, destination);
+      femit_x86_64_operand_separator(context);
+      femit_x86_64_register(context, source);
       break;
     default: panic("ERROR: femit_x86_64_reg_to_reg(): Unsupported dialect %d", context->dialect);
   }
+  code_buffer_char(context->code, '\n');
 }
 
 static void femit_x86_64_reg_to_name(CodegenContext *context, enum Instructions_x86_64 inst, va_list args) {
@@ -383,17 +488,21 @@ static void femit_x86_64_reg_to_name(CodegenContext *context, enum Instructions_
   const char *source = register_name(source_register);
   const char *address = register_name(address_register);
 
+  femit_x86_64_mnemonic(context, mnemonic);
   switch (context->dialect) {
     case CG_ASM_DIALECT_ATT:
-      fprintf(context->code, "%s %%%s, %s(%%%s)\n",
-          mnemonic, source, name, address);
+      femit_x86_64_register(context, source);
+      femit_x86_64_operand_separator(context);
+      femit_x86_64_name(context, address, name);
       break;
     case CG_ASM_DIALECT_INTEL:
-      fprintf(context->code, "%s [%s + %s], %s\n",
-          mnemonic, address, name, source);
+      femit_x86_64_name(context, address, name);
+      femit_x86_64_operand_separator(context);
+      femit_x86_64_register(context, source);
       break;
     default: panic("ERROR: femit_x86_64_reg_to_name(): Unsupported dialect %d", context->dialect);
   }
+  code_buffer_char(context->code, '\n');
 }
 
 static void femit_x86_64_mem(CodegenContext *context, enum Instructions_x86_64 inst, va_list args) {
@@ -403,17 +512,9 @@ static void femit_x86_64_mem(CodegenContext *context, enum Instructions_x86_64 i
   const char *mnemonic = instruction_mnemonic_x86_64(context, inst);
   const char *address = register_name(address_register);
 
-  switch (context->dialect) {
-    case CG_ASM_DIALECT_ATT:
-      fprintf(context->code, "%s %" PRId64 "(%%%s)\n",
-          mnemonic, offset, address);
-      break;
-    case CG_ASM_DIALECT_INTEL:
-      fprintf(context->code, "%s [%s + %" PRId64 "]\n",
-          mnemonic, address, offset);
-      break;
-    default: panic("ERROR: femit_x86_64_mem(): Unsupported dialect %d", context->dialect);
-  }
+  femit_x86_64_mnemonic(context, mnemonic);
+  femit_x86_64_memory(context, address, offset);
+  code_buffer_char(context->code, '\n');
 }
 
 static void femit_x86_64_reg(CodegenContext *context, enum Instructions_x86_64 inst, va_list args) {
@@ -422,17 +523,9 @@ static void femit_x86_64_reg(CodegenContext *context, enum Instructions_x86_64 i
   const char *mnemonic = instruction_mnemonic_x86_64(context, inst);
   const char *source = register_name(source_register);
 
-  switch (context->dialect) {
-    case CG_ASM_DIALECT_ATT:
-      fprintf(context->code, "%s %%%s\n",
-          mnemonic, source);
-      break;
-    case CG_ASM_DIALECT_INTEL:
-      fprintf(context->code, "%s %s\n",
-          mnemonic, source);
-      break;
-    default: panic("ERROR: femit_x86_64_reg(): Unsupported dialect %d", context->dialect);
-  }
+  femit_x86_64_mnemonic(context, mnemonic);
+  femit_x86_64_register(context, source);
+  code_buffer_char(context->code, '\n');
 }
 
 static void femit_x86_64_imm(CodegenContext *context, enum Instructions_x86_64 inst, va_list args) {
@@ -440,17 +533,9 @@ static void femit_x86_64_imm(CodegenContext *context, enum Instructions_x86_64 i
 
   const char *mnemonic = instruction_mnemonic_x86_64(context, inst);
 
-  switch (context->dialect) {
-    case CG_ASM_DIALECT_ATT:
-      fprintf(context->code, "%s $%" PRId64 "\n",
-          mnemonic, immediate);
-      break;
-    case CG_ASM_DIALECT_INTEL:
-      fprintf(context->code, "%s %" PRId64 "\n",
-          mnemonic, immediate);
-      break;
-    default: panic("ERROR: femit_x86_64_imm(): Unsupported dialect %d", context->dialect);
-  }
+  femit_x86_64_mnemonic(context, mnemonic);
+  femit_x86_64_immediate(context, immediate);
+  code_buffer_char(context->code, '\n');
 }
 
 static void femit_x86_64_indirect_branch(CodegenContext *context, enum Instructions_x86_64 inst, va_list args) {
@@ -459,29 +544,495 @@ static void femit_x86_64_indirect_branch(CodegenContext *context, enum Instructi
   const char *mnemonic = instruction_mnemonic_x86_64(context, inst);
   const char *address = register_name(address_register);
 
-  switch (context->dialect) {
-    case CG_ASM_DIALECT_ATT:
-      fprintf(context->code, "%s *%%%s\n",
-          mnemonic, address);
+  femit_x86_64_mnemonic(context, mnemonic);
+  if (context->dialect == CG_ASM_DIALECT_ATT) {
+    code_buffer_char(context->code, '*');
+  }
+  femit_x86_64_register(context, address);
+  code_buffer_char(context->code, '\n');
+}
+
+//================================================================ BEG machine code
+
+/// Number of each register in the ModR/M, SIB and REX bytes.
+static const uint8_t register_numbers_x86_64[REG_COUNT] = {
+  [REG_RAX] = 0,
+  [REG_RCX] = 1,
+  [REG_RDX] = 2,
+  [REG_RBX] = 3,
+  [REG_RSP] = 4,
+  [REG_RBP] = 5,
+  [REG_RSI] = 6,
+  [REG_RDI] = 7,
+  [REG_R8]  = 8,
+  [REG_R9]  = 9,
+  [REG_R10] = 10,
+  [REG_R11] = 11,
+  [REG_R12] = 12,
+  [REG_R13] = 13,
+  [REG_R14] = 14,
+  [REG_R15] = 15,
+};
+
+/// Condition code of each jump type, as in the low nibble of the
+/// opcode of Jcc and SETcc.
+/// Do NOT reorder these.
+static const uint8_t jump_type_conditions_x86_64[JUMP_TYPE_COUNT] = {
+  0x7, // a
+  0x3, // ae
+  0x2, // b
+  0x6, // be
+  0x2, // c
+  0x4, // e
+  0x4, // z
+  0xf, // g
+  0xd, // ge
+  0xc, // l
+  0xe, // le
+  0x6, // na
+  0x2, // nae
+  0x3, // nb
+  0x7, // nbe
+  0x3, // nc
+  0x5, // ne
+  0xe, // ng
+  0xc, // nge
+  0xd, // nl
+  0xf, // nle
+  0x1, // no
+  0xb, // np
+  0x9, // ns
+  0x5, // nz
+  0x0, // o
+  0xa, // p
+  0xa, // pe
+  0xb, // po
+  0x8, // s
+};
+
+/// Condition code of each comparison, the same as comparison_suffixes_x86_64.
+static const uint8_t comparison_conditions_x86_64[COMPARE_COUNT] = {
+  0x4, // e
+  0x5, // ne
+  0xc, // l
+  0xe, // le
+  0xf, // g
+  0xd, // ge
+};
+
+#define REX_X86_64 0x40
+/// REX prefix for 64-bit operands.
+#define REX_W_X86_64 0x48
+
+/// Opcodes of an instruction that takes a register and a register or
+/// memory operand, in either direction, or an immediate.
+typedef struct Opcodes_x86_64 {
+  /// Register to register or memory.
+  uint16_t to_rm;
+  /// Register or memory to register.
+  uint16_t to_register;
+  /// 32-bit immediate to register or memory.
+  uint16_t immediate;
+  /// What goes into the register field of ModR/M with an immediate.
+  uint8_t extension;
+} Opcodes_x86_64;
+
+static Opcodes_x86_64 opcodes_x86_64(enum Instructions_x86_64 instruction) {
+  switch (instruction) {
+  case I_ADD: return (Opcodes_x86_64){0x01, 0x03, 0x81, 0};
+  case I_SUB: return (Opcodes_x86_64){0x29, 0x2b, 0x81, 5};
+  case I_XOR: return (Opcodes_x86_64){0x31, 0x33, 0x81, 6};
+  case I_CMP: return (Opcodes_x86_64){0x39, 0x3b, 0x81, 7};
+  case I_TEST: return (Opcodes_x86_64){0x85, 0x85, 0xf7, 0};
+  case I_MOV: return (Opcodes_x86_64){0x89, 0x8b, 0xc7, 0};
+  case I_XCHG: return (Opcodes_x86_64){0x87, 0x87, 0, 0};
+  case I_LEA: return (Opcodes_x86_64){0, 0x8d, 0, 0};
+  case I_IMUL: return (Opcodes_x86_64){0, 0x0faf, 0, 0};
+  default: PANIC("Instruction %d does not take two operands.", instruction);
+  }
+  return (Opcodes_x86_64){0};
+}
+
+/// Opcode extension of each shift instruction.
+static uint8_t shift_extension_x86_64(enum Instructions_x86_64 instruction) {
+  switch (instruction) {
+  case I_SAL: return 4;
+  case I_SHR: return 5;
+  case I_SAR: return 7;
+  default: PANIC("Instruction %d is not a shift.", instruction);
+  }
+  return 0;
+}
+
+static char fits_byte_x86_64(int64_t immediate) {
+  return immediate >= INT8_MIN && immediate <= INT8_MAX;
+}
+
+static uint8_t register_number_x86_64(RegisterDescriptor reg) {
+  ASSERT(reg >= 0 && reg < REG_COUNT && reg != REG_RIP,
+         "Register %d can not be encoded as an operand.", reg);
+  return register_numbers_x86_64[reg];
+}
+
+/// Emit the prefix REX with the high bits of the register numbers REG
+/// and RM added, unless it is a plain 0x40 that nothing needs.
+static void encode_rex_x86_64(ObjectFile *object, uint8_t rex, uint8_t reg, uint8_t rm) {
+  rex |= (reg & 8) >> 1 | (rm & 8) >> 3;
+  if (rex != REX_X86_64) {
+    object_file_byte(object, rex);
+  }
+}
+
+/// Emit a one-byte opcode, or a two-byte one that starts with 0x0f.
+static void encode_opcode_x86_64(ObjectFile *object, uint16_t opcode) {
+  if (opcode > 0xff) {
+    object_file_byte(object, (uint8_t)(opcode >> 8));
+  }
+  object_file_byte(object, (uint8_t)opcode);
+}
+
+/// Emit an instruction whose ModR/M operand is the register RM. REG is
+/// the number of the other register, or an opcode extension.
+static void encode_register_operand_x86_64
+(ObjectFile *object,
+ uint8_t rex,
+ uint16_t opcode,
+ uint8_t reg,
+ RegisterDescriptor rm)
+{
+  uint8_t number = register_number_x86_64(rm);
+  encode_rex_x86_64(object, rex, reg, number);
+  encode_opcode_x86_64(object, opcode);
+  object_file_byte(object, 0xc0 | (reg & 7) << 3 | (number & 7));
+}
+
+/// Emit an instruction whose ModR/M operand is the memory OFFSET bytes
+/// from the address in ADDRESS.
+static void encode_memory_operand_x86_64
+(ObjectFile *object,
+ uint8_t rex,
+ uint16_t opcode,
+ uint8_t reg,
+ RegisterDescriptor address,
+ int64_t offset)
+{
+  uint8_t base = register_number_x86_64(address);
+  encode_rex_x86_64(object, rex, reg, base);
+  encode_opcode_x86_64(object, opcode);
+
+  // Without a displacement, RBP and R13 as the base would mean an
+  // address relative to RIP instead.
+  uint8_t mod = 2;
+  if (offset == 0 && (base & 7) != 5) {
+    mod = 0;
+  } else if (fits_byte_x86_64(offset)) {
+    mod = 1;
+  }
+  ASSERT(offset >= INT32_MIN && offset <= INT32_MAX, "Offset %" PRId64 " does not fit in 32 bits.", offset);
+  object_file_byte(object, mod << 6 | (reg & 7) << 3 | (base & 7));
+  // RSP and R12 as the base need a SIB byte.
+  if ((base & 7) == 4) {
+    object_file_byte(object, 0x24);
+  }
+  if (mod == 1) {
+    object_file_integer(object, (uint64_t)offset, 1);
+  } else if (mod == 2) {
+    object_file_integer(object, (uint64_t)offset, 4);
+  }
+}
+
+/// Emit an instruction whose ModR/M operand is the memory at the
+/// symbol NAME, addressed relative to RIP. IMMEDIATE_SIZE bytes of
+/// immediate are to follow.
+static void encode_name_operand_x86_64
+(ObjectFile *object,
+ uint8_t rex,
+ uint16_t opcode,
+ uint8_t reg,
+ RegisterDescriptor address,
+ const char *name,
+ size_t immediate_size)
+{
+  ASSERT(address == REG_RIP, "Symbols can only be addressed relative to RIP, not %s.", register_name(address));
+  encode_rex_x86_64(object, rex, reg, 0);
+  encode_opcode_x86_64(object, opcode);
+  object_file_byte(object, (reg & 7) << 3 | 5);
+  // The displacement is from the end of the instruction.
+  object_file_relocation(object, name, OBJECT_RELOCATION_PC32, -4 - (int64_t)immediate_size);
+}
+
+/// Get the shortest immediate form of OPCODES that IMMEDIATE fits, and
+/// store how many bytes the immediate takes in SIZE.
+static uint16_t immediate_opcode_x86_64(Opcodes_x86_64 opcodes, int64_t immediate, size_t *size) {
+  ASSERT(opcodes.immediate, "Instruction does not take an immediate.");
+  ASSERT(immediate >= INT32_MIN && immediate <= INT32_MAX,
+         "Immediate %" PRId64 " does not fit in 32 bits.", immediate);
+  if (opcodes.immediate == 0x81 && fits_byte_x86_64(immediate)) {
+    *size = 1;
+    return 0x83;
+  }
+  *size = 4;
+  return opcodes.immediate;
+}
+
+/// Emit a jump or call to LABEL, which is filled in once it is known
+/// where it is.
+static void encode_branch_x86_64
+(ObjectFile *object,
+ uint16_t opcode,
+ const char *label,
+ enum ObjectRelocationType type)
+{
+  encode_opcode_x86_64(object, opcode);
+  object_file_relocation(object, label, type, -4);
+}
+
+/// Append the machine code of INSTRUCTION to the object file of
+/// CONTEXT. Takes the same arguments as femit_x86_64().
+static void encode_x86_64
+(CodegenContext *context,
+ enum Instructions_x86_64 instruction,
+ va_list args)
+{
+  ObjectFile *object = context->object;
+  switch (instruction) {
+    case I_ADD:
+    case I_SUB:
+    case I_TEST:
+    case I_XOR:
+    case I_CMP:
+    case I_MOV:
+    case I_LEA:
+    case I_IMUL:
+    case I_XCHG: {
+      Opcodes_x86_64 opcodes = opcodes_x86_64(instruction);
+      enum InstructionOperands_x86_64 operands = va_arg(args, enum InstructionOperands_x86_64);
+      switch (operands) {
+        default: panic("Unhandled operand type %d in x86_64 code generation for %d.", operands, instruction);
+        case IMMEDIATE_TO_REGISTER: {
+          int64_t immediate = va_arg(args, int64_t);
+          RegisterDescriptor destination = va_arg(args, RegisterDescriptor);
+          if (instruction == I_MOV && (immediate >= 0 || immediate < INT32_MIN)) {
+            // Writing the low half of a register clears the high half,
+            // so unsigned 32-bit immediates can do without REX.W.
+            char wide = immediate < 0 || immediate > UINT32_MAX;
+            uint8_t number = register_number_x86_64(destination);
+            encode_rex_x86_64(object, wide ? REX_W_X86_64 : REX_X86_64, 0, number);
+            object_file_byte(object, 0xb8 | (number & 7));
+            object_file_integer(object, (uint64_t)immediate, wide ? 8 : 4);
+            break;
+          }
+          size_t size;
+          uint16_t opcode = immediate_opcode_x86_64(opcodes, immediate, &size);
+          encode_register_operand_x86_64(object, REX_W_X86_64, opcode, opcodes.extension, destination);
+          object_file_integer(object, (uint64_t)immediate, size);
+        } break;
+        case IMMEDIATE_TO_MEMORY: {
+          int64_t immediate = va_arg(args, int64_t);
+          RegisterDescriptor address = va_arg(args, RegisterDescriptor);
+          int64_t offset = va_arg(args, int64_t);
+          size_t size;
+          uint16_t opcode = immediate_opcode_x86_64(opcodes, immediate, &size);
+          encode_memory_operand_x86_64(object, REX_W_X86_64, opcode, opcodes.extension, address, offset);
+          object_file_integer(object, (uint64_t)immediate, size);
+        } break;
+        case MEMORY_TO_REGISTER: {
+          RegisterDescriptor address = va_arg(args, RegisterDescriptor);
+          int64_t offset = va_arg(args, int64_t);
+          RegisterDescriptor destination = va_arg(args, RegisterDescriptor);
+          encode_memory_operand_x86_64(object, REX_W_X86_64, opcodes.to_register,
+                                       register_number_x86_64(destination), address, offset);
+        } break;
+        case REGISTER_TO_MEMORY: {
+          RegisterDescriptor source = va_arg(args, RegisterDescriptor);
+          RegisterDescriptor address = va_arg(args, RegisterDescriptor);
+          int64_t offset = va_arg(args, int64_t);
+          ASSERT(opcodes.to_rm, "Instruction %d can not write to memory.", instruction);
+          encode_memory_operand_x86_64(object, REX_W_X86_64, opcodes.to_rm,
+                                       register_number_x86_64(source), address, offset);
+        } break;
+        case REGISTER_TO_REGISTER: {
+          RegisterDescriptor source = va_arg(args, RegisterDescriptor);
+          RegisterDescriptor destination = va_arg(args, RegisterDescriptor);
+          // Optimise away moves from a register to itself
+          if (instruction == I_MOV && source == destination) { break; }
+          if (opcodes.to_rm) {
+            encode_register_operand_x86_64(object, REX_W_X86_64, opcodes.to_rm,
+                                           register_number_x86_64(source), destination);
+          } else {
+            encode_register_operand_x86_64(object, REX_W_X86_64, opcodes.to_register,
+                                           register_number_x86_64(destination), source);
+          }
+        } break;
+        case REGISTER_TO_NAME: {
+          RegisterDescriptor source = va_arg(args, RegisterDescriptor);
+          RegisterDescriptor address = va_arg(args, RegisterDescriptor);
+          char *name = va_arg(args, char *);
+          ASSERT(opcodes.to_rm, "Instruction %d can not write to memory.", instruction);
+          encode_name_operand_x86_64(object, REX_W_X86_64, opcodes.to_rm,
+                                     register_number_x86_64(source), address, name, 0);
+        } break;
+        case NAME_TO_REGISTER: {
+          RegisterDescriptor address = va_arg(args, RegisterDescriptor);
+          char *name = va_arg(args, char *);
+          RegisterDescriptor destination = va_arg(args, RegisterDescriptor);
+          encode_name_operand_x86_64(object, REX_W_X86_64, opcodes.to_register,
+                                     register_number_x86_64(destination), address, name, 0);
+        } break;
+      }
+    } break;
+
+    case I_IDIV: {
+      enum InstructionOperands_x86_64 operand = va_arg(args, enum InstructionOperands_x86_64);
+      switch (operand) {
+        default: panic("femit_x86_64() only accepts MEMORY or REGISTER operand type with IDIV instruction.");
+        case MEMORY: {
+          int64_t offset = va_arg(args, int64_t);
+          RegisterDescriptor address = va_arg(args, RegisterDescriptor);
+          encode_memory_operand_x86_64(object, REX_W_X86_64, 0xf7, 7, address, offset);
+        } break;
+        case REGISTER: {
+          RegisterDescriptor divisor = va_arg(args, RegisterDescriptor);
+          encode_register_operand_x86_64(object, REX_W_X86_64, 0xf7, 7, divisor);
+        } break;
+      }
+    } break;
+
+    case I_SAL:
+    case I_SAR:
+    case I_SHR: {
+      uint8_t extension = shift_extension_x86_64(instruction);
+      enum InstructionOperands_x86_64 operand = va_arg(args, enum InstructionOperands_x86_64);
+      switch (operand) {
+        default: panic("femit_x86_64() only accepts REGISTER OR IMMEDIATE_TO_REGISTER operand type with shift instructions.");
+        case IMMEDIATE_TO_REGISTER: {
+          int64_t immediate = va_arg(args, int64_t);
+          RegisterDescriptor reg = va_arg(args, RegisterDescriptor);
+          encode_register_operand_x86_64(object, REX_W_X86_64, 0xc1, extension, reg);
+          object_file_integer(object, (uint64_t)immediate, 1);
+        } break;
+        case REGISTER: {
+          // Shifts by CL.
+          RegisterDescriptor reg = va_arg(args, RegisterDescriptor);
+          encode_register_operand_x86_64(object, REX_W_X86_64, 0xd3, extension, reg);
+        } break;
+      }
+    } break;
+
+    case I_JMP:
+    case I_CALL: {
+      enum InstructionOperands_x86_64 operand = va_arg(args, enum InstructionOperands_x86_64);
+      switch (operand) {
+        default: panic("femit_x86_64() only accepts REGISTER or NAME operand type with CALL/JMP instruction.");
+        case REGISTER: {
+          RegisterDescriptor address = va_arg(args, RegisterDescriptor);
+          encode_register_operand_x86_64(object, REX_X86_64, 0xff, instruction == I_CALL ? 2 : 4, address);
+        } break;
+        case NAME: {
+          char *label = va_arg(args, char *);
+          if (instruction == I_CALL) {
+            encode_branch_x86_64(object, 0xe8, label, OBJECT_RELOCATION_PLT32);
+          } else {
+            encode_branch_x86_64(object, 0xe9, label, OBJECT_RELOCATION_PC32);
+          }
+        } break;
+      }
+    } break;
+
+    case I_PUSH: {
+      enum InstructionOperands_x86_64 operand = va_arg(args, enum InstructionOperands_x86_64);
+      switch (operand) {
+        default: panic("femit_x86_64() only accepts REGISTER, MEMORY, or IMMEDIATE operand type with PUSH instruction.");
+        case REGISTER: {
+          uint8_t number = register_number_x86_64(va_arg(args, RegisterDescriptor));
+          encode_rex_x86_64(object, REX_X86_64, 0, number);
+          object_file_byte(object, 0x50 | (number & 7));
+        } break;
+        case MEMORY: {
+          int64_t offset = va_arg(args, int64_t);
+          RegisterDescriptor address = va_arg(args, RegisterDescriptor);
+          encode_memory_operand_x86_64(object, REX_X86_64, 0xff, 6, address, offset);
+        } break;
+        case IMMEDIATE: {
+          int64_t immediate = va_arg(args, int64_t);
+          ASSERT(immediate >= INT32_MIN && immediate <= INT32_MAX,
+                 "Immediate %" PRId64 " does not fit in 32 bits.", immediate);
+          if (fits_byte_x86_64(immediate)) {
+            object_file_byte(object, 0x6a);
+            object_file_integer(object, (uint64_t)immediate, 1);
+          } else {
+            object_file_byte(object, 0x68);
+            object_file_integer(object, (uint64_t)immediate, 4);
+          }
+        } break;
+      }
+    } break;
+
+    case I_POP: {
+      enum InstructionOperands_x86_64 operand = va_arg(args, enum InstructionOperands_x86_64);
+      switch (operand) {
+        default: panic("femit_x86_64() only accepts REGISTER or MEMORY operand type with POP instruction.");
+        case REGISTER: {
+          uint8_t number = register_number_x86_64(va_arg(args, RegisterDescriptor));
+          encode_rex_x86_64(object, REX_X86_64, 0, number);
+          object_file_byte(object, 0x58 | (number & 7));
+        } break;
+        case MEMORY: {
+          int64_t offset = va_arg(args, int64_t);
+          RegisterDescriptor address = va_arg(args, RegisterDescriptor);
+          encode_memory_operand_x86_64(object, REX_X86_64, 0x8f, 0, address, offset);
+        } break;
+      }
+    } break;
+
+    case I_SETCC: {
+      enum ComparisonType comparison_type = va_arg(args, enum ComparisonType);
+      uint8_t number = register_number_x86_64(va_arg(args, RegisterDescriptor));
+      // Without any REX prefix, the low bytes of RSP through RDI would
+      // be AH through BH instead.
+      if (number >= 4) {
+        object_file_byte(object, REX_X86_64 | (number & 8) >> 3);
+      }
+      encode_opcode_x86_64(object, 0x0f90 | comparison_conditions_x86_64[comparison_type]);
+      object_file_byte(object, 0xc0 | (number & 7));
+    } break;
+
+    case I_JCC: {
+      enum IndirectJumpType_x86_64 type = va_arg(args, enum IndirectJumpType_x86_64);
+      ASSERT(type < JUMP_TYPE_COUNT, "encode_x86_64(): Invalid jump type %d", type);
+      char *label = va_arg(args, char *);
+      encode_branch_x86_64(object, 0x0f80 | jump_type_conditions_x86_64[type], label, OBJECT_RELOCATION_PC32);
+    } break;
+
+    case I_RET:
+      object_file_byte(object, 0xc3);
       break;
-    case CG_ASM_DIALECT_INTEL:
-      fprintf(context->code, "%s %s\n",
-          mnemonic, address);
+
+    case I_CQO:
+      object_file_byte(object, REX_W_X86_64);
+      object_file_byte(object, 0x99);
       break;
-    default: panic("ERROR: femit_x86_64_indirect_branch(): Unsupported dialect %d", context->dialect);
+
+    default: panic("Unhandled instruction in x86_64 code generation: %d.", instruction);
   }
 }
 
-static void femit_x86_64
+//================================================================ END machine code
+
+/// Print INSTRUCTION, or encode it if CONTEXT has an object file.
+static void femit_x86_64_v
 (CodegenContext *context,
  enum Instructions_x86_64 instruction,
- ...)
+ va_list args)
 {
-  va_list args;
-  va_start(args, instruction);
-
   ASSERT(context);
   ASSERT(I_COUNT == 21, "femit_x86_64() must exhaustively handle all x86_64 instructions.");
+  if (context->object) {
+    encode_x86_64(context, instruction, args);
+    return;
+  }
+  ASSERT(context->dialect == CG_ASM_DIALECT_ATT || context->dialect == CG_ASM_DIALECT_INTEL,
+         "femit_x86_64(): Unsupported dialect %d", context->dialect);
 
   switch (instruction) {
     case I_ADD:
@@ -542,17 +1093,21 @@ static void femit_x86_64
           const char *mnemonic = instruction_mnemonic_x86_64(context, instruction);
           const char *cl = register_name_8(REG_RCX);
 
+          femit_x86_64_mnemonic(context, mnemonic);
           switch (context->dialect) {
             case CG_ASM_DIALECT_ATT:
-              fprintf(context->code, "%s %%%s, %%%s\n",
-                  mnemonic, cl, register_name(register_to_shift));
+              femit_x86_64_register(context, cl);
+              femit_x86_64_operand_separator(context);
+              femit_x86_64_register(context, register_name(register_to_shift));
               break;
             case CG_ASM_DIALECT_INTEL:
-              fprintf(context->code, "%s %s, %s\n",
-                  mnemonic, register_name(register_to_shift), cl);
+              femit_x86_64_register(context, register_name(register_to_shift));
+              femit_x86_64_operand_separator(context);
+              femit_x86_64_register(context, cl);
               break;
             default: panic("ERROR: femit_x86_64(): Unsupported dialect %d for shift instruction", context->dialect);
           }
+          code_buffer_char(context->code, '\n');
         } break;
       }
     } break;
@@ -567,14 +1122,9 @@ static void femit_x86_64
           char *label = va_arg(args, char *);
           const char *mnemonic = instruction_mnemonic_x86_64(context, instruction);
 
-          switch (context->dialect) {
-            case CG_ASM_DIALECT_ATT:
-            case CG_ASM_DIALECT_INTEL:
-              fprintf(context->code, "%s %s\n",
-                  mnemonic, label);
-              break;
-            default: panic("ERROR: femit_x86_64(): Unsupported dialect %d for CALL/JMP instruction", context->dialect);
-          }
+          femit_x86_64_mnemonic(context, mnemonic);
+          code_buffer_string(context->code, label);
+          code_buffer_char(context->code, '\n');
         } break;
       }
     } break;
@@ -614,19 +1164,10 @@ static void femit_x86_64
       const char *mnemonic = instruction_mnemonic_x86_64(context, instruction);
       const char *value = register_name_8(value_register);
 
-      switch (context->dialect) {
-        case CG_ASM_DIALECT_ATT:
-          fprintf(context->code, "%s%s %%%s\n",
-              mnemonic,
-              comparison_suffixes_x86_64[comparison_type], value);
-          break;
-        case CG_ASM_DIALECT_INTEL:
-          fprintf(context->code, "%s%s %s\n",
-              mnemonic,
-              comparison_suffixes_x86_64[comparison_type], value);
-          break;
-        default: panic("ERROR: femit_x86_64(): Unsupported dialect %d", context->dialect);
-      }
+      code_buffer_string(context->code, mnemonic);
+      femit_x86_64_mnemonic(context, comparison_suffixes_x86_64[comparison_type]);
+      femit_x86_64_register(context, value);
+      code_buffer_char(context->code, '\n');
     } break;
 
     case I_JCC: {
@@ -636,28 +1177,115 @@ static void femit_x86_64
 
       const char *mnemonic = instruction_mnemonic_x86_64(context, I_JCC);
 
-      switch (context->dialect) {
-        case CG_ASM_DIALECT_ATT:
-        case CG_ASM_DIALECT_INTEL:
-          fprintf(context->code, "%s%s %s\n",
-              mnemonic, jump_type_names_x86_64[type], label);
-          break;
-        default: panic("ERROR: femit_x86_64_direct_branch(): Unsupported dialect %d", context->dialect);
-      }
+      code_buffer_string(context->code, mnemonic);
+      femit_x86_64_mnemonic(context, jump_type_names_x86_64[type]);
+      code_buffer_string(context->code, label);
+      code_buffer_char(context->code, '\n');
     } break;
 
     case I_RET:
     case I_CQO: {
       const char *mnemonic = instruction_mnemonic_x86_64(context, instruction);
-      fprintf(context->code, "%s\n", mnemonic);
+      code_buffer_string(context->code, mnemonic);
+      code_buffer_char(context->code, '\n');
     } break;
 
     default: panic("Unhandled instruction in x86_64 code generation: %d.", instruction);
   }
+}
 
+/// Emit INSTRUCTION right away, even while a function is being
+/// emitted. Takes the same arguments as femit_x86_64().
+static void femit_x86_64_direct
+(CodegenContext *context,
+ enum Instructions_x86_64 instruction,
+ ...)
+{
+  va_list args;
+  va_start(args, instruction);
+  femit_x86_64_v(context, instruction, args);
   va_end(args);
 }
 
+/// How functions call each other under one of the calling conventions
+/// code can be generated for.
+typedef struct CallingConvention_x86_64 {
+  /// The first arguments of a call are passed in these registers, the
+  /// rest on the stack.
+  const RegisterDescriptor *argument_registers;
+  size_t argument_register_count;
+  /// Registers a call may clobber, in the order the register allocator
+  /// should prefer them. The last RESERVED_SCRATCH_REGISTERS_X86_64 of
+  /// them are R10 and R11.
+  const RegisterDescriptor *scratch_registers;
+  size_t scratch_register_count;
+  /// Registers a call preserves, besides RBP and RSP.
+  const RegisterDescriptor *nonvolatile_registers;
+  size_t nonvolatile_register_count;
+  /// The caller reserves this many bytes below the stack arguments of
+  /// a call, for the callee to store its register arguments in.
+  int64_t shadow_space;
+  /// A function that makes no calls may use this many bytes below RSP
+  /// without moving it.
+  int64_t red_zone;
+  /// Whether AL has to hold an upper bound of the number of vector
+  /// registers that a variadic callee is passed.
+  char counts_vector_arguments;
+} CallingConvention_x86_64;
+
+#define REGISTER_LIST_COUNT(list) (sizeof(list) / sizeof(*(list)))
+
+// Link to MSDN documentation (surely will fall away, but it's been Internet Archive'd).
+// https://docs.microsoft.com/en-us/cpp/build/x64-calling-convention?view=msvc-170#callercallee-saved-registers
+// https://web.archive.org/web/20220916164241/https://docs.microsoft.com/en-us/cpp/build/x64-calling-convention?view=msvc-170
+// "The x64 ABI considers the registers RAX, RCX, RDX, R8, R9, R10, R11, and XMM0-XMM5 volatile."
+// "The x64 ABI considers registers RBX, RBP, RDI, RSI, RSP, R12, R13, R14, R15, and XMM6-XMM15 nonvolatile."
+static const RegisterDescriptor mswin_argument_registers_x86_64[] = {
+  REG_RCX, REG_RDX, REG_R8, REG_R9
+};
+static const RegisterDescriptor mswin_scratch_registers_x86_64[] = {
+  REG_RAX, REG_RCX, REG_RDX, REG_R8, REG_R9, REG_R10, REG_R11
+};
+static const RegisterDescriptor mswin_nonvolatile_registers_x86_64[] = {
+  REG_RBX, REG_RDI, REG_RSI, REG_R12, REG_R13, REG_R14, REG_R15
+};
+static const CallingConvention_x86_64 mswin_convention_x86_64 = {
+  .argument_registers = mswin_argument_registers_x86_64,
+  .argument_register_count = REGISTER_LIST_COUNT(mswin_argument_registers_x86_64),
+  .scratch_registers = mswin_scratch_registers_x86_64,
+  .scratch_register_count = REGISTER_LIST_COUNT(mswin_scratch_registers_x86_64),
+  .nonvolatile_registers = mswin_nonvolatile_registers_x86_64,
+  .nonvolatile_register_count = REGISTER_LIST_COUNT(mswin_nonvolatile_registers_x86_64),
+  .shadow_space = 32,
+  .red_zone = 0,
+  .counts_vector_arguments = 0,
+};
+
+// System V Application Binary Interface, AMD64 Architecture Processor
+// Supplement, section 3.2: "Registers %rbp, %rbx and %r12 through %r15
+// "belong" to the calling function and the called function is required
+// to preserve their values."
+static const RegisterDescriptor linux_argument_registers_x86_64[] = {
+  REG_RDI, REG_RSI, REG_RDX, REG_RCX, REG_R8, REG_R9
+};
+static const RegisterDescriptor linux_scratch_registers_x86_64[] = {
+  REG_RAX, REG_RCX, REG_RDX, REG_RSI, REG_RDI, REG_R8, REG_R9, REG_R10, REG_R11
+};
+static const RegisterDescriptor linux_nonvolatile_registers_x86_64[] = {
+  REG_RBX, REG_R12, REG_R13, REG_R14, REG_R15
+};
+static const CallingConvention_x86_64 linux_convention_x86_64 = {
+  .argument_registers = linux_argument_registers_x86_64,
+  .argument_register_count = REGISTER_LIST_COUNT(linux_argument_registers_x86_64),
+  .scratch_registers = linux_scratch_registers_x86_64,
+  .scratch_register_count = REGISTER_LIST_COUNT(linux_scratch_registers_x86_64),
+  .nonvolatile_registers = linux_nonvolatile_registers_x86_64,
+  .nonvolatile_register_count = REGISTER_LIST_COUNT(linux_nonvolatile_registers_x86_64),
+  .shadow_space = 0,
+  .red_zone = 128,
+  .counts_vector_arguments = 1,
+};
+
 /// X86_64-specific code generation state.
 typedef struct StackFrame {
   /// The type of function call that is currently being emitted.
@@ -673,78 +1301,270 @@ typedef struct StackFrame {
   struct StackFrame* parent;
 } StackFrame;
 
+/// An instruction as passed to femit_x86_64(), or a label.
+typedef struct MachineInstruction_x86_64 {
+  /// If this is set, this is not an instruction but a label.
+  const char *label;
+  enum Instructions_x86_64 instruction;
+  enum InstructionOperands_x86_64 operands;
+  /// The ComparisonType of SETCC, or the IndirectJumpType_x86_64 of JCC.
+  int condition;
+  int64_t immediate;
+  int64_t offset;
+  const char *name;
+  /// Also the operand of instructions that only take one register.
+  RegisterDescriptor source;
+  /// Also the operand of SETCC.
+  RegisterDescriptor destination;
+  RegisterDescriptor address;
+  /// Set by the peephole optimizer on instructions it removed.
+  char removed;
+} MachineInstruction_x86_64;
+
 typedef struct ArchData {
   StackFrame *current_call;
+  const CallingConvention_x86_64 *convention;
+
+  /// The function code is being emitted for, and each of its
+  /// instructions by index.
+  IRFunction *function;
+  IRInstruction **instructions;
+  size_t instruction_count;
+  /// How often each instruction of the function is used, by index.
+  size_t *use_counts;
+  /// Offset from RBP of each stack allocation of the function, by
+  /// index.
+  int64_t *frame_offsets;
+  /// Offset from RBP of each parameter of the function.
+  int64_t *parameter_offsets;
+  /// Nonvolatile registers the function saves below the saved RBP.
+  RegisterDescriptor saved_registers[REG_COUNT];
+  size_t saved_register_count;
+
+  /// Instructions and labels of the function, which are only emitted
+  /// once all of it has been, so the peephole optimizer can see them.
+  MachineInstruction_x86_64 *machine_instructions;
+  size_t machine_instruction_count;
+  size_t machine_instruction_capacity;
+  /// Copies of the names and labels the instructions refer to.
+  Arena machine_names;
 } ArchData;
 
-/// Creates a context for the CG_FMT_x86_64_MSWIN architecture.
-CodegenContext *codegen_context_x86_64_mswin_create(CodegenContext *parent) {
-  RegisterPool pool;
+/// Copy NAME, which may well live on the stack of the caller, for an
+/// instruction of the current function.
+static const char *machine_name_x86_64(ArchData *arch, const char *name) {
+  size_t length = strlen(name);
+  char *copy = arena_allocate(&arch->machine_names, length + 1);
+  memcpy(copy, name, length + 1);
+  return copy;
+}
 
-  // If this is the top level context, create the registers.
-  // Otherwise, shallow copy register pool to child context.
-  if (!parent) {
-    Register *registers = calloc(REG_COUNT, sizeof(Register));
-    FOR_ALL_X86_64_REGISTERS(INIT_REGISTER)
+/// Append an empty instruction to the current function.
+static MachineInstruction_x86_64 *machine_instruction_x86_64(ArchData *arch) {
+  if (arch->machine_instruction_count == arch->machine_instruction_capacity) {
+    arch->machine_instruction_capacity = arch->machine_instruction_capacity
+      ? arch->machine_instruction_capacity * 2
+      : 256;
+    arch->machine_instructions = realloc(arch->machine_instructions,
+                                         arch->machine_instruction_capacity * sizeof(MachineInstruction_x86_64));
+    ASSERT(arch->machine_instructions, "Could not allocate memory for machine instructions.");
+  }
+  MachineInstruction_x86_64 *machine = arch->machine_instructions + arch->machine_instruction_count++;
+  memset(machine, 0, sizeof(MachineInstruction_x86_64));
+  return machine;
+}
 
-    // Link to MSDN documentation (surely will fall away, but it's been Internet Archive'd).
-    // https://docs.microsoft.com/en-us/cpp/build/x64-calling-convention?view=msvc-170#callercallee-saved-registers
-    // https://web.archive.org/web/20220916164241/https://docs.microsoft.com/en-us/cpp/build/x64-calling-convention?view=msvc-170
-    // "The x64 ABI considers the registers RAX, RCX, RDX, R8, R9, R10, R11, and XMM0-XMM5 volatile."
-    // "The x64 ABI considers registers RBX, RBP, RDI, RSI, RSP, R12, R13, R14, R15, and XMM6-XMM15 nonvolatile."
-    size_t number_of_scratch_registers = 7;
-    Register **scratch_registers = calloc(number_of_scratch_registers, sizeof(Register *));
-    scratch_registers[0] = registers + REG_RAX;
-    scratch_registers[1] = registers + REG_RCX;
-    scratch_registers[2] = registers + REG_RDX;
-    scratch_registers[3] = registers + REG_R8;
-    scratch_registers[4] = registers + REG_R9;
-    scratch_registers[5] = registers + REG_R10;
-    scratch_registers[6] = registers + REG_R11;
+/** Emit INSTRUCTION with the operands that follow.
+ *
+ * Most instructions take an InstructionOperands_x86_64 first, followed
+ * by the operands it lists; SETCC takes a ComparisonType and a
+ * register, JCC an IndirectJumpType_x86_64 and a label, and RET and
+ * CQO nothing.
+ *
+ * While a function is being emitted, the instruction is only recorded;
+ * see femit_machine_instructions_x86_64().
+ */
+static void femit_x86_64
+(CodegenContext *context,
+ enum Instructions_x86_64 instruction,
+ ...)
+{
+  va_list args;
+  va_start(args, instruction);
 
-    pool.registers = registers;
-    pool.scratch_registers = scratch_registers;
-    pool.num_scratch_registers = number_of_scratch_registers;
-    pool.num_registers = REG_COUNT;
-  } else {
-    pool = parent->register_pool;
+  ArchData *arch = context->arch_data;
+  if (!arch || !arch->function) {
+    femit_x86_64_v(context, instruction, args);
+    va_end(args);
+    return;
   }
 
-  CodegenContext *cg_ctx = calloc(1,sizeof(CodegenContext));
-
-  // Shallow-copy state from the parent.
-  if (parent) {
-    cg_ctx->code = parent->code;
+  MachineInstruction_x86_64 *machine = machine_instruction_x86_64(arch);
+  machine->instruction = instruction;
+  switch (instruction) {
+  case I_SETCC:
+    machine->condition = va_arg(args, enum ComparisonType);
+    machine->destination = va_arg(args, RegisterDescriptor);
+    break;
+  case I_JCC:
+    machine->condition = va_arg(args, enum IndirectJumpType_x86_64);
+    machine->name = machine_name_x86_64(arch, va_arg(args, const char *));
+    break;
+  case I_RET:
+  case I_CQO:
+    break;
+  default:
+    machine->operands = va_arg(args, enum InstructionOperands_x86_64);
+    switch (machine->operands) {
+    case IMMEDIATE:
+      machine->immediate = va_arg(args, int64_t);
+      break;
+    case MEMORY:
+      machine->offset = va_arg(args, int64_t);
+      machine->address = va_arg(args, RegisterDescriptor);
+      break;
+    case REGISTER:
+      machine->source = va_arg(args, RegisterDescriptor);
+      break;
+    case NAME:
+      machine->name = machine_name_x86_64(arch, va_arg(args, const char *));
+      break;
+    case IMMEDIATE_TO_REGISTER:
+      machine->immediate = va_arg(args, int64_t);
+      machine->destination = va_arg(args, RegisterDescriptor);
+      break;
+    case IMMEDIATE_TO_MEMORY:
+      machine->immediate = va_arg(args, int64_t);
+      machine->address = va_arg(args, RegisterDescriptor);
+      machine->offset = va_arg(args, int64_t);
+      break;
+    case MEMORY_TO_REGISTER:
+      machine->address = va_arg(args, RegisterDescriptor);
+      machine->offset = va_arg(args, int64_t);
+      machine->destination = va_arg(args, RegisterDescriptor);
+      break;
+    case NAME_TO_REGISTER:
+      machine->address = va_arg(args, RegisterDescriptor);
+      machine->name = machine_name_x86_64(arch, va_arg(args, const char *));
+      machine->destination = va_arg(args, RegisterDescriptor);
+      break;
+    case REGISTER_TO_MEMORY:
+      machine->source = va_arg(args, RegisterDescriptor);
+      machine->address = va_arg(args, RegisterDescriptor);
+      machine->offset = va_arg(args, int64_t);
+      break;
+    case REGISTER_TO_REGISTER:
+      machine->source = va_arg(args, RegisterDescriptor);
+      machine->destination = va_arg(args, RegisterDescriptor);
+      break;
+    case REGISTER_TO_NAME:
+      machine->source = va_arg(args, RegisterDescriptor);
+      machine->address = va_arg(args, RegisterDescriptor);
+      machine->name = machine_name_x86_64(arch, va_arg(args, const char *));
+      break;
+    default:
+      PANIC("Unhandled operand type %d for instruction %d.", machine->operands, instruction);
+    }
+  }
+
+  va_end(args);
+}
+
+/// The last scratch registers of the pool are never allocated to a
+/// value, so that spilled values can always be reloaded into them.
+#define RESERVED_SCRATCH_REGISTERS_X86_64 2
+
+/// Create a context that calls functions as CONVENTION says, or one
+/// that shares the registers and state of PARENT if there is one.
+static CodegenContext *codegen_context_x86_64_create
+(CodegenContext *parent,
+ enum CodegenCallingConvention call_convention,
+ const CallingConvention_x86_64 *convention)
+{
+  RegisterPool pool;
+
+  // If this is the top level context, create the registers.
+  // Otherwise, shallow copy register pool to child context.
+  if (!parent) {
+    Register *registers = calloc(REG_COUNT, sizeof(Register));
+    FOR_ALL_X86_64_REGISTERS(INIT_REGISTER)
+
+    size_t number_of_scratch_registers = convention->scratch_register_count;
+    Register **scratch_registers = calloc(number_of_scratch_registers, sizeof(Register *));
+    for (size_t i = 0; i < number_of_scratch_registers; ++i) {
+      scratch_registers[i] = registers + convention->scratch_registers[i];
+    }
+
+    pool.registers = registers;
+    pool.scratch_registers = scratch_registers;
+    pool.num_scratch_registers = number_of_scratch_registers;
+    pool.num_registers = REG_COUNT;
+  } else {
+    pool = parent->register_pool;
+  }
+
+  CodegenContext *cg_ctx = calloc(1,sizeof(CodegenContext));
+
+  // Shallow-copy state from the parent.
+  if (parent) {
+    cg_ctx->code = parent->code;
+    cg_ctx->object = parent->object;
     cg_ctx->arch_data = parent->arch_data;
     cg_ctx->format = parent->format;
     cg_ctx->call_convention = parent->call_convention;
     cg_ctx->dialect = parent->dialect;
   } else {
-    cg_ctx->arch_data = calloc(1, sizeof(ArchData));
+    ArchData *arch_data = calloc(1, sizeof(ArchData));
+    arch_data->convention = convention;
+    cg_ctx->arch_data = arch_data;
     cg_ctx->format = CG_FMT_x86_64_GAS;
-    cg_ctx->call_convention = CG_CALL_CONV_MSWIN;
+    cg_ctx->call_convention = call_convention;
     cg_ctx->dialect = CG_ASM_DIALECT_ATT;
   }
 
   cg_ctx->parent = parent;
   cg_ctx->locals = environment_create(NULL);
-  cg_ctx->locals_offset = -32;
+  cg_ctx->locals_offset = -convention->shadow_space;
   cg_ctx->register_pool = pool;
   return cg_ctx;
 }
 
-/// Free a context created by codegen_context_x86_64_mswin_create.
-void codegen_context_x86_64_mswin_free(CodegenContext *ctx) {
+/// Free a context created by codegen_context_x86_64_create().
+static void codegen_context_x86_64_free(CodegenContext *ctx) {
   // Only free the registers and arch data if this is the top-level context.
   if (!ctx->parent) {
     free(ctx->register_pool.registers);
     free(ctx->register_pool.scratch_registers);
-    free(ctx->arch_data);
+    ArchData *arch = ctx->arch_data;
+    free(arch->machine_instructions);
+    arena_free(&arch->machine_names);
+    free(arch);
   }
   // TODO(sirraide): Free environment.
   free(ctx);
 }
 
+/// Creates a context for the CG_FMT_x86_64_MSWIN architecture.
+CodegenContext *codegen_context_x86_64_mswin_create(CodegenContext *parent) {
+  return codegen_context_x86_64_create(parent, CG_CALL_CONV_MSWIN, &mswin_convention_x86_64);
+}
+
+/// Free a context created by codegen_context_x86_64_mswin_create.
+void codegen_context_x86_64_mswin_free(CodegenContext *ctx) {
+  codegen_context_x86_64_free(ctx);
+}
+
+/// Creates a context for x86_64 code that follows the System V ABI,
+/// as on Linux.
+CodegenContext *codegen_context_x86_64_linux_create(CodegenContext *parent) {
+  return codegen_context_x86_64_create(parent, CG_CALL_CONV_LINUX, &linux_convention_x86_64);
+}
+
+/// Free a context created by codegen_context_x86_64_linux_create.
+void codegen_context_x86_64_linux_free(CodegenContext *ctx) {
+  codegen_context_x86_64_free(ctx);
+}
+
 /// Save state before a function call.
 void codegen_prepare_call_x86_64(CodegenContext *cg_context) {
   ArchData *arch_data = cg_context->arch_data;
@@ -953,7 +1773,10 @@ void codegen_stack_allocate_x86_64(CodegenContext *cg_context, long long int siz
 void codegen_prologue_x86_64(CodegenContext *cg_context) {
   femit_x86_64(cg_context, I_PUSH, REGISTER, REG_RBP);
   femit_x86_64(cg_context, I_MOV, REGISTER_TO_REGISTER, REG_RSP, REG_RBP);
-  femit_x86_64(cg_context, I_SUB, IMMEDIATE_TO_REGISTER, (int64_t)-cg_context->locals_offset, REG_RSP);
+  // A frame in the red zone needs no room made for it.
+  if (cg_context->locals_offset) {
+    femit_x86_64(cg_context, I_SUB, IMMEDIATE_TO_REGISTER, (int64_t)-cg_context->locals_offset, REG_RSP);
+  }
 }
 
 /// Emit the function epilogue.
@@ -970,77 +1793,1504 @@ void codegen_set_return_value_x86_64(CodegenContext *cg_context, RegisterDescrip
 
 /// Emit the entry point of the program.
 void codegen_entry_point_x86_64(CodegenContext *cg_context) {
-  fprintf(cg_context->code,
-      "%s"
-      ".section .text\n"
-      ".global main\n"
-      "main:\n",
-      cg_context->dialect == CG_ASM_DIALECT_INTEL ? ".intel_syntax noprefix\n" : "");
+  if (cg_context->object) {
+    object_file_label(cg_context->object, "main", 1);
+    codegen_prologue_x86_64(cg_context);
+    return;
+  }
+  if (cg_context->dialect == CG_ASM_DIALECT_INTEL) {
+    code_buffer_literal(cg_context->code, ".intel_syntax noprefix\n");
+  }
+  code_buffer_literal(cg_context->code,
+                      ".section .text\n"
+                      ".global main\n"
+                      "main:\n");
   codegen_prologue_x86_64(cg_context);
 }
 
 
+//================================================================ BEG emitter benchmark
+
+/// Number of lines emitted by one call to femit_x86_64_benchmark_mix().
+#define EMITTER_BENCHMARK_LINES 22
+
+/// Emit a fixed mix of instructions that covers every operand form.
+static void femit_x86_64_benchmark_mix(CodegenContext *context) {
+  femit_x86_64(context, I_PUSH, REGISTER, REG_RBP);
+  femit_x86_64(context, I_MOV, REGISTER_TO_REGISTER, REG_RSP, REG_RBP);
+  femit_x86_64(context, I_SUB, IMMEDIATE_TO_REGISTER, (int64_t)32, REG_RSP);
+  femit_x86_64(context, I_MOV, MEMORY_TO_REGISTER, REG_RBP, (int64_t)-8, REG_RAX);
+  femit_x86_64(context, I_MOV, REGISTER_TO_MEMORY, REG_RAX, REG_RBP, (int64_t)-16);
+  femit_x86_64(context, I_MOV, REGISTER_TO_MEMORY, REG_RCX, REG_RAX, (int64_t)0);
+  femit_x86_64(context, I_LEA, NAME_TO_REGISTER, REG_RIP, "counter", REG_RCX);
+  femit_x86_64(context, I_MOV, REGISTER_TO_NAME, REG_RDX, REG_RIP, "counter");
+  femit_x86_64(context, I_MOV, IMMEDIATE_TO_MEMORY, (int64_t)42, REG_RBP, (int64_t)-24);
+  femit_x86_64(context, I_ADD, REGISTER_TO_REGISTER, REG_RCX, REG_RAX);
+  femit_x86_64(context, I_CMP, REGISTER_TO_REGISTER, REG_RCX, REG_RAX);
+  femit_x86_64(context, I_SETCC, COMPARE_LT, REG_RAX);
+  femit_x86_64(context, I_TEST, REGISTER_TO_REGISTER, REG_RAX, REG_RAX);
+  femit_x86_64(context, I_JCC, JUMP_TYPE_Z, ".L12");
+  femit_x86_64(context, I_CALL, REGISTER, REG_RAX);
+  femit_x86_64(context, I_CALL, NAME, "puts");
+  femit_x86_64(context, I_SAL, REGISTER, REG_R10);
+  femit_x86_64(context, I_IDIV, MEMORY, (int64_t)-8, REG_RBP);
+  femit_x86_64(context, I_PUSH, IMMEDIATE, (int64_t)-1234567);
+  femit_x86_64(context, I_CQO);
+  femit_x86_64(context, I_POP, REGISTER, REG_RBP);
+  femit_x86_64(context, I_RET);
+}
+
+/// The same mix as femit_x86_64_benchmark_mix(), formatted by stdio
+/// the way the emitter used to.
+static void fprintf_x86_64_benchmark_mix(FILE *file, enum CodegenAssemblyDialect dialect) {
+  if (dialect == CG_ASM_DIALECT_ATT) {
+    fprintf(file, "%s %%%s\n", "push", "rbp");
+    fprintf(file, "%s %%%s, %%%s\n", "mov", "rsp", "rbp");
+    fprintf(file, "%s $%" PRId64 ", %%%s\n", "sub", (int64_t)32, "rsp");
+    fprintf(file, "%s %" PRId64 "(%%%s), %%%s\n", "mov", (int64_t)-8, "rbp", "rax");
+    fprintf(file, "%s %%%s, %" PRId64 "(%%%s)\n", "mov", "rax", (int64_t)-16, "rbp");
+    fprintf(file, "%s %%%s, (%%%s)\n", "mov", "rcx", "rax");
+    fprintf(file, "%s %s(%%%s), %%%s\n", "lea", "counter", "rip", "rcx");
+    fprintf(file, "%s %%%s, %s(%%%s)\n", "mov", "rdx", "counter", "rip");
+    fprintf(file, "%sq $%" PRId64 ", %" PRId64 "(%%%s)\n", "mov", (int64_t)42, (int64_t)-24, "rbp");
+    fprintf(file, "%s %%%s, %%%s\n", "add", "rcx", "rax");
+    fprintf(file, "%s %%%s, %%%s\n", "cmp", "rcx", "rax");
+    fprintf(file, "%s%s %%%s\n", "set", "l", "al");
+    fprintf(file, "%s %%%s, %%%s\n", "test", "rax", "rax");
+    fprintf(file, "%s%s %s\n", "j", "z", ".L12");
+    fprintf(file, "%s *%%%s\n", "call", "rax");
+    fprintf(file, "%s %s\n", "call", "puts");
+    fprintf(file, "%s %%%s, %%%s\n", "sal", "cl", "r10");
+    fprintf(file, "%s %" PRId64 "(%%%s)\n", "idiv", (int64_t)-8, "rbp");
+    fprintf(file, "%s $%" PRId64 "\n", "push", (int64_t)-1234567);
+    fprintf(file, "%s\n", "cqto");
+    fprintf(file, "%s %%%s\n", "pop", "rbp");
+    fprintf(file, "%s\n", "ret");
+  } else {
+    fprintf(file, "%s %s\n", "push", "rbp");
+    fprintf(file, "%s %s, %s\n", "mov", "rbp", "rsp");
+    fprintf(file, "%s %s, %" PRId64 "\n", "sub", "rsp", (int64_t)32);
+    fprintf(file, "%s %s, [%s + %" PRId64 "]\n", "mov", "rax", "rbp", (int64_t)-8);
+    fprintf(file, "%s [%s + %" PRId64 "], %s\n", "mov", "rbp", (int64_t)-16, "rax");
+    fprintf(file, "%s [%s], %s\n", "mov", "rax", "rcx");
+    fprintf(file, "%s %s, [%s + %s]\n", "lea", "rcx", "rip", "counter");
+    fprintf(file, "%s [%s + %s], %s\n", "mov", "rip", "counter", "rdx");
+    fprintf(file, "%s qword ptr [%s + %" PRId64 "], %" PRId64 "\n", "mov", "rbp", (int64_t)-24, (int64_t)42);
+    fprintf(file, "%s %s, %s\n", "add", "rax", "rcx");
+    fprintf(file, "%s %s, %s\n", "cmp", "rax", "rcx");
+    fprintf(file, "%s%s %s\n", "set", "l", "al");
+    fprintf(file, "%s %s, %s\n", "test", "rax", "rax");
+    fprintf(file, "%s%s %s\n", "j", "z", ".L12");
+    fprintf(file, "%s %s\n", "call", "rax");
+    fprintf(file, "%s %s\n", "call", "puts");
+    fprintf(file, "%s %s, %s\n", "sal", "r10", "cl");
+    fprintf(file, "%s [%s + %" PRId64 "]\n", "idiv", "rbp", (int64_t)-8);
+    fprintf(file, "%s %" PRId64 "\n", "push", (int64_t)-1234567);
+    fprintf(file, "%s\n", "cqo");
+    fprintf(file, "%s %s\n", "pop", "rbp");
+    fprintf(file, "%s\n", "ret");
+  }
+}
+
+/// @return Boolean-like value: 1 if both files have the same contents.
+static int benchmark_files_equal(FILE *a, FILE *b) {
+  rewind(a);
+  rewind(b);
+  int c;
+  while ((c = fgetc(a)) != EOF) {
+    if (c != fgetc(b)) { return 0; }
+  }
+  return fgetc(b) == EOF;
+}
+
+void codegen_benchmark_emitter_x86_64
+(enum CodegenAssemblyDialect dialect,
+ FILE *sink,
+ size_t iterations)
+{
+  CodegenContext context;
+  memset(&context, 0, sizeof(CodegenContext));
+  context.dialect = dialect;
+
+  // Make sure both ways of emitting agree before timing them.
+  FILE *buffered_output = tmpfile();
+  FILE *stdio_output = tmpfile();
+  if (buffered_output && stdio_output) {
+    context.code = code_buffer_create(buffered_output);
+    femit_x86_64_benchmark_mix(&context);
+    code_buffer_free(context.code);
+    fprintf_x86_64_benchmark_mix(stdio_output, dialect);
+    printf("Emitted code matches stdio formatting: %s\n",
+           benchmark_files_equal(buffered_output, stdio_output) ? "yes" : "NO");
+  }
+  if (buffered_output) { fclose(buffered_output); }
+  if (stdio_output) { fclose(stdio_output); }
+
+  double lines = (double)iterations * EMITTER_BENCHMARK_LINES;
+
+  context.code = code_buffer_create(sink);
+  clock_t start = clock();
+  for (size_t i = 0; i < iterations; ++i) {
+    femit_x86_64_benchmark_mix(&context);
+  }
+  code_buffer_flush(context.code);
+  double buffered_seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  code_buffer_free(context.code);
+
+  start = clock();
+  for (size_t i = 0; i < iterations; ++i) {
+    fprintf_x86_64_benchmark_mix(sink, dialect);
+  }
+  fflush(sink);
+  double stdio_seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  printf("Emitted %.0f lines through the code buffer in %.3f seconds", lines, buffered_seconds);
+  if (buffered_seconds > 0) {
+    printf(" (%.1f million lines/s)", lines / buffered_seconds / 1e6);
+  }
+  printf(".\nEmitted %.0f lines through stdio in %.3f seconds", lines, stdio_seconds);
+  if (stdio_seconds > 0) {
+    printf(" (%.1f million lines/s)", lines / stdio_seconds / 1e6);
+  }
+  printf(".\n");
+}
+
+void codegen_benchmark_encoder_x86_64(size_t iterations) {
+  CodegenContext context;
+  memset(&context, 0, sizeof(CodegenContext));
+  context.object = object_file_create();
+
+  // Only the code of one mix is kept at a time, so that the benchmark
+  // does not grow the object by hundreds of megabytes. The symbols it
+  // refers to stay, like they would in a real program.
+  size_t bytes = 0;
+  clock_t start = clock();
+  for (size_t i = 0; i < iterations; ++i) {
+    femit_x86_64_benchmark_mix(&context);
+    bytes += context.object->code_size;
+    context.object->code_size = 0;
+    context.object->relocation_count = 0;
+  }
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  object_file_free(context.object);
+
+  double lines = (double)iterations * EMITTER_BENCHMARK_LINES;
+  printf("Encoded %.0f instructions into %zu bytes in %.3f seconds", lines, bytes, seconds);
+  if (seconds > 0) {
+    printf(" (%.1f million instructions/s)", lines / seconds / 1e6);
+  }
+  printf(".\n");
+}
+
+//================================================================ END emitter benchmark
+
+/// Print where register allocation put each value of FUNCTION.
+static void femit_register_allocation_x86_64(FILE *file, IRFunction *function) {
+  fprintf(file, "f%zu: %zu stack slot%s\n", function->id,
+          function->spill_slots, function->spill_slots == 1 ? "" : "s");
+  for (IRBlock *block = function->first; block; block = block->next) {
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      if (!ir_is_value(instruction)) { continue; }
+      if (instruction->spill_slot) {
+        fprintf(file, "  %%%zu -> slot %zu\n", instruction->id, instruction->spill_slot);
+      } else {
+        fprintf(file, "  %%%zu -> %s\n", instruction->id, register_name(instruction->result));
+      }
+    }
+  }
+}
+
+//================================================================ BEG IR lowering
+
+#define LABEL_SIZE_X86_64 64
+
+/// Where a value is, or is to be put.
+typedef struct Location {
+  enum {
+    LOCATION_REGISTER,
+    /// `value` bytes from the address in `reg`.
+    LOCATION_MEMORY,
+    /// The constant `value`.
+    LOCATION_IMMEDIATE,
+  } kind;
+  RegisterDescriptor reg;
+  int64_t value;
+} Location;
+
+typedef struct Move {
+  Location source;
+  Location destination;
+} Move;
+
+static Location location_register(RegisterDescriptor reg) {
+  return (Location){.kind = LOCATION_REGISTER, .reg = reg};
+}
+
+static Location location_memory(RegisterDescriptor address, int64_t offset) {
+  return (Location){.kind = LOCATION_MEMORY, .reg = address, .value = offset};
+}
+
+static char location_equal(Location a, Location b) {
+  if (a.kind != b.kind) { return 0; }
+  switch (a.kind) {
+  case LOCATION_REGISTER: return a.reg == b.reg;
+  case LOCATION_MEMORY: return a.reg == b.reg && a.value == b.value;
+  case LOCATION_IMMEDIATE: return a.value == b.value;
+  }
+  UNREACHABLE();
+  return 0;
+}
+
+static char fits_immediate_x86_64(int64_t immediate) {
+  return immediate >= INT32_MIN && immediate <= INT32_MAX;
+}
+
+/// Offset from RBP of the stack slot SLOT that register allocation
+/// spilled values to.
+static int64_t spill_offset_x86_64(CodegenContext *context, size_t slot) {
+  ArchData *arch = context->arch_data;
+  return -(int64_t)(8 * (arch->saved_register_count + slot));
+}
+
+/// Offset from RBP of the stack memory LOCAL stands for.
+static int64_t local_offset_x86_64(CodegenContext *context, IRInstruction *local) {
+  ArchData *arch = context->arch_data;
+  switch (local->type) {
+  case IR_PARAMETER_REFERENCE:
+    return arch->parameter_offsets[local->value.immediate - 1];
+  case IR_STACK_ALLOCATE:
+    ASSERT(local->index < arch->instruction_count && arch->instructions[local->index] == local,
+           "Accessing locals of an enclosing function is not supported yet.");
+    return arch->frame_offsets[local->index];
+  default:
+    PANIC("Instruction of type %d does not name stack memory.", local->type);
+  }
+  return 0;
+}
+
+/// Immediates are never materialized on their own; every use folds
+/// them in instead.
+static Location value_location_x86_64(CodegenContext *context, IRInstruction *value) {
+  ASSERT(ir_is_value(value), "Instruction of type %d has no value.", value->type);
+  if (value->type == IR_IMMEDIATE) {
+    return (Location){.kind = LOCATION_IMMEDIATE, .value = value->value.immediate};
+  }
+  if (value->spill_slot) {
+    return location_memory(REG_RBP, spill_offset_x86_64(context, value->spill_slot));
+  }
+  return location_register(value->result);
+}
+
+/// Emit a move from SOURCE to DESTINATION. R10 is used if the move
+/// can not be done in a single instruction.
+static void emit_move_x86_64(CodegenContext *context, Location source, Location destination) {
+  if (location_equal(source, destination)) { return; }
+  switch (destination.kind) {
+  case LOCATION_REGISTER:
+    switch (source.kind) {
+    case LOCATION_REGISTER:
+      codegen_copy_register_x86_64(context, source.reg, destination.reg);
+      return;
+    case LOCATION_MEMORY:
+      femit_x86_64(context, I_MOV, MEMORY_TO_REGISTER, source.reg, source.value, destination.reg);
+      return;
+    case LOCATION_IMMEDIATE:
+      femit_x86_64(context, I_MOV, IMMEDIATE_TO_REGISTER, source.value, destination.reg);
+      return;
+    }
+    break;
+  case LOCATION_MEMORY:
+    switch (source.kind) {
+    case LOCATION_REGISTER:
+      femit_x86_64(context, I_MOV, REGISTER_TO_MEMORY, source.reg, destination.reg, destination.value);
+      return;
+    case LOCATION_IMMEDIATE:
+      if (fits_immediate_x86_64(source.value)) {
+        femit_x86_64(context, I_MOV, IMMEDIATE_TO_MEMORY, source.value, destination.reg, destination.value);
+        return;
+      }
+      // Fall through.
+    case LOCATION_MEMORY:
+      emit_move_x86_64(context, source, location_register(REG_R10));
+      emit_move_x86_64(context, location_register(REG_R10), destination);
+      return;
+    }
+    break;
+  case LOCATION_IMMEDIATE:
+    break;
+  }
+  UNREACHABLE();
+}
+
+/** Emit the COUNT moves in MOVES as if they all happened at once.
+ *
+ * A move is emitted once no other pending move reads its destination.
+ * If that holds for none of them, the rest form cycles, one of which
+ * is broken by saving a destination in R11 first.
+ */
+static void emit_parallel_move_x86_64(CodegenContext *context, Move *moves, size_t count) {
+  size_t pending = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (!location_equal(moves[i].source, moves[i].destination)) {
+      moves[pending++] = moves[i];
+    }
+  }
+
+  while (pending) {
+    char progress = 0;
+    size_t i = 0;
+    while (i < pending) {
+      char blocked = 0;
+      for (size_t j = 0; j < pending; ++j) {
+        if (j != i && location_equal(moves[j].source, moves[i].destination)) {
+          blocked = 1;
+          break;
+        }
+      }
+      if (blocked) {
+        ++i;
+        continue;
+      }
+      emit_move_x86_64(context, moves[i].source, moves[i].destination);
+      moves[i] = moves[--pending];
+      progress = 1;
+    }
+
+    if (!progress) {
+      Location saved = moves[0].destination;
+      emit_move_x86_64(context, saved, location_register(REG_R11));
+      for (size_t j = 0; j < pending; ++j) {
+        if (location_equal(moves[j].source, saved)) {
+          moves[j].source = location_register(REG_R11);
+        }
+      }
+    }
+  }
+}
+
+/// The register to compute VALUE in: its own, or R10 if it was
+/// spilled.
+static RegisterDescriptor result_register_x86_64(IRInstruction *value) {
+  return value->spill_slot ? REG_R10 : value->result;
+}
+
+/// Write VALUE back to its stack slot if it was computed in R10.
+static void emit_result_x86_64(CodegenContext *context, IRInstruction *value) {
+  if (value->spill_slot) {
+    codegen_store_local_x86_64(context, REG_R10, spill_offset_x86_64(context, value->spill_slot));
+  }
+}
+
+/// Return a register that holds VALUE, loading it into SCRATCH if
+/// there is none.
+static RegisterDescriptor operand_register_x86_64
+(CodegenContext *context,
+ IRInstruction *value,
+ RegisterDescriptor scratch)
+{
+  Location location = value_location_x86_64(context, value);
+  if (location.kind == LOCATION_REGISTER) { return location.reg; }
+  emit_move_x86_64(context, location, location_register(scratch));
+  return scratch;
+}
+
+static void emit_arithmetic_x86_64
+(CodegenContext *context,
+ IRInstruction *instruction,
+ enum Instructions_x86_64 operation)
+{
+  RegisterDescriptor result = result_register_x86_64(instruction);
+  Location lhs = value_location_x86_64(context, instruction->value.pair.car);
+  Location rhs = value_location_x86_64(context, instruction->value.pair.cdr);
+
+  // Prefer an immediate on the right, and the result register on the
+  // left.
+  if (operation != I_SUB
+      && (lhs.kind == LOCATION_IMMEDIATE
+          || location_equal(rhs, location_register(result)))) {
+    Location tmp = lhs;
+    lhs = rhs;
+    rhs = tmp;
+  }
+
+  // Adding a constant to a register that stays live is a single lea.
+  if (operation == I_ADD
+      && rhs.kind == LOCATION_IMMEDIATE && fits_immediate_x86_64(rhs.value)
+      && lhs.kind == LOCATION_REGISTER && lhs.reg != result) {
+    femit_x86_64(context, I_LEA, MEMORY_TO_REGISTER, lhs.reg, rhs.value, result);
+    emit_result_x86_64(context, instruction);
+    return;
+  }
+
+  // RHS would be overwritten by LHS.
+  if (location_equal(rhs, location_register(result)) && !location_equal(lhs, rhs)) {
+    emit_move_x86_64(context, rhs, location_register(REG_R11));
+    rhs = location_register(REG_R11);
+  }
+  if (rhs.kind == LOCATION_IMMEDIATE
+      && (operation == I_IMUL || !fits_immediate_x86_64(rhs.value))) {
+    emit_move_x86_64(context, rhs, location_register(REG_R11));
+    rhs = location_register(REG_R11);
+  }
+
+  emit_move_x86_64(context, lhs, location_register(result));
+  switch (rhs.kind) {
+  case LOCATION_REGISTER:
+    switch (operation) {
+    case I_ADD: codegen_add_x86_64(context, rhs.reg, result); break;
+    case I_SUB: codegen_subtract_x86_64(context, result, rhs.reg); break;
+    case I_IMUL: codegen_multiply_x86_64(context, rhs.reg, result); break;
+    default: UNREACHABLE();
+    }
+    break;
+  case LOCATION_MEMORY:
+    femit_x86_64(context, operation, MEMORY_TO_REGISTER, rhs.reg, rhs.value, result);
+    break;
+  case LOCATION_IMMEDIATE:
+    if (operation == I_ADD) {
+      codegen_add_immediate_x86_64(context, result, rhs.value);
+    } else {
+      femit_x86_64(context, operation, IMMEDIATE_TO_REGISTER, rhs.value, result);
+    }
+    break;
+  }
+  emit_result_x86_64(context, instruction);
+}
+
+/// idiv divides RDX:RAX, so both are saved around it unless they are
+/// the result.
+static void emit_division_x86_64(CodegenContext *context, IRInstruction *instruction) {
+  RegisterDescriptor result = result_register_x86_64(instruction);
+  char save_rax = result != REG_RAX;
+  char save_rdx = result != REG_RDX;
+
+  emit_move_x86_64(context,
+                   value_location_x86_64(context, instruction->value.pair.cdr),
+                   location_register(REG_R11));
+  if (save_rax) { femit_x86_64(context, I_PUSH, REGISTER, REG_RAX); }
+  if (save_rdx) { femit_x86_64(context, I_PUSH, REGISTER, REG_RDX); }
+  emit_move_x86_64(context,
+                   value_location_x86_64(context, instruction->value.pair.car),
+                   location_register(REG_RAX));
+  femit_x86_64(context, I_CQO);
+  femit_x86_64(context, I_IDIV, REGISTER, REG_R11);
+  codegen_copy_register_x86_64(context,
+                               instruction->type == IR_DIVIDE ? REG_RAX : REG_RDX,
+                               REG_R10);
+  if (save_rdx) { femit_x86_64(context, I_POP, REGISTER, REG_RDX); }
+  if (save_rax) { femit_x86_64(context, I_POP, REGISTER, REG_RAX); }
+  codegen_copy_register_x86_64(context, REG_R10, result);
+  emit_result_x86_64(context, instruction);
+}
+
+/// A shift count that is not a constant has to be in CL.
+static void emit_shift_x86_64
+(CodegenContext *context,
+ IRInstruction *instruction,
+ enum Instructions_x86_64 operation)
+{
+  RegisterDescriptor result = result_register_x86_64(instruction);
+  Location lhs = value_location_x86_64(context, instruction->value.pair.car);
+  Location rhs = value_location_x86_64(context, instruction->value.pair.cdr);
+
+  if (rhs.kind == LOCATION_IMMEDIATE) {
+    emit_move_x86_64(context, lhs, location_register(result));
+    femit_x86_64(context, operation, IMMEDIATE_TO_REGISTER, rhs.value & 63, result);
+  } else {
+    emit_move_x86_64(context, lhs, location_register(REG_R10));
+    emit_move_x86_64(context, rhs, location_register(REG_R11));
+    if (result != REG_RCX) { femit_x86_64(context, I_PUSH, REGISTER, REG_RCX); }
+    codegen_copy_register_x86_64(context, REG_R11, REG_RCX);
+    femit_x86_64(context, operation, REGISTER, REG_R10);
+    if (result != REG_RCX) { femit_x86_64(context, I_POP, REGISTER, REG_RCX); }
+    codegen_copy_register_x86_64(context, REG_R10, result);
+  }
+  emit_result_x86_64(context, instruction);
+}
+
+static enum IndirectJumpType_x86_64 comparison_jump_type_x86_64(enum ComparisonType type) {
+  switch (type) {
+  case COMPARE_EQ: return JUMP_TYPE_E;
+  case COMPARE_NE: return JUMP_TYPE_NE;
+  case COMPARE_LT: return JUMP_TYPE_L;
+  case COMPARE_LE: return JUMP_TYPE_LE;
+  case COMPARE_GT: return JUMP_TYPE_G;
+  case COMPARE_GE: return JUMP_TYPE_GE;
+  default: PANIC("Invalid comparison type %d", type);
+  }
+  return JUMP_TYPE_COUNT;
+}
+
+static enum ComparisonType comparison_inverse(enum ComparisonType type) {
+  switch (type) {
+  case COMPARE_EQ: return COMPARE_NE;
+  case COMPARE_NE: return COMPARE_EQ;
+  case COMPARE_LT: return COMPARE_GE;
+  case COMPARE_LE: return COMPARE_GT;
+  case COMPARE_GT: return COMPARE_LE;
+  case COMPARE_GE: return COMPARE_LT;
+  default: PANIC("Invalid comparison type %d", type);
+  }
+  return COMPARE_COUNT;
+}
+
+/// Set the flags according to the operands of COMPARISON.
+static void emit_compare_x86_64(CodegenContext *context, IRInstruction *comparison) {
+  RegisterDescriptor lhs = operand_register_x86_64(context, comparison->value.comparison.pair.car, REG_R10);
+  Location rhs = value_location_x86_64(context, comparison->value.comparison.pair.cdr);
+  if (rhs.kind == LOCATION_IMMEDIATE && !fits_immediate_x86_64(rhs.value)) {
+    emit_move_x86_64(context, rhs, location_register(REG_R11));
+    rhs = location_register(REG_R11);
+  }
+  switch (rhs.kind) {
+  case LOCATION_REGISTER:
+    femit_x86_64(context, I_CMP, REGISTER_TO_REGISTER, rhs.reg, lhs);
+    break;
+  case LOCATION_MEMORY:
+    femit_x86_64(context, I_CMP, MEMORY_TO_REGISTER, rhs.reg, rhs.value, lhs);
+    break;
+  case LOCATION_IMMEDIATE:
+    femit_x86_64(context, I_CMP, IMMEDIATE_TO_REGISTER, rhs.value, lhs);
+    break;
+  }
+}
+
+static void emit_comparison_x86_64(CodegenContext *context, IRInstruction *instruction) {
+  enum ComparisonType type = instruction->value.comparison.type;
+  RegisterDescriptor result = result_register_x86_64(instruction);
+  Location lhs = value_location_x86_64(context, instruction->value.comparison.pair.car);
+  Location rhs = value_location_x86_64(context, instruction->value.comparison.pair.cdr);
+
+  if (lhs.kind == LOCATION_REGISTER && rhs.kind == LOCATION_REGISTER
+      && lhs.reg != result && rhs.reg != result) {
+    codegen_comparison_x86_64(context, type, lhs.reg, rhs.reg, result);
+  } else {
+    // The result register may hold an operand, so it is only cleared
+    // after the comparison, by a move that leaves the flags alone.
+    emit_compare_x86_64(context, instruction);
+    femit_x86_64(context, I_MOV, IMMEDIATE_TO_REGISTER, (int64_t)0, result);
+    femit_x86_64(context, I_SETCC, type, result);
+  }
+  emit_result_x86_64(context, instruction);
+}
+
+/// Return non-zero iff CALL is to a function that is not part of the
+/// program. Functions of the program are named by local labels, which
+/// no identifier can be spelled like.
+static char calls_external_x86_64(IRCall *call) {
+  return call->type == IR_CALLTYPE_DIRECT && strncmp(call->value.name, ".L", 2) != 0;
+}
+
+static void emit_call_x86_64(CodegenContext *context, IRInstruction *instruction) {
+  ArchData *arch = context->arch_data;
+  const CallingConvention_x86_64 *convention = arch->convention;
+  IRCall *call = &instruction->value.call;
+  size_t argument_count = call->argument_count;
+
+  // Arguments and the callee are all put in place at once, as any of
+  // them may be in a register another one goes to.
+  Move *moves = calloc(argument_count + 1, sizeof(Move));
+  ASSERT(moves, "Could not allocate memory for call arguments.");
+  size_t move_count = 0;
+  for (size_t i = 0; i < argument_count; ++i) {
+    Move *move = moves + move_count;
+    move->source = value_location_x86_64(context, call->arguments[i]);
+    if (move_count < convention->argument_register_count) {
+      move->destination = location_register(convention->argument_registers[move_count]);
+    } else {
+      move->destination = location_memory
+        (REG_RSP, convention->shadow_space
+         + 8 * (int64_t)(move_count - convention->argument_register_count));
+    }
+    move_count++;
+  }
+  if (call->type == IR_CALLTYPE_INDIRECT) {
+    moves[move_count].source = value_location_x86_64(context, call->value.callee);
+    moves[move_count].destination = location_register(REG_RAX);
+    move_count++;
+  }
+  emit_parallel_move_x86_64(context, moves, move_count);
+  free(moves);
+
+  // No floating point values are ever passed, in vector registers or
+  // otherwise. RAX is no argument register, so it is free by now.
+  if (convention->counts_vector_arguments && calls_external_x86_64(call)) {
+    codegen_zero_register_x86_64(context, REG_RAX);
+  }
+
+  if (call->type == IR_CALLTYPE_INDIRECT) {
+    femit_x86_64(context, I_CALL, REGISTER, REG_RAX);
+  } else {
+    femit_x86_64(context, I_CALL, NAME, call->value.name);
+  }
+  emit_move_x86_64(context, location_register(REG_RAX), value_location_x86_64(context, instruction));
+}
+
+static void emit_return_x86_64(CodegenContext *context) {
+  ArchData *arch = context->arch_data;
+  IRInstruction *return_value = arch->function->return_value;
+  if (return_value && ir_is_value(return_value)) {
+    emit_move_x86_64(context, value_location_x86_64(context, return_value), location_register(REG_RAX));
+  } else {
+    codegen_zero_register_x86_64(context, REG_RAX);
+  }
+  for (size_t i = 0; i < arch->saved_register_count; ++i) {
+    codegen_load_local_into_x86_64(context, -8 * (long long)(i + 1), arch->saved_registers[i]);
+  }
+  codegen_epilogue_x86_64(context);
+}
+
 void emit_instruction(CodegenContext *context, IRInstruction *instruction) {
+  ASSERT(IR_COUNT == 24, "emit_instruction() must exhaustively handle IR instruction types.");
+  RegisterDescriptor result = result_register_x86_64(instruction);
   switch (instruction->type) {
+  case IR_IMMEDIATE:
+  case IR_PHI:
+  case IR_PARAMETER_REFERENCE:
+  case IR_STACK_ALLOCATE:
+    // Folded into uses, copied to by predecessors, or part of the
+    // stack frame.
+    break;
+  case IR_CALL:
+    emit_call_x86_64(context, instruction);
+    break;
+  case IR_RETURN:
+    emit_return_x86_64(context);
+    break;
+  case IR_LOAD: {
+    RegisterDescriptor address = operand_register_x86_64(context, instruction->value.reference, REG_R11);
+    femit_x86_64(context, I_MOV, MEMORY_TO_REGISTER, address, (int64_t)0, result);
+    emit_result_x86_64(context, instruction);
+  } break;
+  case IR_STORE: {
+    RegisterDescriptor address = operand_register_x86_64(context, instruction->value.pair.car, REG_R11);
+    Location data = value_location_x86_64(context, instruction->value.pair.cdr);
+    if (data.kind == LOCATION_REGISTER) {
+      codegen_store_x86_64(context, data.reg, address);
+    } else {
+      emit_move_x86_64(context, data, location_memory(address, 0));
+    }
+  } break;
+  case IR_ADD:
+    emit_arithmetic_x86_64(context, instruction, I_ADD);
+    break;
+  case IR_SUBTRACT:
+    emit_arithmetic_x86_64(context, instruction, I_SUB);
+    break;
+  case IR_MULTIPLY:
+    emit_arithmetic_x86_64(context, instruction, I_IMUL);
+    break;
+  case IR_DIVIDE:
+  case IR_MODULO:
+    emit_division_x86_64(context, instruction);
+    break;
+  case IR_SHIFT_LEFT:
+    emit_shift_x86_64(context, instruction, I_SAL);
+    break;
+  case IR_SHIFT_RIGHT_ARITHMETIC:
+    emit_shift_x86_64(context, instruction, I_SAR);
+    break;
+  case IR_LOCAL_LOAD:
+    codegen_load_local_into_x86_64(context,
+                                   local_offset_x86_64(context, instruction->value.reference),
+                                   result);
+    emit_result_x86_64(context, instruction);
+    break;
+  case IR_LOCAL_STORE:
+    emit_move_x86_64(context,
+                     value_location_x86_64(context, instruction->value.pair.cdr),
+                     location_memory(REG_RBP, local_offset_x86_64(context, instruction->value.pair.car)));
+    break;
+  case IR_LOCAL_ADDRESS:
+    codegen_load_local_address_into_x86_64(context,
+                                           local_offset_x86_64(context, instruction->value.reference),
+                                           result);
+    emit_result_x86_64(context, instruction);
+    break;
+  case IR_GLOBAL_LOAD:
+    codegen_load_global_into_x86_64(context, instruction->value.name, result);
+    emit_result_x86_64(context, instruction);
+    break;
+  case IR_GLOBAL_STORE:
+    codegen_store_global_x86_64(context,
+                                operand_register_x86_64(context,
+                                                        instruction->value.global_assignment.new_value,
+                                                        REG_R11),
+                                instruction->value.global_assignment.name);
+    break;
+  case IR_GLOBAL_ADDRESS:
+    codegen_load_global_address_into_x86_64(context, instruction->value.name, result);
+    emit_result_x86_64(context, instruction);
+    break;
+  case IR_COMPARISON:
+    emit_comparison_x86_64(context, instruction);
+    break;
+  default:
+    // Branches need to know their block, see emit_branch().
+    PANIC("emit_instruction(): Unexpected IRType %d", instruction->type);
+  }
+}
+
+static void block_label_x86_64(char *label, IRBlock *block) {
+  snprintf(label, LABEL_SIZE_X86_64, ".Lbb%zu", block->id);
+}
+
+/// Label for the copies on the edge from BLOCK to SUCCESSOR, if they
+/// can not be put at the end of BLOCK.
+static void edge_label_x86_64(char *label, IRBlock *block, IRBlock *successor) {
+  snprintf(label, LABEL_SIZE_X86_64, ".Lbb%zu_%zu", block->id, successor->id);
+}
+
+/// Emit LABEL right away; see femit_x86_64_direct().
+static void femit_label_x86_64_direct(CodegenContext *context, const char *label) {
+  if (context->object) {
+    object_file_label(context->object, label, 0);
+    return;
+  }
+  code_buffer_string(context->code, label);
+  code_buffer_literal(context->code, ":\n");
+}
+
+static void femit_label_x86_64(CodegenContext *context, const char *label) {
+  ArchData *arch = context->arch_data;
+  if (!arch || !arch->function) {
+    femit_label_x86_64_direct(context, label);
+    return;
+  }
+  machine_instruction_x86_64(arch)->label = machine_name_x86_64(arch, label);
+}
+
+/// Index of the first instruction after INDEX that was not removed, or
+/// COUNT if there is none.
+static size_t peephole_next_x86_64(MachineInstruction_x86_64 *instructions, size_t count, size_t index) {
+  do { index++; } while (index < count && instructions[index].removed);
+  return index;
+}
+
+static char peephole_is_x86_64
+(MachineInstruction_x86_64 *machine,
+ enum Instructions_x86_64 instruction,
+ enum InstructionOperands_x86_64 operands)
+{
+  return machine && !machine->label && machine->instruction == instruction && machine->operands == operands;
+}
+
+/// Whether nothing reads the flags after instruction INDEX before they
+/// are written again. The backend never keeps the flags alive across
+/// a label or out of a block, so that is where the search stops.
+static char peephole_flags_dead_x86_64(MachineInstruction_x86_64 *instructions, size_t count, size_t index) {
+  for (index = peephole_next_x86_64(instructions, count, index);
+       index < count;
+       index = peephole_next_x86_64(instructions, count, index)
+       ) {
+    MachineInstruction_x86_64 *machine = instructions + index;
+    if (machine->label) { return 1; }
+    switch (machine->instruction) {
+    case I_JCC:
+    case I_SETCC:
+      return 0;
+    case I_ADD:
+    case I_SUB:
+    case I_IMUL:
+    case I_IDIV:
+    case I_XOR:
+    case I_CMP:
+    case I_TEST:
+    case I_CALL:
+    case I_JMP:
+    case I_RET:
+      return 1;
+    case I_SAL:
+    case I_SAR:
+    case I_SHR:
+      // A shift by zero, or by CL which may be zero, leaves them alone.
+      return machine->operands == IMMEDIATE_TO_REGISTER && (machine->immediate & 63);
+    default:
+      break;
+    }
+  }
+  return 1;
+}
+
+/// Whether all of REG except the low byte is known to be zero right
+/// before instruction INDEX, which is how the backend sets up the
+/// result of a SETCC.
+static char peephole_zeroed_x86_64(MachineInstruction_x86_64 *instructions, size_t index, RegisterDescriptor reg) {
+  while (index--) {
+    MachineInstruction_x86_64 *machine = instructions + index;
+    if (machine->removed) { continue; }
+    if (peephole_is_x86_64(machine, I_XOR, REGISTER_TO_REGISTER)) {
+      return machine->source == reg && machine->destination == reg;
+    }
+    if (peephole_is_x86_64(machine, I_MOV, IMMEDIATE_TO_REGISTER) && machine->destination == reg) {
+      return machine->immediate == 0;
+    }
+    if (machine->label || (machine->instruction != I_CMP && machine->instruction != I_TEST)) {
+      return 0;
+    }
+  }
+  return 0;
+}
+
+/// Whether MACHINE only writes its destination register.
+static char peephole_pure_move_x86_64(MachineInstruction_x86_64 *machine) {
+  if (machine->label || (machine->instruction != I_MOV && machine->instruction != I_LEA)) { return 0; }
+  switch (machine->operands) {
+  case IMMEDIATE_TO_REGISTER:
+  case MEMORY_TO_REGISTER:
+  case NAME_TO_REGISTER:
+  case REGISTER_TO_REGISTER:
+    return 1;
   default:
-    TODO("Handle IRType %d\n", instruction->type);
+    return 0;
+  }
+}
+
+/// Whether MACHINE overwrites REG without reading it.
+static char peephole_overwrites_x86_64(MachineInstruction_x86_64 *machine, RegisterDescriptor reg) {
+  if (!peephole_pure_move_x86_64(machine) || machine->destination != reg) { return 0; }
+  switch (machine->operands) {
+  case REGISTER_TO_REGISTER: return machine->source != reg;
+  case MEMORY_TO_REGISTER:
+  case NAME_TO_REGISTER: return machine->address != reg;
+  default: return 1;
+  }
+}
+
+/// Try to remove or simplify instruction INDEX, looking at the ones
+/// up to the next label. Return whether anything changed.
+static char peephole_instruction_x86_64(MachineInstruction_x86_64 *instructions, size_t count, size_t index) {
+  MachineInstruction_x86_64 *machine = instructions + index;
+  size_t next_index = peephole_next_x86_64(instructions, count, index);
+  MachineInstruction_x86_64 *next = NULL;
+  if (next_index < count && !instructions[next_index].label) {
+    next = instructions + next_index;
+  }
+
+  // mov %rax, %rax
+  if (peephole_is_x86_64(machine, I_MOV, REGISTER_TO_REGISTER) && machine->source == machine->destination) {
+    machine->removed = 1;
+    return 1;
+  }
+
+  // lea 0(%rax), %rcx  ->  mov %rax, %rcx
+  if (peephole_is_x86_64(machine, I_LEA, MEMORY_TO_REGISTER) && machine->offset == 0 && machine->address != REG_RIP) {
+    machine->instruction = I_MOV;
+    machine->operands = REGISTER_TO_REGISTER;
+    machine->source = machine->address;
+    return 1;
+  }
+
+  // add $0, %rax
+  if ((peephole_is_x86_64(machine, I_ADD, IMMEDIATE_TO_REGISTER)
+       || peephole_is_x86_64(machine, I_SUB, IMMEDIATE_TO_REGISTER))
+      && machine->immediate == 0
+      && peephole_flags_dead_x86_64(instructions, count, index)) {
+    machine->removed = 1;
+    return 1;
+  }
+
+  // mov $0, %rax  ->  xor %rax, %rax
+  if (peephole_is_x86_64(machine, I_MOV, IMMEDIATE_TO_REGISTER)
+      && machine->immediate == 0
+      && peephole_flags_dead_x86_64(instructions, count, index)) {
+    machine->instruction = I_XOR;
+    machine->operands = REGISTER_TO_REGISTER;
+    machine->source = machine->destination;
+    return 1;
+  }
+
+  if (!next) { return 0; }
+
+  // push %rax; pop %rcx  ->  mov %rax, %rcx
+  if (peephole_is_x86_64(machine, I_PUSH, REGISTER) && peephole_is_x86_64(next, I_POP, REGISTER)) {
+    next->removed = 1;
+    if (machine->source == next->source) {
+      machine->removed = 1;
+    } else {
+      machine->instruction = I_MOV;
+      machine->operands = REGISTER_TO_REGISTER;
+      machine->destination = next->source;
+    }
+    return 1;
+  }
+
+  // mov %rax, %rcx; mov %rcx, %rax
+  if (peephole_is_x86_64(machine, I_MOV, REGISTER_TO_REGISTER)
+      && peephole_is_x86_64(next, I_MOV, REGISTER_TO_REGISTER)
+      && machine->source == next->destination
+      && machine->destination == next->source) {
+    next->removed = 1;
+    return 1;
+  }
+
+  // mov %rax, -8(%rbp); mov -8(%rbp), %rcx  ->  mov %rax, -8(%rbp); mov %rax, %rcx
+  if (peephole_is_x86_64(machine, I_MOV, REGISTER_TO_MEMORY)
+      && peephole_is_x86_64(next, I_MOV, MEMORY_TO_REGISTER)
+      && machine->address == next->address
+      && machine->offset == next->offset) {
+    next->operands = REGISTER_TO_REGISTER;
+    next->source = machine->source;
+    return 1;
+  }
+
+  // mov -8(%rbp), %rax; mov %rax, -8(%rbp)
+  if (peephole_is_x86_64(machine, I_MOV, MEMORY_TO_REGISTER)
+      && peephole_is_x86_64(next, I_MOV, REGISTER_TO_MEMORY)
+      && machine->address == next->address
+      && machine->offset == next->offset
+      && machine->destination == next->source
+      && machine->destination != machine->address) {
+    next->removed = 1;
+    return 1;
+  }
+
+  // mov $1, %rax; mov %rcx, %rax
+  if (peephole_pure_move_x86_64(machine) && peephole_overwrites_x86_64(next, machine->destination)) {
+    machine->removed = 1;
+    return 1;
+  }
+
+  // sete %al; test %rax, %rax; jz .L0  ->  sete %al; jne .L0
+  // The SETCC stays, as its result may be used elsewhere.
+  if (!machine->label && machine->instruction == I_SETCC
+      && peephole_is_x86_64(next, I_TEST, REGISTER_TO_REGISTER)
+      && next->source == machine->destination
+      && next->destination == machine->destination
+      && peephole_zeroed_x86_64(instructions, index, machine->destination)) {
+    size_t jump_index = peephole_next_x86_64(instructions, count, next_index);
+    MachineInstruction_x86_64 *jump = jump_index < count ? instructions + jump_index : NULL;
+    if (jump && !jump->label && jump->instruction == I_JCC) {
+      enum ComparisonType type = machine->condition;
+      switch (jump->condition) {
+      case JUMP_TYPE_Z:
+      case JUMP_TYPE_E:
+        type = comparison_inverse(type);
+        // FALLTHROUGH
+      case JUMP_TYPE_NZ:
+      case JUMP_TYPE_NE:
+        jump->condition = comparison_jump_type_x86_64(type);
+        next->removed = 1;
+        return 1;
+      default:
+        break;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/// Remove and simplify instructions of the current function until
+/// nothing changes anymore.
+static void peephole_optimize_x86_64(ArchData *arch) {
+  MachineInstruction_x86_64 *instructions = arch->machine_instructions;
+  size_t count = arch->machine_instruction_count;
+  for (char changed = 1; changed;) {
+    changed = 0;
+    for (size_t index = 0; index < count; ++index) {
+      if (instructions[index].removed || instructions[index].label) { continue; }
+      if (peephole_instruction_x86_64(instructions, count, index)) { changed = 1; }
+    }
+  }
+}
+
+/// Emit MACHINE right away.
+static void femit_machine_instruction_x86_64(CodegenContext *context, MachineInstruction_x86_64 *machine) {
+  if (machine->label) {
+    femit_label_x86_64_direct(context, machine->label);
+    return;
+  }
+
+  enum Instructions_x86_64 instruction = machine->instruction;
+  switch (instruction) {
+  case I_SETCC:
+    femit_x86_64_direct(context, instruction, (enum ComparisonType)machine->condition, machine->destination);
+    return;
+  case I_JCC:
+    femit_x86_64_direct(context, instruction, (enum IndirectJumpType_x86_64)machine->condition, machine->name);
+    return;
+  case I_RET:
+  case I_CQO:
+    femit_x86_64_direct(context, instruction);
+    return;
+  default:
+    break;
+  }
+
+  switch (machine->operands) {
+  case IMMEDIATE:
+    femit_x86_64_direct(context, instruction, IMMEDIATE, machine->immediate);
+    break;
+  case MEMORY:
+    femit_x86_64_direct(context, instruction, MEMORY, machine->offset, machine->address);
+    break;
+  case REGISTER:
+    femit_x86_64_direct(context, instruction, REGISTER, machine->source);
+    break;
+  case NAME:
+    femit_x86_64_direct(context, instruction, NAME, machine->name);
+    break;
+  case IMMEDIATE_TO_REGISTER:
+    femit_x86_64_direct(context, instruction, IMMEDIATE_TO_REGISTER, machine->immediate, machine->destination);
+    break;
+  case IMMEDIATE_TO_MEMORY:
+    femit_x86_64_direct(context, instruction, IMMEDIATE_TO_MEMORY,
+                        machine->immediate, machine->address, machine->offset);
+    break;
+  case MEMORY_TO_REGISTER:
+    femit_x86_64_direct(context, instruction, MEMORY_TO_REGISTER,
+                        machine->address, machine->offset, machine->destination);
+    break;
+  case NAME_TO_REGISTER:
+    femit_x86_64_direct(context, instruction, NAME_TO_REGISTER,
+                        machine->address, machine->name, machine->destination);
+    break;
+  case REGISTER_TO_MEMORY:
+    femit_x86_64_direct(context, instruction, REGISTER_TO_MEMORY,
+                        machine->source, machine->address, machine->offset);
+    break;
+  case REGISTER_TO_REGISTER:
+    femit_x86_64_direct(context, instruction, REGISTER_TO_REGISTER, machine->source, machine->destination);
+    break;
+  case REGISTER_TO_NAME:
+    femit_x86_64_direct(context, instruction, REGISTER_TO_NAME,
+                        machine->source, machine->address, machine->name);
     break;
   }
 }
 
+/// Emit the instructions recorded for the current function, after the
+/// peephole optimizer had a go at them if optimizations are enabled.
+static void femit_machine_instructions_x86_64(CodegenContext *context) {
+  ArchData *arch = context->arch_data;
+  if (context->optimization_level >= 1) {
+    peephole_optimize_x86_64(arch);
+  }
+  for (size_t index = 0; index < arch->machine_instruction_count; ++index) {
+    if (arch->machine_instructions[index].removed) { continue; }
+    femit_machine_instruction_x86_64(context, arch->machine_instructions + index);
+  }
+  arch->machine_instruction_count = 0;
+  arena_reset(&arch->machine_names);
+}
+
+/// Emit the copies into the phi nodes of SUCCESSOR for the edge from
+/// BLOCK, and return how many there are. If EMIT is zero, only count.
+static size_t phi_copies_x86_64(CodegenContext *context, IRBlock *block, IRBlock *successor, char emit) {
+  size_t count = 0;
+  for (uint32_t i = 0; i < successor->instruction_count; ++i) {
+    IRInstruction *phi = successor->instructions[i];
+    if (phi->type != IR_PHI) { continue; }
+    for (IRPhiArgument *argument = phi->value.phi_argument; argument; argument = argument->next) {
+      if (argument->block == block) { count++; }
+    }
+  }
+  if (!emit || !count) { return count; }
+
+  Move *moves = calloc(count, sizeof(Move));
+  ASSERT(moves, "Could not allocate memory for phi copies.");
+  size_t move_count = 0;
+  for (uint32_t i = 0; i < successor->instruction_count; ++i) {
+    IRInstruction *phi = successor->instructions[i];
+    if (phi->type != IR_PHI) { continue; }
+    for (IRPhiArgument *argument = phi->value.phi_argument; argument; argument = argument->next) {
+      if (argument->block != block) { continue; }
+      moves[move_count].source = value_location_x86_64(context, argument->value);
+      moves[move_count].destination = value_location_x86_64(context, phi);
+      move_count++;
+    }
+  }
+  emit_parallel_move_x86_64(context, moves, move_count);
+  free(moves);
+  return count;
+}
+
+/// Leave BLOCK for SUCCESSOR, falling through if it comes next and
+/// FALLTHROUGH is non-zero.
+static void emit_jump_x86_64(CodegenContext *context, IRBlock *block, IRBlock *successor, char fallthrough) {
+  phi_copies_x86_64(context, block, successor, 1);
+  if (!fallthrough || block->next != successor) {
+    char label[LABEL_SIZE_X86_64];
+    block_label_x86_64(label, successor);
+    codegen_branch_x86_64(context, label);
+  }
+}
+
+/// A comparison that is only used by the conditional branch right
+/// after it is not materialized; the branch jumps on the flags.
+static char comparison_fused_x86_64(CodegenContext *context, IRBlock *block, IRInstruction *comparison) {
+  ArchData *arch = context->arch_data;
+  return comparison->type == IR_COMPARISON
+    && block->instruction_count
+    && block->instructions[block->instruction_count - 1] == comparison
+    && block->branch->type == IR_BRANCH_CONDITIONAL
+    && block->branch->value.conditional_branch.condition == comparison
+    && arch->use_counts[comparison->index] == 1;
+}
+
+static void emit_branch_x86_64(CodegenContext *context, IRBlock *block) {
+  IRInstruction *branch = block->branch;
+  switch (branch->type) {
+  case IR_RETURN:
+    emit_instruction(context, branch);
+    break;
+  case IR_BRANCH:
+    emit_jump_x86_64(context, block, branch->value.block, 1);
+    break;
+  case IR_BRANCH_CONDITIONAL: {
+    IRBranchConditional *conditional = &branch->value.conditional_branch;
+    // Jump away to one successor and fall into the other, preferably
+    // the one that comes next.
+    char jump_if_true = block->next != conditional->true_branch;
+    IRBlock *taken = jump_if_true ? conditional->true_branch : conditional->false_branch;
+    IRBlock *other = jump_if_true ? conditional->false_branch : conditional->true_branch;
+    char trampoline = phi_copies_x86_64(context, block, taken, 0) != 0;
+
+    char label[LABEL_SIZE_X86_64];
+    if (trampoline) {
+      edge_label_x86_64(label, block, taken);
+    } else {
+      block_label_x86_64(label, taken);
+    }
+
+    IRInstruction *condition = conditional->condition;
+    if (comparison_fused_x86_64(context, block, condition)) {
+      enum ComparisonType type = condition->value.comparison.type;
+      emit_compare_x86_64(context, condition);
+      femit_x86_64(context, I_JCC,
+                   comparison_jump_type_x86_64(jump_if_true ? type : comparison_inverse(type)),
+                   label);
+    } else {
+      RegisterDescriptor reg = operand_register_x86_64(context, condition, REG_R10);
+      if (jump_if_true) {
+        femit_x86_64(context, I_TEST, REGISTER_TO_REGISTER, reg, reg);
+        femit_x86_64(context, I_JCC, JUMP_TYPE_NZ, label);
+      } else {
+        codegen_branch_if_zero_x86_64(context, reg, label);
+      }
+    }
+
+    emit_jump_x86_64(context, block, other, !trampoline);
+    if (trampoline) {
+      femit_label_x86_64(context, label);
+      emit_jump_x86_64(context, block, taken, 1);
+    }
+  } break;
+  default:
+    PANIC("Block ends in IRType %d, which is not a branch.", branch->type);
+  }
+}
+
 void emit_block(CodegenContext *context, IRBlock *block) {
-  // TODO: Generate block label.
-  for (IRInstruction *instruction = block->instructions;
-       instruction;
-       instruction = instruction->next
-       ) {
+  char label[LABEL_SIZE_X86_64];
+  block_label_x86_64(label, block);
+  femit_label_x86_64(context, label);
+
+  for (uint32_t i = 0; i < block->instruction_count; ++i) {
+    IRInstruction *instruction = block->instructions[i];
+    if (comparison_fused_x86_64(context, block, instruction)) { continue; }
     emit_instruction(context, instruction);
   }
 
-  emit_instruction(context, block->branch);
+  emit_branch_x86_64(context, block);
 }
 
+static void count_use_x86_64(IRInstruction **operand, void *data) {
+  ArchData *arch = data;
+  size_t index = (*operand)->index;
+  if (index < arch->instruction_count && arch->instructions[index] == *operand) {
+    arch->use_counts[index]++;
+  }
+}
+
+/** Emit FUNCTION, which register allocation has been run on.
+ *
+ * The frame below the saved RBP holds, from the top: the nonvolatile
+ * registers the function uses, the stack slots of spilled values,
+ * stack allocations, the register parameters if the caller reserved
+ * no shadow space for them, and the arguments of the calls it makes.
+ * Register parameters are stored to memory on entry, so parameters are
+ * always read from memory. A function that makes no calls, and pushes
+ * nothing around a division or shift, keeps its frame in the red zone,
+ * if there is one and it fits.
+ */
 void emit_function(CodegenContext *context, IRFunction *function) {
-  // TODO: Generate function label.
+  ArchData *arch = context->arch_data;
+  const CallingConvention_x86_64 *convention = arch->convention;
+  ASSERT(function->name, "Function f%zu has no name.", function->id);
+
+  arch->function = function;
+  arch->instruction_count = function->last->branch->index + 1;
+  arch->instructions = calloc(arch->instruction_count, sizeof(IRInstruction *));
+  arch->use_counts = calloc(arch->instruction_count, sizeof(size_t));
+  arch->frame_offsets = calloc(arch->instruction_count, sizeof(int64_t));
+  ASSERT(arch->instructions && arch->use_counts && arch->frame_offsets,
+         "Could not allocate memory for function f%zu.", function->id);
+
+  arch->saved_register_count = 0;
+  for (size_t i = 0; i < convention->nonvolatile_register_count; ++i) {
+    RegisterDescriptor reg = convention->nonvolatile_registers[i];
+    if (function->registers_used & ((uint64_t)1 << reg)) {
+      arch->saved_registers[arch->saved_register_count++] = reg;
+    }
+  }
+
+  int64_t frame_size = 8 * (int64_t)(arch->saved_register_count + function->spill_slots);
+  int64_t outgoing_size = 0;
+  int64_t parameter_count = 0;
+  char leaf = 1;
+  for (IRBlock *block = function->first; block; block = block->next) {
+    for (uint32_t i = 0; i < block->instruction_count; ++i) {
+      IRInstruction *instruction = block->instructions[i];
+      arch->instructions[instruction->index] = instruction;
+      switch (instruction->type) {
+      case IR_STACK_ALLOCATE:
+        frame_size += (instruction->value.immediate + 7) & ~(int64_t)7;
+        arch->frame_offsets[instruction->index] = -frame_size;
+        break;
+      case IR_PARAMETER_REFERENCE:
+        if (instruction->value.immediate > parameter_count) {
+          parameter_count = instruction->value.immediate;
+        }
+        break;
+      case IR_CALL: {
+        int64_t size = convention->shadow_space;
+        size_t argument_count = instruction->value.call.argument_count;
+        if (argument_count > convention->argument_register_count) {
+          size += 8 * (int64_t)(argument_count - convention->argument_register_count);
+        }
+        if (size > outgoing_size) { outgoing_size = size; }
+        leaf = 0;
+      } break;
+      // These push registers they clobber, which would overwrite a
+      // frame kept in the red zone.
+      case IR_DIVIDE:
+      case IR_MODULO:
+        leaf = 0;
+        break;
+      case IR_SHIFT_LEFT:
+      case IR_SHIFT_RIGHT_ARITHMETIC:
+        if (instruction->value.pair.cdr->type != IR_IMMEDIATE) { leaf = 0; }
+        break;
+      default:
+        break;
+      }
+    }
+    arch->instructions[block->branch->index] = block->branch;
+  }
+
+  // Stack parameters are above the return address, and the shadow
+  // space of the register parameters right below them.
+  arch->parameter_offsets = calloc(parameter_count ? parameter_count : 1, sizeof(int64_t));
+  ASSERT(arch->parameter_offsets, "Could not allocate memory for parameters of function f%zu.", function->id);
+  for (int64_t i = 0; i < parameter_count; ++i) {
+    if (i < (int64_t)convention->argument_register_count && !convention->shadow_space) {
+      frame_size += 8;
+      arch->parameter_offsets[i] = -frame_size;
+    } else {
+      arch->parameter_offsets[i] = 16 + convention->shadow_space
+        + 8 * (i - (int64_t)convention->argument_register_count);
+    }
+  }
+
+  if (leaf && frame_size <= convention->red_zone) {
+    frame_size = 0;
+  } else {
+    // Keep RSP 16-byte aligned at calls.
+    frame_size = (frame_size + outgoing_size + 15) & ~(int64_t)15;
+  }
+
+  for (size_t index = 0; index < arch->instruction_count; ++index) {
+    if (arch->instructions[index]) {
+      ir_for_each_operand(arch->instructions[index], count_use_x86_64, arch);
+    }
+  }
+  if (function->return_value) {
+    count_use_x86_64(&function->return_value, arch);
+  }
+
+  context->locals_offset = -frame_size;
+  if (function == context->function) {
+    codegen_entry_point_x86_64(context);
+  } else {
+    femit_label_x86_64(context, function->name);
+    codegen_prologue_x86_64(context);
+  }
+  for (size_t i = 0; i < arch->saved_register_count; ++i) {
+    codegen_store_local_x86_64(context, arch->saved_registers[i], -8 * (long long)(i + 1));
+  }
+  for (int64_t i = 0; i < parameter_count && i < (int64_t)convention->argument_register_count; ++i) {
+    codegen_store_local_x86_64(context, convention->argument_registers[i], arch->parameter_offsets[i]);
+  }
+
   for (IRBlock *block = function->first; block; block = block->next) {
     emit_block(context, block);
   }
+  femit_machine_instructions_x86_64(context);
+
+  free(arch->instructions);
+  free(arch->use_counts);
+  free(arch->frame_offsets);
+  free(arch->parameter_offsets);
+  arch->instructions = NULL;
+  arch->use_counts = NULL;
+  arch->frame_offsets = NULL;
+  arch->parameter_offsets = NULL;
+  arch->instruction_count = 0;
+  arch->function = NULL;
+}
+
+//================================================================ END IR lowering
+
+/// Functions that are allocated registers and emitted by a pool of
+/// workers, each into output of its own, to be put together in order
+/// afterwards.
+typedef struct EmissionJob_x86_64 {
+  CodegenContext *context;
+  IRFunction **functions;
+  const RegisterAllocationTarget *target;
+  /// The context of each worker, with registers and arch data of its
+  /// own, created when the worker first needs it.
+  CodegenContext **workers;
+  /// The assembly of each function, by index.
+  char **assembly;
+  size_t *assembly_sizes;
+  /// The machine code of each function, by index, if the output is
+  /// an object file.
+  ObjectFile **objects;
+} EmissionJob_x86_64;
+
+static void emit_function_task_x86_64(void *data, size_t worker, size_t index) {
+  EmissionJob_x86_64 *job = data;
+  IRFunction *function = job->functions[index];
+  if (job->context->optimization_level >= 2) {
+    ra_graph_coloring(function, job->target);
+  } else {
+    ra_linear_scan(function, job->target);
+  }
+
+  CodegenContext *context = job->workers[worker];
+  if (!context) {
+    ArchData *arch = job->context->arch_data;
+    context = codegen_context_x86_64_create(NULL, job->context->call_convention, arch->convention);
+    context->parse_context = job->context->parse_context;
+    context->function = job->context->function;
+    context->format = job->context->format;
+    context->dialect = job->context->dialect;
+    context->optimization_level = job->context->optimization_level;
+    if (!job->context->object) {
+      context->code = code_buffer_create(NULL);
+    }
+    job->workers[worker] = context;
+  }
 
-  emit_instruction(context, function->return_value);
+  if (job->context->object) {
+    context->object = job->objects[index] = object_file_create();
+    emit_function(context, function);
+  } else {
+    emit_function(context, function);
+    job->assembly[index] = code_buffer_take(context->code, job->assembly_sizes + index);
+  }
 }
 
 void codegen_emit_x86_64(CodegenContext *context) {
   // Generate global variables.
 
-  fprintf(context->code, "%s", ".section .data\n");
+  if (!context->object) {
+    code_buffer_literal(context->code, ".section .data\n");
+  }
 
   Binding *var_it = context->parse_context->variables->bind;
-  Node *type_info = node_allocate();
+  Node *type_info = node_allocate_scratch();
   while (var_it) {
     Node *var_id = var_it->id;
-    Node *type_id = node_allocate();
+    Node *type_id = node_allocate_scratch();
     *type_id = *var_it->value;
     // Do not emit "external" typed variables.
     // TODO: Probably should have external attribute rather than this nonsense!
-    if (strcmp(type_id->value.symbol, "external function") != 0) {
+    if (type_id->value.symbol != symbol_external_function) {
       Error err = parse_get_type(context->parse_context, type_id, type_info);
       if (err.type) {
         print_node(type_id, 0);
         print_error(err);
         PANIC();
       }
-      fprintf(context->code, "%s: .space %lld\n", var_id->value.symbol, type_info->children->value.integer);
+      if (context->object) {
+        object_file_allocate(context->object, var_id->value.symbol,
+                             (uint64_t)type_info->children->value.integer, 8);
+      } else {
+        code_buffer_string(context->code, var_id->value.symbol);
+        code_buffer_literal(context->code, ": .space ");
+        code_buffer_integer(context->code, type_info->children->value.integer);
+        code_buffer_char(context->code, '\n');
+      }
     }
     var_it = var_it->next;
   }
-  free(type_info);
+  node_scratch_reset();
+
+  // Allocate registers to each temporary within the program.
+  RegisterAllocationTarget target;
+  RegisterDescriptor *allocatable = calloc(context->register_pool.num_scratch_registers,
+                                           sizeof(RegisterDescriptor));
+  ASSERT(allocatable, "Could not allocate memory for allocatable registers.");
+  target.registers = allocatable;
+  target.register_count = context->register_pool.num_scratch_registers - RESERVED_SCRATCH_REGISTERS_X86_64;
+  for (size_t i = 0; i < target.register_count; ++i) {
+    allocatable[i] = context->register_pool.scratch_registers[i]->descriptor;
+  }
+  ArchData *arch = context->arch_data;
+  target.preserved_registers = arch->convention->nonvolatile_registers;
+  target.preserved_register_count = arch->convention->nonvolatile_register_count;
+
+  // Each function is allocated registers and emitted on its own, so
+  // that can happen on as many threads as there are workers.
+  size_t count = 0;
+  for (IRFunction *function = context->function; function; function = function->next) { count++; }
+  size_t workers = worker_pool_size(codegen_jobs, count);
+  if (workers > 1 && !ir_functions_self_contained(context->function)) { workers = 1; }
+  EmissionJob_x86_64 job;
+  job.context = context;
+  job.target = &target;
+  job.functions = calloc(count ? count : 1, sizeof(IRFunction *));
+  job.workers = calloc(workers, sizeof(CodegenContext *));
+  job.assembly = calloc(count ? count : 1, sizeof(char *));
+  job.assembly_sizes = calloc(count ? count : 1, sizeof(size_t));
+  job.objects = calloc(count ? count : 1, sizeof(ObjectFile *));
+  ASSERT(job.functions && job.workers && job.assembly && job.assembly_sizes && job.objects,
+         "Could not allocate memory for emitting functions.");
+  size_t index = 0;
+  for (IRFunction *function = context->function; function; function = function->next) {
+    job.functions[index++] = function;
+  }
 
-  // TODO: Fixup parameter references (spill to stack every time for
-  // now). This converts parameters into local variables, which makes
-  // life 1000% easier.
+  worker_pool_run(workers, count, emit_function_task_x86_64, &job);
 
-  // TODO: Setup register allocation strucutres and allocate registers
-  // to each temporary within the program.
+  // Main comes first, as it is the entry point.
+  for (index = 0; index < count; ++index) {
+    if (codegen_verbose) {
+      femit_register_allocation_x86_64(stdout, job.functions[index]);
+    }
+    if (context->object) {
+      object_file_append(context->object, job.objects[index]);
+      object_file_free(job.objects[index]);
+    } else if (job.assembly_sizes[index]) {
+      code_buffer_write(context->code, job.assembly[index], job.assembly_sizes[index]);
+    }
+    free(job.assembly[index]);
+  }
 
-  TODO("Emit code based on intermediate representation in context.");
+  for (size_t worker = 0; worker < workers; ++worker) {
+    if (!job.workers[worker]) { continue; }
+    code_buffer_free(job.workers[worker]->code);
+    codegen_context_x86_64_free(job.workers[worker]);
+  }
+  free(job.functions);
+  free(job.workers);
+  free(job.assembly);
+  free(job.assembly_sizes);
+  free(job.objects);
+  free(allocatable);
 }
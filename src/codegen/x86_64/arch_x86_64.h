@@ -2,6 +2,8 @@
 #define ARCH_X86_64_H
 
 #include <codegen/codegen_forward.h>
+#include <stddef.h>
+#include <stdio.h>
 
 /// This is used for defining lookup tables etc. and
 /// ensures that the registers are always in the correct
@@ -28,7 +30,20 @@
 /// Context allocation/deallocation
 CodegenContext *codegen_context_x86_64_mswin_create(CodegenContext *parent);
 void codegen_context_x86_64_mswin_free(CodegenContext *ctx);
+CodegenContext *codegen_context_x86_64_linux_create(CodegenContext *parent);
+void codegen_context_x86_64_linux_free(CodegenContext *ctx);
 
 void codegen_emit_x86_64(CodegenContext *context);
 
+/// Emit a fixed mix of instructions ITERATIONS times to SINK, through
+/// the code buffer and through stdio, and print lines per second.
+void codegen_benchmark_emitter_x86_64
+(enum CodegenAssemblyDialect dialect,
+ FILE *sink,
+ size_t iterations);
+
+/// Encode the same mix of instructions ITERATIONS times into an object
+/// file, and print instructions per second.
+void codegen_benchmark_encoder_x86_64(size_t iterations);
+
 #endif // ARCH_X86_64_H
@@ -1,9 +1,12 @@
 #include <environment.h>
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <intern.h>
 #include <parser.h>
 
 void environment_print(Environment env, long long indent) {
@@ -27,33 +30,108 @@ void environment_print(Environment env, long long indent) {
 }
 
 Environment *environment_create(Environment *parent) {
-  Environment *env = malloc(sizeof(Environment));
+  Environment *env = calloc(1, sizeof(Environment));
   ASSERT(env, "Could not allocate memory for new environment");
   env->parent = parent;
-  env->bind = NULL;
   return env;
 }
 
-int environment_set(Environment *env, Node *id, Node *value) {
-  // Over-write existing value if ID is already bound in environment.
-  if (!env || !id || !value) {
-    return 0;
+/// Environments start out with this many hash buckets.
+#define ENVIRONMENT_INITIAL_BUCKET_COUNT 16
+
+/// Hash an ID such that any two IDs that node_compare() considers
+/// equal end up with the same hash.
+static size_t environment_hash(Node *id) {
+  uint64_t key;
+  switch (id->type) {
+  case NODE_TYPE_SYMBOL:
+  case NODE_TYPE_VARIABLE_ACCESS:
+  case NODE_TYPE_BINARY_OPERATOR:
+    // Symbols are interned, so the string address identifies them.
+    key = (uint64_t)(uintptr_t)id->value.symbol;
+    break;
+  case NODE_TYPE_INTEGER:
+  case NODE_TYPE_INDEX:
+    key = (uint64_t)id->value.integer;
+    break;
+  default:
+    key = (uint64_t)id->type;
+    break;
   }
-  Binding *binding_it = env->bind;
+  // Fibonacci hashing; fold the well-mixed high bits into the low bits
+  // that are used to select a bucket.
+  key *= 11400714819323198485ULL;
+  return (size_t)(key ^ (key >> 32));
+}
+
+/// Find the binding of ID within ENV, or NULL if there is none.
+static Binding *environment_find(Environment *env, Node *id) {
+  if (!env->bucket_count || !id) { return NULL; }
+  Binding *binding_it = env->buckets[environment_hash(id) & (env->bucket_count - 1)];
   while (binding_it) {
     if (node_compare(binding_it->id, id)) {
-      binding_it->value = value;
-      return 2;
+      return binding_it;
     }
-    binding_it = binding_it->next;
+    binding_it = binding_it->bucket_next;
   }
-  // Create new binding.
-  Binding *binding = malloc(sizeof(Binding));
+  return NULL;
+}
+
+/// Chain BINDING into the hash bucket of its ID.
+static void environment_bucket_insert(Environment *env, Binding *binding) {
+  size_t bucket = environment_hash(binding->id) & (env->bucket_count - 1);
+  binding->bucket_next = env->buckets[bucket];
+  env->buckets[bucket] = binding;
+}
+
+/// Make sure there is room in the hash table for another binding.
+static void environment_grow(Environment *env) {
+  // Keep the load factor at or below three quarters.
+  if ((env->binding_count + 1) * 4 <= env->bucket_count * 3) {
+    return;
+  }
+  size_t new_count = env->bucket_count
+    ? env->bucket_count * 2
+    : ENVIRONMENT_INITIAL_BUCKET_COUNT;
+  free(env->buckets);
+  env->buckets = calloc(new_count, sizeof(Binding *));
+  ASSERT(env->buckets, "Could not allocate hash buckets for environment");
+  env->bucket_count = new_count;
+  for (Binding *binding_it = env->bind; binding_it; binding_it = binding_it->next) {
+    environment_bucket_insert(env, binding_it);
+  }
+}
+
+/// Create a new binding of ID to VALUE that is not yet part of the
+/// iteration order.
+static Binding *environment_binding_create(Environment *env, Node *id, Node *value) {
+  environment_grow(env);
+  Binding *binding = calloc(1, sizeof(Binding));
   ASSERT(binding, "Could not allocate new binding for environment");
   binding->id = id;
   binding->value = value;
+  environment_bucket_insert(env, binding);
+  env->binding_count += 1;
+  return binding;
+}
+
+int environment_set(Environment *env, Node *id, Node *value) {
+  // Over-write existing value if ID is already bound in environment.
+  if (!env || !id || !value) {
+    return 0;
+  }
+  Binding *existing = environment_find(env, id);
+  if (existing) {
+    existing->value = value;
+    return 2;
+  }
+  // Create new binding.
+  Binding *binding = environment_binding_create(env, id, value);
   binding->next = env->bind;
   env->bind = binding;
+  if (!env->last) {
+    env->last = binding;
+  }
   return 1;
 }
 
@@ -65,42 +143,36 @@ int environment_set_end(Environment *env, Node *id, Node *value) {
   if (!env->bind) {
     return environment_set(env, id, value);
   }
-  Binding *last_binding = env->bind;
-  Binding *binding_it = env->bind;
-  while (binding_it) {
-    if (node_compare(binding_it->id, id)) {
-      binding_it->value = value;
-      return 2;
-    }
-    last_binding = binding_it;
-    binding_it = binding_it->next;
+  Binding *existing = environment_find(env, id);
+  if (existing) {
+    existing->value = value;
+    return 2;
   }
   // Create new binding.
-  Binding *binding = calloc(1,sizeof(Binding));
-  ASSERT(binding, "Could not allocate new binding for environment");
-  binding->id = id;
-  binding->value = value;
-  last_binding->next = binding;
+  Binding *binding = environment_binding_create(env, id, value);
+  env->last->next = binding;
+  env->last = binding;
   return 1;
 }
 
 int environment_get(Environment env, Node *id, Node *result) {
-  Binding *binding_it = env.bind;
-  while (binding_it) {
-    if (node_compare(binding_it->id, id)) {
-      *result = *binding_it->value;
-      return 1;
-    }
-    binding_it = binding_it->next;
+  Binding *binding = environment_find(&env, id);
+  if (binding) {
+    *result = *binding->value;
+    return 1;
   }
   return 0;
 }
 
 int environment_get_by_symbol(Environment env, char *symbol, Node *result) {
-  Node *symbol_node = node_symbol(symbol);
-  int status = environment_get(env, symbol_node, result);
-  free(symbol_node);
-  return status;
+  // A symbol that was never interned can not be bound to anything.
+  char *interned = intern_find(symbol, strlen(symbol));
+  if (!interned) { return 0; }
+  Node symbol_node = (Node) {
+    .type = NODE_TYPE_SYMBOL,
+    .value.symbol = interned,
+  };
+  return environment_get(env, &symbol_node, result);
 }
 
 int environment_get_by_value(Environment env, Node *value, Node *result) {
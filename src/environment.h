@@ -1,6 +1,8 @@
 #ifndef COMPILER_ENVIRONMENT_H
 #define COMPILER_ENVIRONMENT_H
 
+#include <stddef.h>
+
 typedef struct Node Node;
 
 // TODO:
@@ -9,13 +11,25 @@ typedef struct Node Node;
 typedef struct Binding {
   Node *id;
   Node *value;
+  /// Next binding in iteration order.
   struct Binding *next;
+  /// Next binding within the same hash bucket.
+  struct Binding *bucket_next;
 } Binding;
 
+/// Bindings are kept in a linked list (`bind`) that determines
+/// iteration order, and are also chained into hash buckets keyed by
+/// their ID, so that lookups do not have to walk every binding.
 // TODO: API to create new Environment.
 typedef struct Environment {
   struct Environment *parent;
   Binding *bind;
+  /// Last binding in `bind`, for appending in constant time.
+  Binding *last;
+  /// Hash buckets; `bucket_count` is zero or a power of two.
+  Binding **buckets;
+  size_t bucket_count;
+  size_t binding_count;
 } Environment;
 
 void environment_print(Environment env, long long indent);
@@ -6,6 +6,15 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__) || defined(__unix__) || defined(__APPLE__)
+#  define FILE_IO_MMAP
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
 
 size_t file_size(FILE *file) {
   if (!file) { return 0; }
@@ -23,32 +32,138 @@ size_t file_size(FILE *file) {
   return out;
 }
 
-char *file_contents(char *path) {
-  FILE *file = fopen(path, "r");
-  if (!file) {
-    printf("Could not open file at %s\n", path);
-    return NULL;
-  }
-  size_t size = file_size(file);
-  char *contents = malloc(size + 1);
-  ASSERT(contents, "Could not allocate buffer for file contents");
-  char *write_it = contents;
+/// Read FILE until end of file into a NUL-terminated heap buffer.
+/// This works for streams that can not seek, like pipes.
+static char *file_contents_buffered(FILE *file, size_t *size) {
+  size_t capacity = 4096;
   size_t bytes_read = 0;
-  while (bytes_read < size) {
-    size_t bytes_read_this_iteration = fread(write_it, 1, size - bytes_read, file);
+  char *contents = malloc(capacity);
+  ASSERT(contents, "Could not allocate buffer for file contents");
+  for (;;) {
+    // Always leave room for the NUL terminator.
+    if (capacity - bytes_read < 2) {
+      capacity *= 2;
+      contents = realloc(contents, capacity);
+      ASSERT(contents, "Could not allocate buffer for file contents");
+    }
+    size_t bytes_read_this_iteration =
+      fread(contents + bytes_read, 1, capacity - bytes_read - 1, file);
+    bytes_read += bytes_read_this_iteration;
     if (ferror(file)) {
       printf("Error while reading: %i\n", errno);
       free(contents);
       return NULL;
     }
-
-    bytes_read += bytes_read_this_iteration;
-    write_it += bytes_read_this_iteration;
-
     if (feof(file)) {
       break;
     }
   }
   contents[bytes_read] = '\0';
+  if (size) { *size = bytes_read; }
   return contents;
 }
+
+char *file_contents(char *path) {
+  SourceFile file;
+  if (!source_file_open(path, &file)) {
+    return NULL;
+  }
+  if (file.storage == SOURCE_FILE_BUFFERED) {
+    return file.contents;
+  }
+  // Caller expects to free() the result, so copy it out of the mapping.
+  char *contents = malloc(file.size + 1);
+  ASSERT(contents, "Could not allocate buffer for file contents");
+  memcpy(contents, file.contents, file.size + 1);
+  source_file_close(&file);
+  return contents;
+}
+
+#ifdef FILE_IO_MMAP
+
+/** Map SIZE bytes of the regular file open as FD, followed by at
+ * least one zero byte.
+ *
+ * The kernel zero-fills the last page of a mapping past the end of
+ * the file. When SIZE is a multiple of the page size there is no such
+ * tail, so the file is mapped over a reservation that is one byte
+ * larger, leaving a zero page behind it.
+ *
+ * @return Boolean-like value: 1 for success, 0 for failure.
+ */
+static int source_file_map(int fd, size_t size, SourceFile *file) {
+  size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+  size_t mapping_size = (size + 1 + page_size - 1) & ~(page_size - 1);
+  char *mapping = mmap(NULL, mapping_size, PROT_READ,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED) { return 0; }
+  if (size && mmap(mapping, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(mapping, mapping_size);
+    return 0;
+  }
+  file->contents = mapping;
+  file->size = size;
+  file->storage = SOURCE_FILE_MAPPED;
+  file->mapping_size = mapping_size;
+  return 1;
+}
+
+#endif /* FILE_IO_MMAP */
+
+int source_file_open(char *path, SourceFile *file) {
+  if (!path || !file) { return 0; }
+  memset(file, 0, sizeof(SourceFile));
+
+  if (strcmp(path, "-") == 0) {
+    file->contents = file_contents_buffered(stdin, &file->size);
+    file->storage = SOURCE_FILE_BUFFERED;
+    return file->contents != NULL;
+  }
+
+#ifdef FILE_IO_MMAP
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    printf("Could not open file at %s\n", path);
+    return 0;
+  }
+  struct stat info;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)
+      && source_file_map(fd, (size_t)info.st_size, file)) {
+    close(fd);
+    return 1;
+  }
+  // Not a regular file, or mapping it failed; read it instead.
+  FILE *stream = fdopen(fd, "rb");
+  if (!stream) {
+    printf("Could not open file at %s\n", path);
+    close(fd);
+    return 0;
+  }
+#else
+  FILE *stream = fopen(path, "rb");
+  if (!stream) {
+    printf("Could not open file at %s\n", path);
+    return 0;
+  }
+#endif
+
+  file->contents = file_contents_buffered(stream, &file->size);
+  file->storage = SOURCE_FILE_BUFFERED;
+  fclose(stream);
+  return file->contents != NULL;
+}
+
+void source_file_close(SourceFile *file) {
+  if (!file || !file->contents) { return; }
+  switch (file->storage) {
+  case SOURCE_FILE_BUFFERED:
+    free(file->contents);
+    break;
+  case SOURCE_FILE_MAPPED:
+#ifdef FILE_IO_MMAP
+    munmap(file->contents, file->mapping_size);
+#endif
+    break;
+  }
+  memset(file, 0, sizeof(SourceFile));
+}
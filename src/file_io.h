@@ -7,4 +7,33 @@
 size_t file_size(FILE *file);
 char *file_contents(char *path);
 
+typedef enum SourceFileStorage {
+  /// Contents were read into a heap buffer.
+  SOURCE_FILE_BUFFERED,
+  /// Contents are a read-only, private mapping of the file.
+  SOURCE_FILE_MAPPED,
+} SourceFileStorage;
+
+/// The contents of a source file, followed by a NUL terminator.
+typedef struct SourceFile {
+  char *contents;
+  /// Size of contents in bytes, not including the NUL terminator.
+  size_t size;
+  SourceFileStorage storage;
+  /// Size in bytes of the mapping when storage is mapped.
+  size_t mapping_size;
+} SourceFile;
+
+/** Open the file at PATH, or standard input if PATH is "-".
+ *
+ * Regular files are memory-mapped where supported, so the contents
+ * must not be written to. Anything else, like a pipe, is read into a
+ * buffer.
+ *
+ * @return Boolean-like value: 1 for success, 0 for failure.
+ */
+int source_file_open(char *path, SourceFile *file);
+
+void source_file_close(SourceFile *file);
+
 #endif /* COMPILER_FILE_IO_H */
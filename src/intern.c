@@ -0,0 +1,106 @@
+#include <intern.h>
+
+#include <arena.h>
+#include <error.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct InternEntry {
+  char *string;
+  size_t length;
+  size_t hash;
+} InternEntry;
+
+/// Open-addressed hash table of interned strings; `intern_capacity` is
+/// zero or a power of two.
+static InternEntry *intern_table = NULL;
+static size_t intern_capacity = 0;
+static size_t intern_count = 0;
+/// Storage for the characters of every interned string.
+static Arena intern_arena;
+
+#define INTERN_INITIAL_CAPACITY 1024
+
+static size_t intern_hash(const char *buffer, size_t length) {
+  // FNV-1a
+  size_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= (unsigned char)buffer[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/// Get the slot that either holds the given string or is the empty slot
+/// it would be inserted into.
+static InternEntry *intern_slot(const char *buffer, size_t length, size_t hash) {
+  size_t mask = intern_capacity - 1;
+  size_t index = hash & mask;
+  for (;;) {
+    InternEntry *entry = intern_table + index;
+    if (!entry->string) { return entry; }
+    if (entry->hash == hash
+        && entry->length == length
+        && memcmp(entry->string, buffer, length) == 0) {
+      return entry;
+    }
+    index = (index + 1) & mask;
+  }
+}
+
+/// Make sure there is room in the table for another string.
+static void intern_grow() {
+  // Keep the load factor at or below one half.
+  if ((intern_count + 1) * 2 <= intern_capacity) { return; }
+
+  InternEntry *old_table = intern_table;
+  size_t old_capacity = intern_capacity;
+
+  intern_capacity = old_capacity ? old_capacity * 2 : INTERN_INITIAL_CAPACITY;
+  intern_table = calloc(intern_capacity, sizeof(InternEntry));
+  ASSERT(intern_table, "Could not allocate memory for symbol intern table");
+
+  for (size_t i = 0; i < old_capacity; ++i) {
+    InternEntry *entry = old_table + i;
+    if (!entry->string) { continue; }
+    *intern_slot(entry->string, entry->length, entry->hash) = *entry;
+  }
+  free(old_table);
+}
+
+char *intern_buffer(const char *buffer, size_t length) {
+  ASSERT(buffer, "Can not intern NULL buffer");
+  intern_grow();
+  size_t hash = intern_hash(buffer, length);
+  InternEntry *entry = intern_slot(buffer, length, hash);
+  if (entry->string) { return entry->string; }
+
+  char *string = arena_allocate(&intern_arena, length + 1);
+  memcpy(string, buffer, length);
+  string[length] = '\0';
+
+  entry->string = string;
+  entry->length = length;
+  entry->hash = hash;
+  intern_count += 1;
+  return string;
+}
+
+char *intern(const char *string) {
+  return intern_buffer(string, strlen(string));
+}
+
+char *intern_find(const char *buffer, size_t length) {
+  if (!intern_capacity) { return NULL; }
+  return intern_slot(buffer, length, intern_hash(buffer, length))->string;
+}
+
+void intern_free_all() {
+  free(intern_table);
+  intern_table = NULL;
+  intern_capacity = 0;
+  intern_count = 0;
+  arena_free(&intern_arena);
+}
@@ -0,0 +1,24 @@
+#ifndef COMPILER_INTERN_H
+#define COMPILER_INTERN_H
+
+#include <stddef.h>
+
+/** Get the canonical copy of the LENGTH bytes at BUFFER.
+ *
+ * Every distinct string is stored exactly once per compilation, so two
+ * interned strings are equal if and only if their pointers are equal.
+ * The returned string is NUL-terminated and must not be modified.
+ */
+char *intern_buffer(const char *buffer, size_t length);
+
+/// Like intern_buffer(), but for a NUL-terminated STRING.
+char *intern(const char *string);
+
+/// Get the canonical copy of the LENGTH bytes at BUFFER only if it has
+/// already been interned, otherwise return NULL.
+char *intern_find(const char *buffer, size_t length);
+
+/// Free every interned string.
+void intern_free_all();
+
+#endif /* COMPILER_INTERN_H */
@@ -1,11 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <codegen.h>
 #include <error.h>
 #include <environment.h>
 #include <file_io.h>
+#include <intern.h>
 #include <parser.h>
 #include <typechecker.h>
 
@@ -16,12 +18,23 @@ void print_usage(char **argv) {
          "   `--formats`       :: List acceptable output formats.\n"
          "   `--callings`      :: List acceptable calling conventions.\n"
          "   `--dialects`      :: List acceptable assembly dialects.\n"
-         "   `-v`, `--verbose` :: Print out more information.\n");
+         "   `-v`, `--verbose` :: Print out more information, and what the\n"
+         "                        optimizer did to standard error.\n"
+         "   `-O0`/`-O1`/`-O2` :: Set how hard to optimize; `-O1` folds constants,\n"
+         "                        hoists invariants out of loops and turns tail\n"
+         "                        calls into loops, and `-O2` also inlines calls\n"
+         "                        and colors registers.\n"
+         "   `--benchmark`     :: Measure lexer, parser, and emitter speed and exit.\n"
+         "   `--run`           :: Run the program in memory instead of writing it\n"
+         "                        out, and exit with what it returns. Nothing\n"
+         "                        but the program prints to standard output.\n");
   printf("Options:\n"
          "    `-o`, `--output`   :: Set the output filepath to the one given.\n"
          "    `-f`, `--format`   :: Set the output format to the one given.\n"
          "    `-cc`, `--calling` :: Set the calling convention to the one given.\n"
          "    `-d`, `--dialect`   :: Set the output assembly dialect to the one given.\n"
+         "    `-j`, `--jobs`     :: Set how many threads to generate code on; `0`,\n"
+         "                          the default, means one per processor.\n"
          "Anything other arguments are treated as input filepaths (source code).\n");
 }
 
@@ -31,11 +44,15 @@ enum CodegenOutputFormat output_format = CG_FMT_DEFAULT;
 enum CodegenCallingConvention output_calling_convention = CG_CALL_CONV_DEFAULT;
 enum CodegenAssemblyDialect output_assembly_dialect = CG_ASM_DIALECT_DEFAULT;
 int verbosity = 0;
+int optimization_level = 0;
+int benchmark = 0;
+int run = 0;
 
 void print_acceptable_formats() {
   printf("Acceptable formats include:\n"
          " -> default\n"
-         " -> x86_64_gas\n");
+         " -> x86_64_gas\n"
+         " -> x86_64_elf\n");
 }
 
 void print_acceptable_calling_conventions() {
@@ -75,6 +92,15 @@ int handle_command_line_arguments(int argc, char **argv) {
     } else if (strcmp(argument, "-v") == 0
                || strcmp(argument, "--verbose") == 0) {
       verbosity = 1;
+      codegen_statistics = 1;
+    } else if (argument[0] == '-' && argument[1] == 'O'
+               && argument[2] >= '0' && argument[2] <= '9'
+               && argument[3] == '\0') {
+      optimization_level = argument[2] - '0';
+    } else if (strcmp(argument, "--benchmark") == 0) {
+      benchmark = 1;
+    } else if (strcmp(argument, "--run") == 0) {
+      run = 1;
     } else if (strcmp(argument, "-o") == 0
                || strcmp(argument, "--output") == 0) {
       i++;
@@ -104,6 +130,8 @@ int handle_command_line_arguments(int argc, char **argv) {
         output_format = CG_FMT_DEFAULT;
       } else if (strcmp(argv[i], "x86_64_gas") == 0) {
         output_format = CG_FMT_x86_64_GAS;
+      } else if (strcmp(argv[i], "x86_64_elf") == 0) {
+        output_format = CG_FMT_x86_64_ELF;
       } else {
         printf("ERROR: Expected format after format command line argument\n"
                "Instead, got an unrecognized format: \"%s\".\n", argv[i]);
@@ -156,6 +184,20 @@ int handle_command_line_arguments(int argc, char **argv) {
         print_acceptable_asm_dialects();
         return 1;
       }
+    } else if (strcmp(argument, "-j") == 0
+               || strcmp(argument, "--jobs") == 0) {
+      i++;
+      if (i >= argc) {
+        panic("ERROR: Expected number of jobs after jobs command line argument");
+      }
+      char *end = NULL;
+      unsigned long jobs = strtoul(argv[i], &end, 10);
+      if (*argv[i] < '0' || *argv[i] > '9' || *end != '\0') {
+        printf("ERROR: Expected number of jobs after jobs command line argument\n"
+               "Instead, got \"%s\".\n", argv[i]);
+        return 1;
+      }
+      codegen_jobs = (size_t)jobs;
     } else if (strcmp(argument, "--aluminium") == 0) {
 #     if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
       // Windows
@@ -178,6 +220,96 @@ int handle_command_line_arguments(int argc, char **argv) {
   return 0;
 }
 
+/// Lex the file at FILEPATH, repeated until there are at least a few
+/// megabytes of source, and print the throughput. Then, lex and parse
+/// the file once and print how long each took.
+/// @return Zero if everything goes well, otherwise return non-zero value.
+int benchmark_frontend(char *filepath) {
+  const size_t minimum_size = 16 * 1024 * 1024;
+  const int iterations = 8;
+
+  SourceFile file;
+  if (!source_file_open(filepath, &file)) {
+    printf("ERROR: Could not read file at \"%s\"\n", filepath);
+    return 1;
+  }
+  if (!file.size) {
+    printf("ERROR: Can not benchmark lexer on empty file at \"%s\"\n", filepath);
+    source_file_close(&file);
+    return 1;
+  }
+
+  // Large files are lexed in place.
+  char *source = file.contents;
+  size_t source_size = file.size;
+  if (file.size < minimum_size) {
+    // Repeat the contents on separate lines so that a trailing comment
+    // does not swallow the next copy.
+    size_t copies = (minimum_size + file.size) / (file.size + 1);
+    source_size = copies * (file.size + 1);
+    source = malloc(source_size + 1);
+    if (!source) {
+      source_file_close(&file);
+      panic("ERROR: Could not allocate memory for lexer benchmark.");
+    }
+    for (size_t i = 0; i < copies; ++i) {
+      memcpy(source + i * (file.size + 1), file.contents, file.size);
+      source[i * (file.size + 1) + file.size] = '\n';
+    }
+    source[source_size] = '\0';
+  }
+
+  TokenStream stream;
+  memset(&stream, 0, sizeof(TokenStream));
+
+  size_t token_count = 0;
+  clock_t start = clock();
+  for (int i = 0; i < iterations; ++i) {
+    Error err = lex_stream(source, &stream);
+    if (err.type) {
+      print_error(err);
+      token_stream_free(&stream);
+      if (source != file.contents) { free(source); }
+      source_file_close(&file);
+      return 1;
+    }
+    // Do not count the end token.
+    token_count += stream.count - 1;
+  }
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  double megabytes = (double)source_size * iterations / (1024.0 * 1024.0);
+  if (source != file.contents) { free(source); }
+
+  printf("Lexed %zu tokens from %.2f MiB of source in %.3f seconds.\n",
+         token_count, megabytes, seconds);
+  if (seconds > 0) {
+    printf("Lexer throughput: %.1f MiB/s\n", megabytes / seconds);
+  }
+
+  // A program can only be parsed once, as parsing defines variables,
+  // so the parser is measured on a single copy of the input file.
+  start = clock();
+  Error err = lex_stream(file.contents, &stream);
+  clock_t lexed = clock();
+  if (err.type == ERROR_NONE) {
+    Node *program = node_allocate();
+    ParsingContext *context = parse_context_default_create();
+    err = parse_tokens(context, &stream, program);
+  }
+  clock_t parsed = clock();
+  token_stream_free(&stream);
+  source_file_close(&file);
+  if (err.type) {
+    print_error(err);
+    return 1;
+  }
+
+  printf("Input file: lexed in %.3f ms, parsed in %.3f ms.\n",
+         (double)(lexed - start) * 1000.0 / CLOCKS_PER_SEC,
+         (double)(parsed - lexed) * 1000.0 / CLOCKS_PER_SEC);
+  return 0;
+}
+
 int main(int argc, char **argv) {
   if (argc < 2) {
     print_usage(argv);
@@ -186,12 +318,30 @@ int main(int argc, char **argv) {
 
   int status = handle_command_line_arguments(argc, argv);
   if (status) { return status; }
+  parse_intern_symbols();
   if (input_filepath_index == -1) {
     printf("Input file path was not provided.");
     print_usage(argv);
     return 1;
   }
 
+  if (benchmark) {
+    status = benchmark_frontend(argv[input_filepath_index]);
+    if (status) { return status; }
+#   if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+    FILE *sink = fopen("NUL", "w");
+#   else
+    FILE *sink = fopen("/dev/null", "w");
+#   endif
+    if (!sink) {
+      printf("ERROR: Could not open null device for emitter benchmark.\n");
+      return 1;
+    }
+    codegen_benchmark_emitter(output_format, output_assembly_dialect, sink, 1000000);
+    fclose(sink);
+    return 0;
+  }
+
   Node *program = node_allocate();
   ParsingContext *context = parse_context_default_create();
   Error err = parse_program(argv[input_filepath_index], context, program);
@@ -215,8 +365,27 @@ int main(int argc, char **argv) {
     return 2;
   }
 
-  char *output_filepath = output_filepath_index == -1 ? "code.S" : argv[output_filepath_index];
-  err = codegen(output_format, output_calling_convention, output_assembly_dialect, output_filepath, context, program);
+  if (run) {
+    codegen_verbose = 0;
+    int exit_status = 0;
+    err = codegen_run(output_calling_convention, optimization_level, context, program, &exit_status);
+    if (err.type) {
+      print_error(err);
+      return 3;
+    }
+    node_free_all();
+    intern_free_all();
+    return exit_status;
+  }
+
+  char *output_filepath = "code.S";
+  if (output_filepath_index != -1) {
+    output_filepath = argv[output_filepath_index];
+  } else if (output_format == CG_FMT_x86_64_ELF) {
+    output_filepath = "code.o";
+  }
+  err = codegen(output_format, output_calling_convention, output_assembly_dialect,
+                optimization_level, output_filepath, context, program);
   if (err.type) {
     print_error(err);
     return 3;
@@ -224,7 +393,8 @@ int main(int argc, char **argv) {
 
   printf("\nGenerated code at output filepath \"%s\"\n", output_filepath);
 
-  node_free(program);
+  node_free_all();
+  intern_free_all();
 
   return 0;
 }
@@ -1,30 +1,156 @@
 #include <parser.h>
 
+#include <arena.h>
 #include <error.h>
 #include <environment.h>
 #include <file_io.h>
+#include <intern.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#  include <stdint.h>
+#endif
+
 //================================================================ BEG lexer
 
+enum LexByteClass {
+  LEX_WHITESPACE = 1 << 0,
+  LEX_DELIMITER  = 1 << 1,
+  LEX_COMMENT    = 1 << 2,
+  /// Any byte a token may not extend past; delimiters and the NUL terminator.
+  LEX_TOKEN_END  = 1 << 3,
+};
+
 // TODO: Allow multi-byte comment delimiters.
-const char *comment_delimiters = ";#";
-const char *whitespace         = " \r\n";
 // TODO: Think harder about delimiters.
-const char *delimiters         = " \r\n,{}()[]<>:&@";
+/// Class of every byte, as a combination of LexByteClass flags.
+/// Comments begin with ";#", whitespace is " \r\n", and delimiters
+/// are whitespace along with ",{}()[]<>:&@".
+static const unsigned char lex_byte_class[256] = {
+  ['\0'] = LEX_TOKEN_END,
+  [' ']  = LEX_WHITESPACE | LEX_DELIMITER | LEX_TOKEN_END,
+  ['\r'] = LEX_WHITESPACE | LEX_DELIMITER | LEX_TOKEN_END,
+  ['\n'] = LEX_WHITESPACE | LEX_DELIMITER | LEX_TOKEN_END,
+  [',']  = LEX_DELIMITER | LEX_TOKEN_END,
+  ['{']  = LEX_DELIMITER | LEX_TOKEN_END,
+  ['}']  = LEX_DELIMITER | LEX_TOKEN_END,
+  ['(']  = LEX_DELIMITER | LEX_TOKEN_END,
+  [')']  = LEX_DELIMITER | LEX_TOKEN_END,
+  ['[']  = LEX_DELIMITER | LEX_TOKEN_END,
+  [']']  = LEX_DELIMITER | LEX_TOKEN_END,
+  ['<']  = LEX_DELIMITER | LEX_TOKEN_END,
+  ['>']  = LEX_DELIMITER | LEX_TOKEN_END,
+  [':']  = LEX_DELIMITER | LEX_TOKEN_END,
+  ['&']  = LEX_DELIMITER | LEX_TOKEN_END,
+  ['@']  = LEX_DELIMITER | LEX_TOKEN_END,
+  [';']  = LEX_COMMENT,
+  ['#']  = LEX_COMMENT,
+};
+
+#define lex_byte_is(c, class) (lex_byte_class[(unsigned char)(c)] & (class))
 
 /// @return Boolean-like value: 1 for success, 0 for failure.
 int comment_at_beginning(Token token) {
-  const char *comment_it = comment_delimiters;
-  while (*comment_it) {
-    if (*(token.beginning) == *comment_it) {
-      return 1;
+  return lex_byte_is(*token.beginning, LEX_COMMENT) != 0;
+}
+
+/// Most runs are only a few bytes long, and for those a table lookup
+/// per byte beats setting up a vector compare. Runs longer than this
+/// many bytes are handed over to the *_long() variants.
+#define LEX_SHORT_RUN 16
+
+#if defined(__SSE2__)
+
+// The vector scans below may read up to 15 bytes past the NUL
+// terminator. They never cross into the next page, so this can not
+// fault, but the sanitizer would rightfully flag it.
+#  if defined(__GNUC__)
+#    define LEX_NO_SANITIZE __attribute__((no_sanitize_address))
+#  else
+#    define LEX_NO_SANITIZE
+#  endif
+
+/// Whether 16 bytes may be loaded from IT without crossing a page.
+#define lex_vector_loadable(it) (((uintptr_t)(it) & 4095) <= 4096 - 16)
+
+LEX_NO_SANITIZE
+static char *lex_skip_whitespace_long(char *it) {
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i carriage_return = _mm_set1_epi8('\r');
+  const __m128i newline = _mm_set1_epi8('\n');
+  while (lex_vector_loadable(it)) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)it);
+    __m128i is_whitespace = _mm_or_si128(_mm_cmpeq_epi8(chunk, space),
+                                         _mm_or_si128(_mm_cmpeq_epi8(chunk, carriage_return),
+                                                      _mm_cmpeq_epi8(chunk, newline)));
+    unsigned mask = ~(unsigned)_mm_movemask_epi8(is_whitespace) & 0xffff;
+    if (mask) { return it + __builtin_ctz(mask); }
+    it += 16;
+  }
+  while (lex_byte_is(*it, LEX_WHITESPACE)) { it++; }
+  return it;
+}
+
+LEX_NO_SANITIZE
+static char *lex_skip_token_long(char *it) {
+  // Every byte that ends a token is either at most '@' or one of
+  // "[]{}", which are '{' and '}' once 0x20 is or-ed in. Bytes that
+  // pass this filter are only candidates; the table has the final say.
+  const __m128i at_most = _mm_set1_epi8('@');
+  const __m128i case_bit = _mm_set1_epi8(0x20);
+  const __m128i open_brace = _mm_set1_epi8('{');
+  const __m128i close_brace = _mm_set1_epi8('}');
+  for (;;) {
+    if (lex_vector_loadable(it)) {
+      __m128i chunk = _mm_loadu_si128((const __m128i *)it);
+      __m128i folded = _mm_or_si128(chunk, case_bit);
+      __m128i candidates =
+        _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(chunk, at_most), chunk),
+                     _mm_or_si128(_mm_cmpeq_epi8(folded, open_brace),
+                                  _mm_cmpeq_epi8(folded, close_brace)));
+      unsigned mask = (unsigned)_mm_movemask_epi8(candidates);
+      if (!mask) {
+        it += 16;
+        continue;
+      }
+      it += __builtin_ctz(mask);
     }
-    comment_it++;
+    if (lex_byte_is(*it, LEX_TOKEN_END)) { return it; }
+    it++;
   }
-  return 0;
+}
+
+#else /* !defined(__SSE2__) */
+
+static char *lex_skip_whitespace_long(char *it) {
+  while (lex_byte_is(*it, LEX_WHITESPACE)) { it++; }
+  return it;
+}
+
+static char *lex_skip_token_long(char *it) {
+  while (!lex_byte_is(*it, LEX_TOKEN_END)) { it++; }
+  return it;
+}
+
+#endif /* defined(__SSE2__) */
+
+/// @return Pointer to first byte of IT that is not whitespace.
+static char *lex_skip_whitespace(char *it) {
+  for (int i = 0; i < LEX_SHORT_RUN; ++i, ++it) {
+    if (!lex_byte_is(*it, LEX_WHITESPACE)) { return it; }
+  }
+  return lex_skip_whitespace_long(it);
+}
+
+/// @return Pointer to first byte of IT that ends a token.
+static char *lex_skip_token(char *it) {
+  for (int i = 0; i < LEX_SHORT_RUN; ++i, ++it) {
+    if (lex_byte_is(*it, LEX_TOKEN_END)) { return it; }
+  }
+  return lex_skip_token_long(it);
 }
 
 // "a +- 4" == "a + -4"
@@ -40,27 +166,22 @@ Error lex(char *source, Token *token) {
     ERROR_PREP(err, ERROR_ARGUMENTS, "Can not lex empty source.");
     return err;
   }
-  token->beginning = source;
-  token->beginning += strspn(token->beginning, whitespace);
-  token->end = token->beginning;
-  if (*(token->end) == '\0') {
-    return err;
-  }
+  token->beginning = lex_skip_whitespace(source);
   // Check if current line is a comment, and skip past it.
   while (comment_at_beginning(*token)) {
     // Skip to next newline.
-    token->beginning = strpbrk(token->beginning, "\n");
-    if (!token->beginning) {
+    char *newline = strchr(token->beginning, '\n');
+    if (!newline) {
       // If last line of file is comment, we're done lexing.
-      token->end = token->beginning;
-      return err;
+      token->beginning += strlen(token->beginning);
+      break;
     }
     // Skip to beginning of next token after comment.
-    token->beginning += strspn(token->beginning, whitespace);
-    token->end = token->beginning;
+    token->beginning = lex_skip_whitespace(newline);
   }
+  token->end = token->beginning;
   if (*(token->end) == '\0') { return err; }
-  token->end += strcspn(token->beginning, delimiters);
+  token->end = lex_skip_token(token->beginning);
   if (token->end == token->beginning) {
     token->end += 1;
   }
@@ -80,6 +201,50 @@ Error lex_extend(Token *token) {
   return err;
 }
 
+Error lex_stream(char *source, TokenStream *stream) {
+  Error err = ok;
+  if (!source || !stream) {
+    ERROR_PREP(err, ERROR_ARGUMENTS, "lex_stream(): pointer arguments must not be NULL!");
+    return err;
+  }
+  stream->source = source;
+  stream->count = 0;
+  Token token;
+  token.end = source;
+  for (;;) {
+    err = lex(token.end, &token);
+    if (err.type) { return err; }
+    size_t offset = token.beginning - source;
+    size_t length = token.end - token.beginning;
+    if (offset > UINT32_MAX || length > UINT16_MAX) {
+      ERROR_PREP(err, ERROR_GENERIC, "Source or token within it is too large to lex.");
+      return err;
+    }
+    if (stream->count == stream->capacity) {
+      stream->capacity = stream->capacity ? stream->capacity * 2 : 1024;
+      stream->tokens = realloc(stream->tokens, stream->capacity * sizeof(LexedToken));
+      ASSERT(stream->tokens, "Could not allocate memory for token stream.");
+    }
+    LexedToken *lexed = stream->tokens + stream->count++;
+    lexed->offset = (uint32_t)offset;
+    lexed->length = (uint16_t)length;
+    if (length == 0) {
+      lexed->kind = TOKEN_KIND_END;
+      return err;
+    }
+    lexed->kind = lex_byte_is(*token.beginning, LEX_DELIMITER)
+      ? TOKEN_KIND_DELIMITER
+      : TOKEN_KIND_WORD;
+  }
+}
+
+void token_stream_free(TokenStream *stream) {
+  free(stream->tokens);
+  stream->tokens = NULL;
+  stream->count = 0;
+  stream->capacity = 0;
+}
+
 int token_string_equalp(char* string, Token *token) {
   if (!string || !token) { return 0; }
   char *beg = token->beginning;
@@ -103,10 +268,23 @@ void print_token(Token t) {
 
 //================================================================ END lexer
 
+/// Every node of a compilation is carved out of this arena and freed at
+/// once by node_free_all().
+static Arena node_arena;
+/// Short-lived nodes that are only needed while handling a single
+/// top-level expression; see node_allocate_scratch().
+static Arena node_scratch_arena;
+
 Node *node_allocate() {
-  Node *node = calloc(1,sizeof(Node));
-  ASSERT(node, "Could not allocate memory for AST node");
-  return node;
+  return arena_allocate(&node_arena, sizeof(Node));
+}
+
+Node *node_allocate_scratch() {
+  return arena_allocate(&node_scratch_arena, sizeof(Node));
+}
+
+void node_scratch_reset() {
+  arena_reset(&node_scratch_arena);
 }
 
 void node_add_child(Node *parent, Node *new_child) {
@@ -132,7 +310,7 @@ void node_add_child(Node *parent, Node *new_child) {
 }
 
 int node_compare(Node *a, Node *b) {
-  ASSERT(NODE_TYPE_MAX == 15, "node_compare() must handle all node types");
+  ASSERT(NODE_TYPE_MAX == 16, "node_compare() must handle all node types");
 
   // Actually really nice debug output when you need it.
   //printf("Comparing nodes:\n");
@@ -184,12 +362,8 @@ int node_compare(Node *a, Node *b) {
   case NODE_TYPE_VARIABLE_ACCESS:
   case NODE_TYPE_SYMBOL:
   case NODE_TYPE_BINARY_OPERATOR:
-    if (a->value.symbol && b->value.symbol) {
-      if (strcmp(a->value.symbol, b->value.symbol) == 0) {
-        return 1;
-      }
-      break;
-    } else if (!a->value.symbol && !b->value.symbol) {
+    // Symbols are interned, so equal symbols share the same string.
+    if (a->value.symbol == b->value.symbol) {
       return 1;
     }
     break;
@@ -203,7 +377,7 @@ Node *node_none() {
   return none;
 }
 
-Node *node_integer(long long value) {
+Node *node_integer(int64_t value) {
   Node *integer = node_allocate();
   integer->type = NODE_TYPE_INTEGER;
   integer->value.integer = value;
@@ -213,19 +387,61 @@ Node *node_integer(long long value) {
 Node *node_symbol(char *symbol_string) {
   Node *symbol = node_allocate();
   symbol->type = NODE_TYPE_SYMBOL;
-  symbol->value.symbol = strdup(symbol_string);
+  symbol->value.symbol = intern(symbol_string);
   return symbol;
 }
 
+char *symbol_integer = NULL;
+char *symbol_byte = NULL;
+char *symbol_function = NULL;
+char *symbol_external_function = NULL;
+char *symbol_array = NULL;
+
+// Keywords and operators that begin an expression.
+static char *symbol_if = NULL;
+static char *symbol_while = NULL;
+static char *symbol_cast = NULL;
+static char *symbol_dereference = NULL;
+static char *symbol_address_of = NULL;
+
+// Operators of the parse stack.
+static char *symbol_lambda_body = NULL;
+static char *symbol_lambda_parameters = NULL;
+static char *symbol_if_condition = NULL;
+static char *symbol_if_then_body = NULL;
+static char *symbol_if_else_body = NULL;
+static char *symbol_while_condition = NULL;
+static char *symbol_while_body = NULL;
+static char *symbol_funcall = NULL;
+
+void parse_intern_symbols() {
+  symbol_integer = intern("integer");
+  symbol_byte = intern("byte");
+  symbol_function = intern("function");
+  symbol_external_function = intern("external function");
+  symbol_array = intern("array");
+
+  symbol_if = intern("if");
+  symbol_while = intern("while");
+  symbol_cast = intern("[");
+  symbol_dereference = intern("@");
+  symbol_address_of = intern("&");
+
+  symbol_lambda_body = intern("lambda-body");
+  symbol_lambda_parameters = intern("lambdarameters");
+  symbol_if_condition = intern("if-condition");
+  symbol_if_then_body = intern("if-then-body");
+  symbol_if_else_body = intern("if-else-body");
+  symbol_while_condition = intern("while-condition");
+  symbol_while_body = intern("while-body");
+  symbol_funcall = intern("funcall");
+}
+
 Node *node_symbol_from_buffer(char *buffer, size_t length) {
   ASSERT(buffer, "Can not create AST symbol node from NULL buffer");
-  char *symbol_string = malloc(length + 1);
-  ASSERT(symbol_string, "Could not allocate memory for symbol string");
-  memcpy(symbol_string, buffer, length);
-  symbol_string[length] = '\0';
   Node *symbol = node_allocate();
   symbol->type = NODE_TYPE_SYMBOL;
-  symbol->value.symbol = symbol_string;
+  symbol->value.symbol = intern_buffer(buffer, length);
   return symbol;
 }
 
@@ -255,7 +471,7 @@ Error define_type(Environment *types, int type, Node *type_symbol, long long byt
 #define NODE_TEXT_BUFFER_SIZE 512
 char node_text_buffer[512];
 char *node_text(Node *node) {
-  ASSERT(NODE_TYPE_MAX == 15, "print_node() must handle all node types");
+  ASSERT(NODE_TYPE_MAX == 16, "print_node() must handle all node types");
   if (!node) {
     return "NULL";
   }
@@ -290,6 +506,9 @@ char *node_text(Node *node) {
   case NODE_TYPE_IF:
     snprintf(node_text_buffer, NODE_TEXT_BUFFER_SIZE, "IF");
     break;
+  case NODE_TYPE_WHILE:
+    snprintf(node_text_buffer, NODE_TEXT_BUFFER_SIZE, "WHILE");
+    break;
   case NODE_TYPE_ADDRESSOF:
     snprintf(node_text_buffer, NODE_TEXT_BUFFER_SIZE, "ADDRESSOF");
     break;
@@ -332,35 +551,18 @@ void print_node(Node *node, size_t indent_level) {
   }
 }
 
-void node_free(Node *root) {
-  if (!root) { return; }
-  Node *child = root->children;
-  Node *next_child = NULL;
-  while (child) {
-    next_child = child->next_child;
-    node_free(child);
-    child = next_child;
-  }
-  if (symbolp(*root) && root->value.symbol) {
-    free(root->value.symbol);
-  }
-  free(root);
+void node_free_all() {
+  arena_free(&node_arena);
+  arena_free(&node_scratch_arena);
 }
 
 void node_copy(Node *a, Node *b) {
   if (!a || !b) { return; }
   b->type = a->type;
   b->pointer_indirection = a->pointer_indirection;
-  // Handle all allocated values here.
-  switch (a->type) {
-  default:
-    b->value = a->value;
-    break;
-  case NODE_TYPE_SYMBOL:
-    b->value.symbol = strdup(a->value.symbol);
-    ASSERT(b->value.symbol, "node_copy(): Could not allocate memory for new symbol");
-    break;
-  }
+  b->opcode = a->opcode;
+  // Symbols are interned, so the value can be shared as-is.
+  b->value = a->value;
   Node *child = a->children;
   Node *child_it = NULL;
   while (child) {
@@ -380,8 +582,17 @@ void node_copy(Node *a, Node *b) {
   }
 }
 
-ParsingState parse_state_create(Token *current_token, size_t *token_length, char **end) {
+ParsingState parse_state_create
+(TokenStream *stream,
+ size_t *index,
+ Token *current_token,
+ size_t *token_length,
+ char **end
+ )
+{
   ParsingState out;
+  out.stream = stream;
+  out.index = index;
   out.current = current_token;
   out.length = token_length;
   out.end = end;
@@ -390,17 +601,20 @@ ParsingState parse_state_create(Token *current_token, size_t *token_length, char
 
 void parse_state_update
 (ParsingState *state,
+ size_t index,
  Token current_token,
  size_t token_length,
  char *end
  )
 {
+  *state->index = index;
   *state->current = current_token;
   *state->length = token_length;
   *state->end = end;
 }
 
 void parse_state_update_from(ParsingState *state, ParsingState new_state) {
+  *state->index   = *new_state.index;
   *state->current = *new_state.current;
   *state->length  = *new_state.length;
   *state->end     = *new_state.end;
@@ -489,7 +703,7 @@ ParsingContext *parse_context_default_create() {
   Error err = ok;
   err = define_type(ctx->types,
                     NODE_TYPE_INTEGER,
-                    node_symbol("integer"),
+                    node_symbol(symbol_integer),
                     sizeof(long long));
   if (err.type != ERROR_NONE) {
     printf("ERROR: Failed to set builtin integer type in types environment.\n");
@@ -498,29 +712,29 @@ ParsingContext *parse_context_default_create() {
   // FIXME: Use precedence enum!
   const char *binop_error_message = "ERROR: Failed to set builtin binary operator in environment.";
 
-  err = define_binary_operator(ctx, "=", 3, "integer", "integer", "integer");
+  err = define_binary_operator(ctx, "=", BINARY_OPERATOR_EQUAL, 3, "integer", "integer", "integer");
   if (err.type != ERROR_NONE) { puts(binop_error_message); }
-  err = define_binary_operator(ctx, "<", 3, "integer", "integer", "integer");
+  err = define_binary_operator(ctx, "<", BINARY_OPERATOR_LESS_THAN, 3, "integer", "integer", "integer");
   if (err.type != ERROR_NONE) { puts(binop_error_message); }
-  err = define_binary_operator(ctx, ">", 3, "integer", "integer", "integer");
+  err = define_binary_operator(ctx, ">", BINARY_OPERATOR_GREATER_THAN, 3, "integer", "integer", "integer");
   if (err.type != ERROR_NONE) { puts(binop_error_message); }
 
   // TODO/FIXME: These are very much so temporary bitshifting operators!!!
-  err = define_binary_operator(ctx, "<<", 4, "integer", "integer", "integer");
+  err = define_binary_operator(ctx, "<<", BINARY_OPERATOR_SHIFT_LEFT, 4, "integer", "integer", "integer");
   if (err.type != ERROR_NONE) { puts(binop_error_message); }
-  err = define_binary_operator(ctx, ">>", 4, "integer", "integer", "integer");
+  err = define_binary_operator(ctx, ">>", BINARY_OPERATOR_SHIFT_RIGHT, 4, "integer", "integer", "integer");
   if (err.type != ERROR_NONE) { puts(binop_error_message); }
 
-  err = define_binary_operator(ctx, "+", 5, "integer", "integer", "integer");
+  err = define_binary_operator(ctx, "+", BINARY_OPERATOR_ADD, 5, "integer", "integer", "integer");
   if (err.type != ERROR_NONE) { puts(binop_error_message); }
-  err = define_binary_operator(ctx, "-", 5, "integer", "integer", "integer");
+  err = define_binary_operator(ctx, "-", BINARY_OPERATOR_SUBTRACT, 5, "integer", "integer", "integer");
   if (err.type != ERROR_NONE) { puts(binop_error_message); }
 
-  err = define_binary_operator(ctx, "*", 10, "integer", "integer", "integer");
+  err = define_binary_operator(ctx, "*", BINARY_OPERATOR_MULTIPLY, 10, "integer", "integer", "integer");
   if (err.type != ERROR_NONE) { puts(binop_error_message); }
-  err = define_binary_operator(ctx, "/", 10, "integer", "integer", "integer");
+  err = define_binary_operator(ctx, "/", BINARY_OPERATOR_DIVIDE, 10, "integer", "integer", "integer");
   if (err.type != ERROR_NONE) { puts(binop_error_message); }
-  err = define_binary_operator(ctx, "%", 10, "integer", "integer", "integer");
+  err = define_binary_operator(ctx, "%", BINARY_OPERATOR_MODULO, 10, "integer", "integer", "integer");
   if (err.type != ERROR_NONE) { puts(binop_error_message); }
 
   return ctx;
@@ -528,16 +742,22 @@ ParsingContext *parse_context_default_create() {
 
 /// Update token, token length, and end of current token pointer.
 Error lex_advance(ParsingState *state) {
-  if (!state || !state->current || !state->length || !state->end) {
+  if (!state || !state->stream || !state->index
+      || !state->current || !state->length || !state->end) {
     ERROR_CREATE(err, ERROR_ARGUMENTS,
                  "lex_advance(): pointer arguments must not be NULL!");
     return err;
   }
-  Error err = lex(state->current->end, state->current);
+  LexedToken *lexed = state->stream->tokens + *state->index;
+  // Once the end is reached, keep yielding the end token.
+  if (lexed->kind != TOKEN_KIND_END) {
+    *state->index += 1;
+  }
+  state->current->beginning = state->stream->source + lexed->offset;
+  state->current->end = state->current->beginning + lexed->length;
   *state->end = state->current->end;
-  if (err.type != ERROR_NONE) { return err; }
-  *state->length = state->current->end - state->current->beginning;
-  return err;
+  *state->length = lexed->length;
+  return ok;
 }
 
 typedef struct ExpectReturnValue {
@@ -551,15 +771,18 @@ ExpectReturnValue lex_expect(char *expected, ParsingState *state) {
   out.done = 0;
   out.found = 0;
   out.err = ok;
-  if (!expected || !state || !state->current || !state->length || !state->end) {
+  if (!expected || !state || !state->stream || !state->index
+      || !state->current || !state->length || !state->end) {
     ERROR_PREP(out.err, ERROR_ARGUMENTS,
                "lex_expect() must not be passed NULL pointers!");
     return out;
   }
+  size_t index_copy  = *state->index;
   Token current_copy = *state->current;
   size_t length_copy = *state->length;
   char *end_copy     = *state->end;
-  ParsingState state_copy = parse_state_create(&current_copy, &length_copy, &end_copy);
+  ParsingState state_copy = parse_state_create(state->stream, &index_copy,
+                                               &current_copy, &length_copy, &end_copy);
   out.err = lex_advance(&state_copy);
   if (out.err.type != ERROR_NONE) { return out; }
   if (length_copy == 0) {
@@ -585,20 +808,19 @@ Error parse_get_type(ParsingContext *context, Node *id, Node *result) {
   // Handle pointers and functions, as they are both memory addresses.
   // This should ideally return target format-dependant address size.
   if (id->pointer_indirection > 0
-      || strcmp(id->value.symbol, "function") == 0
-      || strcmp(id->value.symbol, "external function") == 0) {
+      || id->value.symbol == symbol_function
+      || id->value.symbol == symbol_external_function) {
     result->children = node_integer(8);
     return ok;
   }
 
-  if (strcmp(id->value.symbol, "array") == 0) {
+  if (id->value.symbol == symbol_array) {
     // Get size of base type!
-    Node *base_type = node_allocate();
+    Node *base_type = node_allocate_scratch();
     err = parse_get_type(context, id->children->next_child, base_type);
     if (err.type) { return err; }
     // Size of array is equal to size of base type multiplied by capacity of array.
     result->children = node_integer(id->children->value.integer * base_type->children->value.integer);
-    free(base_type);
     return ok;
   }
 
@@ -665,37 +887,46 @@ Error parse_binary_infix_operator
   Error err = ok;
   // Look ahead for a binary infix operator.
   *found = 0;
+  size_t index_copy  = *state->index;
   Token current_copy = *state->current;
   size_t length_copy = *state->length;
   char *end_copy     = *state->end;
-  ParsingState state_copy = parse_state_create(&current_copy, &length_copy, &end_copy);
+  ParsingState state_copy = parse_state_create(state->stream, &index_copy,
+                                               &current_copy, &length_copy, &end_copy);
   err = lex_advance(&state_copy);
   if (err.type != ERROR_NONE) { return err; }
 
-  // While state_copy.current->end isn't whitespace, is delimiter,
-  // and is not null terminator, extend binary operator.
+  // While the next token is a delimiter directly following this one,
+  // extend binary operator.
   // This is needed to catch binary operators like "<<" made up of
   // multiple delimiters.
-  while (*state_copy.current->end != '\0'
-         && strchr(whitespace, *state_copy.current->end) == NULL
-         && strchr(delimiters, *state_copy.current->end) != NULL) {
-    state_copy.current->end += 1;
-    *state_copy.length += 1;
+  for (;;) {
+    LexedToken *next = state->stream->tokens + index_copy;
+    if (next->kind != TOKEN_KIND_DELIMITER
+        || state->stream->source + next->offset != state_copy.current->end) {
+      break;
+    }
+    state_copy.current->end += next->length;
+    *state_copy.length += next->length;
+    index_copy += 1;
   }
 
-  Node *operator_symbol =
-    node_symbol_from_buffer(state_copy.current->beginning, *state_copy.length);
+  // Every operator is interned when it is defined, so a lexeme that
+  // was never interned can not possibly be an operator.
+  char *operator_symbol =
+    intern_find(state_copy.current->beginning, *state_copy.length);
 
-  Node *operator_value = node_allocate();
+  Node *operator_value = node_allocate_scratch();
   ParsingContext *global = context;
 
   while (global->parent) { global = global->parent; }
-  if (environment_get(*global->binary_operators, operator_symbol, operator_value)) {
+  if (operator_symbol
+      && environment_get_by_symbol(*global->binary_operators, operator_symbol, operator_value)) {
     parse_state_update_from(state, state_copy);
     long long precedence = operator_value->children->value.integer;
 
     //printf("Got op. %s with precedence %lld (working %lld)\n",
-    //       operator_symbol->value.symbol,
+    //       operator_symbol,
     //       precedence, *working_precedence);
     //printf("working precedence: %lld\n", *working_precedence);
 
@@ -715,7 +946,8 @@ Error parse_binary_infix_operator
     Node *result_copy = node_allocate();
     node_copy(result_pointer, result_copy);
     result_pointer->type = NODE_TYPE_BINARY_OPERATOR;
-    result_pointer->value.symbol = operator_symbol->value.symbol;
+    result_pointer->value.symbol = operator_symbol;
+    result_pointer->opcode = (int)operator_value->value.integer;
     result_pointer->children = result_copy;
     result_pointer->next_child = NULL;
 
@@ -730,8 +962,6 @@ Error parse_binary_infix_operator
 
   // TODO: Iterate advanced token end backwards until reaching a valid binary operator.
 
-  free(operator_symbol);
-  free(operator_value);
   return ok;
 }
 
@@ -774,7 +1004,7 @@ Error handle_stack_operator
     return err;
   }
 
-  if (strcmp(operator->value.symbol, "lambda-body") == 0) {
+  if (operator->value.symbol == symbol_lambda_body) {
     EXPECT(expected, "}", state);
     if (expected.found) {
 
@@ -791,11 +1021,12 @@ Error handle_stack_operator
     (*stack)->result->next_child = next_expr;
     (*stack)->result = next_expr;
     *working_result = next_expr;
+    *working_precedence = 0;
     *status = STACK_HANDLED_PARSE;
     return ok;
   }
 
-  if (strcmp(operator->value.symbol, "lambdarameters") == 0) {
+  if (operator->value.symbol == symbol_lambda_parameters) {
     EXPECT(expected, ")", state);
     if (expected.found) {
       // Pass stack to lambda-body
@@ -812,10 +1043,11 @@ Error handle_stack_operator
       node_add_child(body, first_expression);
 
       // Enter new ParsingStack to handle lambda body.
-      (*stack)->operator = node_symbol("lambda-body");
+      (*stack)->operator = node_symbol(symbol_lambda_body);
       (*stack)->body = body;
       (*stack)->result = first_expression;
       *working_result = first_expression;
+      *working_precedence = 0;
       *status = STACK_HANDLED_PARSE;
       return ok;
     }
@@ -831,11 +1063,12 @@ Error handle_stack_operator
     (*stack)->result->next_child = next_expr;
     (*stack)->result = next_expr;
     *working_result = next_expr;
+    *working_precedence = 0;
     *status = STACK_HANDLED_PARSE;
     return ok;
   }
 
-  if (strcmp(operator->value.symbol, "if-condition") == 0) {
+  if (operator->value.symbol == symbol_if_condition) {
     // TODO: Maybe eventually allow multiple expressions in an if
     // condition, or something like that.
     EXPECT(expected, "{", state);
@@ -860,11 +1093,13 @@ Error handle_stack_operator
       }
 
       // TODO: Don't leak stack->operator.
-      (*stack)->operator = node_symbol("if-then-body");
+      (*stack)->operator = node_symbol(symbol_if_then_body);
       (*stack)->body = if_then_body;
       (*stack)->result = if_then_first_expr;
 
       *working_result = if_then_first_expr;
+
+      *working_precedence = 0;
       *status = STACK_HANDLED_PARSE;
       return ok;
     }
@@ -874,7 +1109,7 @@ Error handle_stack_operator
     return err;
   }
 
-  if (strcmp(operator->value.symbol, "if-then-body") == 0) {
+  if (operator->value.symbol == symbol_if_then_body) {
     // Evaluate next expression unless it's a closing brace.
     EXPECT(expected, "}", state);
     if (expected.done) {
@@ -900,10 +1135,11 @@ Error handle_stack_operator
           (*stack)->body->next_child = if_else_body;
 
           // TODO: Don't leak stack operator!
-          (*stack)->operator = node_symbol("if-else-body");
+          (*stack)->operator = node_symbol(symbol_if_else_body);
           (*stack)->body = if_else_body;
           (*stack)->result = if_else_first_expr;
           *working_result = if_else_first_expr;
+          *working_precedence = 0;
           *status = STACK_HANDLED_PARSE;
           return ok;
         }
@@ -919,11 +1155,12 @@ Error handle_stack_operator
     (*stack)->result->next_child = next_expr;
     (*stack)->result = next_expr;
     *working_result = next_expr;
+    *working_precedence = 0;
     *status = STACK_HANDLED_PARSE;
     return ok;
   }
 
-  if (strcmp(operator->value.symbol, "if-else-body") == 0) {
+  if (operator->value.symbol == symbol_if_else_body) {
     // Evaluate next expression unless it's a closing brace.
     EXPECT(expected, "}", state);
     if (expected.done || expected.found) {
@@ -936,11 +1173,67 @@ Error handle_stack_operator
     (*stack)->result->next_child = next_expr;
     (*stack)->result = next_expr;
     *working_result = next_expr;
+    *working_precedence = 0;
     *status = STACK_HANDLED_PARSE;
     return ok;
   }
 
-  if (strcmp(operator->value.symbol, "funcall") == 0) {
+  if (operator->value.symbol == symbol_while_condition) {
+    EXPECT(expected, "{", state);
+    if (expected.found) {
+      Node *while_body = node_allocate();
+      (*stack)->result->next_child = while_body;
+      Node *while_first_expr = node_allocate();
+      node_add_child(while_body, while_first_expr);
+
+      // Empty while-body handling.
+      EXPECT(expected, "}", state);
+      if (expected.found) {
+        *context = (*context)->parent;
+        *stack = (*stack)->parent;
+        *status = STACK_HANDLED_CHECK;
+        return ok;
+      }
+
+      (*stack)->operator = node_symbol(symbol_while_body);
+      (*stack)->body = while_body;
+      (*stack)->result = while_first_expr;
+
+      *working_result = while_first_expr;
+
+      *working_precedence = 0;
+      *status = STACK_HANDLED_PARSE;
+      return ok;
+    }
+    ERROR_PREP(err, ERROR_SYNTAX,
+               "Expected `{` after `while` condition. `while` expression requires a body.");
+    return err;
+  }
+
+  if (operator->value.symbol == symbol_while_body) {
+    // Evaluate next expression unless it's a closing brace.
+    EXPECT(expected, "}", state);
+    if (expected.done) {
+      ERROR_PREP(err, ERROR_SYNTAX, "EOF reached before end of while-body.");
+      return err;
+    }
+    if (expected.found) {
+      // Eat while-body context.
+      *context = (*context)->parent;
+      *stack = (*stack)->parent;
+      *status = STACK_HANDLED_CHECK;
+      return ok;
+    }
+    Node *next_expr = node_allocate();
+    (*stack)->result->next_child = next_expr;
+    (*stack)->result = next_expr;
+    *working_result = next_expr;
+    *working_precedence = 0;
+    *status = STACK_HANDLED_PARSE;
+    return ok;
+  }
+
+  if (operator->value.symbol == symbol_funcall) {
     EXPECT(expected, ")", state);
     if (expected.done) {
       ERROR_PREP(err, ERROR_SYNTAX, "Expected closing parenthesis for functionc all before end of file.");
@@ -991,10 +1284,12 @@ Error parse_base_type
 {
   Error err = ok;
 
+  size_t index_copy = *state->index;
   Token current_copy = *state->current;
   size_t length_copy = *state->length;
   char *end_copy = *state->end;
-  ParsingState state_copy = parse_state_create(&current_copy, &length_copy, &end_copy);
+  ParsingState state_copy = parse_state_create(state->stream, &index_copy,
+                                               &current_copy, &length_copy, &end_copy);
 
   unsigned indirection_level = 0;
   // Loop over all pointer declaration symbols.
@@ -1015,7 +1310,7 @@ Error parse_base_type
   *type = *type_symbol;
   type->pointer_indirection = indirection_level;
 
-  Node *type_validator = node_allocate();
+  Node *type_validator = node_allocate_scratch();
   err = parse_get_type(context, type_symbol, type_validator);
   if (err.type) { return err; }
   if (nonep(*type_validator)) {
@@ -1023,8 +1318,6 @@ Error parse_base_type
     printf("\nINVALID TYPE: \"%s\"\n", type_symbol->value.symbol);
     return err;
   }
-  free(type_symbol);
-  free(type_validator);
 
   parse_state_update_from(state, state_copy);
 
@@ -1057,13 +1350,11 @@ Error parse_type(ParsingContext *context, ParsingState *state, Node *type) {
   if (expected.found) {
     Node *return_type = node_allocate();
     node_copy(type, return_type);
-    free(type->value.symbol);
     Node *function_type =
       external
-      ? node_symbol("external function")
-      : node_symbol("function");
+      ? node_symbol(symbol_external_function)
+      : node_symbol(symbol_function);
     *type = *function_type;
-    free(function_type);
     node_add_child(type, return_type);
 
     // Parse parameters of function signature
@@ -1125,11 +1416,9 @@ Error parse_type(ParsingContext *context, ParsingState *state, Node *type) {
     // Copy base type
     Node *base_type = node_allocate();
     node_copy(type, base_type);
-    free(type->value.symbol);
     // Create array type
-    Node *array_type = node_symbol("array");
+    Node *array_type = node_symbol(symbol_array);
     *type = *array_type;
-    free(array_type);
 
     // Parse size integer
     err = lex_advance(state);
@@ -1159,7 +1448,8 @@ Error parse_type(ParsingContext *context, ParsingState *state, Node *type) {
 
 Error parse_expr
 (ParsingContext *context,
- char *source,
+ TokenStream *stream,
+ size_t *index,
  char **end,
  Node *result
  )
@@ -1171,10 +1461,10 @@ Error parse_expr
 
   size_t token_length = 0;
   Token current_token;
-  current_token.beginning  = source;
-  current_token.end        = source;
+  current_token.beginning  = *end;
+  current_token.end        = *end;
 
-  ParsingState state = parse_state_create(&current_token, &token_length, end);
+  ParsingState state = parse_state_create(stream, index, &current_token, &token_length, end);
   Node *working_result = result;
   long long working_precedence = 0;
 
@@ -1225,7 +1515,7 @@ Error parse_expr
 
           // Enter new ParsingStack to handle lambda body.
           stack = parse_stack_create(stack);
-          stack->operator = node_symbol("lambda-body");
+          stack->operator = node_symbol(symbol_lambda_body);
           stack->body = body;
           stack->result = first_expression;
           working_result = first_expression;
@@ -1237,7 +1527,7 @@ Error parse_expr
 
         // Enter new ParsingStack to handle lambda parameters.
         stack = parse_stack_create(stack);
-        stack->operator = node_symbol("lambdarameters");
+        stack->operator = node_symbol(symbol_lambda_parameters);
         stack->body = parameters;
         stack->result = first_parameter;
         working_result = first_parameter;
@@ -1252,7 +1542,7 @@ Error parse_expr
 
         // FIXME: Experimental and not implemented in typechecker or codegen backends yet.
         // NOTE: Square bracket syntax is for sure experimental, and likely temporary.
-        if (strcmp("[", symbol->value.symbol) == 0) {
+        if (symbol->value.symbol == symbol_cast) {
           working_result->type = NODE_TYPE_CAST;
 
           err = lex_advance(&state);
@@ -1277,7 +1567,7 @@ Error parse_expr
           continue;
         }
 
-        if (strcmp("@", symbol->value.symbol) == 0) {
+        if (symbol->value.symbol == symbol_dereference) {
           working_result->type = NODE_TYPE_DEREFERENCE;
           Node *child = node_allocate();
           node_add_child(working_result, child);
@@ -1285,7 +1575,7 @@ Error parse_expr
           continue;
         }
 
-        if (strcmp("&", symbol->value.symbol) == 0) {
+        if (symbol->value.symbol == symbol_address_of) {
           working_result->type = NODE_TYPE_ADDRESSOF;
           Node *child = node_allocate();
           node_add_child(working_result, child);
@@ -1293,7 +1583,7 @@ Error parse_expr
           continue;
         }
 
-        if (strcmp("if", symbol->value.symbol) == 0) {
+        if (symbol->value.symbol == symbol_if) {
           Node *if_conditional = working_result;
           if_conditional->type = NODE_TYPE_IF;
           Node *condition_expression = node_allocate();
@@ -1302,7 +1592,23 @@ Error parse_expr
           context = parse_context_create(context);
 
           stack = parse_stack_create(stack);
-          stack->operator = node_symbol("if-condition");
+          stack->operator = node_symbol(symbol_if_condition);
+          stack->result = condition_expression;
+
+          working_result = condition_expression;
+          continue;
+        }
+
+        if (symbol->value.symbol == symbol_while) {
+          Node *while_loop = working_result;
+          while_loop->type = NODE_TYPE_WHILE;
+          Node *condition_expression = node_allocate();
+          node_add_child(while_loop, condition_expression);
+
+          context = parse_context_create(context);
+
+          stack = parse_stack_create(stack);
+          stack->operator = node_symbol(symbol_while_condition);
           stack->result = condition_expression;
 
           working_result = condition_expression;
@@ -1316,14 +1622,14 @@ Error parse_expr
         // declaration, or declaration with initialization.
 
         // Check for variable access here.
-        Node *var_binding = node_allocate();
+        Node *var_binding = node_allocate_scratch();
         err = parse_get_variable(context, symbol, var_binding);
         if (!nonep(*var_binding)) {
           if (err.type) { return err; }
 
           // Create variable access node.
           working_result->type = NODE_TYPE_VARIABLE_ACCESS;
-          working_result->value.symbol = strdup(symbol->value.symbol);
+          working_result->value.symbol = symbol->value.symbol;
 
           // Lookahead for function call
           EXPECT(expected, "(", &state);
@@ -1344,7 +1650,7 @@ Error parse_expr
               Node *first_parameter = node_allocate();
               node_add_child(parameters, first_parameter);
               stack = parse_stack_create(stack);
-              stack->operator = node_symbol("funcall");
+              stack->operator = node_symbol(symbol_funcall);
               stack->result = first_parameter;
               working_result = first_parameter;
               continue;
@@ -1363,7 +1669,7 @@ Error parse_expr
               err = lex_advance(&state);
               if (err.type) { return err; }
 
-              Node *integer_offset = node_allocate();
+              Node *integer_offset = node_allocate_scratch();
               if (parse_integer(state.current, integer_offset) == 0) {
                 ERROR_PREP(err, ERROR_SYNTAX,
                            "Expected integer following opening index operator: '['.");
@@ -1371,7 +1677,6 @@ Error parse_expr
               }
 
               working_result->value.integer = integer_offset->value.integer;
-              node_free(integer_offset);
 
               EXPECT(expected, "]", &state);
               if (!expected.found) {
@@ -1425,15 +1730,13 @@ Error parse_expr
             err = parse_type(context, &state, type);
             if (err.type) { return err; }
 
-            Node *variable_binding = node_allocate();
+            Node *variable_binding = node_allocate_scratch();
             if (environment_get(*context->variables, symbol, variable_binding)) {
               // TODO: Create new error type.
               printf("ID of redefined variable: \"%s\"\n", symbol->value.symbol);
               ERROR_PREP(err, ERROR_GENERIC, "Redefinition of variable!");
               return err;
             }
-            // Variable binding is shell-node for environment value contents.
-            free(variable_binding);
 
             Node *variable_declaration = working_result;
             variable_declaration->type = NODE_TYPE_VARIABLE_DECLARATION;
@@ -1466,7 +1769,7 @@ Error parse_expr
               // FIXME: This is a problem. We should use LHS copy.
               Node *lhs = node_allocate();
               lhs->type = NODE_TYPE_VARIABLE_ACCESS;
-              lhs->value.symbol = strdup(symbol->value.symbol);
+              lhs->value.symbol = symbol->value.symbol;
               node_add_child(reassign, lhs);
               node_add_child(reassign, value_expression);
 
@@ -1484,7 +1787,6 @@ Error parse_expr
             return err;
           }
         }
-        free(var_binding);
       }
     }
 
@@ -1525,24 +1827,18 @@ Error parse_expr
 }
 
 
-Error parse_program(char *filepath, ParsingContext *context, Node *result) {
+Error parse_tokens(ParsingContext *context, TokenStream *stream, Node *result) {
   Error err = ok;
-  char *contents = file_contents(filepath);
-  if (!contents) {
-    printf("Filepath: \"%s\"\n", filepath);
-    ERROR_PREP(err, ERROR_GENERIC, "parse_program(): Couldn't get file contents");
-    return err;
-  }
   result->type = NODE_TYPE_PROGRAM;
-  char *contents_it = contents;
+  size_t index = 0;
+  char *contents_it = stream->source;
   for (;;) {
     Node *expression = node_allocate();
     node_add_child(result, expression);
-    err = parse_expr(context, contents_it, &contents_it, expression);
-    if (err.type != ERROR_NONE) {
-      free(contents);
-      return err;
-    }
+    err = parse_expr(context, stream, &index, &contents_it, expression);
+    // Nothing allocated from scratch outlives a top-level expression.
+    node_scratch_reset();
+    if (err.type != ERROR_NONE) { return err; }
 
     // Check for end-of-parsing case (source and end are the same).
     if (!(*contents_it)) { break; }
@@ -1552,20 +1848,41 @@ Error parse_program(char *filepath, ParsingContext *context, Node *result) {
     //putchar('\n');
 
   }
-  free(contents);
   return ok;
 }
 
+Error parse_program(char *filepath, ParsingContext *context, Node *result) {
+  Error err = ok;
+  SourceFile file;
+  if (!source_file_open(filepath, &file)) {
+    printf("Filepath: \"%s\"\n", filepath);
+    ERROR_PREP(err, ERROR_GENERIC, "parse_program(): Couldn't get file contents");
+    return err;
+  }
+  TokenStream stream;
+  memset(&stream, 0, sizeof(TokenStream));
+  err = lex_stream(file.contents, &stream);
+  if (err.type == ERROR_NONE) {
+    err = parse_tokens(context, &stream, result);
+  }
+  token_stream_free(&stream);
+  source_file_close(&file);
+  return err;
+}
+
 Error define_binary_operator
 (ParsingContext *context,
  char *operator,
+ enum BinaryOperator opcode,
  int precedence,
  char *return_type,
  char *lhs_type,
  char *rhs_type
  )
 {
+  ASSERT(opcode < BINARY_OPERATOR_COUNT, "Invalid binary operator opcode %d", opcode);
   Node *binop = node_allocate();
+  binop->value.integer = opcode;
   node_add_child(binop, node_integer(precedence));
   node_add_child(binop, node_symbol(return_type));
   node_add_child(binop, node_symbol(lhs_type));
@@ -1578,5 +1895,6 @@ Error define_binary_operator
     ERROR_CREATE(err, ERROR_GENERIC, "Could not define binary operator in environment");
     return err;
   }
+  context->binary_operator_definitions[opcode] = binop;
   return ok;
 }
@@ -16,6 +16,36 @@ typedef struct Token {
 void print_token(Token t);
 Error lex(char *source, Token *token);
 
+typedef enum TokenKind {
+  /// Zero-length token at the NUL terminator; always the last token.
+  TOKEN_KIND_END = 0,
+  /// A single delimiter byte, like `(` or `:`.
+  TOKEN_KIND_DELIMITER,
+  /// Anything else, up to the next delimiter.
+  TOKEN_KIND_WORD,
+} TokenKind;
+
+/// A token as a byte range into the source it was lexed from.
+typedef struct LexedToken {
+  uint32_t offset;
+  uint16_t length;
+  uint8_t kind;
+} LexedToken;
+
+/// Every token of a source, lexed once up front.
+typedef struct TokenStream {
+  char *source;
+  LexedToken *tokens;
+  size_t count;
+  size_t capacity;
+} TokenStream;
+
+/// Lex all of SOURCE into STREAM, ending with a TOKEN_KIND_END token.
+/// STREAM must be zero-initialized or previously freed.
+Error lex_stream(char *source, TokenStream *stream);
+
+void token_stream_free(TokenStream *stream);
+
 typedef enum NodeType {
   // BEGIN NULL DENOTATION TYPES
 
@@ -62,6 +92,11 @@ typedef enum NodeType {
   /// TODO: 3. "ELSE" Expression List
   NODE_TYPE_IF,
 
+  /// Contains two children.
+  /// 1. Condition Expression
+  /// 2. Body Expression List, repeated while the condition is non-zero
+  NODE_TYPE_WHILE,
+
   NODE_TYPE_ADDRESSOF,
   NODE_TYPE_DEREFERENCE,
 
@@ -85,6 +120,23 @@ typedef enum NodeType {
   NODE_TYPE_MAX,
 } NodeType;
 
+/// The builtin binary operators. The parser resolves each operator to
+/// one of these once, so later stages never compare operator symbols.
+enum BinaryOperator {
+  BINARY_OPERATOR_EQUAL,
+  BINARY_OPERATOR_LESS_THAN,
+  BINARY_OPERATOR_GREATER_THAN,
+  BINARY_OPERATOR_SHIFT_LEFT,
+  BINARY_OPERATOR_SHIFT_RIGHT,
+  BINARY_OPERATOR_ADD,
+  BINARY_OPERATOR_SUBTRACT,
+  BINARY_OPERATOR_MULTIPLY,
+  BINARY_OPERATOR_DIVIDE,
+  BINARY_OPERATOR_MODULO,
+
+  BINARY_OPERATOR_COUNT
+};
+
 typedef struct Node {
   // Tree structure.
   struct Node *parent;
@@ -101,13 +153,28 @@ typedef struct Node {
 
   unsigned int pointer_indirection;
 
+  /// For NODE_TYPE_BINARY_OPERATOR, the `enum BinaryOperator` that
+  /// `value.symbol` stands for.
+  int opcode;
+
+  /// The type of this expression, as found by typecheck_program().
+  /// NULL for nodes that have no type, such as declarations.
+  struct Node *resolved_type;
+
   IRInstruction *result;
 } Node;
 
 char *node_text(Node *node);
 
+/// Allocate a zeroed node that lives until node_free_all().
 Node *node_allocate();
 
+/// Allocate a zeroed, short-lived node for temporary results.
+/// Scratch nodes are only valid until the next node_scratch_reset(),
+/// which happens after every top-level expression.
+Node *node_allocate_scratch();
+void node_scratch_reset();
+
 #define nonep(node)    ((node).type == NODE_TYPE_NONE)
 #define integerp(node) ((node).type == NODE_TYPE_INTEGER)
 #define symbolp(node)  ((node).type == NODE_TYPE_SYMBOL)
@@ -121,16 +188,29 @@ int node_compare(Node *a, Node *b);
 /// Create a new node with integer type and given value.
 Node *node_integer(int64_t value);
 
-// TODO: Think about caching used symbols and not creating duplicates!
-/// Create a new node with symbol type and given value.
+/// Create a new node with symbol type and given value, interned.
 Node *node_symbol(char *symbol_string);
 
-/// Create a new node with symbol type and value copied from given buffer.
+/// Interned spellings of the types the compiler itself refers to, so
+/// that checking for one is a pointer compare. Set by
+/// parse_intern_symbols().
+extern char *symbol_integer;
+extern char *symbol_byte;
+extern char *symbol_function;
+extern char *symbol_external_function;
+extern char *symbol_array;
+
+/// Intern every symbol the parser, typechecker and code generator
+/// compare against. Call once at startup, before anything is parsed.
+void parse_intern_symbols();
+
+/// Create a new node with symbol type and value interned from given buffer.
 Node *node_symbol_from_buffer(char *buffer, size_t length);
 
 void print_node(Node *node, size_t indent_level);
 
-void node_free(Node *root);
+/// Free every node and symbol string allocated by this compilation.
+void node_free_all();
 
 /// Copy A into B, asserting allocations.
 void node_copy(Node *a, Node *b);
@@ -142,13 +222,18 @@ int token_string_equalp(char* string, Token *token);
 int parse_integer(Token *token, Node *node);
 
 typedef struct ParsingState {
+  TokenStream *stream;
+  /// Index of the token within stream that the next lex_advance() yields.
+  size_t *index;
   Token *current;
   size_t *length;
   char **end;
 } ParsingState;
 
-ParsingState parse_state_create(Token *token, size_t *length, char **end);
-void parse_state_update(ParsingState *state, Token token, size_t length, char *end);
+ParsingState parse_state_create
+(TokenStream *stream, size_t *index, Token *token, size_t *length, char **end);
+void parse_state_update
+(ParsingState *state, size_t index, Token token, size_t length, char *end);
 void parse_state_update_from(ParsingState *state, ParsingState new_state);
 
 // TODO: Separate context from stack.
@@ -178,12 +263,15 @@ typedef struct ParsingContext {
   /// `-- SYMBOL (NAME) -> FUNCTION
   Environment *functions;
   /// BINARY INFIX OPERATOR
-  /// `-- SYMBOL (OPERATOR) -> NONE
+  /// `-- SYMBOL (OPERATOR) -> NONE (OPCODE)
   ///                          `-- INTEGER (PRECEDENCE)
   ///                              -> SYMBOL (RETURN TYPE)
   ///                              -> SYMBOL (LHS TYPE)
   ///                              -> SYMBOL (RHS TYPE)
   Environment *binary_operators;
+  /// The definition of each binary operator in `binary_operators`,
+  /// indexed by opcode. Only set in the global context.
+  Node *binary_operator_definitions[BINARY_OPERATOR_COUNT];
 } ParsingContext;
 
 void parse_context_print(ParsingContext *top, size_t indent);
@@ -194,6 +282,7 @@ void parse_context_add_child(ParsingContext *parent, ParsingContext *child);
 Error define_binary_operator
 (ParsingContext *context,
  char *operator,
+ enum BinaryOperator opcode,
  int precedence,
  char *return_type, char *lhs_type, char *rhs_type);
 
@@ -214,8 +303,13 @@ ParsingContext *parse_context_default_create();
 
 Error parse_program(char *filepath, ParsingContext *context, Node *result);
 
+/// Parse every expression of STREAM into RESULT, a program node.
+Error parse_tokens(ParsingContext *context, TokenStream *stream, Node *result);
+
+/// Parse one expression, beginning at the token at INDEX of STREAM.
+/// INDEX and END are updated to just past the last token parsed.
 Error parse_expr(ParsingContext *context,
-                 char *source, char **end,
+                 TokenStream *stream, size_t *index, char **end,
                  Node *result);
 
 #endif /* COMPILER_PARSER_H */
@@ -66,8 +66,9 @@ char type_compare_symbol(Node *a, Node *b) {
     printf("DEVELOPER WARNING: type_compare_symbol() called on non-symbol nodes!\n");
     return 0;
   }
+  // Symbols are interned, so equal symbols share the same string.
   if (a->pointer_indirection != b->pointer_indirection
-      || strcmp(a->value.symbol, b->value.symbol) != 0) {
+      || a->value.symbol != b->value.symbol) {
     return 0;
   }
   Node *a_child = a->children;
@@ -99,11 +100,16 @@ Error typecheck_expression
     return err;
   }
   ParsingContext *context_it = context;
-  Node *value = node_allocate();
-  Node *tmpnode = node_allocate();
+  // Temporaries only ever hold copies of nodes that outlive this call,
+  // so they can live on the stack.
+  Node value_storage = {0};
+  Node tmpnode_storage = {0};
+  Node type_storage = {0};
+  Node *value = &value_storage;
+  Node *tmpnode = &tmpnode_storage;
   Node *iterator = NULL;
-  Node *result = node_allocate();
-  Node *type = node_allocate();
+  Node *type = &type_storage;
+  char has_type = 1;
 
   // TODO: I feel like children should only be checked when parent type is handled.
   // Typecheck all the children of node before typechecking node.
@@ -120,16 +126,17 @@ Error typecheck_expression
   default:
     printf("DEVELOPER WARNING: Unhandled expression type in typecheck_expression()\n");
     print_node(expression,2);
+    has_type = 0;
     break;
   case NODE_TYPE_NONE:
-    break;
   case NODE_TYPE_VARIABLE_DECLARATION:
+    has_type = 0;
     break;
   case NODE_TYPE_INTEGER:
-    if (0) { ; }
-    Node *integer_type = node_symbol("integer");
-    *result_type = *integer_type;
-    free(integer_type);
+    *result_type = (Node) {
+      .type = NODE_TYPE_SYMBOL,
+      .value.symbol = symbol_integer,
+    };
     break;
   case NODE_TYPE_VARIABLE_ACCESS:
     // Get type symbol from variables environment using variable symbol.
@@ -154,7 +161,7 @@ Error typecheck_expression
     }
     // Ensure variable being accessed is of an array type.
     err = typecheck_expression(context, context_to_enter, expression->children, tmpnode);
-    if (strcmp(tmpnode->value.symbol, "array") != 0) {
+    if (tmpnode->value.symbol != symbol_array) {
       ERROR_PREP(err, ERROR_TYPE, "Array index may only operate on variables of array type.");
       return err;
     }
@@ -216,7 +223,8 @@ Error typecheck_expression
       // Enter `if` OTHERWISE context.
       to_enter = (*context_to_enter)->children;
       Node *otherwise_expression = expression->children->next_child->next_child->children;
-      Node *otherwise_type = node_allocate();
+      Node otherwise_type_storage = {0};
+      Node *otherwise_type = &otherwise_type_storage;
       while (otherwise_expression) {
         err = typecheck_expression(*context_to_enter, &to_enter, otherwise_expression, otherwise_type);
         if (err.type) { return err; }
@@ -233,16 +241,43 @@ Error typecheck_expression
         ERROR_PREP(err, ERROR_TYPE, "All branches of `if` expression must return same type.");
         return err;
       }
-      free(otherwise_type);
     }
     break;
+  case NODE_TYPE_WHILE:
+    if (0) { ; }
+
+    Node condition_type_storage = {0};
+    err = typecheck_expression(context, context_to_enter, expression->children, &condition_type_storage);
+    if (err.type) { return err; }
+
+    // Enter `while` body context.
+    to_enter = (*context_to_enter)->children;
+    Node body_type_storage = {0};
+    Node *body_expression = expression->children->next_child
+      ? expression->children->next_child->children
+      : NULL;
+    while (body_expression) {
+      err = typecheck_expression(*context_to_enter, &to_enter, body_expression, &body_type_storage);
+      if (err.type) { return err; }
+      body_expression = body_expression->next_child;
+    }
+    // Eat `while` body context.
+    *context_to_enter = (*context_to_enter)->next_child;
+
+    // A loop has no value of its own to return.
+    *result_type = (Node) {
+      .type = NODE_TYPE_SYMBOL,
+      .value.symbol = symbol_integer,
+    };
+    break;
   case NODE_TYPE_FUNCTION:
     // Only handle function body when it exists.
     if (expression->children->next_child->next_child->children) {
       // Typecheck body of function in proper context.
       to_enter = (*context_to_enter)->children;
       Node *body_expression = expression->children->next_child->next_child->children;
-      Node *expr_return_type = node_allocate();
+      Node expr_return_type_storage = {0};
+      Node *expr_return_type = &expr_return_type_storage;
       while (body_expression) {
         err = typecheck_expression(*context_to_enter, &to_enter, body_expression, expr_return_type);
         if (err.type) { return err; }
@@ -259,16 +294,16 @@ Error typecheck_expression
         ERROR_PREP(err, ERROR_TYPE, "Return type of last expression in function does not match function return type.");
         return err;
       }
-
-      free(expr_return_type);
     }
 
     // TODO: Copy result type from function, don't just make it up!
-    Node *function_type_symbol = node_symbol("function");
-    *result_type = *function_type_symbol;
+    *result_type = (Node) {
+      .type = NODE_TYPE_SYMBOL,
+      .value.symbol = symbol_function,
+    };
 
     // Return type of function as first child.
-    result_type->children = node_allocate();
+    result_type->children = node_allocate_scratch();
     node_copy(expression->children, result_type->children);
     result_type->children->children = NULL;
     result_type->children->next_child = NULL;
@@ -276,7 +311,7 @@ Error typecheck_expression
     Node *parameter = expression->children->next_child->children;
     if (parameter) {
       do {
-        Node *parameter_type = node_allocate();
+        Node *parameter_type = node_allocate_scratch();
         if (parameter->type != NODE_TYPE_VARIABLE_DECLARATION) {
           ERROR_PREP(err, ERROR_TYPE, "Function parameter declaration must be a valid variable declaration!");
           return err;
@@ -307,7 +342,8 @@ Error typecheck_expression
     //print_node(result_type,0);
 
     // Get return type of right hand side expression.
-    Node *rhs_return_value = node_allocate();
+    Node rhs_return_value_storage = {0};
+    Node *rhs_return_value = &rhs_return_value_storage;
     err = typecheck_expression(context, context_to_enter,
                                expression->children->next_child,
                                rhs_return_value);
@@ -326,19 +362,17 @@ Error typecheck_expression
       printf("RHS TYPE:\n");
       print_node(rhs_return_value,2);
       ERROR_PREP(err, ERROR_TYPE, "Type of LHS of variable reassignment must match RHS return type.");
-
-      free(rhs_return_value);
       return err;
     }
-    free(rhs_return_value);
     break;
   case NODE_TYPE_BINARY_OPERATOR:
     // Get global context.
     while (context_it->parent) { context_it = context_it->parent; }
     // Get binary operator definition from global context into `value`.
-    environment_get_by_symbol(*context_it->binary_operators,
-                              expression->value.symbol,
-                              value);
+    ASSERT(expression->opcode >= 0 && expression->opcode < BINARY_OPERATOR_COUNT
+           && context_it->binary_operator_definitions[expression->opcode],
+           "Binary operator \"%s\" has no definition.", expression->value.symbol);
+    *value = *context_it->binary_operator_definitions[expression->opcode];
     // Get return type of LHS into `type`.
     err = typecheck_expression(context, context_to_enter, expression->children, type);
     if (err.type) { return err; }
@@ -364,16 +398,13 @@ Error typecheck_expression
   case NODE_TYPE_FUNCTION_CALL:
 
     // Ensure function call arguments are of correct type.
-    // Get function info from functions environment.
-    while (context_it) {
-      if (environment_get(*context_it->variables, expression->children, value)) {
-        break;
-      }
-      context_it = context_it->parent;
-    }
+    // Get type of the called variable, which also records it for
+    // codegen.
+    err = typecheck_expression(context, context_to_enter, expression->children, value);
+    if (err.type) { return err; }
 
     // Ensure variable that is being accessed is of function type.
-    if (strcmp(value->value.symbol, "function") != 0 && strcmp(value->value.symbol, "external function") != 0) {
+    if (value->value.symbol != symbol_function && value->value.symbol != symbol_external_function) {
       print_node(expression,0);
       ERROR_PREP(err, ERROR_TYPE, "A called variable must have a function type!");
       return err;
@@ -430,7 +461,8 @@ Error typecheck_expression
     // Result of a cast expression will always be the casted-to type.
     *result_type = *cast_type;
 
-    Node *expression_type = node_allocate();
+    Node expression_type_storage = {0};
+    Node *expression_type = &expression_type_storage;
     err = typecheck_expression(context, context_to_enter, expression->children->next_child, expression_type);
     if (err.type) { return err; }
 
@@ -458,16 +490,16 @@ Error typecheck_expression
       // typecast.
       size_t cast_type_size;
       size_t expression_type_size;
-      Node *cast_type_info = node_allocate();
-      Node *expression_type_info = node_allocate();
+      Node *cast_type_info = node_allocate_scratch();
+      Node *expression_type_info = node_allocate_scratch();
 
       // Use type copy without pointer indirection to get size of base
       // type!
-      Node *cast_type_no_pointer = node_allocate();
+      Node *cast_type_no_pointer = node_allocate_scratch();
       *cast_type_no_pointer = *cast_type;
       cast_type_no_pointer->pointer_indirection = 0;
 
-      Node *expression_type_no_pointer = node_allocate();
+      Node *expression_type_no_pointer = node_allocate_scratch();
       *expression_type_no_pointer = *expression_type;
       expression_type_no_pointer->pointer_indirection = 0;
 
@@ -477,8 +509,6 @@ Error typecheck_expression
       if (err.type) { return err; }
       cast_type_size = cast_type_info->children->value.integer;
       expression_type_size = expression_type_info->children->value.integer;
-      free(cast_type_info);
-      free(expression_type_info);
 
       // a : integer = 69
       // ;; a is an 8 byte integer
@@ -502,12 +532,12 @@ Error typecheck_expression
     // cast type are base types.
     Node int_type = (Node) {
       .type = NODE_TYPE_SYMBOL,
-      .value.symbol = "integer",
+      .value.symbol = symbol_integer,
     };
 
     Node byte_type = (Node) {
       .type = NODE_TYPE_SYMBOL,
-      .value.symbol = "byte",
+      .value.symbol = symbol_byte,
     };
 
     // TODO: Extract is_base_type() helper function.
@@ -521,19 +551,28 @@ Error typecheck_expression
     }
     break;
   }
-  free(result);
-  free(value);
-  free(tmpnode);
+
+  // Remember the type, so that later stages need not typecheck again.
+  // The result may point into scratch memory, so it is copied.
+  if (err.type == ERROR_NONE && has_type) {
+    if (!expression->resolved_type) {
+      expression->resolved_type = node_allocate();
+    }
+    *expression->resolved_type = (Node){0};
+    node_copy(result_type, expression->resolved_type);
+  }
   return err;
 }
 
 Error typecheck_program(ParsingContext *context, Node *program) {
   Error err = ok;
   Node *expression = program->children;
-  Node *type = node_allocate();
+  Node type;
   ParsingContext *to_enter = context->children;
   while (expression) {
-    err = typecheck_expression(context, &to_enter, expression, type);
+    memset(&type, 0, sizeof(Node));
+    err = typecheck_expression(context, &to_enter, expression, &type);
+    node_scratch_reset();
     if (err.type) { return err; }
     expression = expression->next_child;
   }
@@ -0,0 +1,140 @@
+#include <worker_pool.h>
+
+#include <error.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#  include <pthread.h>
+#  include <unistd.h>
+#else
+#  include <windows.h>
+#endif
+
+/// State shared by the workers of one worker_pool_run().
+typedef struct WorkerPool {
+#ifndef _WIN32
+  pthread_mutex_t lock;
+#else
+  CRITICAL_SECTION lock;
+#endif
+  /// The next index to hand out.
+  size_t next;
+  size_t count;
+  WorkerTask *task;
+  void *data;
+} WorkerPool;
+
+typedef struct Worker {
+  WorkerPool *pool;
+  size_t number;
+#ifndef _WIN32
+  pthread_t thread;
+#else
+  HANDLE thread;
+#endif
+} Worker;
+
+static void worker_pool_work(Worker *worker) {
+  WorkerPool *pool = worker->pool;
+  for (;;) {
+#ifndef _WIN32
+    pthread_mutex_lock(&pool->lock);
+#else
+    EnterCriticalSection(&pool->lock);
+#endif
+    size_t index = pool->next;
+    if (index < pool->count) { pool->next++; }
+#ifndef _WIN32
+    pthread_mutex_unlock(&pool->lock);
+#else
+    LeaveCriticalSection(&pool->lock);
+#endif
+    if (index >= pool->count) { return; }
+    pool->task(pool->data, worker->number, index);
+  }
+}
+
+#ifndef _WIN32
+static void *worker_thread(void *argument) {
+  worker_pool_work(argument);
+  return NULL;
+}
+#else
+static DWORD WINAPI worker_thread(LPVOID argument) {
+  worker_pool_work(argument);
+  return 0;
+}
+#endif
+
+size_t worker_pool_size(size_t workers, size_t count) {
+  if (!workers) {
+#ifndef _WIN32
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = processors > 0 ? (size_t)processors : 1;
+#else
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    workers = info.dwNumberOfProcessors ? (size_t)info.dwNumberOfProcessors : 1;
+#endif
+  }
+  if (workers > count) { workers = count; }
+  return workers ? workers : 1;
+}
+
+void worker_pool_run(size_t workers, size_t count, WorkerTask *task, void *data) {
+  workers = worker_pool_size(workers, count);
+  if (workers == 1) {
+    for (size_t index = 0; index < count; ++index) {
+      task(data, 0, index);
+    }
+    return;
+  }
+
+  WorkerPool pool;
+  pool.next = 0;
+  pool.count = count;
+  pool.task = task;
+  pool.data = data;
+#ifndef _WIN32
+  int status = pthread_mutex_init(&pool.lock, NULL);
+  ASSERT(status == 0, "Could not create mutex of worker pool.");
+#else
+  InitializeCriticalSection(&pool.lock);
+#endif
+
+  Worker *pool_workers = calloc(workers, sizeof(Worker));
+  ASSERT(pool_workers, "Could not allocate memory for workers.");
+  // If a thread can not be started, the ones that could pick up its
+  // share of the work.
+  size_t started = 1;
+  for (; started < workers; ++started) {
+    Worker *worker = pool_workers + started;
+    worker->pool = &pool;
+    worker->number = started;
+#ifndef _WIN32
+    if (pthread_create(&worker->thread, NULL, worker_thread, worker) != 0) { break; }
+#else
+    worker->thread = CreateThread(NULL, 0, worker_thread, worker, 0, NULL);
+    if (!worker->thread) { break; }
+#endif
+  }
+  pool_workers[0].pool = &pool;
+  pool_workers[0].number = 0;
+  worker_pool_work(pool_workers);
+
+  for (size_t i = 1; i < started; ++i) {
+#ifndef _WIN32
+    pthread_join(pool_workers[i].thread, NULL);
+#else
+    WaitForSingleObject(pool_workers[i].thread, INFINITE);
+    CloseHandle(pool_workers[i].thread);
+#endif
+  }
+  free(pool_workers);
+#ifndef _WIN32
+  pthread_mutex_destroy(&pool.lock);
+#else
+  DeleteCriticalSection(&pool.lock);
+#endif
+}
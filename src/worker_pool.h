@@ -0,0 +1,25 @@
+#ifndef COMPILER_WORKER_POOL_H
+#define COMPILER_WORKER_POOL_H
+
+#include <stddef.h>
+
+/// Do item INDEX of whatever DATA describes, on behalf of worker
+/// number WORKER.
+typedef void WorkerTask(void *data, size_t worker, size_t index);
+
+/// The number of workers worker_pool_run() uses for COUNT items when
+/// asked for WORKERS, where zero means one per processor.
+size_t worker_pool_size(size_t workers, size_t count);
+
+/** Call TASK with DATA for every index below COUNT, spread over
+ * worker_pool_size(WORKERS, COUNT) threads, and return once every
+ * call has returned.
+ *
+ * Indices are handed out in order to whichever worker is free, so
+ * TASK may only write to state of its own index, or of its worker.
+ * The calling thread is worker zero. With a single worker, every call
+ * happens on the calling thread in order of index.
+ */
+void worker_pool_run(size_t workers, size_t count, WorkerTask *task, void *data);
+
+#endif /* COMPILER_WORKER_POOL_H */